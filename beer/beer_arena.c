@@ -0,0 +1,178 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <beer/beer_mem.h>
+#include <beer/beer_arena.h>
+
+/* slabs stop doubling at this size */
+#define BEER_ARENA_SLAB_MAX (16 * 1024 * 1024)
+
+#define BEER_ARENA_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+struct beer_arena_slab {
+	struct beer_arena_slab *next;
+	size_t size;
+	size_t used;
+	size_t pad; /* keeps data aligned on 16 bytes */
+};
+
+#define BEER_ARENA_DATA(slab) ((char *)((slab) + 1))
+
+static struct beer_arena_slab *
+beer_arena_slab(size_t size) {
+	struct beer_arena_slab *slab =
+		beer_mem_alloc(sizeof(struct beer_arena_slab) + size);
+	if (slab == NULL)
+		return NULL;
+	slab->next = NULL;
+	slab->size = size;
+	slab->used = 0;
+	return slab;
+}
+
+struct beer_arena *
+beer_arena_new(struct beer_arena *a, size_t slab_size) {
+	int alloc = (a == NULL);
+	if (alloc) {
+		a = beer_mem_alloc(sizeof(struct beer_arena));
+		if (a == NULL)
+			return NULL;
+	}
+	memset(a, 0, sizeof(struct beer_arena));
+	a->slab_size = slab_size ? BEER_ARENA_ALIGN(slab_size) : BEER_ARENA_SLAB;
+	a->alloc = alloc;
+	return a;
+}
+
+void *
+beer_arena_alloc(struct beer_arena *a, size_t size) {
+	size = BEER_ARENA_ALIGN(size);
+	struct beer_arena_slab *slab = a->slab;
+	if (slab && slab->size - slab->used >= size) {
+		void *ptr = BEER_ARENA_DATA(slab) + slab->used;
+		slab->used += size;
+		return ptr;
+	}
+	/* big blocks get their own slab, behind the current one */
+	if (slab && size > a->slab_size / 2) {
+		struct beer_arena_slab *big = beer_arena_slab(size);
+		if (big == NULL)
+			return NULL;
+		big->used = size;
+		big->next = slab->next;
+		slab->next = big;
+		return BEER_ARENA_DATA(big);
+	}
+	size_t slab_size = a->slab_size;
+	while (slab_size < size)
+		slab_size *= 2;
+	struct beer_arena_slab *fresh = beer_arena_slab(slab_size);
+	if (fresh == NULL)
+		return NULL;
+	if (slab_size < BEER_ARENA_SLAB_MAX)
+		a->slab_size = 2 * slab_size;
+	fresh->used = size;
+	fresh->next = slab;
+	a->slab = fresh;
+	return BEER_ARENA_DATA(fresh);
+}
+
+/* check that block is the last one in current slab */
+static inline int
+beer_arena_last(struct beer_arena *a, void *ptr, size_t size) {
+	struct beer_arena_slab *slab = a->slab;
+	return slab && (char *)ptr + size == BEER_ARENA_DATA(slab) + slab->used;
+}
+
+int
+beer_arena_extend(struct beer_arena *a, void *ptr, size_t size,
+		  size_t new_size) {
+	size = BEER_ARENA_ALIGN(size);
+	new_size = BEER_ARENA_ALIGN(new_size);
+	if (!beer_arena_last(a, ptr, size) ||
+	    a->slab->used - size + new_size > a->slab->size)
+		return -1;
+	a->slab->used = a->slab->used - size + new_size;
+	return 0;
+}
+
+void
+beer_arena_release(struct beer_arena *a, void *ptr, size_t size) {
+	size = BEER_ARENA_ALIGN(size);
+	if (beer_arena_last(a, ptr, size))
+		a->slab->used -= size;
+}
+
+void
+beer_arena_enter(struct beer_arena *a) {
+	a->prev = beer_mem_arena(a);
+}
+
+void
+beer_arena_leave(struct beer_arena *a) {
+	beer_mem_arena(a->prev);
+	a->prev = NULL;
+}
+
+void
+beer_arena_reset(struct beer_arena *a) {
+	struct beer_arena_slab *slab = a->slab;
+	if (slab == NULL)
+		return;
+	if (slab->next == NULL) {
+		slab->used = 0;
+		return;
+	}
+	/* replace slabs with one, that fits the whole batch */
+	size_t size = 0;
+	while (slab) {
+		struct beer_arena_slab *next = slab->next;
+		size += slab->size;
+		beer_mem_free(slab);
+		slab = next;
+	}
+	a->slab = beer_arena_slab(size);
+}
+
+void
+beer_arena_free(struct beer_arena *a) {
+	struct beer_arena_slab *slab = a->slab;
+	while (slab) {
+		struct beer_arena_slab *next = slab->next;
+		beer_mem_free(slab);
+		slab = next;
+	}
+	a->slab = NULL;
+	if (a->alloc)
+		beer_mem_free(a);
+}
@@ -62,7 +62,7 @@ beer_auth_raw(struct beer_stream *s, const char *user, int ulen,
 		user = "guest";
 		ulen = 5;
 	}
-	encode_header(&hdr, BEER_OP_AUTH, s->reqid++);
+	encode_header(&hdr, BEER_OP_AUTH, s->reqid++, 0);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[64]; data = body; body_start = data;
@@ -0,0 +1,259 @@
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/uio.h>
+
+#include <beer/beer_mem.h>
+#include <beer/beer_reply.h>
+#include <beer/beer_stream.h>
+#include <beer/beer_buf.h>
+#include <beer/beer_net.h>
+#include <beer/beer_request.h>
+#include <beer/beer_pending.h>
+#include <beer/beer_batch.h>
+
+#include "pmatomic.h"
+
+/* initial count of items */
+#define BEER_BATCH_ITEMS 64
+
+struct beer_batch *
+beer_batch_init(struct beer_batch *b, struct beer_stream *s) {
+	int alloc = (b == NULL);
+	if (alloc) {
+		b = beer_mem_alloc(sizeof(struct beer_batch));
+		if (b == NULL)
+			return NULL;
+	}
+	memset(b, 0, sizeof(struct beer_batch));
+	b->buf = beer_buf(NULL);
+	if (b->buf == NULL) {
+		if (alloc)
+			beer_mem_free(b);
+		return NULL;
+	}
+	b->s = s;
+	b->sorted = 1;
+	b->alloc = alloc;
+	return b;
+}
+
+static int
+beer_batch_grow(struct beer_batch *b) {
+	uint32_t size = b->size ? b->size * 2 : BEER_BATCH_ITEMS;
+	struct beer_batch_item *items =
+		beer_mem_realloc(b->items, size * sizeof(struct beer_batch_item));
+	if (items == NULL)
+		return -1;
+	b->items = items;
+	b->size = size;
+	return 0;
+}
+
+int64_t
+beer_batch_add(struct beer_batch *b, struct beer_request *req) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(b->s);
+	if (b->count == b->size && beer_batch_grow(b) == -1) {
+		sn->error = BEER_EMEMORY;
+		return -1;
+	}
+	/* encoded aside, with sync and schema id of the stream */
+	b->buf->reqid = b->s->reqid;
+	b->buf->schema_id = b->s->schema_id;
+	int64_t sync = beer_request_compile(b->buf, req);
+	if (sync == -1) {
+		sn->error = BEER_EMEMORY;
+		return -1;
+	}
+	b->s->reqid = b->buf->reqid;
+	struct beer_batch_item *item = &b->items[b->count];
+	memset(item, 0, sizeof(struct beer_batch_item));
+	beer_reply_init(&item->reply);
+	item->sync = sync;
+	item->status = BEER_BATCH_QUEUED;
+	if (b->count && b->items[b->count - 1].sync >= (uint64_t)sync)
+		b->sorted = 0;
+	return b->count++;
+}
+
+static void
+beer_batch_fail(struct beer_batch *b, uint32_t from, uint32_t to,
+		enum beer_error error) {
+	uint32_t i;
+	for (i = from; i < to; i++) {
+		struct beer_batch_item *item = &b->items[i];
+		if (item->status != BEER_BATCH_QUEUED &&
+		    item->status != BEER_BATCH_SENT)
+			continue;
+		item->status = BEER_BATCH_FAILED;
+		item->error = error;
+		b->received++;
+	}
+}
+
+int
+beer_batch_send(struct beer_batch *b) {
+	struct beer_stream *s = b->s;
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	uint32_t count = b->count - b->sent;
+	if (count == 0)
+		return 0;
+	if (s->write(s, BEER_SBUF_DATA(b->buf), BEER_SBUF_SIZE(b->buf)) == -1) {
+		/* nothing is buffered, so it may be sent again */
+		if (sn->error == BEER_EAGAIN)
+			return -1;
+		uint32_t first = b->sent;
+		b->sent = b->count;
+		beer_batch_fail(b, first, b->count, sn->error);
+		beer_buf_reset(b->buf);
+		return -1;
+	}
+	beer_buf_reset(b->buf);
+	/* one write, but a reply per request */
+	pm_atomic_fetch_add(&s->wrcnt, count - 1);
+	uint32_t i;
+	for (i = b->sent; i < b->count; i++)
+		b->items[i].status = BEER_BATCH_SENT;
+	b->sent = b->count;
+	/* the rest of non-blocking write stays buffered */
+	if (beer_flush(s) == -1 && sn->error != BEER_EAGAIN) {
+		beer_batch_fail(b, 0, b->sent, sn->error);
+		return -1;
+	}
+	return 0;
+}
+
+/* items are looked up among the sent ones, by sync */
+static struct beer_batch_item *
+beer_batch_find(struct beer_batch *b, uint64_t sync) {
+	if (!b->sorted) {
+		uint32_t i;
+		for (i = 0; i < b->sent; i++)
+			if (b->items[i].sync == sync)
+				return &b->items[i];
+		return NULL;
+	}
+	uint32_t lo = 0, hi = b->sent;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (b->items[mid].sync < sync)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < b->sent && b->items[lo].sync == sync)
+		return &b->items[lo];
+	return NULL;
+}
+
+/* store reply of sent item */
+static int
+beer_batch_complete(struct beer_batch *b, struct beer_batch_item *item,
+		    struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(b->s);
+	/* non-blocking stream can't compact pinned recv buffer */
+	if (sn->opt.nonblock && r->iob && beer_reply_detach(r) == -1) {
+		beer_reply_free(r);
+		sn->error = BEER_EMEMORY;
+		return -1;
+	}
+	int alloc = item->reply.alloc;
+	memcpy(&item->reply, r, sizeof(struct beer_reply));
+	item->reply.alloc = alloc;
+	item->status = r->code ? BEER_BATCH_ERROR : BEER_BATCH_OK;
+	b->received++;
+	return 0;
+}
+
+int
+beer_batch_recv(struct beer_batch *b) {
+	struct beer_stream *s = b->s;
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	/* replies may be parked, while other requests were waited for */
+	uint32_t i;
+	for (i = 0; i < b->sent && b->received < b->sent; i++) {
+		struct beer_batch_item *item = &b->items[i];
+		if (item->status != BEER_BATCH_SENT)
+			continue;
+		struct beer_reply r;
+		beer_reply_init(&r);
+		if (beer_pending_take(s, item->sync, &r) == 0 &&
+		    beer_batch_complete(b, item, &r) == -1)
+			return -1;
+	}
+	while (b->received < b->sent) {
+		struct beer_reply r;
+		beer_reply_init(&r);
+		int rc = s->read_reply(s, &r);
+		if (rc == 1) {
+			/* there's no replies in flight */
+			sn->error = BEER_EFAIL;
+		}
+		if (rc != 0) {
+			if (sn->error != BEER_EAGAIN)
+				beer_batch_fail(b, 0, b->sent, sn->error);
+			return -1;
+		}
+		struct beer_batch_item *item = beer_batch_find(b, r.sync);
+		if (item == NULL || item->status != BEER_BATCH_SENT) {
+			if (beer_pending_route(s, &r) == -1)
+				return -1;
+			continue;
+		}
+		if (beer_batch_complete(b, item, &r) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+void
+beer_batch_reset(struct beer_batch *b) {
+	uint32_t i;
+	for (i = 0; i < b->count; i++)
+		beer_reply_free(&b->items[i].reply);
+	beer_buf_reset(b->buf);
+	b->count = 0;
+	b->sent = 0;
+	b->received = 0;
+	b->sorted = 1;
+}
+
+void
+beer_batch_free(struct beer_batch *b) {
+	beer_batch_reset(b);
+	beer_mem_free(b->items);
+	beer_stream_free(b->buf);
+	if (b->alloc)
+		beer_mem_free(b);
+}
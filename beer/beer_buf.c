@@ -41,10 +41,10 @@
 static void beer_buf_free(struct beer_stream *s) {
 	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
 	if (!sb->as && sb->data)
-		beer_mem_free(sb->data);
+		beer_mem_batch_free(sb->data);
 	if (sb->free)
 		sb->free(s);
-	beer_mem_free(s->data);
+	beer_mem_batch_free(s->data);
 	s->data = NULL;
 }
 
@@ -63,18 +63,27 @@ beer_buf_read(struct beer_stream *s, char *buf, size_t size) {
 	return size;
 }
 
+/* grow geometrically, so that appending costs amortized O(1) */
+static int
+beer_buf_grow(struct beer_stream_buf *sb, size_t size) {
+	if (sb->size + size <= sb->alloc)
+		return 0;
+	size_t nsize = sb->alloc ? 2 * sb->alloc : BEER_BUF_MIN;
+	while (nsize < sb->size + size)
+		nsize *= 2;
+	char *nd = beer_mem_batch_realloc(sb->data, nsize);
+	if (nd == NULL)
+		return -1;
+	sb->data = nd;
+	sb->alloc = nsize;
+	return 0;
+}
+
 static char* beer_buf_resize(struct beer_stream *s, size_t size) {
 	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
-	size_t off = sb->size;
-	size_t nsize = off + size;
-	char *nd = realloc(sb->data, nsize);
-	if (nd == NULL) {
-		beer_mem_free(sb->data);
+	if (beer_buf_grow(sb, size) == -1)
 		return NULL;
-	}
-	sb->data = nd;
-	sb->alloc = nsize;
-	return sb->data + off;
+	return sb->data + sb->size;
 }
 
 static ssize_t
@@ -128,7 +137,7 @@ struct beer_stream *beer_buf(struct beer_stream *s) {
 	if (s == NULL)
 		return NULL;
 	/* allocating stream data */
-	s->data = beer_mem_alloc(sizeof(struct beer_stream_buf));
+	s->data = beer_mem_batch_alloc(sizeof(struct beer_stream_buf));
 	if (s->data == NULL) {
 		if (allocated)
 			beer_stream_free(s);
@@ -153,6 +162,43 @@ struct beer_stream *beer_buf(struct beer_stream *s) {
 	return s;
 }
 
+int beer_buf_reserve(struct beer_stream *s, size_t size)
+{
+	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
+	if (sb->as)
+		return -1;
+	return beer_buf_grow(sb, size);
+}
+
+int beer_buf_shrink(struct beer_stream *s)
+{
+	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
+	if (sb->as || sb->alloc == sb->size)
+		return 0;
+	if (sb->size == 0) {
+		beer_mem_batch_free(sb->data);
+		sb->data = NULL;
+		sb->alloc = 0;
+		return 0;
+	}
+	char *nd = beer_mem_batch_realloc(sb->data, sb->size);
+	if (nd == NULL)
+		return -1;
+	sb->data = nd;
+	sb->alloc = sb->size;
+	return 0;
+}
+
+void beer_buf_reset(struct beer_stream *s)
+{
+	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
+	s->reqid = 0;
+	s->wrcnt = 0;
+	sb->rdoff = 0;
+	if (!sb->as)
+		sb->size = 0;
+}
+
 struct beer_stream *beer_buf_as(struct beer_stream *s, char *buf, size_t buf_len)
 {
 	if (s == NULL) {
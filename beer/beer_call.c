@@ -28,7 +28,7 @@ beer_rpc_base(struct beer_stream *s, const char *proc, size_t proc_len,
 	struct beer_iheader hdr;
 	struct iovec v[6]; int v_sz = 6;
 	char *data = NULL, *body_start = NULL;
-	encode_header(&hdr, op, s->reqid++);
+	encode_header(&hdr, op, s->reqid++, s->schema_id);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[64]; body_start = body; data = body;
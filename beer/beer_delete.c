@@ -25,7 +25,7 @@ beer_delete(struct beer_stream *s, uint32_t space, uint32_t index,
 	struct beer_iheader hdr;
 	struct iovec v[4]; int v_sz = 4;
 	char *data = NULL;
-	encode_header(&hdr, BEER_OP_DELETE, s->reqid++);
+	encode_header(&hdr, BEER_OP_DELETE, s->reqid++, s->schema_id);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[64]; data = body;
@@ -50,3 +50,54 @@ beer_delete(struct beer_stream *s, uint32_t space, uint32_t index,
 	v[0].iov_len = len_end - len_prefix;
 	return s->writev(s, v, v_sz);
 }
+
+/* delete by key, that is encoded in key[] and followed by str */
+static ssize_t
+beer_delete_point(struct beer_stream *s, uint32_t space, uint32_t index,
+		  const char *key, size_t key_size, const char *str,
+		  size_t str_size)
+{
+	char frame[BEER_FRAME_MAX];
+	char *data = encode_frame_header(frame, BEER_OP_DELETE, s->reqid++,
+					 s->schema_id);
+	data = mp_encode_map(data, 3);
+	data = mp_encode_uint(data, BEER_SPACE);
+	data = mp_encode_uint(data, space);
+	data = mp_encode_uint(data, BEER_INDEX);
+	data = mp_encode_uint(data, index);
+	data = mp_encode_uint(data, BEER_KEY);
+	memcpy(data, key, key_size);
+	data += key_size;
+	return write_frame(s, frame, data, str, str_size);
+}
+
+ssize_t
+beer_delete_uint(struct beer_stream *s, uint32_t space, uint32_t index,
+		uint64_t key)
+{
+	char k[16];
+	char *end = mp_encode_array(k, 1);
+	end = mp_encode_uint(end, key);
+	return beer_delete_point(s, space, index, k, end - k, NULL, 0);
+}
+
+ssize_t
+beer_delete_uint2(struct beer_stream *s, uint32_t space, uint32_t index,
+		 uint64_t key1, uint64_t key2)
+{
+	char k[32];
+	char *end = mp_encode_array(k, 2);
+	end = mp_encode_uint(end, key1);
+	end = mp_encode_uint(end, key2);
+	return beer_delete_point(s, space, index, k, end - k, NULL, 0);
+}
+
+ssize_t
+beer_delete_str(struct beer_stream *s, uint32_t space, uint32_t index,
+	       const char *key, uint32_t len)
+{
+	char k[16];
+	char *end = mp_encode_array(k, 1);
+	end = mp_encode_strl(end, len);
+	return beer_delete_point(s, space, index, k, end - k, key, len);
+}
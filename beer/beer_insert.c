@@ -23,7 +23,7 @@ beer_store_base(struct beer_stream *s, uint32_t space, struct beer_stream *tuple
 	struct beer_iheader hdr;
 	struct iovec v[4]; int v_sz = 4;
 	char *data = NULL;
-	encode_header(&hdr, op, s->reqid++);
+	encode_header(&hdr, op, s->reqid++, s->schema_id);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[64]; data = body;
@@ -58,3 +58,30 @@ beer_replace(struct beer_stream *s, uint32_t space, struct beer_stream *tuple)
 {
 	return beer_store_base(s, space, tuple, BEER_OP_REPLACE);
 }
+
+static ssize_t
+beer_store_mp(struct beer_stream *s, uint32_t space, const char *tuple,
+	     size_t size, enum beer_request_t op)
+{
+	char frame[BEER_FRAME_MAX];
+	char *data = encode_frame_header(frame, op, s->reqid++, s->schema_id);
+	data = mp_encode_map(data, 2);
+	data = mp_encode_uint(data, BEER_SPACE);
+	data = mp_encode_uint(data, space);
+	data = mp_encode_uint(data, BEER_TUPLE);
+	return write_frame(s, frame, data, tuple, size);
+}
+
+ssize_t
+beer_insert_mp(struct beer_stream *s, uint32_t space, const char *tuple,
+	      size_t size)
+{
+	return beer_store_mp(s, space, tuple, size, BEER_OP_INSERT);
+}
+
+ssize_t
+beer_replace_mp(struct beer_stream *s, uint32_t space, const char *tuple,
+	       size_t size)
+{
+	return beer_store_mp(s, space, tuple, size, BEER_OP_REPLACE);
+}
@@ -49,13 +49,19 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <errno.h>
 
+#include <msgpuck.h>
+
+#include <beer/beer_mem.h>
 #include <beer/beer_net.h>
 #include <beer/beer_io.h>
 
 #include <uri.h>
 
+#include "beer_uring.h"
+
 #if !defined(MIN)
 #	define MIN(a, b) (a) < (b) ? (a) : (b)
 #endif /* !defined(MIN) */
@@ -109,8 +115,11 @@ beer_io_connect_do(struct beer_stream_net *s, struct sockaddr *addr,
 		return result;
 
 	if (connect(s->fd, (struct sockaddr*)addr, addr_size) != -1)
-		return BEER_EOK;
+		return s->opt.nonblock ? BEER_EOK : beer_io_nonblock(s, 0);
 	if (errno == EINPROGRESS) {
+		/* connection is finished by beer_io_connect_check() */
+		if (s->opt.nonblock)
+			return BEER_EAGAIN;
 		/** waiting for connection while handling signal events */
 		const int64_t micro = 1000000;
 		int64_t tmout_usec = s->opt.tmout_connect.tv_sec * micro;
@@ -197,25 +206,41 @@ beer_io_connect_unix(struct beer_stream_net *s, const char *path)
 	memset(&addr, 0, sizeof(struct sockaddr_un));
 	addr.sun_family = AF_UNIX;
 	strcpy(addr.sun_path, path);
+	if (s->opt.nonblock) {
+		enum beer_error result = beer_io_nonblock(s, 1);
+		if (result != BEER_EOK)
+			return result;
+	}
 	if (connect(s->fd, (struct sockaddr*)&addr, sizeof(addr)) != -1)
 		return BEER_EOK;
 	s->errno_ = errno;
 	return BEER_ESYSTEM;
 }
 
-static enum beer_error beer_io_xbufmax(struct beer_stream_net *s, int opt, int min) {
-	int max = 128 * 1024 * 1024;
-	if (min == 0)
-		min = 16384;
-	unsigned int avg = 0;
-	while (min <= max) {
-		avg = ((unsigned int)(min + max)) / 2;
-		if (setsockopt(s->fd, SOL_SOCKET, opt, &avg, sizeof(avg)) == 0)
-			min = avg + 1;
-		else
-			max = avg - 1;
+/* the largest kernel buffer, that is asked for with -1 */
+#define BEER_IO_SOCKBUF_MAX (128 * 1024 * 1024)
+
+/*
+ * Buffers of zero size are left to the kernel (on Linux they are tuned by
+ * traffic then, setting the size turns that off). The largest one is found
+ * from the top: Linux clamps the value to its limit, others refuse it.
+ */
+static enum beer_error beer_io_sockbuf(struct beer_stream_net *s, int opt, int size) {
+	if (size == 0)
+		return BEER_EOK;
+	if (size > 0) {
+		if (setsockopt(s->fd, SOL_SOCKET, opt, &size, sizeof(size)) == -1)
+			goto error;
+		return BEER_EOK;
+	}
+	for (size = BEER_IO_SOCKBUF_MAX; size >= 16384; size /= 2) {
+		if (setsockopt(s->fd, SOL_SOCKET, opt, &size, sizeof(size)) == 0)
+			return BEER_EOK;
 	}
 	return BEER_EOK;
+error:
+	s->errno_ = errno;
+	return BEER_ESYSTEM;
 }
 
 static enum beer_error beer_io_setopts(struct beer_stream_net *s) {
@@ -225,8 +250,9 @@ static enum beer_error beer_io_setopts(struct beer_stream_net *s) {
 			goto error;
 	}
 
-	beer_io_xbufmax(s, SO_SNDBUF, s->opt.send_buf);
-	beer_io_xbufmax(s, SO_RCVBUF, s->opt.recv_buf);
+	if (beer_io_sockbuf(s, SO_SNDBUF, s->opt.sock_send_buf) != BEER_EOK ||
+	    beer_io_sockbuf(s, SO_RCVBUF, s->opt.sock_recv_buf) != BEER_EOK)
+		return BEER_ESYSTEM;
 
 	if (setsockopt(s->fd, SOL_SOCKET, SO_SNDTIMEO,
 		       &s->opt.tmout_send, sizeof(s->opt.tmout_send)) == -1)
@@ -254,6 +280,24 @@ static int beer_io_htopf(int host_hint) {
 	}
 }
 
+/*
+ * io_uring is used by blocking stream, that is buffered in both directions;
+ * socket timeouts aren't applied to io_uring operations, so they are done by
+ * syscalls, if timeouts are set
+ */
+static void
+beer_io_uring_start(struct beer_stream_net *s)
+{
+	if (!s->opt.io_uring || s->opt.nonblock)
+		return;
+	if (s->sbuf.buf == NULL || s->rbuf.buf == NULL ||
+	    s->sbuf.tx || s->sbuf.txv || s->rbuf.tx)
+		return;
+	if (timerisset(&s->opt.tmout_send) || timerisset(&s->opt.tmout_recv))
+		return;
+	s->uring = beer_uring_new(s->fd, &s->sbuf, &s->rbuf);
+}
+
 enum beer_error
 beer_io_connect(struct beer_stream_net *s)
 {
@@ -289,17 +333,48 @@ beer_io_connect(struct beer_stream_net *s)
 	default:
 		result = BEER_EFAIL;
 	}
+	if (result == BEER_EAGAIN)
+		return result;
 	if (result != BEER_EOK)
 		goto out;
 	s->connected = 1;
+	beer_io_uring_start(s);
 	return BEER_EOK;
 out:
 	beer_io_close(s);
 	return result;
 }
 
+enum beer_error
+beer_io_connect_check(struct beer_stream_net *s)
+{
+	struct pollfd pfd = { .fd = s->fd, .events = POLLOUT, .revents = 0 };
+	int rc = poll(&pfd, 1, 0);
+	if (rc == -1 && errno != EINTR) {
+		s->errno_ = errno;
+		goto error;
+	}
+	if (rc <= 0)
+		return BEER_EAGAIN;
+	int opt = 0;
+	socklen_t len = sizeof(opt);
+	if ((getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &opt, &len) == -1) || opt) {
+		s->errno_ = (opt) ? opt : errno;
+		goto error;
+	}
+	s->connected = 1;
+	return BEER_EOK;
+error:
+	beer_io_close(s);
+	return BEER_ESYSTEM;
+}
+
 void beer_io_close(struct beer_stream_net *s)
 {
+	if (s->uring) {
+		beer_uring_free(s->uring);
+		s->uring = NULL;
+	}
 	if (s->fd > 0) {
 		close(s->fd);
 		s->fd = -1;
@@ -307,16 +382,176 @@ void beer_io_close(struct beer_stream_net *s)
 	s->connected = 0;
 }
 
-ssize_t beer_io_flush(struct beer_stream_net *s) {
+static void
+beer_io_error(struct beer_stream_net *s, ssize_t r)
+{
+	if (r == -1 && s->opt.nonblock &&
+	    (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		s->error = BEER_EAGAIN;
+		return;
+	}
+	s->error = BEER_ESYSTEM;
+	s->errno_ = errno;
+}
+
+/*
+ * Adaptive buffers (BEER_OPT_ADAPTIVE_BUF) are doubled, when data doesn't
+ * fit them, up to the limit, and halved (down to the configured size), when
+ * a quarter of them was enough for BEER_IO_ADAPT_ROUNDS uses in a row.
+ * Buffers are resized only when nothing points into them, and buffers
+ * registered with io_uring keep their size.
+ */
+#define BEER_IO_ADAPT_ROUNDS 64
+
+static int
+beer_io_adapt_grow(struct beer_stream_net *s, struct beer_iob *iob,
+		   size_t need)
+{
+	size_t max = s->opt.adaptive_buf > 0 ? s->opt.adaptive_buf : 0;
+	if (need <= iob->size || need > max || iob->pin || s->uring)
+		return 0;
+	size_t size = iob->size;
+	while (size < need)
+		size *= 2;
+	if (beer_iob_resize(iob, MIN(size, max)) == -1)
+		return 0;
+	iob->peak = 0;
+	iob->rounds = 0;
+	return 1;
+}
+
+static void
+beer_io_adapt_use(struct beer_stream_net *s, struct beer_iob *iob,
+		  size_t used)
+{
+	if (s->opt.adaptive_buf <= 0)
+		return;
+	if (used > iob->peak)
+		iob->peak = used;
+	iob->rounds++;
+}
+
+static void
+beer_io_adapt_shrink(struct beer_stream_net *s, struct beer_iob *iob,
+		     size_t min)
+{
+	if (iob->rounds < BEER_IO_ADAPT_ROUNDS)
+		return;
+	if (iob->peak * 4 > iob->size || iob->size / 2 < min || s->uring) {
+		iob->peak = 0;
+		iob->rounds = 0;
+		return;
+	}
+	/* the next use may find buffer drained */
+	if (iob->pin || iob->off != iob->top)
+		return;
+	iob->peak = 0;
+	iob->rounds = 0;
+	beer_iob_resize(iob, iob->size / 2);
+}
+
+static ssize_t
+beer_io_flush_nb(struct beer_stream_net *s) {
+	size_t sent = 0;
+	while (sent < s->sbuf.off) {
+		ssize_t rc = beer_io_send_raw(s, s->sbuf.buf + sent,
+					     s->sbuf.off - sent, 0);
+		if (rc == -1)
+			break;
+		sent += rc;
+	}
+	if (sent == 0)
+		return -1;
+	/* keep the rest for the next flush */
+	memmove(s->sbuf.buf, s->sbuf.buf + sent, s->sbuf.off - sent);
+	s->sbuf.off -= sent;
+	if (s->sbuf.off && s->error != BEER_EAGAIN)
+		return -1;
+	return sent;
+}
+
+/* max count of writes queued by reference until flush */
+#define BEER_IO_REFS 64
+
+/* blocking send of buffered data */
+static ssize_t
+beer_io_flush_send(struct beer_stream_net *s, struct iovec *iov, int count)
+{
+	if (s->uring == NULL)
+		return beer_io_sendv_raw(s, iov, count, 1);
+	/* replies are read into the free tail of recv buffer meanwhile */
+	struct beer_iob *rbuf = &s->rbuf;
+	if (!s->uring->reading)
+		beer_iob_wrap(rbuf);
+	ssize_t r = beer_uring_writev(s->uring, iov, count,
+				      rbuf->buf + rbuf->top,
+				      beer_iob_room(rbuf), rbuf->top);
+	if (r < 0) {
+		errno = -r;
+		beer_io_error(s, -1);
+		return -1;
+	}
+	return r;
+}
+
+/* buffered data and queued writes are sent in one writev */
+static ssize_t
+beer_io_flush_ref(struct beer_stream_net *s)
+{
+	struct iovec v[BEER_IO_REFS * 2 + 1];
+	int n = 0, i;
+	size_t off = 0;
+	for (i = 0; i < s->sbuf.ref_count; i++) {
+		struct beer_iob_ref *ref = &s->sbuf.ref[i];
+		if (ref->off > off) {
+			v[n].iov_base = s->sbuf.buf + off;
+			v[n++].iov_len = ref->off - off;
+			off = ref->off;
+		}
+		v[n].iov_base = (void *)ref->data;
+		v[n++].iov_len = ref->size;
+	}
+	if (s->sbuf.off > off) {
+		v[n].iov_base = s->sbuf.buf + off;
+		v[n++].iov_len = s->sbuf.off - off;
+	}
+	/* caller's memory isn't referenced after flush, even if it failed */
+	s->sbuf.ref_count = 0;
+	s->sbuf.off = 0;
+	return beer_io_flush_send(s, v, n);
+}
+
+static ssize_t
+beer_io_flush_buf(struct beer_stream_net *s) {
+	if (s->sbuf.ref_count)
+		return beer_io_flush_ref(s);
 	if (s->sbuf.off == 0)
 		return 0;
-	ssize_t rc = beer_io_send_raw(s, s->sbuf.buf, s->sbuf.off, 1);
+	if (s->opt.nonblock)
+		return beer_io_flush_nb(s);
+	ssize_t rc;
+	if (s->uring) {
+		struct iovec v = { s->sbuf.buf, s->sbuf.off };
+		rc = beer_io_flush_send(s, &v, 1);
+	} else {
+		rc = beer_io_send_raw(s, s->sbuf.buf, s->sbuf.off, 1);
+	}
 	if (rc == -1)
 		return -1;
 	s->sbuf.off = 0;
 	return rc;
 }
 
+ssize_t beer_io_flush(struct beer_stream_net *s) {
+	size_t used = s->sbuf.off;
+	ssize_t rc = beer_io_flush_buf(s);
+	if (rc > 0 && s->sbuf.off == 0) {
+		beer_io_adapt_use(s, &s->sbuf, used);
+		beer_io_adapt_shrink(s, &s->sbuf, s->opt.send_buf);
+	}
+	return rc;
+}
+
 ssize_t
 beer_io_send_raw(struct beer_stream_net *s, const char *buf, size_t size, int all)
 {
@@ -331,8 +566,7 @@ beer_io_send_raw(struct beer_stream_net *s, const char *buf, size_t size, int al
 			} while (r == -1 && (errno == EINTR));
 		}
 		if (r <= 0) {
-			s->error = BEER_ESYSTEM;
-			s->errno_ = errno;
+			beer_io_error(s, r);
 			return -1;
 		}
 		off += r;
@@ -348,14 +582,15 @@ beer_io_sendv_raw(struct beer_stream_net *s, struct iovec *iov, int count, int a
 		ssize_t r;
 		if (s->sbuf.txv) {
 			r = s->sbuf.txv(&s->sbuf, iov, MIN(count, IOV_MAX));
+		} else if (s->sbuf.tx) {
+			r = s->sbuf.tx(&s->sbuf, iov->iov_base, iov->iov_len);
 		} else {
 			do {
 				r = writev(s->fd, iov, count);
 			} while (r == -1 && (errno == EINTR));
 		}
 		if (r <= 0) {
-			s->error = BEER_ESYSTEM;
-			s->errno_ = errno;
+			beer_io_error(s, r);
 			return -1;
 		}
 		total += r;
@@ -376,60 +611,202 @@ beer_io_sendv_raw(struct beer_stream_net *s, struct iovec *iov, int count, int a
 	return total;
 }
 
+/* flush as much as possible, to get 'size' bytes of room in sbuf */
+static int
+beer_io_flush_room(struct beer_stream_net *s, size_t size)
+{
+	if (beer_io_flush_nb(s) == -1 && s->error != BEER_EAGAIN)
+		return -1;
+	if (s->sbuf.off + size > s->sbuf.size) {
+		s->error = BEER_EAGAIN;
+		return -1;
+	}
+	return 0;
+}
+
+inline static void
+beer_io_sendv_put(struct beer_stream_net *s, struct iovec *iov, int count) {
+	int i;
+	for (i = 0 ; i < count ; i++) {
+		memcpy(s->sbuf.buf + s->sbuf.off,
+		       iov[i].iov_base,
+		       iov[i].iov_len);
+		s->sbuf.off += iov[i].iov_len;
+	}
+}
+
+/* max count of iovecs sent together with the buffered data */
+#define BEER_IO_BIG_IOV 16
+
+/*
+ * data that doesn't fit the send buffer is sent right away, after the
+ * buffered data, in one writev; non-blocking stream can't wait for the
+ * socket, so its buffer grows instead
+ */
+static ssize_t
+beer_io_send_big(struct beer_stream_net *s, struct iovec *iov, int count,
+		 size_t size)
+{
+	if (s->opt.nonblock) {
+		if (beer_io_flush_nb(s) == -1 && s->error != BEER_EAGAIN)
+			return -1;
+		if (beer_iob_resize(&s->sbuf, s->sbuf.off + size) == -1) {
+			s->error = BEER_EMEMORY;
+			return -1;
+		}
+		beer_io_sendv_put(s, iov, count);
+		return size;
+	}
+	if (s->sbuf.ref_count && beer_io_flush(s) == -1)
+		return -1;
+	/* iovecs are advanced while sent, caller's ones are kept intact */
+	struct iovec v[BEER_IO_BIG_IOV + 1];
+	int n = 0;
+	if (s->sbuf.off) {
+		v[n].iov_base = s->sbuf.buf;
+		v[n++].iov_len = s->sbuf.off;
+	}
+	if (count > BEER_IO_BIG_IOV) {
+		if (n && beer_io_sendv_raw(s, v, n, 1) == -1)
+			return -1;
+		s->sbuf.off = 0;
+		n = 0;
+		while (n < count) {
+			int part = MIN(count - n, BEER_IO_BIG_IOV);
+			memcpy(v, iov + n, part * sizeof(struct iovec));
+			if (beer_io_sendv_raw(s, v, part, 1) == -1)
+				return -1;
+			n += part;
+		}
+		return size;
+	}
+	memcpy(v + n, iov, count * sizeof(struct iovec));
+	if (beer_io_sendv_raw(s, v, n + count, 1) == -1)
+		return -1;
+	s->sbuf.off = 0;
+	return size;
+}
+
+/* headers of requests are built on stack, and are never that long */
+#define BEER_IO_REF_MIN 256
+
+/* writes are queued by reference only by blocking stream */
+static inline int
+beer_io_by_ref(struct beer_stream_net *s, size_t size)
+{
+	if (s->opt.send_ref <= 0 || s->opt.nonblock)
+		return 0;
+	return size >= BEER_IO_REF_MIN && size >= (size_t)s->opt.send_ref;
+}
+
+/*
+ * iovecs of at least send_ref bytes are queued by reference, and are sent
+ * from caller's memory on flush; the rest is copied into send buffer
+ */
+static ssize_t
+beer_io_sendv_ref(struct beer_stream_net *s, struct iovec *iov, int count,
+		  size_t size)
+{
+	if (s->sbuf.ref == NULL) {
+		s->sbuf.ref = beer_mem_alloc(BEER_IO_REFS *
+					     sizeof(struct beer_iob_ref));
+		if (s->sbuf.ref == NULL) {
+			s->error = BEER_EMEMORY;
+			return -1;
+		}
+	}
+	int i;
+	for (i = 0; i < count; i++) {
+		size_t len = iov[i].iov_len;
+		if (beer_io_by_ref(s, len)) {
+			if (s->sbuf.ref_count == BEER_IO_REFS &&
+			    beer_io_flush(s) == -1)
+				return -1;
+			struct beer_iob_ref *ref =
+				&s->sbuf.ref[s->sbuf.ref_count++];
+			ref->off = s->sbuf.off;
+			ref->data = iov[i].iov_base;
+			ref->size = len;
+			continue;
+		}
+		if (s->sbuf.off + len > s->sbuf.size && beer_io_flush(s) == -1)
+			return -1;
+		if (len > s->sbuf.size) {
+			struct iovec v = iov[i];
+			if (beer_io_sendv_raw(s, &v, 1, 1) == -1)
+				return -1;
+			continue;
+		}
+		memcpy(s->sbuf.buf + s->sbuf.off, iov[i].iov_base, len);
+		s->sbuf.off += len;
+	}
+	return size;
+}
+
 ssize_t
 beer_io_send(struct beer_stream_net *s, const char *buf, size_t size)
 {
 	if (s->sbuf.buf == NULL)
 		return beer_io_send_raw(s, buf, size, 1);
+	if (beer_io_by_ref(s, size)) {
+		struct iovec v = { (void *)buf, size };
+		return beer_io_sendv_ref(s, &v, 1, size);
+	}
+	if (s->sbuf.off + size > s->sbuf.size)
+		beer_io_adapt_grow(s, &s->sbuf, s->sbuf.off + size);
 	if (size > s->sbuf.size) {
-		s->error = BEER_EBIG;
-		return -1;
+		struct iovec v = { (void *)buf, size };
+		return beer_io_send_big(s, &v, 1, size);
 	}
 	if ((s->sbuf.off + size) <= s->sbuf.size) {
 		memcpy(s->sbuf.buf + s->sbuf.off, buf, size);
 		s->sbuf.off += size;
 		return size;
 	}
-	ssize_t r = beer_io_send_raw(s, s->sbuf.buf, s->sbuf.off, 1);
-	if (r == -1)
+	if (s->opt.nonblock) {
+		if (beer_io_flush_room(s, size) == -1)
+			return -1;
+		memcpy(s->sbuf.buf + s->sbuf.off, buf, size);
+		s->sbuf.off += size;
+		return size;
+	}
+	if (beer_io_flush(s) == -1)
 		return -1;
-	s->sbuf.off = size;
 	memcpy(s->sbuf.buf, buf, size);
+	s->sbuf.off = size;
 	return size;
 }
 
-inline static void
-beer_io_sendv_put(struct beer_stream_net *s, struct iovec *iov, int count) {
-	int i;
-	for (i = 0 ; i < count ; i++) {
-		memcpy(s->sbuf.buf + s->sbuf.off,
-		       iov[i].iov_base,
-		       iov[i].iov_len);
-		s->sbuf.off += iov[i].iov_len;
-	}
-}
-
 ssize_t
 beer_io_sendv(struct beer_stream_net *s, struct iovec *iov, int count)
 {
 	if (s->sbuf.buf == NULL)
 		return beer_io_sendv_raw(s, iov, count, 1);
-	size_t size = 0;
+	size_t size = 0, max = 0;
 	int i;
-	for (i = 0 ; i < count ; i++)
+	for (i = 0 ; i < count ; i++) {
 		size += iov[i].iov_len;
-	if (size > s->sbuf.size) {
-		s->error = BEER_EBIG;
-		return -1;
+		if (iov[i].iov_len > max)
+			max = iov[i].iov_len;
 	}
+	if (beer_io_by_ref(s, max))
+		return beer_io_sendv_ref(s, iov, count, size);
+	if (s->sbuf.off + size > s->sbuf.size)
+		beer_io_adapt_grow(s, &s->sbuf, s->sbuf.off + size);
+	if (size > s->sbuf.size)
+		return beer_io_send_big(s, iov, count, size);
 	if ((s->sbuf.off + size) <= s->sbuf.size) {
 		beer_io_sendv_put(s, iov, count);
 		return size;
 	}
-	ssize_t r = beer_io_send_raw(s, s->sbuf.buf, s->sbuf.off, 1);
-	if (r == -1)
+	if (s->opt.nonblock) {
+		if (beer_io_flush_room(s, size) == -1)
+			return -1;
+		beer_io_sendv_put(s, iov, count);
+		return size;
+	}
+	if (beer_io_flush(s) == -1)
 		return -1;
-	s->sbuf.off = 0;
 	beer_io_sendv_put(s, iov, count);
 	return size;
 }
@@ -448,8 +825,7 @@ beer_io_recv_raw(struct beer_stream_net *s, char *buf, size_t size, int all)
 			} while (r == -1 && (errno == EINTR));
 		}
 		if (r <= 0) {
-			s->error = BEER_ESYSTEM;
-			s->errno_ = errno;
+			beer_io_error(s, r);
 			return -1;
 		}
 		off += r;
@@ -457,41 +833,155 @@ beer_io_recv_raw(struct beer_stream_net *s, char *buf, size_t size, int all)
 	return off;
 }
 
+/*
+ * take the read started by flush; returns 1 if data was added to recv
+ * buffer, 0 if there's no read in flight
+ */
+static int
+beer_io_uring_recv(struct beer_stream_net *s)
+{
+	if (s->uring == NULL || !s->uring->reading)
+		return 0;
+	ssize_t r = beer_uring_read(s->uring);
+	if (r <= 0) {
+		if (r < 0)
+			errno = -r;
+		beer_io_error(s, r < 0 ? -1 : 0);
+		return -1;
+	}
+	/* drained buffer may be rewound meanwhile */
+	if (s->uring->read_off != s->rbuf.top)
+		memmove(s->rbuf.buf + s->rbuf.top,
+			s->rbuf.buf + s->uring->read_off, r);
+	s->rbuf.top += r;
+	return 1;
+}
+
+/* read at least 'size' bytes past rbuf.off, keeping them contiguous */
+static int
+beer_io_fill(struct beer_stream_net *s, size_t size)
+{
+	while (s->rbuf.top - s->rbuf.off < size) {
+		int rc = beer_io_uring_recv(s);
+		if (rc == -1)
+			return -1;
+		if (rc == 1)
+			continue;
+		beer_iob_wrap(&s->rbuf);
+		/* ring has room for any frame that fits, unless it's pinned */
+		if (s->rbuf.off + size > s->rbuf.top + beer_iob_room(&s->rbuf)) {
+			if (s->rbuf.pin || s->rbuf.mirror)
+				return 1;
+			memmove(s->rbuf.buf, s->rbuf.buf + s->rbuf.off,
+				s->rbuf.top - s->rbuf.off);
+			s->rbuf.top -= s->rbuf.off;
+			s->rbuf.off = 0;
+		}
+		ssize_t top = beer_io_recv_raw(s, s->rbuf.buf + s->rbuf.top,
+					      beer_iob_room(&s->rbuf), 0);
+		if (top <= 0)
+			return -1;
+		s->rbuf.top += top;
+	}
+	return 0;
+}
+
+/* in non-blocking mode data isn't consumed until it's fully buffered */
+static ssize_t
+beer_io_recv_nb(struct beer_stream_net *s, char *buf, size_t size)
+{
+	if (size > s->rbuf.size) {
+		s->error = BEER_EBIG;
+		return -1;
+	}
+	int rc = beer_io_fill(s, size);
+	if (rc == 1)
+		s->error = BEER_EBIG;
+	if (rc != 0)
+		return -1;
+	memcpy(buf, s->rbuf.buf + s->rbuf.off, size);
+	s->rbuf.off += size;
+	return size;
+}
+
 ssize_t
 beer_io_recv(struct beer_stream_net *s, char *buf, size_t size)
 {
 	if (s->rbuf.buf == NULL)
 		return beer_io_recv_raw(s, buf, size, 1);
-	size_t lv, rv, off = 0, left = size;
-	while (1) {
-		if ((s->rbuf.off + left) <= s->rbuf.top) {
-			memcpy(buf + off, s->rbuf.buf + s->rbuf.off, left);
-			s->rbuf.off += left;
-			return size;
+	if (s->opt.nonblock)
+		return beer_io_recv_nb(s, buf, size);
+	size_t off = 0;
+	while (off < size) {
+		size_t avail = s->rbuf.top - s->rbuf.off;
+		if (avail) {
+			size_t n = MIN(avail, size - off);
+			memcpy(buf + off, s->rbuf.buf + s->rbuf.off, n);
+			s->rbuf.off += n;
+			off += n;
+			continue;
 		}
-
-		lv = s->rbuf.top - s->rbuf.off;
-		rv = left - lv;
-		if (lv) {
-			memcpy(buf + off, s->rbuf.buf + s->rbuf.off, lv);
-			off += lv;
+		int rc = beer_io_uring_recv(s);
+		if (rc == -1)
+			return -1;
+		if (rc == 1)
+			continue;
+		/* buffer is drained, pinned data must be kept intact */
+		beer_iob_wrap(&s->rbuf);
+		size_t room = beer_iob_room(&s->rbuf);
+		if (room == 0) {
+			if (beer_io_recv_raw(s, buf + off, size - off, 1) == -1)
+				return -1;
+			return size;
 		}
+		ssize_t top = beer_io_recv_raw(s, s->rbuf.buf + s->rbuf.top,
+					      room, 0);
+		if (top <= 0)
+			return -1;
+		s->rbuf.top += top;
+	}
+	return size;
+}
 
-		s->rbuf.off = 0;
-		ssize_t top = beer_io_recv_raw(s, s->rbuf.buf, s->rbuf.size, 0);
-		if (top <= 0) {
-			s->errno_ = errno;
-			s->error = BEER_ESYSTEM;
+int
+beer_io_peek(struct beer_stream_net *s, size_t *size)
+{
+	if (s->rbuf.buf == NULL)
+		return 1;
+	beer_io_adapt_shrink(s, &s->rbuf, s->opt.recv_buf);
+	int rc = beer_io_fill(s, 5);
+	/* there's no copy fallback without blocking, replies must be freed */
+	if (rc == 1 && s->opt.nonblock) {
+		s->error = BEER_EBIG;
+		return -1;
+	}
+	if (rc != 0)
+		return rc;
+	const char *p = s->rbuf.buf + s->rbuf.off;
+	if (mp_typeof(*p) != MP_UINT)
+		return 1;
+	size_t len = mp_decode_uint(&p) + 5;
+	beer_io_adapt_use(s, &s->rbuf, len);
+	if (len > s->rbuf.size && !beer_io_adapt_grow(s, &s->rbuf, len)) {
+		if (!s->opt.nonblock)
+			return 1;
+		/* there's no copy fallback without blocking */
+		if (s->rbuf.pin) {
+			s->error = BEER_EBIG;
 			return -1;
 		}
-
-		s->rbuf.top = top;
-		if (rv <= s->rbuf.top) {
-			memcpy(buf + off, s->rbuf.buf, rv);
-			s->rbuf.off = rv;
-			return size;
+		if (beer_iob_resize(&s->rbuf, len) == -1) {
+			s->error = BEER_EMEMORY;
+			return -1;
 		}
-		left -= lv;
 	}
-	return -1;
+	rc = beer_io_fill(s, len);
+	if (rc == 1 && s->opt.nonblock) {
+		s->error = BEER_EBIG;
+		return -1;
+	}
+	if (rc != 0)
+		return rc;
+	*size = len;
+	return 0;
 }
@@ -36,9 +36,82 @@
 #include <unistd.h>
 #include <sys/uio.h>
 
+#if defined(__linux__)
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#endif /* defined(__linux__) */
+
 #include <beer/beer_mem.h>
 #include <beer/beer_iob.h>
 
+#if defined(__linux__) && defined(__NR_memfd_create)
+
+/*
+ * Ring of 'size' bytes, mapped twice in a row: data, that wraps around the
+ * end of the ring, is contiguous in the second mapping.
+ */
+static char *
+beer_iob_mirror_new(size_t size)
+{
+	int fd = syscall(__NR_memfd_create, "beer_iob", 1 /* MFD_CLOEXEC */);
+	if (fd == -1)
+		return NULL;
+	char *buf = MAP_FAILED;
+	if (ftruncate(fd, size) == -1)
+		goto done;
+	buf = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+		   -1, 0);
+	if (buf == MAP_FAILED)
+		goto done;
+	if (mmap(buf, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		 fd, 0) == MAP_FAILED ||
+	    mmap(buf + size, size, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(buf, size * 2);
+		buf = MAP_FAILED;
+	}
+done:
+	close(fd);
+	return buf == MAP_FAILED ? NULL : buf;
+}
+
+static void
+beer_iob_mirror_free(char *buf, size_t size)
+{
+	munmap(buf, size * 2);
+}
+
+static size_t
+beer_iob_mirror_size(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (size + page - 1) & ~(page - 1);
+}
+
+#else /* mirror isn't supported */
+
+static char *
+beer_iob_mirror_new(size_t size)
+{
+	(void)size;
+	return NULL;
+}
+
+static void
+beer_iob_mirror_free(char *buf, size_t size)
+{
+	(void)buf;
+	(void)size;
+}
+
+static size_t
+beer_iob_mirror_size(size_t size)
+{
+	return size;
+}
+
+#endif
+
 int
 beer_iob_init(struct beer_iob *iob, size_t size,
 	     beer_iob_tx_t tx,
@@ -50,7 +123,14 @@ beer_iob_init(struct beer_iob *iob, size_t size,
 	iob->size = size;
 	iob->off = 0;
 	iob->top = 0;
+	iob->pin = 0;
+	iob->low = 0;
+	iob->mirror = 0;
 	iob->buf = NULL;
+	iob->ref = NULL;
+	iob->ref_count = 0;
+	iob->peak = 0;
+	iob->rounds = 0;
 	if (size > 0) {
 		iob->buf = beer_mem_alloc(size);
 		if (iob->buf == NULL)
@@ -60,16 +140,122 @@ beer_iob_init(struct beer_iob *iob, size_t size,
 	return 0;
 }
 
+int
+beer_iob_init_ring(struct beer_iob *iob, size_t size, beer_iob_tx_t tx,
+		  void *ptr)
+{
+	if (beer_iob_init(iob, 0, tx, NULL, ptr) == -1)
+		return -1;
+	if (size > 0) {
+		size_t ring = beer_iob_mirror_size(size);
+		iob->buf = beer_iob_mirror_new(ring);
+		if (iob->buf) {
+			iob->size = ring;
+			iob->mirror = 1;
+			return 0;
+		}
+	}
+	/* plain buffer, if pages can't be mapped twice */
+	return beer_iob_init(iob, size, tx, NULL, ptr);
+}
+
 void
 beer_iob_clear(struct beer_iob *iob)
 {
 	iob->top = 0;
 	iob->off = 0;
+	iob->pin = 0;
+	iob->ref_count = 0;
 }
 
 void
 beer_iob_free(struct beer_iob *iob)
 {
-	if (iob->buf)
+	if (iob->mirror)
+		beer_iob_mirror_free(iob->buf, iob->size);
+	else if (iob->buf)
 		beer_mem_free(iob->buf);
+	if (iob->ref)
+		beer_mem_free(iob->ref);
+}
+
+int
+beer_iob_resize(struct beer_iob *iob, size_t size)
+{
+	if (iob->mirror) {
+		/* data is moved to the start of new ring */
+		size_t ring = beer_iob_mirror_size(size);
+		char *buf = beer_iob_mirror_new(ring);
+		if (buf == NULL)
+			return -1;
+		memcpy(buf, iob->buf + iob->off, iob->top - iob->off);
+		beer_iob_mirror_free(iob->buf, iob->size);
+		iob->buf = buf;
+		iob->size = ring;
+		iob->top -= iob->off;
+		iob->off = 0;
+		return 0;
+	}
+	char *buf = beer_mem_realloc(iob->buf, size);
+	if (buf == NULL)
+		return -1;
+	iob->buf = buf;
+	iob->size = size;
+	return 0;
+}
+
+/* free space at top, that is contiguous */
+size_t
+beer_iob_room(struct beer_iob *iob)
+{
+	if (!iob->mirror)
+		return iob->size - iob->top;
+	size_t keep = iob->pin ? iob->low : iob->off;
+	return keep + iob->size - iob->top;
+}
+
+/*
+ * rewind drained buffer; offsets of ring are moved back into the first
+ * mapping, once everything before them is consumed
+ */
+void
+beer_iob_wrap(struct beer_iob *iob)
+{
+	if (iob->off == iob->top && iob->pin == 0) {
+		iob->off = 0;
+		iob->top = 0;
+		return;
+	}
+	if (!iob->mirror)
+		return;
+	size_t keep = iob->pin ? iob->low : iob->off;
+	if (keep < iob->size)
+		return;
+	iob->off -= iob->size;
+	iob->top -= iob->size;
+	if (iob->pin)
+		iob->low -= iob->size;
+}
+
+/* called for a reply, that starts at off, before off is moved past it */
+void
+beer_iob_pin(struct beer_iob *iob)
+{
+	if (iob->pin++ == 0)
+		iob->low = iob->off;
+}
+
+void
+beer_iob_unpin(struct beer_iob *iob)
+{
+	if (iob->pin == 0)
+		return;
+	/*
+	 * rewind drained buffer, once nobody points into it (ring is
+	 * rewound by beer_iob_wrap(), a read may be in flight at top)
+	 */
+	if (--iob->pin == 0 && !iob->mirror && iob->off == iob->top) {
+		iob->off = 0;
+		iob->top = 0;
+	}
 }
@@ -44,7 +44,7 @@
 static struct beer_iter *beer_iter_init(struct beer_iter *i) {
 	int alloc = (i == NULL);
 	if (alloc) {
-		i = beer_mem_alloc(sizeof(struct beer_iter));
+		i = beer_mem_batch_alloc(sizeof(struct beer_iter));
 		if (i == NULL)
 			return NULL;
 	}
@@ -279,7 +279,7 @@ void beer_iter_free(struct beer_iter *i) {
 	if (i->free)
 		i->free(i);
 	if (i->alloc)
-		beer_mem_free(i);
+		beer_mem_batch_free(i);
 }
 
 int beer_next(struct beer_iter *i) {
@@ -33,6 +33,7 @@
 #include <string.h>
 
 #include <beer/beer_mem.h>
+#include <beer/beer_arena.h>
 
 static void *custom_realloc(void *ptr, size_t size) {
 	if (!ptr) {
@@ -80,3 +81,75 @@ char *beer_mem_dup(char *sz) {
 void beer_mem_free(void *ptr) {
 	_beer_realloc(ptr, 0);
 }
+
+/* header of batch allocation, tells where the block came from */
+struct beer_mem_batch {
+	size_t size;
+	struct beer_arena *arena; /* NULL, if it's allocated with _beer_realloc */
+};
+
+static __thread struct beer_arena *beer_mem_arena_cur = NULL;
+
+struct beer_arena *beer_mem_arena(struct beer_arena *a) {
+	struct beer_arena *old = beer_mem_arena_cur;
+	beer_mem_arena_cur = a;
+	return old;
+}
+
+void *beer_mem_batch_alloc(size_t size) {
+	struct beer_arena *a = beer_mem_arena_cur;
+	struct beer_mem_batch *b;
+	if (beerlikely(a == NULL)) {
+		b = _beer_realloc(NULL, sizeof(struct beer_mem_batch) + size);
+		if (b == NULL)
+			return NULL;
+	} else {
+		b = beer_arena_alloc(a, sizeof(struct beer_mem_batch) + size);
+		if (b == NULL)
+			return NULL;
+		/* as if it's calloc'ed, like by default allocator */
+		memset(b + 1, 0, size);
+	}
+	b->size = size;
+	b->arena = a;
+	return b + 1;
+}
+
+void *beer_mem_batch_realloc(void *ptr, size_t size) {
+	if (ptr == NULL)
+		return beer_mem_batch_alloc(size);
+	if (size == 0) {
+		beer_mem_batch_free(ptr);
+		return NULL;
+	}
+	struct beer_mem_batch *b = (struct beer_mem_batch *)ptr - 1;
+	if (b->arena == NULL) {
+		b = _beer_realloc(b, sizeof(struct beer_mem_batch) + size);
+		if (b == NULL)
+			return NULL;
+		b->size = size;
+		return b + 1;
+	}
+	if (beer_arena_extend(b->arena, b, sizeof(struct beer_mem_batch) + b->size,
+			      sizeof(struct beer_mem_batch) + size) == 0) {
+		b->size = size;
+		return ptr;
+	}
+	void *nptr = beer_mem_batch_alloc(size);
+	if (nptr == NULL)
+		return NULL;
+	memcpy(nptr, ptr, b->size < size ? b->size : size);
+	beer_mem_batch_free(ptr);
+	return nptr;
+}
+
+void beer_mem_batch_free(void *ptr) {
+	if (ptr == NULL)
+		return;
+	struct beer_mem_batch *b = (struct beer_mem_batch *)ptr - 1;
+	if (b->arena == NULL)
+		_beer_realloc(b, 0);
+	else
+		beer_arena_release(b->arena, b,
+				   sizeof(struct beer_mem_batch) + b->size);
+}
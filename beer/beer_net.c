@@ -48,21 +48,27 @@
 #include <beer/beer_select.h>
 #include <beer/beer_iter.h>
 #include <beer/beer_auth.h>
+#include <beer/beer_pending.h>
 
 #include <beer/beer_net.h>
 #include <beer/beer_io.h>
 
+#include "beer_retry.h"
 #include "pmatomic.h"
 
 static void beer_net_free(struct beer_stream *s) {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
 	beer_io_close(sn);
+	beer_pending_clear(s);
+	beer_retry_clear(s);
 	beer_mem_free(sn->greeting);
 	beer_iob_free(&sn->sbuf);
 	beer_iob_free(&sn->rbuf);
+	if (sn->schema)
+		beer_schema_unref(sn->schema);
+	if (sn->loading)
+		beer_schema_unref(sn->loading);
 	beer_opt_free(&sn->opt);
-	beer_schema_free(sn->schema);
-	beer_mem_free(sn->schema);
 	beer_mem_free(s->data);
 	s->data = NULL;
 }
@@ -78,8 +84,14 @@ static ssize_t
 beer_net_write(struct beer_stream *s, const char *buf, size_t size) {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
 	ssize_t rc = beer_io_send(sn, buf, size);
-	if (rc != -1)
-		pm_atomic_fetch_add(&s->wrcnt, 1);
+	if (rc == -1)
+		return -1;
+	pm_atomic_fetch_add(&s->wrcnt, 1);
+	/* waiting for definitions isn't possible in non-blocking mode */
+	if (s->schema_id && !sn->opt.nonblock) {
+		struct iovec v = { (void *)buf, size };
+		beer_retry_keep(s, &v, 1);
+	}
 	return rc;
 }
 
@@ -87,8 +99,11 @@ static ssize_t
 beer_net_writev(struct beer_stream *s, struct iovec *iov, int count) {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
 	ssize_t rc = beer_io_sendv(sn, iov, count);
-	if (rc != -1)
-		pm_atomic_fetch_add(&s->wrcnt, 1);
+	if (rc == -1)
+		return -1;
+	pm_atomic_fetch_add(&s->wrcnt, 1);
+	if (s->schema_id && !sn->opt.nonblock)
+		beer_retry_keep(s, iov, count);
 	return rc;
 }
 
@@ -99,11 +114,62 @@ beer_net_recv_cb(struct beer_stream *s, char *buf, ssize_t size) {
 }
 
 static int
-beer_net_reply(struct beer_stream *s, struct beer_reply *r) {
+beer_net_reply_one(struct beer_stream *s, struct beer_reply *r) {
 	if (pm_atomic_load(&s->wrcnt) == 0)
 		return 1;
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	size_t size = 0;
+	int rc = 1;
+	/* in non-blocking mode reply is parsed only when it's fully buffered */
+	if (sn->opt.zero_copy || sn->opt.nonblock) {
+		rc = beer_io_peek(sn, &size);
+		if (rc == -1)
+			return -1;
+	}
+	r->trusted = sn->opt.trusted;
+	if (sn->opt.zero_copy && rc == 0) {
+		const char *frame = sn->rbuf.buf + sn->rbuf.off;
+		if (beer_reply_view(r, frame + 5, size - 5) == -1) {
+			sn->rbuf.off += size;
+			pm_atomic_fetch_sub(&s->wrcnt, 1);
+			return -1;
+		}
+		r->iob = &sn->rbuf;
+		beer_iob_pin(&sn->rbuf);
+		sn->rbuf.off += size;
+	} else if (beer_reply_from(r, (beer_reply_t)beer_net_recv_cb, s) == -1) {
+		return -1;
+	}
+	/* request is answered, once its reply is consumed */
 	pm_atomic_fetch_sub(&s->wrcnt, 1);
-	return beer_reply_from(r, (beer_reply_t)beer_net_recv_cb, s);
+	if (r->bitmap & (1ULL << BEER_SCHEMA_ID))
+		sn->schema_id = r->schema_id;
+	return 0;
+}
+
+static int
+beer_net_reply(struct beer_stream *s, struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	while (1) {
+		if (sn->retry_ready && beer_retry_ready(s, r))
+			return 0;
+		int rc = beer_net_reply_one(s, r);
+		if (rc != 0 || sn->retry == NULL)
+			return rc;
+		/* replies to requests that were sent again are skipped */
+		rc = beer_retry_reply(s, r);
+		if (rc != 1)
+			return rc;
+	}
+}
+
+/* requests carry schema id of the loaded schema, if it's checked */
+static void
+beer_net_schema_loaded(struct beer_stream *s) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	s->schema_id = 0;
+	if (sn->opt.schema_check)
+		s->schema_id = pm_atomic_load(&sn->schema->schema_id);
 }
 
 struct beer_stream *beer_net(struct beer_stream *s) {
@@ -147,7 +213,15 @@ int beer_set(struct beer_stream *s, int opt, ...) {
 
 int beer_init(struct beer_stream *s) {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
-	if ((sn->schema = beer_schema_new(NULL)) == NULL) {
+	if (sn->opt.nonblock && (sn->opt.send_buf <= 0 || sn->opt.recv_buf <= 0)) {
+		sn->error = BEER_EBADVAL;
+		return -1;
+	}
+	if (sn->opt.schema)
+		sn->schema = beer_schema_ref(sn->opt.schema);
+	else
+		sn->schema = beer_schema_new(NULL);
+	if (sn->schema == NULL) {
 		sn->error = BEER_EMEMORY;
 		return -1;
 	}
@@ -156,7 +230,7 @@ int beer_init(struct beer_stream *s) {
 		sn->error = BEER_EMEMORY;
 		return -1;
 	}
-	if (beer_iob_init(&sn->rbuf, sn->opt.recv_buf, sn->opt.recv_cb, NULL,
+	if (beer_iob_init_ring(&sn->rbuf, sn->opt.recv_buf, sn->opt.recv_cb,
 		sn->opt.recv_cb_arg) == -1) {
 		sn->error = BEER_EMEMORY;
 		return -1;
@@ -168,52 +242,62 @@ int beer_init(struct beer_stream *s) {
 int beer_reload_schema(struct beer_stream *s)
 {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
-	if (!sn->connected || pm_atomic_load(&s->wrcnt) != 0)
+	if (!sn->connected)
+		return -1;
+	/* waits for replies, so it isn't possible in non-blocking mode */
+	if (sn->opt.nonblock) {
+		sn->error = BEER_EBADVAL;
 		return -1;
-	uint64_t oldsync = beer_stream_reqid(s, 127);
-	beer_get_space(s);
-	beer_get_index(s);
-	beer_stream_reqid(s, oldsync);
-	beer_flush(s);
-	struct beer_iter it; beer_iter_reply(&it, s);
-	struct beer_reply bkp; beer_reply_init(&bkp);
-	int sloaded = 0;
-	while (beer_next(&it)) {
-		struct beer_reply *r = BEER_IREPLY_PTR(&it);
-		switch (r->sync) {
-		case(127):
-			if (r->error)
-				goto error;
-			beer_schema_add_spaces(sn->schema, r);
-			sloaded += 1;
-			break;
-		case(128):
-			if (r->error)
-				goto error;
-			if (!(sloaded & 1)) {
-				memcpy(&bkp, r, sizeof(struct beer_reply));
-				r->buf = NULL;
-				break;
-			}
-			sloaded += 2;
-			beer_schema_add_indexes(sn->schema, r);
-			break;
-		default:
-			goto error;
-		}
 	}
-	if (bkp.buf) {
-		beer_schema_add_indexes(sn->schema, &bkp);
-		sloaded += 2;
-		beer_reply_free(&bkp);
+	/* system spaces are selected without schema check */
+	s->schema_id = 0;
+	uint64_t space_sync = s->reqid;
+	if (beer_get_space(s) == -1)
+		return -1;
+	uint64_t index_sync = s->reqid;
+	if (beer_get_index(s) == -1)
+		return -1;
+	if (beer_flush(s) == -1)
+		return -1;
+	/* replies to other requests in flight are parked */
+	struct beer_reply space, index;
+	beer_reply_init(&space);
+	beer_reply_init(&index);
+	int rc = -1;
+	if (beer_reply_sync(s, space_sync, &space) != 0 ||
+	    beer_reply_sync(s, index_sync, &index) != 0)
+		goto exit;
+	if (space.error || index.error)
+		goto exit;
+	/* schema may be shared, so it's built aside and then published */
+	struct beer_schema *fresh = beer_schema_new(NULL);
+	if (fresh == NULL) {
+		sn->error = BEER_EMEMORY;
+		goto exit;
+	}
+	if (beer_schema_add_spaces(fresh, &space) == 0 &&
+	    beer_schema_add_indexes(fresh, &index) == 0) {
+		fresh->schema_id = space.schema_id;
+		beer_schema_replace(sn->schema, fresh);
+		beer_net_schema_loaded(s);
+		rc = 0;
 	}
-	if (sloaded != 3) goto error;
+	beer_schema_unref(fresh);
+exit:
+	beer_reply_free(&space);
+	beer_reply_free(&index);
+	return rc;
+}
 
-	beer_iter_free(&it);
-	return 0;
-error:
-	beer_iter_free(&it);
-	return -1;
+int beer_check_schema(struct beer_stream *s)
+{
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	if (sn->schema_id != 0 &&
+	    pm_atomic_load(&sn->schema->schema_id) == sn->schema_id) {
+		beer_net_schema_loaded(s);
+		return 0;
+	}
+	return beer_reload_schema(s);
 }
 
 static int
@@ -236,14 +320,133 @@ beer_authenticate(struct beer_stream *s)
 		return -1;
 	}
 	beer_reply_free(&rep);
-	beer_reload_schema(s);
+	beer_check_schema(s);
 	return 0;
 }
 
+/* wait for reply on non-blocking stream, sending request first */
+static int
+beer_connect_reply(struct beer_stream *s, struct beer_reply *r)
+{
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	if (sn->sbuf.off) {
+		if (beer_io_flush(sn) == -1 && sn->error != BEER_EAGAIN)
+			return -1;
+		if (sn->sbuf.off) {
+			sn->error = BEER_EAGAIN;
+			return -1;
+		}
+	}
+	beer_reply_init(r);
+	return s->read_reply(s, r);
+}
+
+static int
+beer_connect_nb(struct beer_stream *s)
+{
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct uri *uri = sn->opt.uri;
+	struct beer_reply r;
+	while (1) {
+		switch (sn->state) {
+		case BEER_NET_READY:
+			beer_close(s);
+			/* fallthrough */
+		case BEER_NET_CLOSED:
+			if (!sn->inited && beer_init(s) == -1)
+				return -1;
+			sn->error = beer_io_connect(sn);
+			if (sn->error == BEER_EAGAIN) {
+				sn->state = BEER_NET_CONNECTING;
+				return -1;
+			}
+			if (sn->error != BEER_EOK)
+				return -1;
+			sn->state = BEER_NET_GREETING;
+			break;
+		case BEER_NET_CONNECTING:
+			sn->error = beer_io_connect_check(sn);
+			if (sn->error == BEER_EAGAIN)
+				return -1;
+			if (sn->error != BEER_EOK)
+				goto error;
+			sn->state = BEER_NET_GREETING;
+			break;
+		case BEER_NET_GREETING:
+			if (s->read(s, sn->greeting, BEER_GREETING_SIZE) == -1)
+				goto error;
+			if (!uri->login || !uri->password) {
+				sn->state = BEER_NET_READY;
+				return 0;
+			}
+			if (beer_auth(s, uri->login, uri->login_len, uri->password,
+				     uri->password_len) == -1)
+				goto error;
+			sn->state = BEER_NET_AUTH;
+			break;
+		case BEER_NET_AUTH:
+			if (beer_connect_reply(s, &r) == -1)
+				goto error;
+			if (r.error != NULL) {
+				sn->error = BEER_EFAIL;
+				if (BEER_REPLY_ERR(&r) == BEER_ER_PASSWORD_MISMATCH)
+					sn->error = BEER_ELOGIN;
+				beer_reply_free(&r);
+				goto error;
+			}
+			beer_reply_free(&r);
+			if (sn->schema_id != 0 &&
+			    pm_atomic_load(&sn->schema->schema_id) == sn->schema_id) {
+				beer_net_schema_loaded(s);
+				sn->state = BEER_NET_READY;
+				return 0;
+			}
+			if (beer_get_space(s) == -1)
+				goto error;
+			sn->state = BEER_NET_SPACES;
+			break;
+		case BEER_NET_SPACES:
+			if (beer_connect_reply(s, &r) == -1)
+				goto error;
+			/* schema is optional, as with beer_reload_schema() */
+			if (r.error == NULL && (sn->loading = beer_schema_new(NULL))) {
+				sn->loading->schema_id = r.schema_id;
+				beer_schema_add_spaces(sn->loading, &r);
+			}
+			beer_reply_free(&r);
+			if (beer_get_index(s) == -1)
+				goto error;
+			sn->state = BEER_NET_INDEXES;
+			break;
+		case BEER_NET_INDEXES:
+			if (beer_connect_reply(s, &r) == -1)
+				goto error;
+			if (r.error == NULL && sn->loading &&
+			    beer_schema_add_indexes(sn->loading, &r) == 0)
+				beer_schema_replace(sn->schema, sn->loading);
+			beer_reply_free(&r);
+			if (sn->loading) {
+				beer_schema_unref(sn->loading);
+				sn->loading = NULL;
+			}
+			beer_net_schema_loaded(s);
+			sn->state = BEER_NET_READY;
+			return 0;
+		}
+	}
+error:
+	if (sn->error != BEER_EAGAIN)
+		beer_close(s);
+	return -1;
+}
+
 int beer_connect(struct beer_stream *s)
 {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
-	if (!sn->inited) beer_init(s);
+	if (sn->opt.nonblock)
+		return beer_connect_nb(s);
+	if (!sn->inited && beer_init(s) == -1)
+		return -1;
 	if (sn->connected)
 		beer_close(s);
 	sn->error = beer_io_connect(sn);
@@ -255,6 +458,7 @@ int beer_connect(struct beer_stream *s)
 	if (sn->opt.uri->login && sn->opt.uri->password)
 		if (beer_authenticate(s) == -1)
 			return -1;
+	sn->state = BEER_NET_READY;
 	return 0;
 }
 
@@ -263,6 +467,14 @@ void beer_close(struct beer_stream *s) {
 	beer_iob_clear(&sn->sbuf);
 	beer_iob_clear(&sn->rbuf);
 	beer_io_close(sn);
+	beer_pending_clear(s);
+	beer_retry_clear(s);
+	s->schema_id = 0;
+	if (sn->loading) {
+		beer_schema_unref(sn->loading);
+		sn->loading = NULL;
+	}
+	sn->state = BEER_NET_CLOSED;
 	s->wrcnt = 0;
 	s->reqid = 0;
 }
@@ -272,6 +484,26 @@ ssize_t beer_flush(struct beer_stream *s) {
 	return beer_io_flush(sn);
 }
 
+int beer_want(struct beer_stream *s) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	int want = 0;
+	switch (sn->state) {
+	case BEER_NET_CLOSED:
+		return 0;
+	case BEER_NET_CONNECTING:
+		return BEER_WANT_WRITE;
+	case BEER_NET_READY:
+		if (pm_atomic_load(&s->wrcnt) != 0)
+			want |= BEER_WANT_READ;
+		break;
+	default:
+		want |= BEER_WANT_READ;
+	}
+	if (sn->sbuf.off)
+		want |= BEER_WANT_WRITE;
+	return want;
+}
+
 int beer_fd(struct beer_stream *s) {
 	struct beer_stream_net *sn = BEER_SNET_CAST(s);
 	return sn->fd;
@@ -301,6 +533,7 @@ static struct beer_error_desc beer_error_list[] =
 	{ BEER_ETMOUT,   "operation timeout"        },
 	{ BEER_EBADVAL,  "bad argument"             },
 	{ BEER_ELOGIN,   "failed to login"          },
+	{ BEER_EAGAIN,   "operation would block"    },
 	{ BEER_LAST,      NULL                      }
 };
 
@@ -15,9 +15,11 @@ static void
 beer_sbuf_object_free(struct beer_stream *s)
 {
 	struct beer_sbuf_object *sbo = BEER_SOBJ_CAST(s);
-	if (sbo->stack) beer_mem_free(sbo->stack);
+	if (sbo->stack) beer_mem_batch_free(sbo->stack);
 	sbo->stack = NULL;
-	beer_mem_free(sbo);
+	if (sbo->slots) beer_mem_batch_free(sbo->slots);
+	sbo->slots = NULL;
+	beer_mem_batch_free(sbo);
 }
 
 int
@@ -33,30 +35,77 @@ beer_sbuf_object_grow_stack(struct beer_sbuf_object *sbo)
 {
 	if (sbo->stack_alloc == 128) return -1;
 	uint8_t new_stack_alloc = 2 * sbo->stack_alloc;
-	struct beer_sbo_stack *stack = beer_mem_alloc(new_stack_alloc * sizeof(
-				struct beer_sbo_stack));
+	struct beer_sbo_stack *stack = beer_mem_batch_realloc(sbo->stack,
+			new_stack_alloc * sizeof(struct beer_sbo_stack));
 	if (!stack) return -1;
 	sbo->stack_alloc = new_stack_alloc;
 	sbo->stack = stack;
 	return 0;
 }
 
-static char *
-beer_sbuf_object_resize(struct beer_stream *s, size_t size) {
-	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
-	if (sb->size + size > sb->alloc) {
-		size_t newsize = 2 * (sb->alloc);
-		if (newsize < sb->size + size)
-			newsize = sb->size + size;
-		char *nd = beer_mem_realloc(sb->data, newsize);
-		if (nd == NULL) {
-			beer_mem_free(sb->data);
-			return NULL;
+/*
+ * In BEER_SBO_DEFERRED mode nothing is written when container is opened,
+ * its slot keeps offset of the first value and count of values, and the
+ * stack keeps index of the slot instead of offset.
+ */
+static int
+beer_sbuf_object_add_slot(struct beer_stream *s, enum mp_type type)
+{
+	struct beer_sbuf_object *sbo = BEER_SOBJ_CAST(s);
+	if (sbo->slots_count == sbo->slots_alloc) {
+		size_t new_slots_alloc = sbo->slots_alloc ? 2 * sbo->slots_alloc : 8;
+		struct beer_sbo_stack *slots = beer_mem_batch_realloc(sbo->slots,
+				new_slots_alloc * sizeof(struct beer_sbo_stack));
+		if (!slots) return -1;
+		sbo->slots_alloc = new_slots_alloc;
+		sbo->slots = slots;
+	}
+	struct beer_sbo_stack *slot = &sbo->slots[sbo->slots_count];
+	slot->offset = BEER_SBUF_CAST(s)->size;
+	slot->size = 0;
+	slot->type = type;
+	sbo->stack[sbo->stack_size - 1].offset = sbo->slots_count++;
+	s->wrcnt++;
+	return 0;
+}
+
+/*
+ * Insert headers of closed containers into data. Data is moved from the
+ * end, past the last header first, so every byte is moved once.
+ */
+static ssize_t
+beer_sbuf_object_flush_slots(struct beer_stream *s)
+{
+	struct beer_stream_buf   *sb = BEER_SBUF_CAST(s);
+	struct beer_sbuf_object *sbo = BEER_SOBJ_CAST(s);
+	size_t hsize = 0, i;
+	for (i = 0; i < sbo->slots_count; i++) {
+		struct beer_sbo_stack *slot = &sbo->slots[i];
+		if (slot->type == MP_MAP)
+			hsize += mp_sizeof_map(slot->size/2);
+		else
+			hsize += mp_sizeof_array(slot->size);
+	}
+	if (!sb->resize(s, hsize))
+		return -1;
+	size_t src = sb->size, dst = sb->size + hsize;
+	for (i = sbo->slots_count; i > 0; i--) {
+		struct beer_sbo_stack *slot = &sbo->slots[i - 1];
+		dst -= src - slot->offset;
+		memmove(sb->data + dst, sb->data + slot->offset, src - slot->offset);
+		if (slot->type == MP_MAP) {
+			dst -= mp_sizeof_map(slot->size/2);
+			mp_encode_map(sb->data + dst, slot->size/2);
+		} else {
+			dst -= mp_sizeof_array(slot->size);
+			mp_encode_array(sb->data + dst, slot->size);
 		}
-		sb->data = nd;
-		sb->alloc = newsize;
+		src = slot->offset;
 	}
-	return sb->data + sb->size;
+	assert(src == dst);
+	sb->size += hsize;
+	sbo->slots_count = 0;
+	return hsize;
 }
 
 struct beer_stream *
@@ -66,19 +115,21 @@ beer_object(struct beer_stream *s)
 		goto error;
 
 	struct beer_stream_buf *sb = BEER_SBUF_CAST(s);
-	sb->resize = beer_sbuf_object_resize;
 	sb->free = beer_sbuf_object_free;
 
-	struct beer_sbuf_object *sbo = beer_mem_alloc(sizeof(struct beer_sbuf_object));
+	struct beer_sbuf_object *sbo = beer_mem_batch_alloc(sizeof(struct beer_sbuf_object));
 	if (sbo == NULL)
 		goto error;
 	sb->subdata = sbo;
 	sbo->stack_size = 0;
 	sbo->stack_alloc = 8;
-	sbo->stack = beer_mem_alloc(sbo->stack_alloc *
+	sbo->stack = beer_mem_batch_alloc(sbo->stack_alloc *
 			sizeof(struct beer_sbo_stack));
 	if (sbo->stack == NULL)
 		goto error;
+	sbo->slots = NULL;
+	sbo->slots_count = 0;
+	sbo->slots_alloc = 0;
 	beer_object_type(s, BEER_SBO_SIMPLE);
 
 	return s;
@@ -222,6 +273,8 @@ beer_object_add_array (struct beer_stream *s, uint32_t size)
 		end = mp_encode_array32(data, 0);
 	} else if (BEER_SOBJ_CAST(s)->type == BEER_SBO_PACKED) {
 		end = mp_encode_array(data, 0);
+	} else if (BEER_SOBJ_CAST(s)->type == BEER_SBO_DEFERRED) {
+		return beer_sbuf_object_add_slot(s, MP_ARRAY);
 	} else {
 		return -1;
 	}
@@ -257,6 +310,8 @@ beer_object_add_map (struct beer_stream *s, uint32_t size)
 		end = mp_encode_map32(data, 0);
 	} else if (BEER_SOBJ_CAST(s)->type == BEER_SBO_PACKED) {
 		end = mp_encode_map(data, 0);
+	} else if (BEER_SOBJ_CAST(s)->type == BEER_SBO_DEFERRED) {
+		return beer_sbuf_object_add_slot(s, MP_MAP);
 	} else {
 		return -1;
 	}
@@ -275,6 +330,13 @@ beer_object_container_close (struct beer_stream *s)
 	size_t       offset = sbo->stack[sbo->stack_size - 1].offset;
 	if (type == MP_MAP && size % 2) return -1;
 	sbo->stack_size -= 1;
+	if (sbo->type == BEER_SBO_DEFERRED) {
+		/* offset is index of slot */
+		sbo->slots[offset].size = size;
+		if (sbo->stack_size > 0)
+			return 0;
+		return beer_sbuf_object_flush_slots(s);
+	}
 	char *lenp = sb->data + offset;
 	if (sbo->type == BEER_SBO_SIMPLE) {
 		return 0;
@@ -319,7 +381,7 @@ int beer_object_verify(struct beer_stream *obj, int8_t type)
 
 ssize_t beer_object_vformat(struct beer_stream *s, const char *fmt, va_list vl)
 {
-	if (beer_object_type(s, BEER_SBO_PACKED) == -1)
+	if (beer_object_type(s, BEER_SBO_DEFERRED) == -1)
 		return -1;
 	ssize_t result = 0, rv = 0;
 
@@ -418,10 +480,15 @@ ssize_t beer_object_vformat(struct beer_stream *s, const char *fmt, va_list vl)
 				assert(false);
 			}
 
-			if (int_status) {
+			if (int_status == 1) {
 				if ((rv = beer_object_add_int(s, int_value)) == -1)
 					return -1;
 				result += rv;
+			} else if (int_status == 2) {
+				if ((rv = beer_object_add_uint(s,
+						(uint64_t)int_value)) == -1)
+					return -1;
+				result += rv;
 			}
 		} else if (f[0] == 'N' && f[1] == 'I' && f[2] == 'L') {
 			if ((rv = beer_object_add_nil(s)) == -1)
@@ -442,6 +509,320 @@ ssize_t beer_object_format(struct beer_stream *s, const char *fmt, ...)
 	return res;
 }
 
+/* max depth of containers in compiled format */
+#define BEER_FORMAT_DEPTH 128
+
+enum beer_format_op {
+	BEER_FOP_END = 0,
+	BEER_FOP_RAW,    /* size byte and msgpack to copy */
+	BEER_FOP_INT,    /* int, short, char */
+	BEER_FOP_UINT,   /* unsigned int, short, char */
+	BEER_FOP_LONG,
+	BEER_FOP_ULONG,
+	BEER_FOP_LLONG,
+	BEER_FOP_ULLONG,
+	BEER_FOP_FLOAT,
+	BEER_FOP_DOUBLE,
+	BEER_FOP_BOOL,
+	BEER_FOP_STR,    /* zero-end string */
+	BEER_FOP_STRL,   /* length and string */
+};
+
+struct beer_format_emit {
+	char *ops;      /* NULL on the first pass */
+	size_t pos;     /* program size */
+	size_t raw;     /* offset of size byte of the last RAW op, or 0 */
+	size_t fixed;
+	uint32_t *sizes; /* count of values of containers, in order of opening */
+};
+
+static void
+beer_format_op(struct beer_format_emit *e, enum beer_format_op op, size_t max)
+{
+	if (e->ops)
+		e->ops[e->pos] = op;
+	e->pos += 1;
+	e->raw = 0;
+	e->fixed += max;
+}
+
+static void
+beer_format_raw(struct beer_format_emit *e, const char *data, size_t size)
+{
+	if (e->raw == 0 ||
+	    (e->ops && (uint8_t)e->ops[e->raw] + size > UINT8_MAX)) {
+		beer_format_op(e, BEER_FOP_RAW, 0);
+		e->raw = e->pos++;
+		if (e->ops)
+			e->ops[e->raw] = 0;
+	}
+	if (e->ops) {
+		memcpy(e->ops + e->pos, data, size);
+		e->ops[e->raw] += size;
+	}
+	e->pos += size;
+	e->fixed += size;
+}
+
+/*
+ * Walk format string. The first pass counts values of containers into
+ * sizes and an upper bound of program size (headers are taken as 5 bytes,
+ * RAW ops as not split), the second one writes the program.
+ */
+static int
+beer_format_parse(struct beer_format_emit *e, const char *fmt, uint32_t *count)
+{
+	uint32_t stack[BEER_FORMAT_DEPTH];
+	int depth = 0;
+	uint32_t containers = 0;
+	*count = 0;
+	for (const char *f = fmt; *f; f++) {
+		enum beer_format_op op = BEER_FOP_END;
+		size_t max = 0;
+		int value = 1;
+		if (f[0] == '[' || f[0] == '{') {
+			if (depth == BEER_FORMAT_DEPTH)
+				return -1;
+			char data[5], *end = data + 5;
+			if (e->ops && f[0] == '[')
+				end = mp_encode_array(data, e->sizes[containers]);
+			else if (e->ops)
+				end = mp_encode_map(data, e->sizes[containers] / 2);
+			else
+				e->sizes[containers] = 0;
+			if (depth > 0 && !e->ops)
+				e->sizes[stack[depth - 1]] += 1;
+			else if (depth == 0)
+				*count += 1;
+			beer_format_raw(e, data, end - data);
+			stack[depth++] = containers++;
+			continue;
+		} else if (f[0] == ']' || f[0] == '}') {
+			if (depth == 0)
+				return -1;
+			depth -= 1;
+			if (f[0] == '}' && e->sizes[stack[depth]] % 2)
+				return -1;
+			continue;
+		} else if (f[0] == '%') {
+			f++;
+			if (f[0] == 'd' || f[0] == 'i') {
+				op = BEER_FOP_INT;
+			} else if (f[0] == 'u') {
+				op = BEER_FOP_UINT;
+			} else if (f[0] == 's') {
+				op = BEER_FOP_STR;
+			} else if (f[0] == '.' && f[1] == '*' && f[2] == 's') {
+				op = BEER_FOP_STRL;
+				f += 2;
+			} else if (f[0] == 'f') {
+				op = BEER_FOP_FLOAT;
+			} else if (f[0] == 'l' && f[1] == 'f') {
+				op = BEER_FOP_DOUBLE;
+				f++;
+			} else if (f[0] == 'b') {
+				op = BEER_FOP_BOOL;
+			} else if (f[0] == 'l'
+				   && (f[1] == 'd' || f[1] == 'i')) {
+				op = BEER_FOP_LONG;
+				f++;
+			} else if (f[0] == 'l' && f[1] == 'u') {
+				op = BEER_FOP_ULONG;
+				f++;
+			} else if (f[0] == 'l' && f[1] == 'l'
+				   && (f[2] == 'd' || f[2] == 'i')) {
+				op = BEER_FOP_LLONG;
+				f += 2;
+			} else if (f[0] == 'l' && f[1] == 'l' && f[2] == 'u') {
+				op = BEER_FOP_ULLONG;
+				f += 2;
+			} else if (f[0] == 'h'
+				   && (f[1] == 'd' || f[1] == 'i')) {
+				op = BEER_FOP_INT;
+				f++;
+			} else if (f[0] == 'h' && f[1] == 'u') {
+				op = BEER_FOP_UINT;
+				f++;
+			} else if (f[0] == 'h' && f[1] == 'h'
+				   && (f[2] == 'd' || f[2] == 'i')) {
+				op = BEER_FOP_INT;
+				f += 2;
+			} else if (f[0] == 'h' && f[1] == 'h' && f[2] == 'u') {
+				op = BEER_FOP_UINT;
+				f += 2;
+			} else if (f[0] == '%') {
+				value = 0;
+			} else {
+				/* unexpected format specifier */
+				return -1;
+			}
+			if (op == BEER_FOP_FLOAT)
+				max = 5;
+			else if (op == BEER_FOP_BOOL)
+				max = 1;
+			else if (op == BEER_FOP_STR || op == BEER_FOP_STRL)
+				max = 5; /* string data is reserved on execution */
+			else
+				max = 9;
+		} else if (f[0] == 'N' && f[1] == 'I' && f[2] == 'L') {
+			char data[1];
+			beer_format_raw(e, data, mp_encode_nil(data) - data);
+			f += 2;
+		} else {
+			value = 0;
+		}
+		if (!value)
+			continue;
+		if (op != BEER_FOP_END)
+			beer_format_op(e, op, max);
+		if (depth > 0 && !e->ops)
+			e->sizes[stack[depth - 1]] += 1;
+		else if (depth == 0)
+			*count += 1;
+	}
+	if (depth > 0)
+		return -1;
+	beer_format_op(e, BEER_FOP_END, 0);
+	return 0;
+}
+
+int beer_format_compile(struct beer_format *f, const char *fmt)
+{
+	memset(f, 0, sizeof(struct beer_format));
+	struct beer_format_emit e;
+	memset(&e, 0, sizeof(struct beer_format_emit));
+	/* every container takes at least one char of format */
+	e.sizes = beer_mem_alloc((strlen(fmt) + 1) * sizeof(uint32_t));
+	if (e.sizes == NULL)
+		return -1;
+	if (beer_format_parse(&e, fmt, &f->count) == -1)
+		goto error;
+	/* RAW ops are split on the second pass, into chunks of more than 128 bytes */
+	size_t alloc = e.pos + 2 * (e.fixed / 128 + 1);
+	f->ops = beer_mem_alloc(alloc);
+	if (f->ops == NULL)
+		goto error;
+	e.ops = f->ops;
+	e.pos = 0;
+	e.raw = 0;
+	e.fixed = 0;
+	if (beer_format_parse(&e, fmt, &f->count) == -1)
+		goto error;
+	assert(e.pos <= alloc);
+	f->size = e.pos;
+	f->fixed = e.fixed;
+	beer_mem_free(e.sizes);
+	return 0;
+error:
+	beer_mem_free(e.sizes);
+	beer_format_free(f);
+	return -1;
+}
+
+void beer_format_free(struct beer_format *f)
+{
+	if (f->ops)
+		beer_mem_free(f->ops);
+	f->ops = NULL;
+	f->size = 0;
+}
+
+ssize_t beer_object_vformat_compiled(struct beer_stream *s,
+				    const struct beer_format *f, va_list vl)
+{
+	struct beer_stream_buf   *sb = BEER_SBUF_CAST(s);
+	struct beer_sbuf_object *sbo = BEER_SOBJ_CAST(s);
+	if (sb->as == 1 || f->ops == NULL)
+		return -1;
+	if (sb->resize(s, f->fixed) == NULL)
+		return -1;
+	char *p = sb->data + sb->size;
+	const uint8_t *op = (const uint8_t *)f->ops;
+	for (;;) {
+		int64_t value;
+		const char *str;
+		uint32_t len;
+		switch (*op++) {
+		case BEER_FOP_END:
+			goto done;
+		case BEER_FOP_RAW:
+			memcpy(p, op + 1, *op);
+			p += *op;
+			op += *op + 1;
+			break;
+		case BEER_FOP_INT:
+			value = va_arg(vl, int);
+			goto signed_int;
+		case BEER_FOP_LONG:
+			value = va_arg(vl, long);
+			goto signed_int;
+		case BEER_FOP_LLONG:
+			value = va_arg(vl, long long);
+signed_int:
+			if (value < 0)
+				p = mp_encode_int(p, value);
+			else
+				p = mp_encode_uint(p, value);
+			break;
+		case BEER_FOP_UINT:
+			p = mp_encode_uint(p, va_arg(vl, unsigned int));
+			break;
+		case BEER_FOP_ULONG:
+			p = mp_encode_uint(p, va_arg(vl, unsigned long));
+			break;
+		case BEER_FOP_ULLONG:
+			p = mp_encode_uint(p, va_arg(vl, unsigned long long));
+			break;
+		case BEER_FOP_FLOAT:
+			p = mp_encode_float(p, (float)va_arg(vl, double));
+			break;
+		case BEER_FOP_DOUBLE:
+			p = mp_encode_double(p, va_arg(vl, double));
+			break;
+		case BEER_FOP_BOOL:
+			p = mp_encode_bool(p, (bool)va_arg(vl, int));
+			break;
+		case BEER_FOP_STR:
+			str = va_arg(vl, const char *);
+			len = (uint32_t)strlen(str);
+			goto string;
+		case BEER_FOP_STRL:
+			len = va_arg(vl, uint32_t);
+			str = va_arg(vl, const char *);
+string:
+			/* fixed part is reserved, data may not fit */
+			if (len > 0) {
+				size_t used = p - (sb->data + sb->size);
+				if (sb->resize(s, used + len + f->fixed) == NULL)
+					return -1;
+				p = sb->data + sb->size + used;
+			}
+			p = mp_encode_str(p, str, len);
+			break;
+		default:
+			assert(false);
+			return -1;
+		}
+	}
+done:;
+	size_t size = p - (sb->data + sb->size);
+	sb->size += size;
+	s->wrcnt++;
+	if (sbo->stack_size > 0)
+		sbo->stack[sbo->stack_size - 1].size += f->count;
+	return size;
+}
+
+ssize_t beer_object_format_compiled(struct beer_stream *s,
+				   const struct beer_format *f, ...)
+{
+	va_list args;
+	va_start(args, f);
+	ssize_t res = beer_object_vformat_compiled(s, f, args);
+	va_end(args);
+	return res;
+}
+
 struct beer_stream *beer_object_as(struct beer_stream *s, char *buf,
 				 size_t buf_len)
 {
@@ -470,6 +851,7 @@ int beer_object_reset(struct beer_stream *s)
 	sb->size = 0;
 	sb->rdoff = 0;
 	sbo->stack_size = 0;
+	sbo->slots_count = 0;
 	sbo->type = BEER_SBO_SIMPLE;
 
 	return 0;
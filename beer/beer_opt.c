@@ -110,6 +110,36 @@ beer_opt_set(struct beer_opt *opt, enum beer_opt_type name, va_list args)
 	case BEER_OPT_RECV_BUF:
 		opt->recv_buf = va_arg(args, int);
 		break;
+	case BEER_OPT_ZERO_COPY:
+		opt->zero_copy = va_arg(args, int);
+		break;
+	case BEER_OPT_NONBLOCK:
+		opt->nonblock = va_arg(args, int);
+		break;
+	case BEER_OPT_SCHEMA:
+		opt->schema = va_arg(args, struct beer_schema *);
+		break;
+	case BEER_OPT_SCHEMA_CHECK:
+		opt->schema_check = va_arg(args, int);
+		break;
+	case BEER_OPT_SEND_REF:
+		opt->send_ref = va_arg(args, int);
+		break;
+	case BEER_OPT_IO_URING:
+		opt->io_uring = va_arg(args, int);
+		break;
+	case BEER_OPT_SOCK_SEND_BUF:
+		opt->sock_send_buf = va_arg(args, int);
+		break;
+	case BEER_OPT_SOCK_RECV_BUF:
+		opt->sock_recv_buf = va_arg(args, int);
+		break;
+	case BEER_OPT_TRUSTED:
+		opt->trusted = va_arg(args, int);
+		break;
+	case BEER_OPT_ADAPTIVE_BUF:
+		opt->adaptive_buf = va_arg(args, int);
+		break;
 	default:
 		return BEER_EFAIL;
 	}
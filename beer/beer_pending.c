@@ -0,0 +1,243 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/uio.h>
+
+#include <beer/beer_mem.h>
+#include <beer/beer_reply.h>
+#include <beer/beer_stream.h>
+#include <beer/beer_net.h>
+#include <beer/beer_pending.h>
+
+/* pending request, stored by value in open-addressing hash */
+struct beer_pending {
+	uint64_t sync;
+	beer_pending_cb_t cb;
+	void *arg;
+	int parked;
+	struct beer_reply reply;
+};
+
+static inline void *
+beer_pending_calloc(size_t count, size_t size) {
+	size_t sz = count * size;
+	void *alloc = beer_mem_alloc(sz);
+	if (!alloc) return 0;
+	memset(alloc, 0, sz);
+	return alloc;
+}
+
+#define mh_arg_t void *
+
+#define mh_eq(a, b, arg)      ((a)->sync == (b)->sync)
+#define mh_eq_key(a, b, arg)  ((a) == (b)->sync)
+#define mh_hash(x, arg)       ((uint32_t)((x)->sync ^ ((x)->sync >> 32)))
+#define mh_hash_key(x, arg)   ((uint32_t)((x) ^ ((x) >> 32)))
+
+#define mh_node_t struct beer_pending
+#define mh_key_t  uint64_t
+
+#define MH_CALLOC(x, y) beer_pending_calloc((x), (y))
+#define MH_FREE(x)      beer_mem_free((x))
+
+#define mh_name               _pending
+#define MH_INCREMENTAL_RESIZE 1
+#define MH_SOURCE             1
+#include                      <mhash.h>
+
+/* initial capacity, so that pipelining doesn't resize the table */
+#define BEER_PENDING_RESERVE 64
+
+static struct mh_pending_t *
+beer_pending_table(struct beer_stream_net *sn) {
+	if (sn->pending == NULL) {
+		sn->pending = mh_pending_new();
+		if (sn->pending == NULL)
+			return NULL;
+		mh_pending_reserve(sn->pending, BEER_PENDING_RESERVE, NULL);
+	}
+	return sn->pending;
+}
+
+/* move reply object contents, keeping allocation mark of destination */
+static void
+beer_pending_move(struct beer_reply *dst, struct beer_reply *src) {
+	int alloc = dst->alloc;
+	memcpy(dst, src, sizeof(struct beer_reply));
+	dst->alloc = alloc;
+	src->buf = NULL;
+	src->iob = NULL;
+	src->owned = 0;
+}
+
+int
+beer_pending_route(struct beer_stream *s, struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_pending_t *h = beer_pending_table(sn);
+	if (h == NULL)
+		goto oom;
+	mh_int_t x = mh_pending_find(h, r->sync, NULL);
+	if (x != mh_end(h) && mh_pending_node(h, x)->cb) {
+		struct beer_pending *p = mh_pending_node(h, x);
+		beer_pending_cb_t cb = p->cb;
+		void *arg = p->arg;
+		mh_pending_del(h, x, NULL);
+		cb(s, r, arg);
+		beer_reply_free(r);
+		return 0;
+	}
+	/* so that it doesn't pin recv buffer while parked */
+	if (beer_reply_detach(r) == -1)
+		goto oom;
+	struct beer_pending p;
+	memset(&p, 0, sizeof(struct beer_pending));
+	p.sync = r->sync;
+	p.parked = 1;
+	beer_pending_move(&p.reply, r);
+	if (mh_pending_put(h, &p, NULL, NULL) == mh_end(h)) {
+		beer_reply_free(&p.reply);
+		goto oom;
+	}
+	return 0;
+oom:
+	beer_reply_free(r);
+	sn->error = BEER_EMEMORY;
+	return -1;
+}
+
+int
+beer_pending_add(struct beer_stream *s, uint64_t sync, beer_pending_cb_t cb,
+		 void *arg) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_pending_t *h = beer_pending_table(sn);
+	if (h == NULL) {
+		sn->error = BEER_EMEMORY;
+		return -1;
+	}
+	mh_int_t x = mh_pending_find(h, sync, NULL);
+	if (x != mh_end(h) && mh_pending_node(h, x)->parked) {
+		struct beer_pending *p = mh_pending_node(h, x);
+		struct beer_reply r;
+		beer_reply_init(&r);
+		beer_pending_move(&r, &p->reply);
+		mh_pending_del(h, x, NULL);
+		cb(s, &r, arg);
+		beer_reply_free(&r);
+		return 0;
+	}
+	struct beer_pending p;
+	memset(&p, 0, sizeof(struct beer_pending));
+	p.sync = sync;
+	p.cb = cb;
+	p.arg = arg;
+	if (mh_pending_put(h, &p, NULL, NULL) == mh_end(h)) {
+		sn->error = BEER_EMEMORY;
+		return -1;
+	}
+	return 0;
+}
+
+int
+beer_pending_dispatch(struct beer_stream *s) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	int count = 0;
+	while (1) {
+		struct beer_reply r;
+		beer_reply_init(&r);
+		int rc = s->read_reply(s, &r);
+		if (rc == 1)
+			break;
+		if (rc == -1) {
+			if (sn->error == BEER_EAGAIN)
+				break;
+			return -1;
+		}
+		if (beer_pending_route(s, &r) == -1)
+			return -1;
+		count++;
+	}
+	return count;
+}
+
+int
+beer_pending_take(struct beer_stream *s, uint64_t sync, struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_pending_t *h = sn->pending;
+	if (h == NULL)
+		return 1;
+	mh_int_t x = mh_pending_find(h, sync, NULL);
+	if (x == mh_end(h))
+		return 1;
+	struct beer_pending *p = mh_pending_node(h, x);
+	int parked = p->parked;
+	if (parked)
+		beer_pending_move(r, &p->reply);
+	/* caller takes the reply, instead of callback */
+	mh_pending_del(h, x, NULL);
+	return parked ? 0 : 1;
+}
+
+int
+beer_reply_sync(struct beer_stream *s, uint64_t sync, struct beer_reply *r) {
+	if (beer_pending_take(s, sync, r) == 0)
+		return 0;
+	while (1) {
+		struct beer_reply rep;
+		beer_reply_init(&rep);
+		int rc = s->read_reply(s, &rep);
+		if (rc != 0)
+			return rc;
+		if (rep.sync == sync) {
+			beer_pending_move(r, &rep);
+			return 0;
+		}
+		if (beer_pending_route(s, &rep) == -1)
+			return -1;
+	}
+}
+
+void
+beer_pending_clear(struct beer_stream *s) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_pending_t *h = sn->pending;
+	if (h == NULL)
+		return;
+	mh_int_t x;
+	mh_foreach(h, x) {
+		struct beer_pending *p = mh_pending_node(h, x);
+		if (p->parked)
+			beer_reply_free(&p->reply);
+	}
+	mh_pending_delete(h);
+	sn->pending = NULL;
+}
@@ -18,7 +18,7 @@ beer_ping(struct beer_stream *s)
 	struct beer_iheader hdr;
 	struct iovec v[3]; int v_sz = 3;
 	char *data = NULL;
-	encode_header(&hdr, BEER_OP_PING, s->reqid++);
+	encode_header(&hdr, BEER_OP_PING, s->reqid++, 0);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[2]; data = body;
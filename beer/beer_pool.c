@@ -0,0 +1,312 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include <sys/uio.h>
+
+#include <beer/beer_mem.h>
+#include <beer/beer_reply.h>
+#include <beer/beer_stream.h>
+#include <beer/beer_schema.h>
+#include <beer/beer_net.h>
+#include <beer/beer_pool.h>
+
+#include "pmatomic.h"
+
+/* delay between reconnect attempts, in seconds */
+#define BEER_POOL_RECONNECT 1
+
+struct beer_pool_thread {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int wakeup;
+	int stop;
+};
+
+/* pool ids are never reused, unlike addresses of freed pools */
+static uint64_t beer_pool_ids;
+
+/*
+ * the last member returned to the pool by this thread: it's kept by pool
+ * id, as the pool may be freed by another thread meanwhile
+ */
+static __thread uint64_t beer_pool_cache;
+static __thread uint32_t beer_pool_cache_idx;
+
+static int
+beer_pool_cached(struct beer_pool *p) {
+	return beer_pool_cache == p->id && beer_pool_cache_idx < p->size;
+}
+
+static void
+beer_pool_push(struct beer_pool *p, uint32_t idx) {
+	struct beer_pool_member *m = &p->members[idx];
+	pm_atomic_store(&m->state, BEER_POOL_FREE);
+	uint64_t old = pm_atomic_load(&p->head);
+	uint64_t new;
+	do {
+		pm_atomic_store(&m->next, (uint32_t)old);
+		/* tag is bumped on every update, against ABA */
+		new = (((old >> 32) + 1) << 32) | (idx + 1);
+	} while (!pm_atomic_compare_exchange_weak(&p->head, &old, new));
+}
+
+static int64_t
+beer_pool_pop(struct beer_pool *p) {
+	uint64_t old = pm_atomic_load(&p->head);
+	uint64_t new;
+	uint32_t idx;
+	do {
+		if ((uint32_t)old == 0)
+			return -1;
+		idx = (uint32_t)old - 1;
+		uint32_t next = pm_atomic_load(&p->members[idx].next);
+		new = (((old >> 32) + 1) << 32) | next;
+	} while (!pm_atomic_compare_exchange_weak(&p->head, &old, new));
+	pm_atomic_store(&p->members[idx].state, BEER_POOL_BUSY);
+	return idx;
+}
+
+static int
+beer_pool_take(struct beer_pool *p, uint32_t idx) {
+	uint32_t expected = BEER_POOL_CACHED;
+	return pm_atomic_compare_exchange_strong(&p->members[idx].state,
+						 &expected, BEER_POOL_BUSY);
+}
+
+/*
+ * Connect a dead member. It's claimed as busy first, so that
+ * beer_pool_connect() and the reconnecting thread never connect the same
+ * stream at once.
+ */
+static int
+beer_pool_revive_member(struct beer_pool *p, uint32_t idx) {
+	struct beer_pool_member *m = &p->members[idx];
+	uint32_t expected = BEER_POOL_DEAD;
+	if (!pm_atomic_compare_exchange_strong(&m->state, &expected,
+					       BEER_POOL_BUSY))
+		return -1;
+	if (beer_connect(&m->s) == -1) {
+		m->failures++;
+		pm_atomic_store(&m->state, BEER_POOL_DEAD);
+		return -1;
+	}
+	m->failures = 0;
+	/* schema is loaded on authentication, or by the first member */
+	if (pm_atomic_load(&p->schema->schema_id) == 0)
+		beer_check_schema(&m->s);
+	pm_atomic_fetch_add(&p->alive, 1);
+	beer_pool_push(p, idx);
+	return 0;
+}
+
+static void
+beer_pool_revive(struct beer_pool *p) {
+	uint32_t i;
+	for (i = 0; i < p->size; i++)
+		beer_pool_revive_member(p, i);
+}
+
+static void *
+beer_pool_reconnect(void *arg) {
+	struct beer_pool *p = arg;
+	struct beer_pool_thread *t = p->thread;
+	pthread_mutex_lock(&t->lock);
+	while (!t->stop) {
+		if (!t->wakeup) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += BEER_POOL_RECONNECT;
+			pthread_cond_timedwait(&t->cond, &t->lock, &ts);
+		}
+		t->wakeup = 0;
+		if (t->stop)
+			break;
+		pthread_mutex_unlock(&t->lock);
+		beer_pool_revive(p);
+		pthread_mutex_lock(&t->lock);
+	}
+	pthread_mutex_unlock(&t->lock);
+	return NULL;
+}
+
+static void
+beer_pool_signal(struct beer_pool *p, int stop) {
+	struct beer_pool_thread *t = p->thread;
+	pthread_mutex_lock(&t->lock);
+	t->wakeup = 1;
+	t->stop |= stop;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+}
+
+struct beer_pool *
+beer_pool_new(uint32_t size) {
+	struct beer_pool *p = beer_mem_alloc(sizeof(struct beer_pool));
+	if (p == NULL)
+		return NULL;
+	memset(p, 0, sizeof(struct beer_pool));
+	p->id = pm_atomic_fetch_add(&beer_pool_ids, 1) + 1;
+	p->members = beer_mem_alloc(size * sizeof(struct beer_pool_member));
+	if (p->members == NULL)
+		goto error;
+	memset(p->members, 0, size * sizeof(struct beer_pool_member));
+	p->schema = beer_schema_new(NULL);
+	if (p->schema == NULL)
+		goto error;
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		struct beer_pool_member *m = &p->members[i];
+		if (beer_net(&m->s) == NULL)
+			goto error;
+		p->size = i + 1;
+		m->state = BEER_POOL_DEAD;
+		beer_set(&m->s, BEER_OPT_SCHEMA, p->schema);
+	}
+	return p;
+error:
+	beer_pool_free(p);
+	return NULL;
+}
+
+int
+beer_pool_set(struct beer_pool *p, int opt, ...) {
+	uint32_t i;
+	for (i = 0; i < p->size; i++) {
+		struct beer_stream_net *sn = BEER_SNET_CAST(&p->members[i].s);
+		va_list args;
+		va_start(args, opt);
+		sn->error = beer_opt_set(&sn->opt, opt, args);
+		va_end(args);
+		if (sn->error != BEER_EOK)
+			return -1;
+	}
+	return 0;
+}
+
+int
+beer_pool_connect(struct beer_pool *p) {
+	beer_pool_revive(p);
+	if (p->thread == NULL) {
+		struct beer_pool_thread *t =
+			beer_mem_alloc(sizeof(struct beer_pool_thread));
+		if (t == NULL)
+			return -1;
+		memset(t, 0, sizeof(struct beer_pool_thread));
+		pthread_mutex_init(&t->lock, NULL);
+		pthread_cond_init(&t->cond, NULL);
+		p->thread = t;
+		if (pthread_create(&t->thread, NULL, beer_pool_reconnect, p) != 0) {
+			pthread_cond_destroy(&t->cond);
+			pthread_mutex_destroy(&t->lock);
+			beer_mem_free(t);
+			p->thread = NULL;
+			return -1;
+		}
+	}
+	return (pm_atomic_load(&p->alive) > 0) ? 0 : -1;
+}
+
+struct beer_stream *
+beer_pool_get(struct beer_pool *p) {
+	if (beer_pool_cached(p)) {
+		beer_pool_cache = 0;
+		if (beer_pool_take(p, beer_pool_cache_idx))
+			return &p->members[beer_pool_cache_idx].s;
+	}
+	int64_t idx = beer_pool_pop(p);
+	if (idx != -1)
+		return &p->members[idx].s;
+	/* steal streams, that are cached by other threads */
+	uint32_t i;
+	for (i = 0; i < p->size; i++) {
+		if (beer_pool_take(p, i))
+			return &p->members[i].s;
+	}
+	return NULL;
+}
+
+void
+beer_pool_put(struct beer_pool *p, struct beer_stream *s) {
+	struct beer_pool_member *m = (struct beer_pool_member *)s;
+	uint32_t idx = m - p->members;
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	if (!sn->connected || sn->error == BEER_ESYSTEM ||
+	    sn->error == BEER_ETMOUT) {
+		beer_close(s);
+		pm_atomic_fetch_sub(&p->alive, 1);
+		pm_atomic_store(&m->state, BEER_POOL_DEAD);
+		if (p->thread)
+			beer_pool_signal(p, 0);
+		return;
+	}
+	if (!beer_pool_cached(p) ||
+	    pm_atomic_load(&p->members[beer_pool_cache_idx].state) !=
+	    BEER_POOL_CACHED) {
+		beer_pool_cache = p->id;
+		beer_pool_cache_idx = idx;
+		pm_atomic_store(&m->state, BEER_POOL_CACHED);
+		return;
+	}
+	beer_pool_push(p, idx);
+}
+
+uint32_t
+beer_pool_alive(struct beer_pool *p) {
+	return pm_atomic_load(&p->alive);
+}
+
+void
+beer_pool_free(struct beer_pool *p) {
+	if (p->thread) {
+		beer_pool_signal(p, 1);
+		pthread_join(p->thread->thread, NULL);
+		pthread_cond_destroy(&p->thread->cond);
+		pthread_mutex_destroy(&p->thread->lock);
+		beer_mem_free(p->thread);
+	}
+	uint32_t i;
+	for (i = 0; i < p->size; i++)
+		beer_stream_free(&p->members[i].s);
+	if (p->members)
+		beer_mem_free(p->members);
+	if (p->schema)
+		beer_schema_unref(p->schema);
+	if (beer_pool_cache == p->id)
+		beer_pool_cache = 0;
+	beer_mem_free(p);
+}
@@ -3,7 +3,7 @@
 #include <beer/beer_proto.h>
 
 struct beer_iheader {
-	char header[25];
+	char header[34];
 	char *end;
 };
 
@@ -12,19 +12,68 @@ is_call(enum beer_request_t op) {
 	return (op == BEER_OP_CALL || op == BEER_OP_CALL_16);
 }
 
+/* schema id is always 9 bytes long, so that it may be patched in place */
+static inline char *
+encode_schema_id(char *h, uint64_t schema_id)
+{
+	h = mp_encode_uint(h, BEER_SCHEMA_ID);
+	h = mp_store_u8(h, 0xcf);
+	return mp_store_u64(h, schema_id);
+}
+
 static inline int
-encode_header(struct beer_iheader *hdr, uint32_t code, uint64_t sync)
+encode_header(struct beer_iheader *hdr, uint32_t code, uint64_t sync,
+	      uint64_t schema_id)
 {
 	memset(hdr, 0, sizeof(struct beer_iheader));
-	char *h = mp_encode_map(hdr->header, 2);
+	char *h = mp_encode_map(hdr->header, schema_id ? 3 : 2);
 	h = mp_encode_uint(h, BEER_CODE);
 	h = mp_encode_uint(h, code);
 	h = mp_encode_uint(h, BEER_SYNC);
 	h = mp_encode_uint(h, sync);
+	if (schema_id)
+		h = encode_schema_id(h, schema_id);
 	hdr->end = h;
 	return 0;
 }
 
+/*
+ * Requests by scalar keys are encoded on stack, in one buffer of this size:
+ * 5 bytes of length prefix (it's filled by write_frame()), header and body;
+ * strings and tuples aren't copied into it
+ */
+#define BEER_FRAME_MAX 128
+
+static inline char *
+encode_frame_header(char *buf, uint32_t code, uint64_t sync,
+		    uint64_t schema_id)
+{
+	char *h = mp_encode_map(buf + 5, schema_id ? 3 : 2);
+	h = mp_encode_uint(h, BEER_CODE);
+	h = mp_encode_uint(h, code);
+	h = mp_encode_uint(h, BEER_SYNC);
+	h = mp_encode_uint(h, sync);
+	if (schema_id)
+		h = encode_schema_id(h, schema_id);
+	return h;
+}
+
+/* write frame from buf to end, followed by size bytes of data */
+static inline ssize_t
+write_frame(struct beer_stream *s, char *buf, char *end, const char *data,
+	    size_t size)
+{
+	char *h = mp_store_u8(buf, 0xce);
+	mp_store_u32(h, (end - buf) - 5 + size);
+	if (size == 0)
+		return s->write(s, buf, end - buf);
+	struct iovec v[2] = {
+		{ buf, end - buf },
+		{ (void *)data, size }
+	};
+	return s->writev(s, v, 2);
+}
+
 static inline size_t
 mp_sizeof_luint32(uint64_t num) {
 	if (num <= UINT32_MAX)
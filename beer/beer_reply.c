@@ -32,17 +32,19 @@
 #include <string.h>
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <msgpuck.h>
 
 #include <beer/beer_mem.h>
+#include <beer/beer_iob.h>
 #include <beer/beer_proto.h>
 #include <beer/beer_reply.h>
 
 struct beer_reply *beer_reply_init(struct beer_reply *r) {
 	int alloc = (r == NULL);
 	if (alloc) {
-		r = beer_mem_alloc(sizeof(struct beer_reply));
+		r = beer_mem_batch_alloc(sizeof(struct beer_reply));
 		if (!r) return NULL;
 	}
 	memset(r, 0, sizeof(struct beer_reply));
@@ -52,107 +54,149 @@ struct beer_reply *beer_reply_init(struct beer_reply *r) {
 
 void beer_reply_free(struct beer_reply *r) {
 	if (r->buf) {
-		beer_mem_free((void *)r->buf);
+		if (r->iob)
+			beer_iob_unpin(r->iob);
+		else if (r->owned)
+			beer_mem_batch_free((void *)r->buf);
 		r->buf = NULL;
+		r->iob = NULL;
+		r->owned = 0;
 	}
-	if (r->alloc) beer_mem_free(r);
+	if (r->alloc) beer_mem_batch_free(r);
 }
 
-int beer_reply_from(struct beer_reply *r, beer_reply_t rcv, void *ptr) {
-	/* cleanup, before processing response */
-	int alloc = r->alloc;
-	memset(r, 0 , sizeof(struct beer_reply));
-	r->alloc = alloc;
-	/* reading iproto header */
-	char length[9]; const char *data = (const char *)length;
-	if (rcv(ptr, length, 5) == -1)
-		goto rollback;
-	if (mp_typeof(*length) != MP_UINT)
-		goto rollback;
-	size_t size = mp_decode_uint(&data);
-	r->buf = beer_mem_alloc(size);
+/*
+ * Header and body are checked and decoded in one pass: every value is
+ * checked (and skipped) once, as it's reached. Data of trusted reply isn't
+ * checked, and if it's the last key of body (as it's sent by server), it
+ * isn't even walked.
+ */
+static int
+beer_reply_parse(struct beer_reply *r, const char *buf, size_t size) {
+	r->buf = buf;
 	r->buf_size = size;
-	if (r->buf == NULL)
-		goto rollback;
-	if(rcv(ptr, (char *)r->buf, size) == -1)
-		goto rollback;
+	const char *end = buf + size;
 	/* header */
-	const char *p = r->buf;
-	const char *test = p;
-	if (mp_check(&test, r->buf + size))
-		goto rollback;
-	if (mp_typeof(*p) != MP_MAP)
-		goto rollback;
+	const char *p = buf;
+	if (p == end || mp_typeof(*p) != MP_MAP || mp_check_map(p, end) > 0)
+		return -1;
 	uint32_t n = mp_decode_map(&p);
 	while (n-- > 0) {
-		if (mp_typeof(*p) != MP_UINT)
-			goto rollback;
+		if (p == end || mp_typeof(*p) != MP_UINT ||
+		    mp_check_uint(p, end) > 0)
+			return -1;
 		uint32_t key = mp_decode_uint(&p);
-		if (mp_typeof(*p) != MP_UINT)
-			goto rollback;
+		if (p == end || mp_typeof(*p) != MP_UINT ||
+		    mp_check_uint(p, end) > 0)
+			return -1;
 		switch (key) {
 		case BEER_SYNC:
-			if (mp_typeof(*p) != MP_UINT)
-				goto rollback;
 			r->sync = mp_decode_uint(&p);
 			break;
 		case BEER_CODE:
-			if (mp_typeof(*p) != MP_UINT)
-				goto rollback;
 			r->code = mp_decode_uint(&p);
 			break;
 		case BEER_SCHEMA_ID:
-			if (mp_typeof(*p) != MP_UINT)
-				goto rollback;
 			r->schema_id = mp_decode_uint(&p);
 			break;
 		default:
-			goto rollback;
+			return -1;
 		}
 		r->bitmap |= (1ULL << key);
 	}
 
 	/* body */
-	if (p == r->buf + size + 5)
-		return size + 5; /* no body */
-	test = p;
-	if (mp_check(&test, r->buf + size))
-		goto rollback;
-	if (mp_typeof(*p) != MP_MAP)
-		goto rollback;
+	if (p == end)
+		return 0; /* no body */
+	if (mp_typeof(*p) != MP_MAP || mp_check_map(p, end) > 0)
+		return -1;
 	n = mp_decode_map(&p);
 	while (n-- > 0) {
+		if (p == end || mp_typeof(*p) != MP_UINT ||
+		    mp_check_uint(p, end) > 0)
+			return -1;
 		uint32_t key = mp_decode_uint(&p);
+		if (p == end)
+			return -1;
+		const char *value = p;
 		switch (key) {
 		case BEER_ERROR: {
-			if (mp_typeof(*p) != MP_STR)
-				goto rollback;
+			if (mp_typeof(*p) != MP_STR || mp_check(&p, end))
+				return -1;
 			uint32_t elen = 0;
-			r->error = mp_decode_str(&p, &elen);
+			r->error = mp_decode_str(&value, &elen);
 			r->error_end = r->error + elen;
 			r->code = r->code & ((1 << 15) - 1);
 			break;
 		}
 		case BEER_DATA: {
 			if (mp_typeof(*p) != MP_ARRAY)
-				goto rollback;
-			r->data = p;
-			mp_next(&p);
+				return -1;
+			if (!r->trusted) {
+				if (mp_check(&p, end))
+					return -1;
+			} else if (n == 0) {
+				p = end;
+			} else {
+				mp_next(&p);
+			}
+			r->data = value;
 			r->data_end = p;
 			break;
 		}
+		default:
+			if (mp_check(&p, end))
+				return -1;
 		}
 		r->bitmap |= (1ULL << key);
 	}
 	return 0;
-rollback:
-	if (r->buf) beer_mem_free((void *)r->buf);
-	alloc = r->alloc;
+}
+
+static void
+beer_reply_reset(struct beer_reply *r) {
+	int alloc = r->alloc;
+	int trusted = r->trusted;
 	memset(r, 0, sizeof(struct beer_reply));
 	r->alloc = alloc;
+	r->trusted = trusted;
+}
+
+int beer_reply_from(struct beer_reply *r, beer_reply_t rcv, void *ptr) {
+	/* cleanup, before processing response */
+	beer_reply_reset(r);
+	/* reading iproto header */
+	char length[9]; const char *data = (const char *)length;
+	if (rcv(ptr, length, 5) == -1)
+		goto rollback;
+	if (mp_typeof(*length) != MP_UINT)
+		goto rollback;
+	size_t size = mp_decode_uint(&data);
+	char *buf = beer_mem_batch_alloc(size);
+	if (buf == NULL)
+		goto rollback;
+	r->buf = buf;
+	r->owned = 1;
+	if (rcv(ptr, buf, size) == -1)
+		goto rollback;
+	if (beer_reply_parse(r, buf, size) == -1)
+		goto rollback;
+	return 0;
+rollback:
+	if (r->owned) beer_mem_batch_free((void *)r->buf);
+	beer_reply_reset(r);
 	return -1;
 }
 
+int beer_reply_view(struct beer_reply *r, const char *buf, size_t size) {
+	beer_reply_reset(r);
+	if (beer_reply_parse(r, buf, size) == -1) {
+		beer_reply_reset(r);
+		return -1;
+	}
+	return 0;
+}
+
 static ssize_t beer_reply_cb(void *ptr[2], char *buf, ssize_t size) {
 	char *src = ptr[0];
 	ssize_t *off = ptr[1];
@@ -187,3 +231,27 @@ beer_reply(struct beer_reply *r, char *buf, size_t size, size_t *off) {
 		*off = offv;
 	return rc;
 }
+
+int
+beer_reply_detach(struct beer_reply *r) {
+	if (r->owned || r->buf == NULL)
+		return 0;
+	char *buf = beer_mem_batch_alloc(r->buf_size);
+	if (buf == NULL)
+		return -1;
+	memcpy(buf, r->buf, r->buf_size);
+	if (r->error) {
+		r->error_end = buf + (r->error_end - r->buf);
+		r->error = buf + (r->error - r->buf);
+	}
+	if (r->data) {
+		r->data_end = buf + (r->data_end - r->buf);
+		r->data = buf + (r->data - r->buf);
+	}
+	if (r->iob)
+		beer_iob_unpin(r->iob);
+	r->iob = NULL;
+	r->buf = buf;
+	r->owned = 1;
+	return 0;
+}
@@ -24,7 +24,7 @@
 struct beer_request *beer_request_init(struct beer_request *req) {
 	int alloc = (req == NULL);
 	if (req == NULL) {
-		req = beer_mem_alloc(sizeof(struct beer_request));
+		req = beer_mem_batch_alloc(sizeof(struct beer_request));
 		if (!req) return NULL;
 	}
 	memset(req, 0, sizeof(struct beer_request));
@@ -40,7 +40,7 @@ void beer_request_free(struct beer_request *req) {
 	if (req->tuple_object)
 		beer_stream_free(req->tuple_object);
 	req->tuple_object = NULL;
-	if (req->alloc) beer_mem_free(req);
+	if (req->alloc) beer_mem_batch_free(req);
 }
 
 #define BEER_REQUEST_CUSTOM(NM, CNM)				\
@@ -127,6 +127,24 @@ int beer_request_set_key_format(struct beer_request *req, const char *fmt, ...)
 	return beer_request_set_key(req, req->key_object);
 }
 
+int beer_request_set_key_compiled(struct beer_request *req,
+				 const struct beer_format *f, ...)
+{
+	if (req->key_object)
+		beer_object_reset(req->key_object);
+	else
+		req->key_object = beer_object(NULL);
+	if (!req->key_object)
+		return -1;
+	va_list args;
+	va_start(args, f);
+	ssize_t res = beer_object_vformat_compiled(req->key_object, f, args);
+	va_end(args);
+	if (res == -1)
+		return -1;
+	return beer_request_set_key(req, req->key_object);
+}
+
 int
 beer_request_set_func(struct beer_request *req, const char *func,
 		     uint32_t flen)
@@ -212,28 +230,36 @@ int beer_request_set_tuple_format(struct beer_request *req, const char *fmt, ...
 	return beer_request_set_tuple(req, req->tuple_object);
 }
 
-int
-beer_request_writeout(struct beer_stream *s, struct beer_request *req,
-		     uint64_t *sync) {
+int beer_request_set_tuple_compiled(struct beer_request *req,
+				   const struct beer_format *f, ...)
+{
+	if (req->tuple_object)
+		beer_object_reset(req->tuple_object);
+	else
+		req->tuple_object = beer_object(NULL);
+	if (!req->tuple_object)
+		return -1;
+	va_list args;
+	va_start(args, f);
+	ssize_t res = beer_object_vformat_compiled(req->tuple_object, f, args);
+	va_end(args);
+	if (res == -1)
+		return -1;
+	return beer_request_set_tuple(req, req->tuple_object);
+}
+
+/*
+ * Encode body of request without data of key and tuple: they go after
+ * key_pos and tuple_pos (these are NULL, if request has no key or tuple).
+ * Returns end of body, or NULL for request with key of unknown type.
+ */
+static char *
+beer_request_encode_body(struct beer_request *req, char *pos, char **key_pos,
+			char **tuple_pos)
+{
 	enum beer_request_t tp = req->hdr.type;
-	if (sync != NULL && *sync == INT64_MAX &&
-	    (s->reqid & INT64_MAX) == INT64_MAX) {
-		s->reqid = 0;
-	}
-	req->hdr.sync = s->reqid++;
-	/* header */
-	/* int (9) + 1 + sync + 1 + op */
-	struct iovec v[10]; int v_sz = 0;
-	char header[128];
-	char *pos = header + 9;
-	char *begin = pos;
-	v[v_sz].iov_base = begin;
-	v[v_sz++].iov_len  = 0;
-	pos = mp_encode_map(pos, 2);              /* 1 */
-	pos = mp_encode_uint(pos, BEER_CODE);      /* 1 */
-	pos = mp_encode_uint(pos, req->hdr.type); /* 1 */
-	pos = mp_encode_uint(pos, BEER_SYNC);      /* 1 */
-	pos = mp_encode_uint(pos, req->hdr.sync); /* 9 */
+	*key_pos = NULL;
+	*tuple_pos = NULL;
 	char *map = pos++;                        /* 1 */
 	size_t nd = 0;
 	if (tp < BEER_OP_CALL_16) {
@@ -283,22 +309,14 @@ beer_request_writeout(struct beer_stream *s, struct beer_request *req,
 			pos = mp_encode_uint(pos, BEER_OPS); /* 1 */
 			break;
 		default:
-			return -1;
+			return NULL;
 		}
-		v[v_sz].iov_base  = begin;
-		v[v_sz++].iov_len = pos - begin;
-		begin = pos;
-		v[v_sz].iov_base  = (void *)req->key;
-		v[v_sz++].iov_len = req->key_end - req->key;
+		*key_pos = pos;
 		nd += 1;
 	}
 	if (req->tuple) {
 		pos = mp_encode_uint(pos, BEER_TUPLE); /* 1 */
-		v[v_sz].iov_base  = begin;
-		v[v_sz++].iov_len = pos - begin;
-		begin = pos;
-		v[v_sz].iov_base  = (void *)req->tuple;
-		v[v_sz++].iov_len = req->tuple_end - req->tuple;
+		*tuple_pos = pos;
 		nd += 1;
 	}
 	if (req->index_base && (tp == BEER_OP_UPDATE || tp == BEER_OP_UPSERT)) {
@@ -307,12 +325,72 @@ beer_request_writeout(struct beer_stream *s, struct beer_request *req,
 		nd += 1;
 	}
 	assert(mp_sizeof_map(nd) == 1);
-	if (pos != begin) {
+	mp_encode_map(map, nd);
+	return pos;
+}
+
+/*
+ * iovecs of body parts: constant bytes of body from begin to end, with key
+ * and tuple data inserted at key_pos and tuple_pos
+ */
+static int
+beer_request_body_iov(struct iovec *v, char *begin, char *end, char *key_pos,
+		     const char *key, size_t key_size, char *tuple_pos,
+		     const char *tuple, size_t tuple_size)
+{
+	int v_sz = 0;
+	if (key_pos) {
 		v[v_sz].iov_base  = begin;
-		v[v_sz++].iov_len = pos - begin;
+		v[v_sz++].iov_len = key_pos - begin;
+		begin = key_pos;
+		v[v_sz].iov_base  = (void *)key;
+		v[v_sz++].iov_len = key_size;
 	}
-	mp_encode_map(map, nd);
-	size_t plen = 0; nd = 0;
+	if (tuple_pos) {
+		v[v_sz].iov_base  = begin;
+		v[v_sz++].iov_len = tuple_pos - begin;
+		begin = tuple_pos;
+		v[v_sz].iov_base  = (void *)tuple;
+		v[v_sz++].iov_len = tuple_size;
+	}
+	if (end != begin) {
+		v[v_sz].iov_base  = begin;
+		v[v_sz++].iov_len = end - begin;
+	}
+	return v_sz;
+}
+
+int
+beer_request_writeout(struct beer_stream *s, struct beer_request *req,
+		     uint64_t *sync) {
+	if (sync != NULL && *sync == INT64_MAX &&
+	    (s->reqid & INT64_MAX) == INT64_MAX) {
+		s->reqid = 0;
+	}
+	req->hdr.sync = s->reqid++;
+	/* header */
+	/* int (9) + 1 + sync + 1 + op */
+	struct iovec v[10]; int v_sz = 0;
+	char header[128];
+	char *pos = header + 9;
+	char *begin = pos;
+	v[v_sz].iov_base = begin;
+	v[v_sz++].iov_len  = 0;
+	pos = mp_encode_map(pos, s->schema_id ? 3 : 2); /* 1 */
+	pos = mp_encode_uint(pos, BEER_CODE);      /* 1 */
+	pos = mp_encode_uint(pos, req->hdr.type); /* 1 */
+	pos = mp_encode_uint(pos, BEER_SYNC);      /* 1 */
+	pos = mp_encode_uint(pos, req->hdr.sync); /* 9 */
+	if (s->schema_id)
+		pos = encode_schema_id(pos, s->schema_id); /* 10 */
+	char *key_pos, *tuple_pos;
+	char *end = beer_request_encode_body(req, pos, &key_pos, &tuple_pos);
+	if (end == NULL)
+		return -1;
+	v_sz += beer_request_body_iov(v + v_sz, begin, end, key_pos, req->key,
+				     req->key_end - req->key, tuple_pos,
+				     req->tuple, req->tuple_end - req->tuple);
+	size_t plen = 0, nd = 0;
 	for (int i = 1; i < v_sz; ++i) plen += v[i].iov_len;
 	nd = mp_sizeof_luint32(plen);
 	v[0].iov_base -= nd;
@@ -333,3 +411,75 @@ beer_request_compile(struct beer_stream *s, struct beer_request *req) {
 		return -1;
 	return sync;
 }
+
+int
+beer_request_prepare(struct beer_request *req, struct beer_prepared *p)
+{
+	memset(p, 0, sizeof(struct beer_prepared));
+	/* sync and schema id are of fixed size, to be patched in place */
+	char *h = mp_encode_map(p->head + 5, 3);
+	h = mp_encode_uint(h, BEER_CODE);
+	h = mp_encode_uint(h, req->hdr.type);
+	h = mp_encode_uint(h, BEER_SYNC);
+	h = mp_store_u8(h, 0xcf);
+	p->sync_off = h - p->head;
+	h = mp_store_u64(h, 0);
+	p->head_size = h - p->head;
+	encode_schema_id(h, 0);
+	char *key_pos, *tuple_pos;
+	char *end = beer_request_encode_body(req, p->body, &key_pos, &tuple_pos);
+	if (end == NULL)
+		return -1;
+	p->body_size = end - p->body;
+	p->key_off = key_pos ? (size_t)(key_pos - p->body) : 0;
+	p->tuple_off = tuple_pos ? (size_t)(tuple_pos - p->body) : 0;
+	p->key = req->key;
+	p->key_end = req->key_end;
+	p->tuple = req->tuple;
+	p->tuple_end = req->tuple_end;
+	return 0;
+}
+
+int64_t
+beer_prepared_execute(struct beer_stream *s, const struct beer_prepared *p,
+		     const char *key, size_t key_size,
+		     const char *tuple, size_t tuple_size)
+{
+	if ((s->reqid & INT64_MAX) == INT64_MAX)
+		s->reqid = 0;
+	uint64_t sync = s->reqid++;
+	/* header is patched on stack, so template may be shared */
+	char head[sizeof(p->head)];
+	memcpy(head, p->head, sizeof(head));
+	size_t head_size = p->head_size;
+	mp_store_u64(head + p->sync_off, sync);
+	if (s->schema_id) {
+		mp_store_u64(head + head_size + 2, s->schema_id);
+		head_size += 10;
+	} else {
+		mp_encode_map(head + 5, 2);
+	}
+	if (key == NULL) {
+		key = p->key;
+		key_size = p->key_end - p->key;
+	}
+	if (tuple == NULL) {
+		tuple = p->tuple;
+		tuple_size = p->tuple_end - p->tuple;
+	}
+	struct iovec v[6];
+	v[0].iov_base = head;
+	v[0].iov_len = head_size;
+	char *body = (char *)p->body;
+	int v_sz = 1 + beer_request_body_iov(v + 1, body, body + p->body_size,
+			p->key_off ? body + p->key_off : NULL, key, key_size,
+			p->tuple_off ? body + p->tuple_off : NULL, tuple,
+			tuple_size);
+	size_t plen = 0;
+	for (int i = 0; i < v_sz; ++i) plen += v[i].iov_len;
+	char *l = mp_store_u8(head, 0xce);
+	mp_store_u32(l, plen - 5);
+	if (s->writev(s, v, v_sz) == -1)
+		return -1;
+	return sync;
+}
@@ -0,0 +1,506 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/uio.h>
+
+#include <msgpuck.h>
+
+#include <beer/beer_mem.h>
+#include <beer/beer_arena.h>
+#include <beer/beer_proto.h>
+#include <beer/beer_reply.h>
+#include <beer/beer_stream.h>
+#include <beer/beer_schema.h>
+#include <beer/beer_net.h>
+#include <beer/beer_io.h>
+
+#include "beer_retry.h"
+#include "pmatomic.h"
+
+enum beer_retry_kind {
+	BEER_RETRY_REQUEST, /* request, that may be sent again */
+	BEER_RETRY_SPACE,   /* select of space definition */
+	BEER_RETRY_INDEX    /* select of index definitions of space */
+};
+
+enum beer_retry_state {
+	BEER_RETRY_SENT,   /* waiting for reply */
+	BEER_RETRY_WAIT,   /* waiting for space definitions to be reloaded */
+	BEER_RETRY_RESENT, /* sent again, the next reply is returned as is */
+	BEER_RETRY_READY   /* wasn't sent again, reply is kept to be returned */
+};
+
+#define BEER_RETRY_NOSPACE UINT32_MAX
+
+/* kept request, stored by value in open-addressing hash */
+struct beer_retry {
+	uint64_t sync;
+	enum beer_retry_kind kind;
+	enum beer_retry_state state;
+	uint32_t space; /* space of request, or space to be reloaded */
+	uint64_t link; /* sync of space select, for select of indexes */
+	char *frame; /* copy of request */
+	size_t size;
+	int arena; /* frame is allocated in arena of stream */
+	size_t schema_off; /* offset of schema id value in frame */
+	struct beer_reply reply;
+};
+
+static inline void *
+beer_retry_calloc(size_t count, size_t size) {
+	size_t sz = count * size;
+	void *alloc = beer_mem_alloc(sz);
+	if (!alloc) return 0;
+	memset(alloc, 0, sz);
+	return alloc;
+}
+
+#define mh_arg_t void *
+
+#define mh_eq(a, b, arg)      ((a)->sync == (b)->sync)
+#define mh_eq_key(a, b, arg)  ((a) == (b)->sync)
+#define mh_hash(x, arg)       ((uint32_t)((x)->sync ^ ((x)->sync >> 32)))
+#define mh_hash_key(x, arg)   ((uint32_t)((x) ^ ((x) >> 32)))
+
+#define mh_node_t struct beer_retry
+#define mh_key_t  uint64_t
+
+#define MH_CALLOC(x, y) beer_retry_calloc((x), (y))
+#define MH_FREE(x)      beer_mem_free((x))
+
+#define mh_name               _retry
+#define MH_INCREMENTAL_RESIZE 1
+#define MH_SOURCE             1
+#include                      <mhash.h>
+
+static struct mh_retry_t *
+beer_retry_table(struct beer_stream_net *sn) {
+	if (sn->retry == NULL)
+		sn->retry = mh_retry_new();
+	return sn->retry;
+}
+
+/*
+ * Copies of requests are allocated in arena, which is reset once none of
+ * them is kept, so that a stream with a few requests in flight doesn't
+ * allocate memory per request. Past the limit, arena isn't grown anymore
+ * (its space isn't reused until reset), and copies are allocated one by
+ * one.
+ */
+#define BEER_RETRY_ARENA_MAX (1024 * 1024)
+
+struct beer_retry_frames {
+	struct beer_arena arena;
+	uint32_t count; /* kept copies in arena */
+	size_t size; /* bytes allocated in arena since reset */
+};
+
+static char *
+beer_retry_frame(struct beer_stream_net *sn, size_t size, int *arena) {
+	struct beer_retry_frames *f = sn->retry_frames;
+	if (f == NULL) {
+		f = beer_mem_alloc(sizeof(struct beer_retry_frames));
+		if (f != NULL) {
+			memset(f, 0, sizeof(struct beer_retry_frames));
+			beer_arena_new(&f->arena, 0);
+			sn->retry_frames = f;
+		}
+	}
+	*arena = 0;
+	if (f && f->size + size <= BEER_RETRY_ARENA_MAX) {
+		char *frame = beer_arena_alloc(&f->arena, size);
+		if (frame) {
+			f->count++;
+			f->size += size;
+			*arena = 1;
+			return frame;
+		}
+	}
+	return beer_mem_alloc(size);
+}
+
+static void
+beer_retry_frame_free(struct beer_stream_net *sn, struct beer_retry *p) {
+	if (p->frame == NULL)
+		return;
+	if (!p->arena) {
+		beer_mem_free(p->frame);
+	} else if (--sn->retry_frames->count == 0) {
+		beer_arena_reset(&sn->retry_frames->arena);
+		sn->retry_frames->size = 0;
+	}
+	p->frame = NULL;
+}
+
+static void
+beer_retry_del(struct beer_stream_net *sn, mh_int_t x) {
+	struct beer_retry *p = mh_retry_node(sn->retry, x);
+	beer_retry_frame_free(sn, p);
+	if (p->reply.buf)
+		beer_reply_free(&p->reply);
+	mh_retry_del(sn->retry, x, NULL);
+}
+
+/* move reply object contents, keeping allocation mark of destination */
+static void
+beer_retry_move(struct beer_reply *dst, struct beer_reply *src) {
+	int alloc = dst->alloc;
+	memcpy(dst, src, sizeof(struct beer_reply));
+	dst->alloc = alloc;
+	src->buf = NULL;
+	src->iob = NULL;
+	src->owned = 0;
+}
+
+/* free contents of consumed reply, so that it may be read into again */
+static void
+beer_retry_release(struct beer_reply *r) {
+	int alloc = r->alloc;
+	r->alloc = 0;
+	beer_reply_free(r);
+	beer_reply_init(r);
+	r->alloc = alloc;
+}
+
+/* find sync, schema id and space of request in frame */
+static int
+beer_retry_parse(struct beer_retry *p, const char *frame, const char *pos,
+		 const char *end) {
+	const char *test = pos;
+	if (mp_check(&test, end) || mp_typeof(*pos) != MP_MAP)
+		return -1;
+	int has_sync = 0;
+	uint32_t n = mp_decode_map(&pos);
+	while (n-- > 0) {
+		if (mp_typeof(*pos) != MP_UINT)
+			return -1;
+		switch (mp_decode_uint(&pos)) {
+		case BEER_SYNC:
+			if (mp_typeof(*pos) != MP_UINT)
+				return -1;
+			p->sync = mp_decode_uint(&pos);
+			has_sync = 1;
+			break;
+		case BEER_SCHEMA_ID:
+			/* it's encoded with fixed size, see encode_schema_id() */
+			if ((uint8_t)*pos != 0xcf)
+				return -1;
+			p->schema_off = pos + 1 - frame;
+			mp_next(&pos);
+			break;
+		default:
+			mp_next(&pos);
+		}
+	}
+	if (!has_sync || p->schema_off == 0)
+		return -1;
+	p->space = BEER_RETRY_NOSPACE;
+	test = pos;
+	if (pos == end || mp_check(&test, end) || mp_typeof(*pos) != MP_MAP)
+		return 0;
+	n = mp_decode_map(&pos);
+	while (n-- > 0) {
+		if (mp_typeof(*pos) != MP_UINT)
+			break;
+		uint64_t key = mp_decode_uint(&pos);
+		if (key == BEER_SPACE && mp_typeof(*pos) == MP_UINT) {
+			p->space = mp_decode_uint(&pos);
+			break;
+		}
+		mp_next(&pos);
+	}
+	return 0;
+}
+
+/*
+ * frames bigger than that aren't kept (and aren't sent again), so bulk
+ * writes don't pay for the copy
+ */
+#define BEER_RETRY_FRAME_MAX (16 * 1024)
+
+/* copy up to size bytes from iov position (i, off), advancing it */
+static size_t
+beer_retry_gather(struct iovec *iov, int count, int *i, size_t *off,
+		  char *dst, size_t size) {
+	size_t done = 0;
+	while (done < size && *i < count) {
+		size_t left = iov[*i].iov_len - *off;
+		size_t n = (size - done < left) ? size - done : left;
+		if (dst)
+			memcpy(dst + done, (char *)iov[*i].iov_base + *off, n);
+		done += n;
+		*off += n;
+		if (*off == iov[*i].iov_len) {
+			(*i)++;
+			*off = 0;
+		}
+	}
+	return done;
+}
+
+void
+beer_retry_keep(struct beer_stream *s, struct iovec *iov, int count) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_retry_t *h = beer_retry_table(sn);
+	if (h == NULL)
+		return;
+	/* there may be a few requests, if a buffer stream is written */
+	int i = 0;
+	size_t off = 0;
+	while (i < count) {
+		/* length prefix may be split between iov entries */
+		char head[9];
+		int hi = i;
+		size_t hoff = off;
+		size_t hsize = beer_retry_gather(iov, count, &hi, &hoff, head,
+						 sizeof(head));
+		const char *p = head, *test = head;
+		if (mp_check(&test, head + hsize) || mp_typeof(*p) != MP_UINT)
+			break;
+		size_t len = mp_decode_uint(&p);
+		size_t size = (p - head) + len;
+		if (size > BEER_RETRY_FRAME_MAX) {
+			if (beer_retry_gather(iov, count, &i, &off, NULL,
+					      size) < size)
+				break;
+			continue;
+		}
+		struct beer_retry r;
+		memset(&r, 0, sizeof(struct beer_retry));
+		r.frame = beer_retry_frame(sn, size, &r.arena);
+		/* on oom request just isn't sent again */
+		if (r.frame == NULL) {
+			beer_retry_gather(iov, count, &i, &off, NULL, size);
+			continue;
+		}
+		if (beer_retry_gather(iov, count, &i, &off, r.frame,
+				      size) < size) {
+			beer_retry_frame_free(sn, &r);
+			break;
+		}
+		const char *frame = r.frame;
+		if (beer_retry_parse(&r, frame, frame + (p - head),
+				     frame + size) == 0) {
+			r.kind = BEER_RETRY_REQUEST;
+			r.state = BEER_RETRY_SENT;
+			r.size = size;
+			if (mh_retry_put(h, &r, NULL, NULL) != mh_end(h))
+				continue;
+		}
+		beer_retry_frame_free(sn, &r);
+	}
+}
+
+/* send request again, with new schema id */
+static int
+beer_retry_send(struct beer_stream *s, struct beer_retry *p,
+		uint64_t schema_id) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	mp_store_u64(p->frame + p->schema_off, schema_id);
+	if (beer_io_send(sn, p->frame, p->size) == -1)
+		return -1;
+	pm_atomic_fetch_add(&s->wrcnt, 1);
+	p->state = BEER_RETRY_RESENT;
+	return 0;
+}
+
+/* request definitions of space, if they aren't requested yet */
+static int
+beer_retry_load(struct beer_stream *s, uint32_t space) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_retry_t *h = sn->retry;
+	mh_int_t x;
+	mh_foreach(h, x) {
+		struct beer_retry *p = mh_retry_node(h, x);
+		if (p->kind == BEER_RETRY_SPACE && p->space == space)
+			return 0;
+	}
+	struct beer_retry sp, ix;
+	memset(&sp, 0, sizeof(struct beer_retry));
+	memset(&ix, 0, sizeof(struct beer_retry));
+	/* system spaces are selected without schema check */
+	uint64_t schema_id = s->schema_id;
+	s->schema_id = 0;
+	sp.sync = s->reqid;
+	ssize_t rc = beer_get_space_by_id(s, space);
+	ix.sync = s->reqid;
+	if (rc != -1)
+		rc = beer_get_index_by_space(s, space);
+	s->schema_id = schema_id;
+	if (rc == -1)
+		return -1;
+	sp.kind = BEER_RETRY_SPACE;
+	sp.space = space;
+	ix.kind = BEER_RETRY_INDEX;
+	ix.space = space;
+	ix.link = sp.sync;
+	if (mh_retry_put(h, &sp, NULL, NULL) == mh_end(h) ||
+	    mh_retry_put(h, &ix, NULL, NULL) == mh_end(h)) {
+		sn->error = BEER_EMEMORY;
+		return -1;
+	}
+	return 0;
+}
+
+/* apply reloaded space definitions and handle requests waiting for them */
+static int
+beer_retry_reload(struct beer_stream *s, mh_int_t x, struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_retry_t *h = sn->retry;
+	struct beer_retry *p = mh_retry_node(h, x);
+	uint32_t space = p->space;
+	mh_int_t y = mh_retry_find(h, p->link, NULL);
+	struct beer_reply *sr = (y != mh_end(h)) ? &mh_retry_node(h, y)->reply :
+						   NULL;
+	int rc = -1;
+	if (sr && sr->buf && sr->error == NULL && r->error == NULL)
+		rc = beer_schema_reload_space(sn->schema, space, sr, r);
+	if (rc != -1)
+		s->schema_id = pm_atomic_load(&sn->schema->schema_id);
+	beer_retry_release(r);
+	beer_retry_del(sn, x);
+	if (y != mh_end(h))
+		beer_retry_del(sn, y);
+	/* requests to dropped or renamed space get their original error */
+	mh_foreach(h, x) {
+		p = mh_retry_node(h, x);
+		if (p->kind != BEER_RETRY_REQUEST || p->state != BEER_RETRY_WAIT ||
+		    p->space != space)
+			continue;
+		if (rc != 0) {
+			p->state = BEER_RETRY_READY;
+			sn->retry_ready++;
+			continue;
+		}
+		beer_reply_free(&p->reply);
+		if (beer_retry_send(s, p, s->schema_id) == -1)
+			return -1;
+	}
+	if (beer_io_flush(sn) == -1)
+		return -1;
+	return 1;
+}
+
+int
+beer_retry_reply(struct beer_stream *s, struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_retry_t *h = sn->retry;
+	mh_int_t x = mh_retry_find(h, r->sync, NULL);
+	if (x == mh_end(h))
+		return 0;
+	struct beer_retry *p = mh_retry_node(h, x);
+	switch (p->kind) {
+	case BEER_RETRY_SPACE:
+		if (beer_reply_detach(r) == -1)
+			goto oom;
+		beer_retry_move(&p->reply, r);
+		beer_retry_release(r);
+		return 1;
+	case BEER_RETRY_INDEX:
+		return beer_retry_reload(s, x, r);
+	default:
+		break;
+	}
+	if (p->state == BEER_RETRY_RESENT ||
+	    r->code != BEER_ER_WRONG_SCHEMA_VERSION) {
+		beer_retry_del(sn, x);
+		return 0;
+	}
+	/*
+	 * request doesn't depend on space definitions, or they are
+	 * already reloaded (maybe by another stream sharing the schema)
+	 */
+	uint64_t schema_id = pm_atomic_load(&sn->schema->schema_id);
+	if (p->space == BEER_RETRY_NOSPACE || schema_id == r->schema_id) {
+		if (schema_id == r->schema_id)
+			s->schema_id = schema_id;
+		if (beer_retry_send(s, p, r->schema_id) == -1)
+			return -1;
+		beer_retry_release(r);
+		if (beer_io_flush(sn) == -1)
+			return -1;
+		return 1;
+	}
+	if (beer_reply_detach(r) == -1)
+		goto oom;
+	beer_retry_move(&p->reply, r);
+	beer_retry_release(r);
+	p->state = BEER_RETRY_WAIT;
+	if (beer_retry_load(s, p->space) == -1 || beer_io_flush(sn) == -1)
+		return -1;
+	return 1;
+oom:
+	sn->error = BEER_EMEMORY;
+	return -1;
+}
+
+int
+beer_retry_ready(struct beer_stream *s, struct beer_reply *r) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_retry_t *h = sn->retry;
+	mh_int_t x;
+	mh_foreach(h, x) {
+		struct beer_retry *p = mh_retry_node(h, x);
+		if (p->state != BEER_RETRY_READY)
+			continue;
+		beer_retry_move(r, &p->reply);
+		beer_retry_del(sn, x);
+		sn->retry_ready--;
+		return 1;
+	}
+	return 0;
+}
+
+void
+beer_retry_clear(struct beer_stream *s) {
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+	struct mh_retry_t *h = sn->retry;
+	sn->retry_ready = 0;
+	if (h != NULL) {
+		mh_int_t x;
+		mh_foreach(h, x) {
+			struct beer_retry *p = mh_retry_node(h, x);
+			if (p->frame && !p->arena)
+				beer_mem_free(p->frame);
+			if (p->reply.buf)
+				beer_reply_free(&p->reply);
+		}
+		mh_retry_delete(h);
+		sn->retry = NULL;
+	}
+	if (sn->retry_frames) {
+		beer_arena_free(&sn->retry_frames->arena);
+		beer_mem_free(sn->retry_frames);
+		sn->retry_frames = NULL;
+	}
+}
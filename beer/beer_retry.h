@@ -0,0 +1,37 @@
+#ifndef BEER_RETRY_H_INCLUDED
+#define BEER_RETRY_H_INCLUDED
+
+#include <sys/uio.h>
+
+struct beer_stream;
+struct beer_reply;
+
+/*
+ * Requests that carry schema id are kept until their reply is received.
+ * If server answers with BEER_ER_WRONG_SCHEMA_VERSION, then definitions of
+ * the request's space are reloaded and the request is sent again (once).
+ */
+
+/*
+ * keep copies of request frames that were just written to stream, frames
+ * bigger than 16KiB aren't kept
+ */
+void
+beer_retry_keep(struct beer_stream *s, struct iovec *iov, int count);
+
+/*
+ * handle reply, returns 0 if it must be returned to the caller,
+ * 1 if it was consumed (request was sent again), -1 on error
+ */
+int
+beer_retry_reply(struct beer_stream *s, struct beer_reply *r);
+
+/* get reply of request, that wasn't retried, returns 1 if there's one */
+int
+beer_retry_ready(struct beer_stream *s, struct beer_reply *r);
+
+/* drop all kept requests */
+void
+beer_retry_clear(struct beer_stream *s);
+
+#endif /* BEER_RETRY_H_INCLUDED */
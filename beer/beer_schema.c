@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <stdint.h>
+#include <sched.h>
 
 #include <msgpuck.h>
 
@@ -17,6 +18,7 @@
 #include <beer/beer_select.h>
 
 #include "beer_assoc.h"
+#include "pmatomic.h"
 
 static inline void
 beer_schema_ival_free(struct beer_schema_ival *val) {
@@ -72,66 +74,64 @@ beer_schema_sval_free(struct beer_schema_sval *val) {
 	beer_mem_free(val);
 }
 
+static inline void
+beer_schema_space_del(struct mh_assoc_t *schema, struct beer_schema_sval *sval) {
+	mh_int_t space_slot = 0;
+	struct assoc_val *av1 = NULL, *av2 = NULL;
+	do {
+		struct assoc_key key_number = {
+			(void *)&(sval->number),
+			sizeof(uint32_t)
+		};
+		space_slot = mh_assoc_find(schema, &key_number, NULL);
+		if (space_slot == mh_end(schema))
+			break;
+		av1 = *mh_assoc_node(schema, space_slot);
+		mh_assoc_del(schema, space_slot, NULL);
+	} while (0);
+	do {
+		struct assoc_key key_string = {
+			sval->name,
+			sval->name_len
+		};
+		space_slot = mh_assoc_find(schema, &key_string, NULL);
+		if (space_slot == mh_end(schema))
+			break;
+		av2 = *mh_assoc_node(schema, space_slot);
+		mh_assoc_del(schema, space_slot, NULL);
+	} while (0);
+	beer_schema_sval_free(sval);
+	if (av1) beer_mem_free((void *)av1);
+	if (av2) beer_mem_free((void *)av2);
+}
+
 static inline void
 beer_schema_space_free(struct mh_assoc_t *schema) {
 	mh_int_t pos = 0;
-	mh_int_t space_slot = 0;
 	mh_foreach(schema, pos) {
 		struct beer_schema_sval *sval = NULL;
 		sval = (*mh_assoc_node(schema, pos))->data;
-		struct assoc_val *av1 = NULL, *av2 = NULL;
-		do {
-			struct assoc_key key_number = {
-				(void *)&(sval->number),
-				sizeof(uint32_t)
-			};
-			space_slot = mh_assoc_find(schema, &key_number, NULL);
-			if (space_slot == mh_end(schema))
-				break;
-			av1 = *mh_assoc_node(schema, space_slot);
-			mh_assoc_del(schema, space_slot, NULL);
-		} while (0);
-		do {
-			struct assoc_key key_string = {
-				sval->name,
-				sval->name_len
-			};
-			space_slot = mh_assoc_find(schema, &key_string, NULL);
-			if (space_slot == mh_end(schema))
-				break;
-			av2 = *mh_assoc_node(schema, space_slot);
-			mh_assoc_del(schema, space_slot, NULL);
-		} while (0);
-		beer_schema_sval_free(sval);
-		if (av1) beer_mem_free((void *)av1);
-		if (av2) beer_mem_free((void *)av2);
+		beer_schema_space_del(schema, sval);
 	}
 }
 
-static inline int
-beer_schema_add_space(struct mh_assoc_t *schema, const char **data)
+/* allocate space value, and insert it by number and by name */
+static struct beer_schema_sval *
+beer_schema_put_space(struct mh_assoc_t *schema, uint32_t number,
+		      const char *name, uint32_t name_len)
 {
 	struct beer_schema_sval *space = NULL;
 	struct assoc_val *space_string = NULL, *space_number = NULL;
-	const char *tuple = *data;
-	if (mp_typeof(*tuple) != MP_ARRAY)
-		goto error;
-	uint32_t tuple_len = mp_decode_array(&tuple); (void )tuple_len;
 	space = beer_mem_alloc(sizeof(struct beer_schema_sval));
 	if (!space)
 		goto error;
 	memset(space, 0, sizeof(struct beer_schema_sval));
-	if (mp_typeof(*tuple) != MP_UINT)
-		goto error;
-	space->number = mp_decode_uint(&tuple);
-	mp_next(&tuple); /* skip owner id */
-	if (mp_typeof(*tuple) != MP_STR)
-		goto error;
-	const char *name_tmp = mp_decode_str(&tuple, &space->name_len);
+	space->number = number;
+	space->name_len = name_len;
 	space->name = beer_mem_alloc(space->name_len);
 	if (!space->name)
 		goto error;
-	memcpy(space->name, name_tmp, space->name_len);
+	memcpy(space->name, name, space->name_len);
 
 	space->index = mh_assoc_new();
 	if (!space->index)
@@ -152,13 +152,35 @@ beer_schema_add_space(struct mh_assoc_t *schema, const char **data)
 		     NULL, NULL);
 	mh_assoc_put(schema, (const struct assoc_val **)&space_number,
 		     NULL, NULL);
-	mp_next(data);
-	return 0;
+	return space;
 error:
-	mp_next(data);
 	beer_schema_sval_free(space);
 	if (space_string) beer_mem_free(space_string);
 	if (space_number) beer_mem_free(space_number);
+	return NULL;
+}
+
+static inline int
+beer_schema_add_space(struct mh_assoc_t *schema, const char **data)
+{
+	const char *tuple = *data;
+	if (mp_typeof(*tuple) != MP_ARRAY)
+		goto error;
+	uint32_t tuple_len = mp_decode_array(&tuple); (void )tuple_len;
+	if (mp_typeof(*tuple) != MP_UINT)
+		goto error;
+	uint32_t number = mp_decode_uint(&tuple);
+	mp_next(&tuple); /* skip owner id */
+	if (mp_typeof(*tuple) != MP_STR)
+		goto error;
+	uint32_t name_len = 0;
+	const char *name = mp_decode_str(&tuple, &name_len);
+	if (beer_schema_put_space(schema, number, name, name_len) == NULL)
+		goto error;
+	mp_next(data);
+	return 0;
+error:
+	mp_next(data);
 	return -1;
 }
 
@@ -178,40 +200,23 @@ int beer_schema_add_spaces(struct beer_schema *schema_obj, struct beer_reply *r)
 	return 0;
 }
 
-static inline int
-beer_schema_add_index(struct mh_assoc_t *schema, const char **data) {
-	const struct beer_schema_sval *space = NULL;
+/* allocate index value, and insert it by number and by name */
+static struct beer_schema_ival *
+beer_schema_put_index(const struct beer_schema_sval *space, uint32_t number,
+		      const char *name, uint32_t name_len)
+{
 	struct beer_schema_ival *index = NULL;
 	struct assoc_val *index_number = NULL, *index_string = NULL;
-	const char *tuple = *data;
-	if (mp_typeof(*tuple) != MP_ARRAY)
-		goto error;
-	int64_t tuple_len = mp_decode_array(&tuple); (void )tuple_len;
-	uint32_t space_number = mp_decode_uint(&tuple);
-	if (mp_typeof(*tuple) != MP_UINT)
-		goto error;
-	struct assoc_key space_key = {
-		(void *)&(space_number),
-		sizeof(uint32_t)
-	};
-	mh_int_t space_slot = mh_assoc_find(schema, &space_key, NULL);
-	if (space_slot == mh_end(schema))
-		return -1;
-	space = (*mh_assoc_node(schema, space_slot))->data;
 	index = beer_mem_alloc(sizeof(struct beer_schema_ival));
 	if (!index)
 		goto error;
 	memset(index, 0, sizeof(struct beer_schema_ival));
-	if (mp_typeof(*tuple) != MP_UINT)
-		goto error;
-	index->number = mp_decode_uint(&tuple);
-	if (mp_typeof(*tuple) != MP_STR)
-		goto error;
-	const char *name_tmp = mp_decode_str(&tuple, &index->name_len);
+	index->number = number;
+	index->name_len = name_len;
 	index->name = beer_mem_alloc(index->name_len);
 	if (!index->name)
 		goto error;
-	memcpy((void *)index->name, name_tmp, index->name_len);
+	memcpy((void *)index->name, name, index->name_len);
 
 	index_string = beer_mem_alloc(sizeof(struct assoc_val));
 	if (!index_string) goto error;
@@ -227,13 +232,45 @@ beer_schema_add_index(struct mh_assoc_t *schema, const char **data) {
 		     NULL, NULL);
 	mh_assoc_put(space->index, (const struct assoc_val **)&index_number,
 		     NULL, NULL);
-	mp_next(data);
-	return 0;
+	return index;
 error:
-	mp_next(data);
 	if (index_string) beer_mem_free(index_string);
 	if (index_number) beer_mem_free(index_number);
 	beer_schema_ival_free(index);
+	return NULL;
+}
+
+static inline int
+beer_schema_add_index(struct mh_assoc_t *schema, const char **data) {
+	const struct beer_schema_sval *space = NULL;
+	const char *tuple = *data;
+	if (mp_typeof(*tuple) != MP_ARRAY)
+		goto error;
+	int64_t tuple_len = mp_decode_array(&tuple); (void )tuple_len;
+	uint32_t space_number = mp_decode_uint(&tuple);
+	if (mp_typeof(*tuple) != MP_UINT)
+		goto error;
+	struct assoc_key space_key = {
+		(void *)&(space_number),
+		sizeof(uint32_t)
+	};
+	mh_int_t space_slot = mh_assoc_find(schema, &space_key, NULL);
+	if (space_slot == mh_end(schema))
+		return -1;
+	space = (*mh_assoc_node(schema, space_slot))->data;
+	if (mp_typeof(*tuple) != MP_UINT)
+		goto error;
+	uint32_t number = mp_decode_uint(&tuple);
+	if (mp_typeof(*tuple) != MP_STR)
+		goto error;
+	uint32_t name_len = 0;
+	const char *name = mp_decode_str(&tuple, &name_len);
+	if (beer_schema_put_index(space, number, name, name_len) == NULL)
+		goto error;
+	mp_next(data);
+	return 0;
+error:
+	mp_next(data);
 	return -1;
 }
 
@@ -253,34 +290,61 @@ int beer_schema_add_indexes(struct beer_schema *schema_obj, struct beer_reply *r
 	return 0;
 }
 
+/* enter read-side section, returns epoch to leave */
+static inline uint32_t
+beer_schema_read_begin(struct beer_schema *schema_obj) {
+	while (1) {
+		uint32_t e = pm_atomic_load(&schema_obj->epoch) & 1;
+		pm_atomic_fetch_add(&schema_obj->readers[e], 1);
+		/* epoch was flipped meanwhile, writer may not wait for us */
+		if ((pm_atomic_load(&schema_obj->epoch) & 1) == e)
+			return e;
+		pm_atomic_fetch_sub(&schema_obj->readers[e], 1);
+	}
+}
+
+static inline void
+beer_schema_read_end(struct beer_schema *schema_obj, uint32_t e) {
+	pm_atomic_fetch_sub(&schema_obj->readers[e], 1);
+}
+
 int32_t beer_schema_stosid(struct beer_schema *schema_obj, const char *name,
 			  uint32_t name_len) {
-	struct mh_assoc_t *schema = schema_obj->space_hash;
+	uint32_t e = beer_schema_read_begin(schema_obj);
+	struct mh_assoc_t *schema = pm_atomic_load(&schema_obj->space_hash);
+	int32_t number = -1;
 	struct assoc_key space_key = {name, name_len};
 	mh_int_t space_slot = mh_assoc_find(schema, &space_key, NULL);
-	if (space_slot == mh_end(schema))
-		return -1;
-	const struct beer_schema_sval *space =
-		(*mh_assoc_node(schema, space_slot))->data;
-	return space->number;
+	if (space_slot != mh_end(schema)) {
+		const struct beer_schema_sval *space =
+			(*mh_assoc_node(schema, space_slot))->data;
+		number = space->number;
+	}
+	beer_schema_read_end(schema_obj, e);
+	return number;
 }
 
 int32_t beer_schema_stoiid(struct beer_schema *schema_obj, uint32_t sid,
 			  const char *name, uint32_t name_len) {
-	struct mh_assoc_t *schema = schema_obj->space_hash;
+	uint32_t e = beer_schema_read_begin(schema_obj);
+	struct mh_assoc_t *schema = pm_atomic_load(&schema_obj->space_hash);
+	int32_t number = -1;
 	struct assoc_key space_key = {(void *)&sid, sizeof(uint32_t)};
 	mh_int_t space_slot = mh_assoc_find(schema, &space_key, NULL);
 	if (space_slot == mh_end(schema))
-		return -1;
+		goto exit;
 	const struct beer_schema_sval *space =
 		(*mh_assoc_node(schema, space_slot))->data;
 	struct assoc_key index_key = {name, name_len};
 	mh_int_t index_slot = mh_assoc_find(space->index, &index_key, NULL);
 	if (index_slot == mh_end(space->index))
-		return -1;
+		goto exit;
 	const struct beer_schema_ival *index =
 		(*mh_assoc_node(space->index, index_slot))->data;
-	return index->number;
+	number = index->number;
+exit:
+	beer_schema_read_end(schema_obj, e);
+	return number;
 }
 
 struct beer_schema *beer_schema_new(struct beer_schema *s) {
@@ -289,18 +353,183 @@ struct beer_schema *beer_schema_new(struct beer_schema *s) {
 		s = beer_mem_alloc(sizeof(struct beer_schema));
 		if (!s) return NULL;
 	}
+	memset(s, 0, sizeof(struct beer_schema));
 	s->space_hash = mh_assoc_new();
+	if (!s->space_hash) {
+		if (alloc) beer_mem_free(s);
+		return NULL;
+	}
 	s->alloc = alloc;
+	s->refs = 1;
+	pthread_mutex_init(&s->lock, NULL);
 	return s;
 }
 
 void beer_schema_flush(struct beer_schema *obj) {
-	beer_schema_space_free(obj->space_hash);
+	struct beer_schema empty;
+	if (beer_schema_new(&empty) == NULL)
+		return;
+	beer_schema_replace(obj, &empty);
+	beer_schema_free(&empty);
+}
+
+/* publish hash of 'from' in 'obj', writer lock must be held */
+static void
+beer_schema_publish(struct beer_schema *obj, struct beer_schema *from) {
+	struct mh_assoc_t *old = pm_atomic_exchange(&obj->space_hash,
+						    from->space_hash);
+	pm_atomic_store(&obj->schema_id, from->schema_id);
+	/* new readers see new hash, wait for the ones that may see old */
+	uint32_t e = pm_atomic_fetch_add(&obj->epoch, 1) & 1;
+	while (pm_atomic_load(&obj->readers[e]) != 0)
+		sched_yield();
+	from->space_hash = old;
+	from->schema_id = 0;
+}
+
+void beer_schema_replace(struct beer_schema *obj, struct beer_schema *from) {
+	pthread_mutex_lock(&obj->lock);
+	beer_schema_publish(obj, from);
+	pthread_mutex_unlock(&obj->lock);
+}
+
+/* deep copy of space hash, every value is stored twice (by number and name) */
+static int
+beer_schema_copy(struct mh_assoc_t *dst, struct mh_assoc_t *src) {
+	mh_int_t pos = 0;
+	mh_foreach(src, pos) {
+		const struct assoc_val *sv = *mh_assoc_node(src, pos);
+		const struct beer_schema_sval *sval = sv->data;
+		if (sv->key.id != (void *)&(sval->number))
+			continue;
+		struct beer_schema_sval *space = beer_schema_put_space(dst,
+				sval->number, sval->name, sval->name_len);
+		if (!space)
+			return -1;
+		mh_int_t ipos = 0;
+		mh_foreach(sval->index, ipos) {
+			const struct assoc_val *iv = *mh_assoc_node(sval->index, ipos);
+			const struct beer_schema_ival *ival = iv->data;
+			if (iv->key.id != (void *)&(ival->number))
+				continue;
+			if (!beer_schema_put_index(space, ival->number, ival->name,
+						   ival->name_len))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+static struct beer_schema_sval *
+beer_schema_find_space(struct mh_assoc_t *schema, const char *id,
+		       uint32_t id_len) {
+	struct assoc_key key = {id, id_len};
+	mh_int_t slot = mh_assoc_find(schema, &key, NULL);
+	if (slot == mh_end(schema))
+		return NULL;
+	return (*mh_assoc_node(schema, slot))->data;
+}
+
+/* drop spaces, that have names of ones in reply (they're stale) */
+static void
+beer_schema_del_names(struct mh_assoc_t *schema, struct beer_reply *r) {
+	const char *tuple = r->data;
+	uint32_t space_count = mp_decode_array(&tuple);
+	while (space_count-- > 0) {
+		const char *field = tuple;
+		mp_next(&tuple);
+		if (mp_typeof(*field) != MP_ARRAY || mp_decode_array(&field) < 3)
+			continue;
+		mp_next(&field);
+		mp_next(&field);
+		if (mp_typeof(*field) != MP_STR)
+			continue;
+		uint32_t name_len = 0;
+		const char *name = mp_decode_str(&field, &name_len);
+		struct beer_schema_sval *sval =
+			beer_schema_find_space(schema, name, name_len);
+		if (sval)
+			beer_schema_space_del(schema, sval);
+	}
+}
+
+int beer_schema_reload_space(struct beer_schema *obj, uint32_t sid,
+			    struct beer_reply *space, struct beer_reply *index) {
+	const char *tuple = space->data;
+	if (!tuple || mp_check(&tuple, space->data_end) ||
+	    mp_typeof(*space->data) != MP_ARRAY)
+		return -1;
+	struct beer_schema fresh;
+	if (beer_schema_new(&fresh) == NULL)
+		return -1;
+	/* no other writer may publish between the copy and our update */
+	pthread_mutex_lock(&obj->lock);
+	struct beer_schema_sval *sval;
+	uint64_t schema_id = pm_atomic_load(&obj->schema_id);
+	int rc = 0;
+	if (space->schema_id != 0 && space->schema_id < schema_id) {
+		/* published schema is newer than the reply, don't patch it */
+		sval = beer_schema_find_space(obj->space_hash, (void *)&sid,
+					      sizeof(uint32_t));
+		rc = (sval == NULL);
+		goto exit;
+	}
+	rc = beer_schema_copy(fresh.space_hash, obj->space_hash);
+	if (rc == -1)
+		goto exit;
+	/* remember the old name, to find out if space was renamed */
+	char *name = NULL;
+	uint32_t name_len = 0;
+	sval = beer_schema_find_space(fresh.space_hash, (void *)&sid,
+				      sizeof(uint32_t));
+	if (sval) {
+		name_len = sval->name_len;
+		name = beer_mem_alloc(name_len);
+		if (!name) {
+			rc = -1;
+			goto exit;
+		}
+		memcpy(name, sval->name, name_len);
+		beer_schema_space_del(fresh.space_hash, sval);
+	}
+	beer_schema_del_names(fresh.space_hash, space);
+	if (beer_schema_add_spaces(&fresh, space) == -1 ||
+	    beer_schema_add_indexes(&fresh, index) == -1) {
+		rc = -1;
+	} else {
+		sval = beer_schema_find_space(fresh.space_hash, (void *)&sid,
+					      sizeof(uint32_t));
+		rc = (sval == NULL) || (name && (sval->name_len != name_len ||
+			memcmp(sval->name, name, name_len) != 0));
+		fresh.schema_id = space->schema_id > schema_id ?
+				  space->schema_id : schema_id;
+		beer_schema_publish(obj, &fresh);
+	}
+	if (name)
+		beer_mem_free(name);
+exit:
+	pthread_mutex_unlock(&obj->lock);
+	beer_schema_free(&fresh);
+	return rc;
+}
+
+struct beer_schema *beer_schema_ref(struct beer_schema *obj) {
+	pm_atomic_fetch_add(&obj->refs, 1);
+	return obj;
+}
+
+void beer_schema_unref(struct beer_schema *obj) {
+	if (pm_atomic_fetch_sub(&obj->refs, 1) != 1)
+		return;
+	beer_schema_free(obj);
+	if (obj->alloc)
+		beer_mem_free(obj);
 }
 
 void beer_schema_free(struct beer_schema *obj) {
 	beer_schema_space_free(obj->space_hash);
 	mh_assoc_delete(obj->space_hash);
+	pthread_mutex_destroy(&obj->lock);
 }
 
 ssize_t
@@ -317,6 +546,36 @@ beer_get_space(struct beer_stream *s)
 	return retval;
 }
 
+ssize_t
+beer_get_space_by_id(struct beer_stream *s, uint32_t sid)
+{
+	struct beer_stream *obj = beer_object(NULL);
+	if (obj == NULL)
+		return -1;
+
+	beer_object_add_array(obj, 1);
+	beer_object_add_uint(obj, sid);
+	ssize_t retval = beer_select(s, beer_vsp_space, beer_vin_primary,
+				    UINT32_MAX, 0, BEER_ITER_EQ, obj);
+	beer_stream_free(obj);
+	return retval;
+}
+
+ssize_t
+beer_get_index_by_space(struct beer_stream *s, uint32_t sid)
+{
+	struct beer_stream *obj = beer_object(NULL);
+	if (obj == NULL)
+		return -1;
+
+	beer_object_add_array(obj, 1);
+	beer_object_add_uint(obj, sid);
+	ssize_t retval = beer_select(s, beer_vsp_index, beer_vin_primary,
+				    UINT32_MAX, 0, BEER_ITER_EQ, obj);
+	beer_stream_free(obj);
+	return retval;
+}
+
 ssize_t
 beer_get_index(struct beer_stream *s)
 {
@@ -52,7 +52,7 @@ beer_stream_init(struct beer_stream *s)
 {
 	int alloc = (s == NULL);
 	if (alloc) {
-		s = beer_mem_alloc(sizeof(struct beer_stream));
+		s = beer_mem_batch_alloc(sizeof(struct beer_stream));
 		if (s == NULL)
 			return NULL;
 	}
@@ -67,5 +67,5 @@ void beer_stream_free(struct beer_stream *s) {
 	if (s->free)
 		s->free(s);
 	if (s->alloc)
-		beer_mem_free(s);
+		beer_mem_batch_free(s);
 }
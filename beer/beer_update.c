@@ -26,7 +26,7 @@ beer_update(struct beer_stream *s, uint32_t space, uint32_t index,
 	struct beer_iheader hdr;
 	struct iovec v[6]; int v_sz = 6;
 	char *data = NULL, *body_start = NULL;
-	encode_header(&hdr, BEER_OP_UPDATE, s->reqid++);
+	encode_header(&hdr, BEER_OP_UPDATE, s->reqid++, s->schema_id);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[64]; body_start = body; data = body;
@@ -70,7 +70,7 @@ beer_upsert(struct beer_stream *s, uint32_t space,
 	struct beer_iheader hdr;
 	struct iovec v[6]; int v_sz = 6;
 	char *data = NULL, *body_start = NULL;
-	encode_header(&hdr, BEER_OP_UPSERT, s->reqid++);
+	encode_header(&hdr, BEER_OP_UPSERT, s->reqid++, s->schema_id);
 	v[1].iov_base = (void *)hdr.header;
 	v[1].iov_len  = hdr.end - hdr.header;
 	char body[64]; body_start = body; data = body;
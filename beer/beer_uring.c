@@ -0,0 +1,329 @@
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <beer/beer_mem.h>
+#include <beer/beer_iob.h>
+
+#include "beer_uring.h"
+
+#if defined(BEER_IO_URING)
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <linux/io_uring.h>
+#endif /* defined(BEER_IO_URING) */
+
+#if defined(BEER_IO_URING) && defined(__NR_io_uring_setup) && \
+    defined(IORING_FEAT_FAST_POLL)
+
+#include "pmatomic.h"
+
+/* at most a write and a read are in flight */
+#define BEER_URING_ENTRIES 4
+
+enum beer_uring_op {
+	BEER_URING_WRITE = 1,
+	BEER_URING_READ
+};
+
+struct beer_uring *
+beer_uring_new(int sock, struct beer_iob *sbuf, struct beer_iob *rbuf)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = syscall(__NR_io_uring_setup, BEER_URING_ENTRIES, &p);
+	if (fd == -1)
+		return NULL;
+	/* without fast poll socket operations are done by worker threads */
+	if (!(p.features & IORING_FEAT_FAST_POLL)) {
+		close(fd);
+		return NULL;
+	}
+	struct beer_uring *u = beer_mem_alloc(sizeof(struct beer_uring));
+	if (u == NULL) {
+		close(fd);
+		return NULL;
+	}
+	memset(u, 0, sizeof(struct beer_uring));
+	u->fd = fd;
+	u->sock = sock;
+	u->sq_ring = u->cq_ring = u->sqes = MAP_FAILED;
+	u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_ring_size = p.cq_off.cqes +
+			  p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED)
+		goto error;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->cq_ring = u->sq_ring;
+	else
+		u->cq_ring = mmap(NULL, u->cq_ring_size,
+				  PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, fd,
+				  IORING_OFF_CQ_RING);
+	if (u->cq_ring == MAP_FAILED)
+		goto error;
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED)
+		goto error;
+	char *sq = u->sq_ring, *cq = u->cq_ring;
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	/* buffers are used unregistered, if they can't be locked */
+	struct iovec v[2] = {
+		{ sbuf->buf, sbuf->size },
+		{ rbuf->buf, rbuf->mirror ? rbuf->size * 2 : rbuf->size }
+	};
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS,
+		    v, 2) == 0) {
+		u->registered = 1;
+		u->sbuf = sbuf->buf;
+		u->sbuf_size = sbuf->size;
+		u->rbuf = rbuf->buf;
+		u->rbuf_size = v[1].iov_len;
+	}
+	return u;
+error:
+	beer_uring_free(u);
+	return NULL;
+}
+
+void
+beer_uring_free(struct beer_uring *u)
+{
+	if (u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqes_size);
+	if (u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+	if (u->sq_ring != MAP_FAILED)
+		munmap(u->sq_ring, u->sq_ring_size);
+	close(u->fd);
+	beer_mem_free(u);
+}
+
+static struct io_uring_sqe *
+beer_uring_sqe(struct beer_uring *u, enum beer_uring_op op)
+{
+	unsigned idx = *u->sq_tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = &u->sqes[idx];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->fd = u->sock;
+	sqe->user_data = op;
+	u->sq_array[idx] = idx;
+	return sqe;
+}
+
+/* entry is seen by kernel only after it's filled */
+static void
+beer_uring_push(struct beer_uring *u)
+{
+	pm_atomic_store_explicit(u->sq_tail, *u->sq_tail + 1,
+				 pm_memory_order_release);
+}
+
+static void
+beer_uring_reap(struct beer_uring *u)
+{
+	unsigned head = *u->cq_head;
+	unsigned tail = pm_atomic_load_explicit(u->cq_tail,
+						pm_memory_order_acquire);
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+		if (cqe->user_data == BEER_URING_READ) {
+			u->read_done = 1;
+			u->read_res = cqe->res;
+		} else {
+			u->write_done = 1;
+			u->write_res = cqe->res;
+		}
+	}
+	pm_atomic_store_explicit(u->cq_head, head, pm_memory_order_release);
+}
+
+/* submit entries and wait until *done is set */
+static int
+beer_uring_wait(struct beer_uring *u, unsigned submit, int *done)
+{
+	beer_uring_reap(u);
+	while (submit > 0 || !*done) {
+		int rc = syscall(__NR_io_uring_enter, u->fd, submit, 1,
+				 IORING_ENTER_GETEVENTS, NULL, 0);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (submit > 0 && rc == 0)
+			return -EBUSY;
+		submit -= (unsigned)rc < submit ? (unsigned)rc : submit;
+		beer_uring_reap(u);
+	}
+	return 0;
+}
+
+static int
+beer_uring_fixed(const char *buf, size_t size, const char *base,
+		 size_t base_size)
+{
+	return buf >= base && buf + size <= base + base_size;
+}
+
+ssize_t
+beer_uring_writev(struct beer_uring *u, struct iovec *iov, int count,
+		  char *buf, size_t room, size_t off)
+{
+	ssize_t total = 0;
+	while (count > 0) {
+		struct io_uring_sqe *sqe = beer_uring_sqe(u, BEER_URING_WRITE);
+		if (count == 1 && u->registered &&
+		    beer_uring_fixed(iov->iov_base, iov->iov_len, u->sbuf,
+				     u->sbuf_size)) {
+			sqe->opcode = IORING_OP_WRITE_FIXED;
+			sqe->addr = (uintptr_t)iov->iov_base;
+			sqe->len = iov->iov_len;
+			sqe->buf_index = 0;
+		} else {
+			sqe->opcode = IORING_OP_WRITEV;
+			sqe->addr = (uintptr_t)iov;
+			sqe->len = count;
+		}
+		beer_uring_push(u);
+		unsigned submit = 1;
+		/* replies are read, while caller is busy */
+		if (room > 0 && !u->reading) {
+			sqe = beer_uring_sqe(u, BEER_URING_READ);
+			if (u->registered &&
+			    beer_uring_fixed(buf, room, u->rbuf, u->rbuf_size)) {
+				sqe->opcode = IORING_OP_READ_FIXED;
+				sqe->buf_index = 1;
+			} else {
+				sqe->opcode = IORING_OP_RECV;
+			}
+			sqe->addr = (uintptr_t)buf;
+			sqe->len = room;
+			beer_uring_push(u);
+			u->reading = 1;
+			u->read_done = 0;
+			u->read_off = off;
+			submit++;
+		}
+		room = 0;
+		u->write_done = 0;
+		int rc = beer_uring_wait(u, submit, &u->write_done);
+		if (rc < 0)
+			return rc;
+		if (u->write_res <= 0)
+			return u->write_res < 0 ? u->write_res : -EIO;
+		total += u->write_res;
+		size_t n = u->write_res;
+		while (count > 0) {
+			if (iov->iov_len > n) {
+				iov->iov_base = (char *)iov->iov_base + n;
+				iov->iov_len -= n;
+				break;
+			}
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+	}
+	return total;
+}
+
+ssize_t
+beer_uring_read(struct beer_uring *u)
+{
+	int rc = beer_uring_wait(u, 0, &u->read_done);
+	if (rc < 0)
+		return rc;
+	u->reading = 0;
+	return u->read_res;
+}
+
+#else /* io_uring isn't supported */
+
+struct beer_uring *
+beer_uring_new(int sock, struct beer_iob *sbuf, struct beer_iob *rbuf)
+{
+	(void)sock;
+	(void)sbuf;
+	(void)rbuf;
+	return NULL;
+}
+
+void
+beer_uring_free(struct beer_uring *u)
+{
+	(void)u;
+}
+
+ssize_t
+beer_uring_writev(struct beer_uring *u, struct iovec *iov, int count,
+		  char *buf, size_t room, size_t off)
+{
+	(void)u;
+	(void)iov;
+	(void)count;
+	(void)buf;
+	(void)room;
+	(void)off;
+	return -ENOSYS;
+}
+
+ssize_t
+beer_uring_read(struct beer_uring *u)
+{
+	(void)u;
+	return -ENOSYS;
+}
+
+#endif
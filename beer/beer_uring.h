@@ -0,0 +1,63 @@
+#ifndef BEER_URING_H_INCLUDED
+#define BEER_URING_H_INCLUDED
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct beer_iob;
+
+/*
+ * io_uring transport of blocking network stream (BEER_OPT_IO_URING).
+ * Flush submits the write of send buffer together with a read into the free
+ * tail of recv buffer, with one io_uring_enter(2). By the time replies are
+ * read they are usually there, and the read is just taken from the ring.
+ * Send and recv buffers are registered, so their pages aren't mapped on
+ * every operation.
+ */
+struct beer_uring {
+	int fd; /* ring */
+	int sock; /* socket of stream */
+	/* submission queue */
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	/* completion queue */
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+	/* registered buffers */
+	const char *sbuf, *rbuf;
+	size_t sbuf_size, rbuf_size;
+	int registered;
+	/* write of flush */
+	int write_done;
+	ssize_t write_res;
+	/* read into recv buffer */
+	int reading; /* it's in flight */
+	int read_done; /* its completion is taken */
+	ssize_t read_res; /* bytes read, or -errno */
+	size_t read_off; /* offset in recv buffer it was started at */
+};
+
+/* create ring for socket; NULL, if io_uring isn't available */
+struct beer_uring *
+beer_uring_new(int fd, struct beer_iob *sbuf, struct beer_iob *rbuf);
+
+/* close ring, reads in flight are canceled */
+void
+beer_uring_free(struct beer_uring *u);
+
+/*
+ * write iovecs, and start reading into buf (if room isn't 0); returns
+ * count of bytes written, or -errno
+ */
+ssize_t
+beer_uring_writev(struct beer_uring *u, struct iovec *iov, int count,
+		  char *buf, size_t room, size_t off);
+
+/* wait for read in flight; returns count of bytes read, or -errno */
+ssize_t
+beer_uring_read(struct beer_uring *u);
+
+#endif /* BEER_URING_H_INCLUDED */
@@ -39,8 +39,8 @@
 #include <dirent.h>
 #include <errno.h>
 
-#include <bee.h>
-#include <beer_dir.h>
+#include <bee/bee.h>
+#include <beer/beer_dir.h>
 
 void beer_dir_init(struct beer_dir *d, enum beer_dir_type type) {
 	d->type = type;
@@ -100,17 +100,15 @@ int beer_dir_scan(struct beer_dir *d, char *path) {
 	if (dir == NULL)
 		goto error;
 
-	struct dirent *dep = NULL;
-	struct dirent de;
+	struct dirent *de;
 	int rc, top = 0;
-	while ((rc = readdir_r(dir, &de, &dep)) == 0) {
-		if (dep == NULL)
-			break;
-		if (strcmp(de.d_name, ".") == 0 ||
-		    strcmp(de.d_name, "..") == 0)
+	/* errno tells end of directory from error */
+	while ((errno = 0, de = readdir(dir)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
 			continue;
 
-		char *ext = strchr(de.d_name, '.');
+		char *ext = strchr(de->d_name, '.');
 		if (ext == NULL)
 			continue;
 
@@ -125,15 +123,16 @@ int beer_dir_scan(struct beer_dir *d, char *path) {
 			break;
 		}
 
-		uint64_t lsn = strtoll(de.d_name, &ext, 10);
-		if (lsn == LLONG_MAX || lsn == LLONG_MIN)
+		char *end = NULL;
+		uint64_t lsn = strtoull(de->d_name, &end, 10);
+		if (end != ext)
 			continue;
 
-		rc = beer_dir_put(d, &top, de.d_name, lsn);
+		rc = beer_dir_put(d, &top, de->d_name, lsn);
 		if (rc == -1)
 			goto error;
 	}
-	if (rc != 0)
+	if (errno != 0)
 		goto error;
 
 	qsort(d->files, d->count, sizeof(struct beer_dir_file),
@@ -0,0 +1,918 @@
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#include <msgpuck.h>
+
+#include <bee/bee.h>
+#include <beer/beer_export.h>
+
+#define BEER_EXPORT_MAGIC "BEERCOL1"
+#define BEER_EXPORT_MAGIC_SIZE 8
+
+/* spaces with smaller id are system ones */
+#define BEER_EXPORT_SPACE_MIN 512
+
+/* group is written earlier, if values take this much memory */
+#define BEER_EXPORT_GROUP_BYTES (1U << 30)
+
+struct beer_export_buf {
+	char *data;
+	size_t size;
+	size_t top;
+};
+
+struct beer_export_column {
+	char *name; /* NULL if isn't in format */
+	char *type;
+	struct beer_export_buf values; /* msgpack of values of current group */
+	struct beer_export_buf ends; /* uint32_t end of value, per row */
+};
+
+struct beer_export_space {
+	uint32_t id;
+	char *name;
+	struct beer_export_column *cols;
+	uint32_t ncols;
+	uint32_t rows; /* rows of current group */
+	size_t bytes; /* size of values of current group */
+	uint64_t total;
+	FILE *f;
+	uint64_t offset;
+	struct beer_export_buf groups; /* metadata of written groups */
+	uint32_t ngroups;
+};
+
+/* string value of chunk, for sorting */
+struct beer_export_str {
+	const char *data;
+	uint32_t len;
+	uint32_t row;
+};
+
+static char *
+beer_export_reserve(struct beer_export_buf *b, size_t size) {
+	if (b->size + size > b->top) {
+		size_t top = b->top ? b->top : 4096;
+		while (top < b->size + size)
+			top *= 2;
+		char *data = beer_mem_realloc(b->data, top);
+		if (data == NULL)
+			return NULL;
+		b->data = data;
+		b->top = top;
+	}
+	return b->data + b->size;
+}
+
+static int
+beer_export_put(struct beer_export_buf *b, const void *data, size_t size) {
+	char *p = beer_export_reserve(b, size);
+	if (p == NULL)
+		return -1;
+	memcpy(p, data, size);
+	b->size += size;
+	return 0;
+}
+
+static void
+beer_export_buf_free(struct beer_export_buf *b) {
+	if (b->data)
+		beer_mem_free(b->data);
+	memset(b, 0, sizeof(struct beer_export_buf));
+}
+
+static inline void
+beer_export_store_u32(char *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline void
+beer_export_store_u64(char *p, uint64_t v) {
+	beer_export_store_u32(p, (uint32_t)v);
+	beer_export_store_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static int
+beer_export_put_u32(struct beer_export_buf *b, uint32_t v) {
+	char *p = beer_export_reserve(b, sizeof(uint32_t));
+	if (p == NULL)
+		return -1;
+	beer_export_store_u32(p, v);
+	b->size += sizeof(uint32_t);
+	return 0;
+}
+
+/* end of value in the values buffer (in host order, isn't written) */
+static int
+beer_export_put_end(struct beer_export_column *c) {
+	uint32_t end = c->values.size;
+	return beer_export_put(&c->ends, &end, sizeof(end));
+}
+
+static inline int
+beer_export_seterr(struct beer_export *e, enum beer_log_error error) {
+	e->error = error;
+	if (error == BEER_LOG_ESYSTEM)
+		e->errno_ = errno;
+	return -1;
+}
+
+int
+beer_export_init(struct beer_export *e, const char *path) {
+	memset(e, 0, sizeof(struct beer_export));
+	e->group_rows = BEER_EXPORT_GROUP_ROWS;
+	e->path = beer_mem_dup((char *)path);
+	if (e->path == NULL)
+		return -1;
+	return 0;
+}
+
+static char *
+beer_export_strdup(const char *str, uint32_t len) {
+	char *s = beer_mem_alloc(len + 1);
+	if (s == NULL)
+		return NULL;
+	memcpy(s, str, len);
+	s[len] = 0;
+	return s;
+}
+
+static struct beer_export_space *
+beer_export_space(struct beer_export *e, uint32_t id) {
+	/* spaces are sorted by id */
+	int lo = 0, hi = e->count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (e->spaces[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < e->count && e->spaces[lo].id == id)
+		return &e->spaces[lo];
+	if (e->count == e->top) {
+		int top = e->top ? e->top * 2 : 16;
+		struct beer_export_space *spaces = beer_mem_realloc(e->spaces,
+			sizeof(struct beer_export_space) * top);
+		if (spaces == NULL)
+			return NULL;
+		e->spaces = spaces;
+		e->top = top;
+	}
+	memmove(&e->spaces[lo + 1], &e->spaces[lo],
+		sizeof(struct beer_export_space) * (e->count - lo));
+	e->count++;
+	struct beer_export_space *s = &e->spaces[lo];
+	memset(s, 0, sizeof(struct beer_export_space));
+	s->id = id;
+	return s;
+}
+
+/* adds columns up to count, rows of current group are nulls there */
+static int
+beer_export_columns(struct beer_export_space *s, uint32_t count) {
+	if (count <= s->ncols)
+		return 0;
+	struct beer_export_column *cols = beer_mem_realloc(s->cols,
+		sizeof(struct beer_export_column) * count);
+	if (cols == NULL)
+		return -1;
+	s->cols = cols;
+	uint32_t i, j;
+	for (i = s->ncols; i < count; i++) {
+		struct beer_export_column *c = &s->cols[i];
+		memset(c, 0, sizeof(struct beer_export_column));
+		s->ncols = i + 1;
+		for (j = 0; j < s->rows; j++) {
+			if (beer_export_put(&c->values, "\xc0", 1) == -1 ||
+			    beer_export_put_end(c) == -1)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* replaces value with string, if it's a string */
+static int
+beer_export_str_value(const char **p, char **value) {
+	if (mp_typeof(**p) != MP_STR) {
+		mp_next(p);
+		return 0;
+	}
+	uint32_t len = 0;
+	const char *str = mp_decode_str(p, &len);
+	if (*value)
+		beer_mem_free(*value);
+	*value = beer_export_strdup(str, len);
+	return *value ? 0 : -1;
+}
+
+/* reads name and format of space from _space tuple:
+ * [id, owner, name, engine, field_count, flags, format] */
+static int
+beer_export_define(struct beer_export *e, const char *p) {
+	if (mp_typeof(*p) != MP_ARRAY)
+		return 0;
+	uint32_t n = mp_decode_array(&p);
+	if (n < 3 || mp_typeof(*p) != MP_UINT)
+		return 0;
+	uint32_t id = mp_decode_uint(&p);
+	mp_next(&p);
+	if (mp_typeof(*p) != MP_STR)
+		return 0;
+	uint32_t len = 0;
+	const char *name = mp_decode_str(&p, &len);
+	struct beer_export_space *s = beer_export_space(e, id);
+	if (s == NULL)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	if (s->name)
+		beer_mem_free(s->name);
+	s->name = beer_export_strdup(name, len);
+	if (s->name == NULL)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	if (n < 7)
+		return 0;
+	mp_next(&p);
+	mp_next(&p);
+	mp_next(&p);
+	if (mp_typeof(*p) != MP_ARRAY)
+		return 0;
+	uint32_t i, count = mp_decode_array(&p);
+	if (beer_export_columns(s, count) == -1)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	for (i = 0; i < count; i++) {
+		if (mp_typeof(*p) != MP_MAP) {
+			mp_next(&p);
+			continue;
+		}
+		struct beer_export_column *c = &s->cols[i];
+		uint32_t k, keys = mp_decode_map(&p);
+		for (k = 0; k < keys; k++) {
+			if (mp_typeof(*p) != MP_STR) {
+				mp_next(&p);
+				mp_next(&p);
+				continue;
+			}
+			const char *key = mp_decode_str(&p, &len);
+			int rc = 0;
+			if (len == 4 && memcmp(key, "name", 4) == 0)
+				rc = beer_export_str_value(&p, &c->name);
+			else if (len == 4 && memcmp(key, "type", 4) == 0)
+				rc = beer_export_str_value(&p, &c->type);
+			else
+				mp_next(&p);
+			if (rc == -1)
+				return beer_export_seterr(e, BEER_LOG_EMEMORY);
+		}
+	}
+	return 0;
+}
+
+static int
+beer_export_write(struct beer_export *e, struct beer_export_space *s,
+		  const void *data, size_t size) {
+	if (size && fwrite(data, size, 1, s->f) != 1)
+		return beer_export_seterr(e, BEER_LOG_ESYSTEM);
+	s->offset += size;
+	return 0;
+}
+
+static int
+beer_export_open(struct beer_export *e, struct beer_export_space *s) {
+	char name[NAME_MAX];
+	if (s->name && *s->name) {
+		/* space name is used as file name */
+		snprintf(name, sizeof(name) - 4, "%s", s->name);
+		char *p;
+		for (p = name; *p; p++)
+			if (*p == '/' || (p == name && *p == '.'))
+				*p = '_';
+	} else {
+		snprintf(name, sizeof(name), "space_%u", s->id);
+	}
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s.col", e->path, name);
+	s->f = fopen(path, "w");
+	if (s->f == NULL)
+		return beer_export_seterr(e, BEER_LOG_ESYSTEM);
+	return beer_export_write(e, s, BEER_EXPORT_MAGIC,
+				 BEER_EXPORT_MAGIC_SIZE);
+}
+
+static int
+beer_export_strcmp(const void *a, const void *b) {
+	const struct beer_export_str *x = a, *y = b;
+	uint32_t len = x->len < y->len ? x->len : y->len;
+	int rc = memcmp(x->data, y->data, len);
+	if (rc != 0)
+		return rc;
+	return (x->len > y->len) - (x->len < y->len);
+}
+
+enum beer_export_encoding {
+	BEER_EXPORT_NULL,
+	BEER_EXPORT_U64,
+	BEER_EXPORT_I64,
+	BEER_EXPORT_DOUBLE,
+	BEER_EXPORT_BOOL,
+	BEER_EXPORT_STR,
+	BEER_EXPORT_DICT,
+	BEER_EXPORT_MSGPACK
+};
+
+static const char *beer_export_encodings[] = {
+	"null", "u64", "i64", "double", "bool", "str", "dict", "msgpack"
+};
+
+/* numeric value of chunk as double, int64 or uint64 */
+union beer_export_num {
+	uint64_t u;
+	int64_t i;
+	double d;
+};
+
+static union beer_export_num
+beer_export_num(const char *p, enum beer_export_encoding enc) {
+	union beer_export_num v;
+	switch (mp_typeof(*p)) {
+	case MP_UINT:
+		if (enc == BEER_EXPORT_DOUBLE)
+			v.d = mp_decode_uint(&p);
+		else
+			v.u = mp_decode_uint(&p);
+		break;
+	case MP_INT:
+		if (enc == BEER_EXPORT_DOUBLE)
+			v.d = mp_decode_int(&p);
+		else
+			v.i = mp_decode_int(&p);
+		break;
+	case MP_FLOAT:
+		v.d = mp_decode_float(&p);
+		break;
+	default:
+		v.d = mp_decode_double(&p);
+		break;
+	}
+	return v;
+}
+
+/* chooses encoding, that keeps all values of chunk */
+static enum beer_export_encoding
+beer_export_classify(struct beer_export_column *c, uint32_t rows,
+		     uint32_t *nulls) {
+	int uint = 0, neg = 0, dbl = 0, str = 0, boolean = 0, other = 0;
+	int big = 0, inexact = 0;
+	uint32_t i, start = 0;
+	*nulls = 0;
+	for (i = 0; i < rows; i++) {
+		const char *p = c->values.data + start;
+		start = ((uint32_t *)c->ends.data)[i];
+		switch (mp_typeof(*p)) {
+		case MP_NIL:
+			(*nulls)++;
+			break;
+		case MP_UINT: {
+			uint64_t v = mp_decode_uint(&p);
+			uint = 1;
+			big |= v > INT64_MAX;
+			inexact |= (uint64_t)(double)v != v;
+			break;
+		}
+		case MP_INT: {
+			int64_t v = mp_decode_int(&p);
+			neg = 1;
+			inexact |= (int64_t)(double)v != v;
+			break;
+		}
+		case MP_FLOAT:
+		case MP_DOUBLE:
+			dbl = 1;
+			break;
+		case MP_STR:
+			str = 1;
+			break;
+		case MP_BOOL:
+			boolean = 1;
+			break;
+		default:
+			other = 1;
+			break;
+		}
+	}
+	if (*nulls == rows)
+		return BEER_EXPORT_NULL;
+	int num = uint || neg || dbl;
+	if (other || (str + boolean + (num != 0)) > 1)
+		return BEER_EXPORT_MSGPACK;
+	if (str)
+		return BEER_EXPORT_STR;
+	if (boolean)
+		return BEER_EXPORT_BOOL;
+	if (dbl)
+		return ((uint || neg) && inexact) ?
+			BEER_EXPORT_MSGPACK : BEER_EXPORT_DOUBLE;
+	if (neg)
+		return big ? BEER_EXPORT_MSGPACK : BEER_EXPORT_I64;
+	return BEER_EXPORT_U64;
+}
+
+static char *
+beer_export_encode_num(char *p, union beer_export_num v,
+		       enum beer_export_encoding enc) {
+	switch (enc) {
+	case BEER_EXPORT_U64:
+		return mp_encode_uint(p, v.u);
+	case BEER_EXPORT_I64:
+		return v.i < 0 ? mp_encode_int(p, v.i) :
+				 mp_encode_uint(p, v.i);
+	default:
+		return mp_encode_double(p, v.d);
+	}
+}
+
+/*
+ * Encodes chunk of column into out, and its metadata (msgpack map) into
+ * meta.
+ */
+static int
+beer_export_chunk(struct beer_export_column *c, uint32_t rows,
+		  uint64_t offset, struct beer_export_buf *out,
+		  struct beer_export_buf *meta) {
+	uint32_t nulls = 0, i, start = 0;
+	const uint32_t *ends = (const uint32_t *)c->ends.data;
+	enum beer_export_encoding enc = beer_export_classify(c, rows, &nulls);
+	out->size = 0;
+	size_t bitmap = (rows + 7) / 8;
+	/* validity bitmap */
+	if (nulls && enc != BEER_EXPORT_NULL) {
+		char *p = beer_export_reserve(out, bitmap);
+		if (p == NULL)
+			return -1;
+		memset(p, 0, bitmap);
+		for (i = 0; i < rows; i++) {
+			if (mp_typeof(c->values.data[start]) != MP_NIL)
+				p[i / 8] |= 1 << (i % 8);
+			start = ends[i];
+		}
+		out->size += bitmap;
+	}
+	char stats[64], *st = stats;
+	uint32_t nstats = 0, distinct = 0;
+	struct beer_export_str *strs = NULL;
+	switch (enc) {
+	case BEER_EXPORT_NULL:
+		break;
+	case BEER_EXPORT_U64:
+	case BEER_EXPORT_I64:
+	case BEER_EXPORT_DOUBLE: {
+		char *p = beer_export_reserve(out, (size_t)rows * 8);
+		if (p == NULL)
+			return -1;
+		union beer_export_num min, max, v;
+		min.u = max.u = 0;
+		int first = 1;
+		for (i = 0, start = 0; i < rows; i++, p += 8) {
+			const char *value = c->values.data + start;
+			start = ends[i];
+			if (mp_typeof(*value) == MP_NIL) {
+				beer_export_store_u64(p, 0);
+				continue;
+			}
+			v = beer_export_num(value, enc);
+			beer_export_store_u64(p, v.u);
+			int less, greater;
+			if (enc == BEER_EXPORT_U64) {
+				less = v.u < min.u;
+				greater = v.u > max.u;
+			} else if (enc == BEER_EXPORT_I64) {
+				less = v.i < min.i;
+				greater = v.i > max.i;
+			} else {
+				less = v.d < min.d;
+				greater = v.d > max.d;
+			}
+			if (first || less)
+				min = v;
+			if (first || greater)
+				max = v;
+			first = 0;
+		}
+		out->size += (size_t)rows * 8;
+		st = mp_encode_str(st, "min", 3);
+		st = beer_export_encode_num(st, min, enc);
+		st = mp_encode_str(st, "max", 3);
+		st = beer_export_encode_num(st, max, enc);
+		nstats = 2;
+		break;
+	}
+	case BEER_EXPORT_BOOL: {
+		char *p = beer_export_reserve(out, bitmap);
+		if (p == NULL)
+			return -1;
+		memset(p, 0, bitmap);
+		for (i = 0, start = 0; i < rows; i++) {
+			const char *value = c->values.data + start;
+			start = ends[i];
+			if (mp_typeof(*value) == MP_BOOL &&
+			    mp_decode_bool(&value))
+				p[i / 8] |= 1 << (i % 8);
+		}
+		out->size += bitmap;
+		break;
+	}
+	case BEER_EXPORT_STR:
+	case BEER_EXPORT_DICT: {
+		/* sorted strings give dictionary, min and max */
+		strs = beer_mem_alloc(sizeof(struct beer_export_str) * rows);
+		uint32_t *codes = beer_mem_alloc(sizeof(uint32_t) * rows);
+		if (strs == NULL || codes == NULL) {
+			if (strs)
+				beer_mem_free(strs);
+			if (codes)
+				beer_mem_free(codes);
+			return -1;
+		}
+		uint32_t n = 0;
+		size_t plain = 0, dict = 0;
+		for (i = 0, start = 0; i < rows; i++) {
+			const char *value = c->values.data + start;
+			start = ends[i];
+			codes[i] = 0;
+			if (mp_typeof(*value) == MP_NIL)
+				continue;
+			strs[n].data = mp_decode_str(&value, &strs[n].len);
+			strs[n].row = i;
+			plain += strs[n].len;
+			n++;
+		}
+		qsort(strs, n, sizeof(struct beer_export_str),
+		      beer_export_strcmp);
+		for (i = 0; i < n; i++) {
+			if (i == 0 || beer_export_strcmp(&strs[i - 1],
+							 &strs[i]) != 0) {
+				distinct++;
+				dict += sizeof(uint32_t) + strs[i].len;
+			}
+			codes[strs[i].row] = distinct - 1;
+		}
+		uint32_t width = distinct <= 0x100 ? 1 :
+				 (distinct <= 0x10000 ? 2 : 4);
+		dict += sizeof(uint32_t) + (size_t)width * rows;
+		plain += sizeof(uint32_t) * ((size_t)rows + 1);
+		int rc = 0;
+		if (dict < plain) {
+			enc = BEER_EXPORT_DICT;
+			rc = beer_export_put_u32(out, distinct);
+			for (i = 0; i < n && rc == 0; i++) {
+				if (i && beer_export_strcmp(&strs[i - 1],
+							    &strs[i]) == 0)
+					continue;
+				rc = beer_export_put_u32(out, strs[i].len);
+				if (rc == 0)
+					rc = beer_export_put(out, strs[i].data,
+							     strs[i].len);
+			}
+			char *p = rc ? NULL :
+				  beer_export_reserve(out, (size_t)width * rows);
+			if (p) {
+				for (i = 0; i < rows; i++, p += width) {
+					p[0] = codes[i];
+					if (width > 1)
+						p[1] = codes[i] >> 8;
+					if (width > 2) {
+						p[2] = codes[i] >> 16;
+						p[3] = codes[i] >> 24;
+					}
+				}
+				out->size += (size_t)width * rows;
+			} else {
+				rc = -1;
+			}
+		} else {
+			uint32_t end = 0;
+			rc = beer_export_put_u32(out, 0);
+			for (i = 0, start = 0; i < rows && rc == 0; i++) {
+				const char *value = c->values.data + start;
+				start = ends[i];
+				uint32_t len = 0;
+				if (mp_typeof(*value) != MP_NIL)
+					mp_decode_str(&value, &len);
+				end += len;
+				rc = beer_export_put_u32(out, end);
+			}
+			for (i = 0, start = 0; i < rows && rc == 0; i++) {
+				const char *value = c->values.data + start;
+				start = ends[i];
+				if (mp_typeof(*value) == MP_NIL)
+					continue;
+				uint32_t len = 0;
+				const char *str = mp_decode_str(&value, &len);
+				rc = beer_export_put(out, str, len);
+			}
+			distinct = 0;
+		}
+		beer_mem_free(codes);
+		if (rc == -1) {
+			beer_mem_free(strs);
+			return -1;
+		}
+		break;
+	}
+	case BEER_EXPORT_MSGPACK: {
+		int rc = beer_export_put_u32(out, 0);
+		for (i = 0; i < rows && rc == 0; i++)
+			rc = beer_export_put_u32(out, ends[i]);
+		if (rc == 0)
+			rc = beer_export_put(out, c->values.data,
+					     c->values.size);
+		if (rc == -1)
+			return -1;
+		break;
+	}
+	}
+	/* metadata of chunk */
+	size_t size = 128 + (st - stats);
+	if (strs && rows) {
+		uint32_t last = rows - nulls - 1;
+		size += mp_sizeof_str(strs[0].len) +
+			mp_sizeof_str(strs[last].len);
+	}
+	char *p = beer_export_reserve(meta, size);
+	if (p == NULL) {
+		if (strs)
+			beer_mem_free(strs);
+		return -1;
+	}
+	char *m = p;
+	m = mp_encode_map(m, 4 + nstats + (strs ? 2 : 0) + (distinct ? 1 : 0));
+	m = mp_encode_str(m, "encoding", 8);
+	m = mp_encode_str(m, beer_export_encodings[enc],
+			  strlen(beer_export_encodings[enc]));
+	m = mp_encode_str(m, "offset", 6);
+	m = mp_encode_uint(m, offset);
+	m = mp_encode_str(m, "size", 4);
+	m = mp_encode_uint(m, out->size);
+	m = mp_encode_str(m, "nulls", 5);
+	m = mp_encode_uint(m, nulls);
+	memcpy(m, stats, st - stats);
+	m += st - stats;
+	if (strs) {
+		uint32_t last = rows - nulls - 1;
+		m = mp_encode_str(m, "min", 3);
+		m = mp_encode_str(m, strs[0].data, strs[0].len);
+		m = mp_encode_str(m, "max", 3);
+		m = mp_encode_str(m, strs[last].data, strs[last].len);
+		beer_mem_free(strs);
+	}
+	if (distinct) {
+		m = mp_encode_str(m, "distinct", 8);
+		m = mp_encode_uint(m, distinct);
+	}
+	meta->size += m - p;
+	return 0;
+}
+
+/* writes column chunks of current group */
+static int
+beer_export_group(struct beer_export *e, struct beer_export_space *s) {
+	if (s->rows == 0)
+		return 0;
+	if (s->f == NULL && beer_export_open(e, s) == -1)
+		return -1;
+	struct beer_export_buf chunk;
+	memset(&chunk, 0, sizeof(chunk));
+	struct beer_export_buf *meta = &s->groups;
+	char *p = beer_export_reserve(meta, 32);
+	if (p == NULL)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	char *m = mp_encode_map(p, 2);
+	m = mp_encode_str(m, "rows", 4);
+	m = mp_encode_uint(m, s->rows);
+	m = mp_encode_str(m, "columns", 7);
+	m = mp_encode_array(m, s->ncols);
+	meta->size += m - p;
+	uint32_t i;
+	int rc = 0;
+	for (i = 0; i < s->ncols && rc == 0; i++) {
+		struct beer_export_column *c = &s->cols[i];
+		if (beer_export_chunk(c, s->rows, s->offset, &chunk,
+				      meta) == -1)
+			rc = beer_export_seterr(e, BEER_LOG_EMEMORY);
+		else
+			rc = beer_export_write(e, s, chunk.data, chunk.size);
+		c->values.size = 0;
+		c->ends.size = 0;
+	}
+	beer_export_buf_free(&chunk);
+	s->ngroups++;
+	s->rows = 0;
+	s->bytes = 0;
+	return rc;
+}
+
+int
+beer_export_row(struct beer_export *e, const struct beer_xrow *row) {
+	if (row->tuple == NULL)
+		return 0;
+	const char *p = row->tuple;
+	if (mp_check(&p, row->tuple_end) != 0)
+		return beer_export_seterr(e, BEER_LOG_ECORRUPT);
+	if (row->space_id == beer_sp_space &&
+	    beer_export_define(e, row->tuple) == -1)
+		return -1;
+	if (row->type != BEER_OP_INSERT && row->type != BEER_OP_REPLACE)
+		return 0;
+	if (row->space_id < BEER_EXPORT_SPACE_MIN && !e->system)
+		return 0;
+	p = row->tuple;
+	if (mp_typeof(*p) != MP_ARRAY)
+		return beer_export_seterr(e, BEER_LOG_ECORRUPT);
+	struct beer_export_space *s = beer_export_space(e, row->space_id);
+	if (s == NULL)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	uint32_t i, count = mp_decode_array(&p);
+	if (beer_export_columns(s, count) == -1)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	for (i = 0; i < s->ncols; i++) {
+		struct beer_export_column *c = &s->cols[i];
+		const char *value = p;
+		if (i < count)
+			mp_next(&p);
+		else
+			value = "\xc0";
+		size_t size = (i < count) ? (size_t)(p - value) : 1;
+		if (beer_export_put(&c->values, value, size) == -1 ||
+		    beer_export_put_end(c) == -1)
+			return beer_export_seterr(e, BEER_LOG_EMEMORY);
+		s->bytes += size;
+	}
+	s->rows++;
+	s->total++;
+	e->rows++;
+	if (s->rows >= e->group_rows || s->bytes >= BEER_EXPORT_GROUP_BYTES)
+		return beer_export_group(e, s);
+	return 0;
+}
+
+/* writes footer and closes file */
+static int
+beer_export_finish(struct beer_export *e, struct beer_export_space *s) {
+	if (beer_export_group(e, s) == -1)
+		return -1;
+	if (s->f == NULL)
+		return 0;
+	struct beer_export_buf footer;
+	memset(&footer, 0, sizeof(footer));
+	size_t size = 128 + (s->name ? strlen(s->name) : 0);
+	uint32_t i;
+	for (i = 0; i < s->ncols; i++) {
+		struct beer_export_column *c = &s->cols[i];
+		size += 64 + (c->name ? strlen(c->name) : 0) +
+			(c->type ? strlen(c->type) : 0);
+	}
+	char *p = beer_export_reserve(&footer, size);
+	if (p == NULL)
+		return beer_export_seterr(e, BEER_LOG_EMEMORY);
+	char *m = mp_encode_map(p, 5);
+	m = mp_encode_str(m, "space_id", 8);
+	m = mp_encode_uint(m, s->id);
+	m = mp_encode_str(m, "name", 4);
+	m = mp_encode_str(m, s->name ? s->name : "",
+			  s->name ? strlen(s->name) : 0);
+	m = mp_encode_str(m, "rows", 4);
+	m = mp_encode_uint(m, s->total);
+	m = mp_encode_str(m, "columns", 7);
+	m = mp_encode_array(m, s->ncols);
+	for (i = 0; i < s->ncols; i++) {
+		struct beer_export_column *c = &s->cols[i];
+		char name[32];
+		const char *n = c->name;
+		if (n == NULL) {
+			snprintf(name, sizeof(name), "field_%u", i + 1);
+			n = name;
+		}
+		const char *type = c->type ? c->type : "any";
+		m = mp_encode_map(m, 2);
+		m = mp_encode_str(m, "name", 4);
+		m = mp_encode_str(m, n, strlen(n));
+		m = mp_encode_str(m, "type", 4);
+		m = mp_encode_str(m, type, strlen(type));
+	}
+	m = mp_encode_str(m, "groups", 6);
+	m = mp_encode_array(m, s->ngroups);
+	footer.size = m - p;
+	int rc = -1;
+	if (beer_export_put(&footer, s->groups.data, s->groups.size) == -1 ||
+	    beer_export_put_u32(&footer, footer.size) == -1 ||
+	    beer_export_put(&footer, BEER_EXPORT_MAGIC,
+			    BEER_EXPORT_MAGIC_SIZE) == -1)
+		beer_export_seterr(e, BEER_LOG_EMEMORY);
+	else
+		rc = beer_export_write(e, s, footer.data, footer.size);
+	beer_export_buf_free(&footer);
+	if (fclose(s->f) != 0 && rc == 0)
+		rc = beer_export_seterr(e, BEER_LOG_ESYSTEM);
+	s->f = NULL;
+	return rc;
+}
+
+int
+beer_export_flush(struct beer_export *e) {
+	int i;
+	for (i = 0; i < e->count; i++)
+		if (beer_export_finish(e, &e->spaces[i]) == -1)
+			return -1;
+	return 0;
+}
+
+int
+beer_export_snapshot(struct beer_export *e, const char *file) {
+	struct beer_log l;
+	if (beer_log_open(&l, file, BEER_LOG_SNAPSHOT) != BEER_LOG_EOK) {
+		e->error = l.error;
+		e->errno_ = l.errno_;
+		return -1;
+	}
+	struct beer_xrow *row;
+	while ((row = beer_log_next(&l)) != NULL) {
+		if (beer_export_row(e, row) == -1) {
+			beer_log_close(&l);
+			return -1;
+		}
+	}
+	if (l.error != BEER_LOG_EOK) {
+		e->error = l.error;
+		e->errno_ = l.errno_;
+		beer_log_close(&l);
+		return -1;
+	}
+	beer_log_close(&l);
+	return beer_export_flush(e);
+}
+
+void
+beer_export_free(struct beer_export *e) {
+	int i;
+	for (i = 0; i < e->count; i++) {
+		struct beer_export_space *s = &e->spaces[i];
+		if (s->f)
+			fclose(s->f);
+		if (s->name)
+			beer_mem_free(s->name);
+		uint32_t j;
+		for (j = 0; j < s->ncols; j++) {
+			struct beer_export_column *c = &s->cols[j];
+			if (c->name)
+				beer_mem_free(c->name);
+			if (c->type)
+				beer_mem_free(c->type);
+			beer_export_buf_free(&c->values);
+			beer_export_buf_free(&c->ends);
+		}
+		if (s->cols)
+			beer_mem_free(s->cols);
+		beer_export_buf_free(&s->groups);
+	}
+	if (e->spaces)
+		beer_mem_free(e->spaces);
+	if (e->path)
+		beer_mem_free(e->path);
+	memset(e, 0, sizeof(struct beer_export));
+}
@@ -32,17 +32,21 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#include <third_party/crc32.h>
+#include <msgpuck.h>
+#include <crc32.h>
 
-#include <bee.h>
-#include <beer_log.h>
+#include <bee/bee.h>
+#include <beer/beer_log.h>
 
-enum beer_log_type beer_log_guess(char *file) {
+enum beer_log_type beer_log_guess(const char *file) {
 	if (file == NULL)
 		return BEER_LOG_XLOG;
 	char *ext = strrchr(file, '.');
@@ -63,172 +67,274 @@ beer_log_seterr(struct beer_log *l, enum beer_log_error e) {
 	return -1;
 }
 
-const uint32_t beer_log_marker_v11 = 0xba0babed;
-const uint32_t beer_log_marker_eof_v11 = 0x10adab1e;
-
+/*
+ * End of data. The last row may be incomplete, if server still writes the
+ * file, so reading is continued from its beginning next time.
+ */
 inline static int
-beer_log_eof(struct beer_log *l, char *data) {
-	uint32_t marker = 0;
-	if (data)
-		beer_mem_free(data);
-	/* checking eof condition */
-	if (ftello(l->fd) == l->offset + sizeof(beer_log_marker_eof_v11)) {
-		fseeko(l->fd, l->offset, SEEK_SET);
-		if (fread(&marker, sizeof(marker), 1, l->fd) != 1)
-			return beer_log_seterr(l, BEER_LOG_ESYSTEM);
-		else
-		if (marker != beer_log_marker_eof_v11)
-			return beer_log_seterr(l, BEER_LOG_ECORRUPT);
-		l->offset = ftello(l->fd);
-	}
-	/* eof */
+beer_log_eof(struct beer_log *l) {
+	if (ferror(l->fd))
+		return beer_log_seterr(l, BEER_LOG_ESYSTEM);
+	clearerr(l->fd);
+	fseeko(l->fd, l->current_offset, SEEK_SET);
 	return 1;
 }
 
-static int beer_log_read(struct beer_log *l, char **buf, uint32_t *size)
+static int
+beer_log_reserve(struct beer_log *l, size_t size) {
+	if (size <= l->buf_size)
+		return 0;
+	size_t buf_size = l->buf_size ? l->buf_size : 4096;
+	while (buf_size < size)
+		buf_size *= 2;
+	char *buf = beer_mem_realloc(l->buf, buf_size);
+	if (buf == NULL)
+		return beer_log_seterr(l, BEER_LOG_EMEMORY);
+	l->buf = buf;
+	l->buf_size = buf_size;
+	return 0;
+}
+
+static inline uint32_t
+beer_log_marker(const char *p) {
+	const unsigned char *u = (const unsigned char *)p;
+	return (uint32_t)u[0] << 24 | u[1] << 16 | u[2] << 8 | u[3];
+}
+
+/* decodes fields of fixed header after marker: length and crc32c of row */
+static int
+beer_log_fixheader_decode(const char *fixheader, uint32_t *size,
+			  uint32_t *crc32c)
+{
+	const char *p = fixheader + sizeof(uint32_t);
+	const char *end = fixheader + BEER_LOG_FIXHEADER_SIZE;
+	uint32_t i, fields[3];
+	for (i = 0; i < 3; i++) {
+		if (mp_typeof(*p) != MP_UINT || mp_check_uint(p, end) > 0)
+			return -1;
+		fields[i] = mp_decode_uint(&p);
+	}
+	/* fields are length, crc32c of previous row and crc32c of row */
+	*size = fields[0];
+	*crc32c = fields[2];
+	return 0;
+}
+
+static int
+beer_log_fixheader(struct beer_log *l, const char *fixheader, uint32_t *size)
+{
+	if (beer_log_fixheader_decode(fixheader, size,
+				      &l->current_crc32c) == -1)
+		return beer_log_seterr(l, BEER_LOG_ECORRUPT);
+	return 0;
+}
+
+static int beer_log_read(struct beer_log *l, uint32_t *size)
 {
 	/* current record offset (before marker) */
 	l->current_offset = ftello(l->fd);
 
 	/* reading marker */
-	char *data = NULL;
-	uint32_t marker = 0;
-	if (fread(&marker, sizeof(marker), 1, l->fd) != 1)
-		return beer_log_eof(l, data);
+	unsigned char fixheader[BEER_LOG_FIXHEADER_SIZE];
+	if (fread(fixheader, sizeof(uint32_t), 1, l->fd) != 1)
+		return beer_log_eof(l);
+	uint32_t marker = beer_log_marker((const char *)fixheader);
+	if (marker == BEER_LOG_MARKER_EOF) {
+		l->offset = ftello(l->fd);
+		return 1;
+	}
 
 	/* seeking for marker if necessary */
-	while (marker != beer_log_marker_v11) {
+	while (marker != BEER_LOG_MARKER) {
 		int c = fgetc(l->fd);
 		if (c == EOF)
-			return beer_log_eof(l, data);
-		marker = marker >> 8 | ((uint32_t) c & 0xff) <<
-			 (sizeof(marker) * 8 - 8);
+			return beer_log_eof(l);
+		marker = marker << 8 | ((uint32_t) c & 0xff);
 	}
 
-	/* reading header */
-	if (fread(&l->current.hdr, sizeof(l->current.hdr), 1, l->fd) != 1)
-		return beer_log_eof(l, data);
+	/* reading the rest of fixed header */
+	if (fread(fixheader + sizeof(uint32_t),
+		  BEER_LOG_FIXHEADER_SIZE - sizeof(uint32_t), 1, l->fd) != 1)
+		return beer_log_eof(l);
+	if (beer_log_fixheader(l, (const char *)fixheader, size) == -1)
+		return -1;
 
-	/* updating offset */
-	l->offset = ftello(l->fd);
+	/* reading data */
+	if (beer_log_reserve(l, *size) == -1)
+		return -1;
+	if (fread(l->buf, *size, 1, l->fd) != 1)
+		return beer_log_eof(l);
 
-	/* checking header crc, starting from lsn */
-	uint32_t crc32_hdr =
-		crc32c(0, (unsigned char*)&l->current.hdr + sizeof(uint32_t),
-		       sizeof(struct beer_log_header_v11) -
-		       sizeof(uint32_t));
-	if (crc32_hdr != l->current.hdr.crc32_hdr)
+	/* checking data crc */
+	if (crc32c(0, (unsigned char*)l->buf, *size) != l->current_crc32c)
 		return beer_log_seterr(l, BEER_LOG_ECORRUPT);
 
-	/* allocating memory and reading data */
-	data = beer_mem_alloc(l->current.hdr.len);
-	if (data == NULL)
-		return beer_log_seterr(l, BEER_LOG_EMEMORY);
-	if (fread(data, l->current.hdr.len, 1, l->fd) != 1)
-		return beer_log_eof(l, data);
+	/* updating offset */
+	l->offset = ftello(l->fd);
+	return 0;
+}
 
-	/* checking data crc */
-	uint32_t crc32_data = crc32c(0, (unsigned char*)data, l->current.hdr.len);
-	if (crc32_data != l->current.hdr.crc32_data) {
-		beer_mem_free(data);
-		return beer_log_seterr(l, BEER_LOG_ECORRUPT);
+
+/*
+ * Seeking for marker in mapped data. First byte of marker is found with
+ * memchr(), that scans a word (or a vector) at a time.
+ */
+static const char *
+beer_log_find_marker(const char *p, const char *end) {
+	while (end - p >= (ptrdiff_t)sizeof(uint32_t)) {
+		p = memchr(p, BEER_LOG_MARKER >> 24,
+			   end - p - sizeof(uint32_t) + 1);
+		if (p == NULL)
+			return NULL;
+		if (beer_log_marker(p) == BEER_LOG_MARKER)
+			return p;
+		p++;
 	}
+	return NULL;
+}
 
-	*buf = data;
-	*size = l->current.hdr.len;
+static int
+beer_log_map(struct beer_log *l, size_t size) {
+	void *map = mmap(NULL, size, PROT_READ, MAP_SHARED,
+			 fileno(l->fd), 0);
+	if (map == MAP_FAILED)
+		return -1;
+	/* rows are read once, from beginning to end */
+	madvise(map, size, MADV_SEQUENTIAL);
+	l->map = map;
+	l->map_size = size;
 	return 0;
 }
 
+/*
+ * Extends mapping, if file was written since it was mapped.
+ * Returns 1 if mapping was extended.
+ */
+static int
+beer_log_remap(struct beer_log *l) {
+	struct stat st;
+	if (fstat(fileno(l->fd), &st) == -1)
+		return beer_log_seterr(l, BEER_LOG_ESYSTEM);
+	if ((size_t)st.st_size <= l->map_size)
+		return 0;
+	munmap((void *)l->map, l->map_size);
+	l->map = NULL;
+	if (beer_log_map(l, st.st_size) == -1)
+		return beer_log_seterr(l, BEER_LOG_ESYSTEM);
+	return 1;
+}
+
+/*
+ * Reads row in place of mapping. Returns 2, if the row is incomplete.
+ */
 static int
-beer_log_process_xlog(struct beer_log *l, char *buf, uint32_t size,
-		     union beer_log_value *value)
+beer_log_read_span(struct beer_log *l, const char **data, uint32_t *size)
 {
-	(void)size;
-	/* copying row data */
-	memcpy(&l->current.row, buf, sizeof(l->current.row));
-
-	/* preparing pseudo iproto header */
-	struct beer_header hdr_iproto;
-	hdr_iproto.type = l->current.row.op;
-	hdr_iproto.len = l->current.hdr.len - sizeof(l->current.row);
-	hdr_iproto.reqid = 0;
-
-	/* deserializing operation */
-	beer_request_init(&value->r);
-	size_t off = 0;
-	int rc = beer_request(&value->r,
-			     buf + sizeof(l->current.row),
-			     l->current.hdr.len - sizeof(l->current.row),
-			     &off,
-			     &hdr_iproto);
-
-	/* in case of not completed request or parsing error */
-	if (rc != 0)
+	const char *p = l->map + l->offset;
+	const char *end = l->map + l->map_size;
+	l->current_offset = l->offset;
+	if (end - p < (ptrdiff_t)sizeof(uint32_t))
+		return 2;
+	uint32_t marker = beer_log_marker(p);
+	if (marker == BEER_LOG_MARKER_EOF) {
+		l->offset += sizeof(uint32_t);
+		return 1;
+	}
+	if (marker != BEER_LOG_MARKER) {
+		p = beer_log_find_marker(p, end);
+		if (p == NULL)
+			return 2;
+	}
+	if (end - p < BEER_LOG_FIXHEADER_SIZE)
+		return 2;
+	if (beer_log_fixheader(l, p, size) == -1)
+		return -1;
+	p += BEER_LOG_FIXHEADER_SIZE;
+	if ((size_t)(end - p) < *size)
+		return 2;
+	/* checking data crc, right in the mapping */
+	if (crc32c(0, (const unsigned char *)p, *size) != l->current_crc32c)
 		return beer_log_seterr(l, BEER_LOG_ECORRUPT);
+	*data = p;
+	l->offset = (p - l->map) + *size;
 	return 0;
 }
 
 static int
-beer_log_process_snapshot(struct beer_log *l, char *buf, uint32_t size,
-		         union beer_log_value *value)
+beer_log_read_map(struct beer_log *l, const char **data, uint32_t *size)
 {
-	(void)size;
-
-	/* freeing previously allocated tuple */
-	beer_tuple_free(&value->t);
-
-	/* copying snapshot row data */
-	memcpy(&l->current.row_snap, buf, sizeof(l->current.row_snap));
-
-	/* reading and validating tuple */
-	struct beer_tuple *tu =
-		beer_tuple_set_as(&value->t, buf + sizeof(l->current.row_snap),
-				 l->current.row_snap.data_size,
-				 l->current.row_snap.tuple_size);
-	if (tu == NULL)
-		return beer_log_seterr(l, BEER_LOG_ECORRUPT);
-
-	return (tu) ? 0 : -1;
+	int rc = beer_log_read_span(l, data, size);
+	if (rc != 2)
+		return rc;
+	/* the last row is incomplete, unless file has grown */
+	if (!l->follow)
+		return 1;
+	rc = beer_log_remap(l);
+	if (rc != 1)
+		return rc == -1 ? -1 : 1;
+	rc = beer_log_read_span(l, data, size);
+	return rc == 2 ? 1 : rc;
 }
 
-struct beer_log_row*
-beer_log_next_to(struct beer_log *l, union beer_log_value *value) {
-	char *buf = NULL;
+struct beer_xrow *beer_log_next(struct beer_log *l) {
+	l->error = BEER_LOG_EOK;
+	const char *data = NULL;
 	uint32_t size = 0;
-	int rc = l->read(l, &buf, &size);
+	int rc = l->map ? beer_log_read_map(l, &data, &size) :
+			  beer_log_read(l, &size);
 	if (rc != 0)
 		return NULL;
-	rc = l->process(l, buf, size, value);
-	if (rc != 0) {
-		beer_mem_free(buf);
+	if (l->map == NULL)
+		data = l->buf;
+	if (beer_xrow_decode(&l->current, data, size) == -1) {
+		beer_log_seterr(l, BEER_LOG_ECORRUPT);
 		return NULL;
 	}
-	if (l->type == BEER_LOG_XLOG) {
-		beer_request_setorigin(&value->r, buf, size);
-	} else {
-		beer_mem_free(buf);
-	}
+	beer_vclock_follow(&l->vclock, &l->current);
 	return &l->current;
 }
 
-struct beer_log_row *beer_log_next(struct beer_log *l) {
-	return beer_log_next_to(l, &l->current_value);
-}
-
 inline static int
 beer_log_open_err(struct beer_log *l, enum beer_log_error e) {
 	beer_log_seterr(l, e);
 	beer_log_close(l);
-	return -1;
+	return e;
+}
+
+/* parses "{1: 10, 2: 15}" */
+static int
+beer_log_parse_vclock(struct beer_log *l, const char *str) {
+	const char *p = strchr(str, '{');
+	if (p == NULL)
+		return -1;
+	p++;
+	for (;;) {
+		while (*p == ' ' || *p == ',')
+			p++;
+		if (*p == '}')
+			return 0;
+		char *next;
+		unsigned long long id = strtoull(p, &next, 10);
+		if (next == p || *next != ':' || id >= BEER_VCLOCK_MAX)
+			return -1;
+		p = next + 1;
+		unsigned long long lsn = strtoull(p, &next, 10);
+		if (next == p)
+			return -1;
+		l->vclock.lsn[id] = lsn;
+		p = next;
+	}
 }
 
 enum beer_log_error
-beer_log_open(struct beer_log *l, char *file, enum beer_log_type type)
+beer_log_open(struct beer_log *l, const char *file, enum beer_log_type type)
 {
 	char filetype[32];
 	char version[32];
 	char *rc, *magic = "\0";
+	memset(l, 0, sizeof(struct beer_log));
 	l->type = type;
+	l->follow = 1;
 	/* trying to open file */
 	if (file) {
 		l->fd = fopen(file, "r");
@@ -245,17 +351,13 @@ beer_log_open(struct beer_log *l, char *file, enum beer_log_type type)
 	rc = fgets(version, sizeof(version), l->fd);
 	if (rc == NULL)
 		return beer_log_open_err(l, BEER_LOG_ESYSTEM);
-	/* checking file type and setting read/process
-	 * interfaces */
-	l->read = beer_log_read;
+	/* checking file type */
 	switch (type) {
 	case BEER_LOG_XLOG:
 		magic = BEER_LOG_MAGIC_XLOG;
-		l->process = beer_log_process_xlog;
 		break;
 	case BEER_LOG_SNAPSHOT:
 		magic = BEER_LOG_MAGIC_SNAP;
-		l->process = beer_log_process_snapshot;
 		break;
 	case BEER_LOG_NONE:
 		break;
@@ -263,8 +365,10 @@ beer_log_open(struct beer_log *l, char *file, enum beer_log_type type)
 	if (strcmp(filetype, magic))
 		return beer_log_open_err(l, BEER_LOG_ETYPE);
 	/* checking version */
-	if (strcmp(version, BEER_LOG_VERSION))
+	if (strcmp(version, BEER_LOG_VERSION) &&
+	    strcmp(version, BEER_LOG_VERSION_13))
 		return beer_log_open_err(l, BEER_LOG_EVERSION);
+	/* reading meta, up to empty line */
 	for (;;) {
 		char buf[256];
 		rc = fgets(buf, sizeof(buf), l->fd);
@@ -272,23 +376,68 @@ beer_log_open(struct beer_log *l, char *file, enum beer_log_type type)
 			return beer_log_open_err(l, BEER_LOG_EFAIL);
 		if (strcmp(rc, "\n") == 0 || strcmp(rc, "\r\n") == 0)
 			break;
+		if (strncmp(buf, "Server: ", 8) == 0 ||
+		    strncmp(buf, "Instance: ", 10) == 0) {
+			const char *uuid = strchr(buf, ' ') + 1;
+			size_t len = strcspn(uuid, "\r\n");
+			if (len > BEER_UUID_STR_LEN)
+				len = BEER_UUID_STR_LEN;
+			memcpy(l->server_uuid, uuid, len);
+			l->server_uuid[len] = 0;
+		} else if (strncmp(buf, "VClock: ", 8) == 0) {
+			if (beer_log_parse_vclock(l, buf + 8) == -1)
+				return beer_log_open_err(l, BEER_LOG_ECORRUPT);
+		}
 	}
 	/* getting current offset */
 	l->offset = ftello(l->fd);
-	l->current_offset = 0;
-	memset(&l->current_value, 0, sizeof(l->current_value));
-	return 0;
+	l->current_offset = l->offset;
+	/* mapping regular file, others are read with stdio */
+	struct stat st;
+	if (fstat(fileno(l->fd), &st) == 0 && S_ISREG(st.st_mode) &&
+	    (uint64_t)st.st_size == (size_t)st.st_size)
+		beer_log_map(l, st.st_size);
+	return BEER_LOG_EOK;
 }
 
 void beer_log_close(struct beer_log *l) {
+	if (l->map)
+		munmap((void *)l->map, l->map_size);
+	l->map = NULL;
+	l->map_size = 0;
 	if (l->fd && l->fd != stdin)
 		fclose(l->fd);
 	l->fd = NULL;
+	if (l->buf)
+		beer_mem_free(l->buf);
+	l->buf = NULL;
+	l->buf_size = 0;
+}
+
+off_t beer_log_find(struct beer_log *l, off_t offset)
+{
+	if (l->map == NULL || offset < 0 || (size_t)offset >= l->map_size)
+		return -1;
+	const char *p = l->map + offset, *end = l->map + l->map_size;
+	/* marker bytes may be found in data, so the row after it is checked */
+	while ((p = beer_log_find_marker(p, end)) != NULL) {
+		uint32_t size, crc;
+		const char *data = p + BEER_LOG_FIXHEADER_SIZE;
+		if (end - p >= BEER_LOG_FIXHEADER_SIZE &&
+		    beer_log_fixheader_decode(p, &size, &crc) == 0 &&
+		    size <= (size_t)(end - data) &&
+		    crc32c(0, (const unsigned char *)data, size) == crc)
+			return p - l->map;
+		p++;
+	}
+	return -1;
 }
 
-int beer_log_seek(struct beer_log *l, off_t offset) 
+int beer_log_seek(struct beer_log *l, off_t offset)
 {
 	l->offset = offset;
+	if (l->map)
+		return 0;
 	return fseeko(l->fd, offset, SEEK_SET);
 }
 
@@ -301,14 +450,14 @@ struct beer_log_error_desc {
 	char *desc;
 };
 
-static struct beer_log_error_desc beer_log_error_list[] = 
+static struct beer_log_error_desc beer_log_error_list[] =
 {
 	{ BEER_LOG_EOK,      "ok"                                },
 	{ BEER_LOG_EFAIL,    "fail"                              },
 	{ BEER_LOG_EMEMORY,  "memory allocation failed"          },
 	{ BEER_LOG_ETYPE,    "file type mismatch"                },
 	{ BEER_LOG_EVERSION, "file version mismatch"             },
-	{ BEER_LOG_ECORRUPT, "file crc failed or bad eof marker" },
+	{ BEER_LOG_ECORRUPT, "file crc failed or bad row"        },
 	{ BEER_LOG_ESYSTEM,  "system error"                      },
 	{ BEER_LOG_LAST,      NULL                               }
 };
@@ -32,66 +32,117 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <time.h>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 
-#include <bee.h>
-#include <beer_net.h>
-#include <beer_io.h>
-#include <beer_log.h>
-#include <beer_rpl.h>
+#include <msgpuck.h>
 
-static const uint32_t beer_rpl_version = 11;
+#include <bee/bee.h>
+#include <beer/beer_net.h>
+#include <beer/beer_io.h>
+#include <beer/beer_rpl.h>
+
+/* system space with cluster uuid */
+#define BEER_RPL_SPACE_SCHEMA 272
 
 static void beer_rpl_free(struct beer_stream *s) {
 	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
-	if (sr->net) {
-		/* network stream should not be free'd here */
-		sr->net = NULL;
-	}
+	/* network stream should not be free'd here */
+	sr->net = NULL;
+	if (sr->buf)
+		beer_mem_free(sr->buf);
 	beer_mem_free(s->data);
+	s->data = NULL;
 }
 
-static ssize_t
-beer_rpl_recv_cb(struct beer_stream *s, char *buf, ssize_t size) {
-	struct beer_stream_net *sn = BEER_SNET_CAST(s);
-	return beer_io_recv(sn, buf, size);
+static int
+beer_rpl_error(struct beer_stream *s, enum beer_error e) {
+	BEER_SNET_CAST(BEER_RPL_CAST(s)->net)->error = e;
+	return -1;
 }
 
+/*
+ * Rows are decoded in place of receive buffer. Row that doesn't fit into
+ * the buffer (or if there's no buffer) is copied out.
+ */
 static int
-beer_rpl_request(struct beer_stream *s, struct beer_request *r)
+beer_rpl_recv(struct beer_stream *s, const char **data, size_t *size)
 {
 	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
 	struct beer_stream_net *sn = BEER_SNET_CAST(sr->net);
-	/* fetching header */
-	if (beer_io_recv(sn, (char*)&sr->hdr, sizeof(sr->hdr)) == -1)
+	size_t frame = 0;
+	int rc = beer_io_peek(sn, &frame);
+	if (rc == -1)
 		return -1;
-	/* fetching row header */
-	if (beer_io_recv(sn, (char*)&sr->row, sizeof(sr->row)) == -1)
+	if (rc == 0) {
+		*data = sn->rbuf.buf + sn->rbuf.off + 5;
+		*size = frame - 5;
+		sn->rbuf.off += frame;
+		return 0;
+	}
+	char length[9];
+	if (beer_io_recv(sn, length, 5) == -1)
 		return -1;
-	/* preparing pseudo iproto header */
-	struct beer_header hdr_iproto;
-	hdr_iproto.type = sr->row.op;
-	hdr_iproto.len = sr->hdr.len - sizeof(struct beer_log_row_v11);
-	hdr_iproto.reqid = 0;
-	/* deserializing operation */
-	if (beer_request_from(r, (beer_request_t)beer_rpl_recv_cb,
-			     sr->net,
-			     &hdr_iproto) == -1)
+	const char *p = length;
+	if (mp_typeof(*p) != MP_UINT)
+		return beer_rpl_error(s, BEER_EFAIL);
+	*size = mp_decode_uint(&p);
+	if (*size > sr->buf_size) {
+		char *buf = beer_mem_realloc(sr->buf, *size);
+		if (buf == NULL)
+			return beer_rpl_error(s, BEER_EMEMORY);
+		sr->buf = buf;
+		sr->buf_size = *size;
+	}
+	if (beer_io_recv(sn, sr->buf, *size) == -1)
 		return -1;
+	*data = sr->buf;
 	return 0;
 }
 
+static int
+beer_rpl_read_row(struct beer_stream *s, struct beer_xrow *row)
+{
+	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
+	if (sr->net == NULL || sr->state == BEER_RPL_NONE)
+		return -1;
+	while (1) {
+		const char *data = NULL;
+		size_t size = 0;
+		if (beer_rpl_recv(s, &data, &size) == -1)
+			return -1;
+		if (beer_xrow_decode(row, data, size) == -1)
+			return beer_rpl_error(s, BEER_EFAIL);
+		if (BEER_XROW_ERROR(row))
+			return beer_rpl_error(s, BEER_EFAIL);
+		if (row->type != 0) {
+			beer_vclock_follow(&sr->vclock, row);
+			return 0;
+		}
+		/* join is finished with vclock of snapshot */
+		if (sr->state == BEER_RPL_JOIN) {
+			sr->state = BEER_RPL_NONE;
+			if (row->vclock &&
+			    beer_vclock_decode(&sr->vclock, row->vclock,
+					       row->vclock_end) == -1)
+				return beer_rpl_error(s, BEER_EFAIL);
+			return 1;
+		}
+		/* other replies are skipped */
+	}
+}
+
 /*
  * beer_rpl()
  *
  * create and initialize replication stream;
  *
  * s - stream pointer, maybe NULL
- * 
- * if stream pointer is NULL, then new stream will be created. 
+ *
+ * if stream pointer is NULL, then new stream will be created.
  *
  * returns stream pointer, or NULL on error.
 */
@@ -108,15 +159,15 @@ struct beer_stream *beer_rpl(struct beer_stream *s)
 	memset(s->data, 0, sizeof(struct beer_stream_rpl));
 	/* initializing interfaces */
 	s->read = NULL;
-	s->read_request = beer_rpl_request;
+	s->read_row = beer_rpl_read_row;
 	s->read_reply = NULL;
-	s->read_tuple = NULL;
 	s->write = NULL;
 	s->writev = NULL;
 	s->free = beer_rpl_free;
 	/* initializing internal data */
 	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
 	sr->net = NULL;
+	sr->state = BEER_RPL_NONE;
 	return s;
 error:
 	if (s->data) {
@@ -128,53 +179,216 @@ error:
 	return NULL;
 }
 
+static int
+beer_rpl_uuid_valid(const char *uuid) {
+	if (strlen(uuid) != BEER_UUID_STR_LEN)
+		return 0;
+	int i;
+	for (i = 0; i < BEER_UUID_STR_LEN; i++) {
+		int dash = (i == 8 || i == 13 || i == 18 || i == 23);
+		if (dash != (uuid[i] == '-'))
+			return 0;
+		if (!dash && strchr("0123456789abcdefABCDEF", uuid[i]) == NULL)
+			return 0;
+	}
+	return 1;
+}
+
 /*
- * beer_rpl_open()
+ * beer_rpl_set_uuid()
+ *
+ * set uuid of replica;
+ *
+ * s    - replication stream pointer
+ * uuid - uuid string
+ *
+ * returns 0 on success, or -1 on bad uuid.
+*/
+int beer_rpl_set_uuid(struct beer_stream *s, const char *uuid) {
+	if (!beer_rpl_uuid_valid(uuid))
+		return -1;
+	memcpy(BEER_RPL_CAST(s)->server_uuid, uuid, BEER_UUID_STR_LEN + 1);
+	return 0;
+}
+
+/* random (version 4) uuid */
+static void
+beer_rpl_uuid_generate(char *uuid) {
+	unsigned char b[16];
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd == -1 || read(fd, b, sizeof(b)) != sizeof(b)) {
+		unsigned int seed = time(NULL) ^ getpid();
+		size_t i;
+		for (i = 0; i < sizeof(b); i++)
+			b[i] = rand_r(&seed);
+	}
+	if (fd != -1)
+		close(fd);
+	b[6] = (b[6] & 0x0f) | 0x40;
+	b[8] = (b[8] & 0x3f) | 0x80;
+	snprintf(uuid, BEER_UUID_STR_LEN + 1,
+		 "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-"
+		 "%02x%02x%02x%02x%02x%02x",
+		 b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9],
+		 b[10], b[11], b[12], b[13], b[14], b[15]);
+}
+
+static int
+beer_rpl_connect(struct beer_stream *s) {
+	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
+	if (sr->net == NULL)
+		return -1;
+	struct beer_stream_net *sn = BEER_SNET_CAST(sr->net);
+	if (sn->state == BEER_NET_READY)
+		return 0;
+	return beer_connect(sr->net);
+}
+
+/* sends request of type with header and body encoded by caller */
+static int
+beer_rpl_send(struct beer_stream *s, const char *body, size_t body_size,
+	      uint32_t type) {
+	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
+	struct beer_stream_net *sn = BEER_SNET_CAST(sr->net);
+	char header[32];
+	char *p = header + 5;
+	p = mp_encode_map(p, 2);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, type);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_uint(p, sr->net->reqid++);
+	*header = 0xce;
+	mp_store_u32(header + 1, (p - header - 5) + body_size);
+	if (beer_io_send(sn, header, p - header) == -1 ||
+	    beer_io_send(sn, body, body_size) == -1 ||
+	    beer_io_flush(sn) == -1)
+		return -1;
+	return 0;
+}
+
+/*
+ * beer_rpl_join()
  *
- * connect to a server and initialize handshake;
+ * connect to a server and request snapshot;
  *
- * s   - replication stream pointer
- * lsn - start lsn 
+ * s - replication stream pointer
  *
  * network stream must be properly initialized before
- * this function called (see tbeer_rpl_net, beer_set).
- * 
+ * this function called (see beer_rpl_attach, beer_set).
+ *
  * returns 0 on success, or -1 on error.
 */
-int beer_rpl_open(struct beer_stream *s, uint64_t lsn)
+int beer_rpl_join(struct beer_stream *s)
 {
 	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
-	/* intializing connection */
-	if (beer_init(sr->net) == -1)
+	if (beer_rpl_connect(s) == -1)
 		return -1;
-	if (beer_connect(sr->net) == -1)
+	if (sr->server_uuid[0] == 0)
+		beer_rpl_uuid_generate(sr->server_uuid);
+	char body[64];
+	char *p = mp_encode_map(body, 1);
+	p = mp_encode_uint(p, BEER_SERVER_UUID);
+	p = mp_encode_str(p, sr->server_uuid, BEER_UUID_STR_LEN);
+	if (beer_rpl_send(s, body, p - body, BEER_OP_JOIN) == -1)
 		return -1;
-	/* sending initial lsn */
-	struct beer_stream_net *sn = BEER_SNET_CAST(sr->net);
-	if (beer_io_send_raw(sn, (char*)&lsn, sizeof(lsn), 1) == -1)
+	memset(&sr->vclock, 0, sizeof(struct beer_vclock));
+	sr->state = BEER_RPL_JOIN;
+	return 0;
+}
+
+/* reads cluster uuid from _schema space */
+static int
+beer_rpl_cluster_uuid(struct beer_stream *s) {
+	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
+	struct beer_stream *key = beer_object(NULL);
+	if (key == NULL)
+		return beer_rpl_error(s, BEER_EMEMORY);
+	beer_object_format(key, "[%s]", "cluster");
+	ssize_t rc = beer_select(sr->net, BEER_RPL_SPACE_SCHEMA, 0, 1, 0,
+				BEER_ITER_EQ, key);
+	beer_stream_free(key);
+	if (rc == -1 || beer_flush(sr->net) == -1)
 		return -1;
-	/* reading and checking version */
-	uint32_t version = 0;
-	if (beer_io_recv_raw(sn, (char*)&version, sizeof(version), 1) == -1)
+	struct beer_reply r;
+	beer_reply_init(&r);
+	if (sr->net->read_reply(sr->net, &r) != 0) {
+		beer_reply_free(&r);
 		return -1;
-	if (version != beer_rpl_version)
+	}
+	rc = -1;
+	const char *p = r.data;
+	uint32_t len = 0;
+	/* [["cluster", "uuid"]] */
+	if (r.code == 0 && p && mp_decode_array(&p) > 0 &&
+	    mp_typeof(*p) == MP_ARRAY && mp_decode_array(&p) > 1) {
+		mp_next(&p);
+		if (mp_typeof(*p) == MP_STR) {
+			const char *uuid = mp_decode_str(&p, &len);
+			if (len == BEER_UUID_STR_LEN) {
+				memcpy(sr->cluster_uuid, uuid, len);
+				sr->cluster_uuid[len] = 0;
+				rc = 0;
+			}
+		}
+	}
+	beer_reply_free(&r);
+	if (rc == -1)
+		return beer_rpl_error(s, BEER_EFAIL);
+	return 0;
+}
+
+/*
+ * beer_rpl_open()
+ *
+ * connect to a server and subscribe;
+ *
+ * s      - replication stream pointer
+ * vclock - vclock to start from, maybe NULL
+ *
+ * network stream must be properly initialized before
+ * this function called (see beer_rpl_attach, beer_set).
+ *
+ * returns 0 on success, or -1 on error.
+*/
+int beer_rpl_open(struct beer_stream *s, const struct beer_vclock *vclock)
+{
+	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
+	if (!beer_rpl_uuid_valid(sr->server_uuid))
 		return -1;
+	if (beer_rpl_connect(s) == -1)
+		return -1;
+	if (sr->cluster_uuid[0] == 0 && beer_rpl_cluster_uuid(s) == -1)
+		return -1;
+	if (vclock)
+		sr->vclock = *vclock;
+	else
+		memset(&sr->vclock, 0, sizeof(struct beer_vclock));
+	char body[128 + BEER_VCLOCK_MAX * 20];
+	char *p = mp_encode_map(body, 3);
+	p = mp_encode_uint(p, BEER_CLUSTER_UUID);
+	p = mp_encode_str(p, sr->cluster_uuid, BEER_UUID_STR_LEN);
+	p = mp_encode_uint(p, BEER_SERVER_UUID);
+	p = mp_encode_str(p, sr->server_uuid, BEER_UUID_STR_LEN);
+	p = mp_encode_uint(p, BEER_VCLOCK);
+	p = beer_vclock_encode(&sr->vclock, p);
+	if (beer_rpl_send(s, body, p - body, BEER_OP_SUBSCRIBE) == -1)
+		return -1;
+	sr->state = BEER_RPL_SUBSCRIBE;
 	return 0;
 }
 
 /*
  * beer_rpl_close()
  *
- * close a connection; 
+ * close a connection;
  *
  * s - replication stream pointer
- * 
- * returns 0 on success, or -1 on error.
 */
 void beer_rpl_close(struct beer_stream *s) {
 	struct beer_stream_rpl *sr = BEER_RPL_CAST(s);
 	if (sr->net)
-		beer_close(s);
+		beer_close(sr->net);
+	sr->state = BEER_RPL_NONE;
 }
 
 /*
@@ -0,0 +1,469 @@
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include <bee/bee.h>
+#include <beer/beer_scan.h>
+
+/* count of rows in batch of ordered mode */
+#define BEER_SCAN_BATCH 256
+/* count of batches, that worker may read ahead per range */
+#define BEER_SCAN_QUEUE 4
+/*
+ * count of ranges per worker, that are taken but not delivered yet (ordered
+ * mode), every one holds an open file and its mapping
+ */
+#define BEER_SCAN_AHEAD 2
+
+struct beer_scan_batch {
+	struct beer_scan_batch *next;
+	int count;
+	struct beer_xrow rows[BEER_SCAN_BATCH];
+};
+
+/* range of file, that is read by one worker */
+struct beer_scan_chunk {
+	int file;
+	off_t start;
+	off_t end;
+	struct beer_log log;
+	int opened;
+	/* batches, that are read but not delivered (ordered mode) */
+	struct beer_scan_batch *head, *tail;
+	int queued;
+	int done;
+};
+
+struct beer_scan_ctx {
+	struct beer_scan *s;
+	beer_scan_f cb;
+	void *arg;
+	struct beer_scan_chunk *chunks;
+	int count;
+	int top;
+	int next; /* next chunk to read */
+	int held; /* chunks taken, but not delivered (ordered mode) */
+	int held_max;
+	int stop; /* error or callback stopped the scan */
+	int rc;
+	struct beer_scan_batch *free;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+struct beer_scan_worker {
+	struct beer_scan_ctx *ctx;
+	int id;
+	pthread_t thread;
+};
+
+void
+beer_scan_init(struct beer_scan *s, struct beer_dir *dir,
+	       enum beer_scan_order order) {
+	memset(s, 0, sizeof(struct beer_scan));
+	s->dir = dir;
+	s->order = order;
+	s->chunk_size = BEER_SCAN_CHUNK;
+	s->file = -1;
+}
+
+static int
+beer_scan_open(struct beer_scan_ctx *ctx, struct beer_log *l, int file) {
+	struct beer_dir *d = ctx->s->dir;
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", d->path, d->files[file].name);
+	enum beer_log_type type = (d->type == BEER_DIR_XLOG) ?
+		BEER_LOG_XLOG : BEER_LOG_SNAPSHOT;
+	if (beer_log_open(l, path, type) != BEER_LOG_EOK)
+		return -1;
+	/* rows point into the mapping, so it must not be moved */
+	if (l->map == NULL) {
+		l->error = BEER_LOG_EFAIL;
+		beer_log_close(l);
+		return -1;
+	}
+	l->follow = 0;
+	return 0;
+}
+
+/* must be called with lock held */
+static void
+beer_scan_fail(struct beer_scan_ctx *ctx, struct beer_log *l, int file) {
+	if (ctx->stop)
+		return;
+	ctx->stop = 1;
+	ctx->rc = -1;
+	ctx->s->error = l->error;
+	ctx->s->errno_ = l->errno_;
+	ctx->s->file = file;
+	pthread_cond_broadcast(&ctx->cond);
+}
+
+static struct beer_scan_chunk *
+beer_scan_add(struct beer_scan_ctx *ctx, int file, off_t start, off_t end) {
+	if (ctx->count == ctx->top) {
+		int top = ctx->top ? ctx->top * 2 : 64;
+		struct beer_scan_chunk *chunks = beer_mem_realloc(ctx->chunks,
+			sizeof(struct beer_scan_chunk) * top);
+		if (chunks == NULL)
+			return NULL;
+		ctx->chunks = chunks;
+		ctx->top = top;
+	}
+	struct beer_scan_chunk *c = &ctx->chunks[ctx->count++];
+	memset(c, 0, sizeof(struct beer_scan_chunk));
+	c->file = file;
+	c->start = start;
+	c->end = end;
+	return c;
+}
+
+/* splits files into ranges, that start at row markers */
+static int
+beer_scan_plan(struct beer_scan_ctx *ctx) {
+	struct beer_scan *s = ctx->s;
+	struct beer_log l;
+	int i;
+	for (i = 0; i < s->dir->count; i++) {
+		if (beer_scan_open(ctx, &l, i) == -1) {
+			beer_scan_fail(ctx, &l, i);
+			return -1;
+		}
+		off_t pos = l.offset;
+		off_t size = l.map_size;
+		while (pos < size) {
+			off_t end = size;
+			if (s->chunk_size && (size_t)(size - pos) > s->chunk_size) {
+				end = beer_log_find(&l, pos + s->chunk_size);
+				if (end == -1)
+					end = size;
+			}
+			if (beer_scan_add(ctx, i, pos, end) == NULL) {
+				l.error = BEER_LOG_EMEMORY;
+				beer_log_close(&l);
+				beer_scan_fail(ctx, &l, i);
+				return -1;
+			}
+			pos = end;
+		}
+		beer_log_close(&l);
+	}
+	return 0;
+}
+
+static struct beer_scan_batch *
+beer_scan_batch(struct beer_scan_ctx *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	struct beer_scan_batch *b = ctx->free;
+	if (b)
+		ctx->free = b->next;
+	pthread_mutex_unlock(&ctx->lock);
+	if (b == NULL) {
+		b = beer_mem_alloc(sizeof(struct beer_scan_batch));
+		if (b == NULL)
+			return NULL;
+	}
+	b->next = NULL;
+	b->count = 0;
+	return b;
+}
+
+/* must be called with lock held */
+static void
+beer_scan_release(struct beer_scan_ctx *ctx, struct beer_scan_batch *b) {
+	b->next = ctx->free;
+	ctx->free = b;
+}
+
+/* queues batch for delivery, waits if consumer is behind */
+static int
+beer_scan_push(struct beer_scan_ctx *ctx, struct beer_scan_chunk *c,
+	       struct beer_scan_batch *b) {
+	pthread_mutex_lock(&ctx->lock);
+	while (c->queued >= BEER_SCAN_QUEUE && !ctx->stop)
+		pthread_cond_wait(&ctx->cond, &ctx->lock);
+	if (ctx->stop) {
+		beer_scan_release(ctx, b);
+		pthread_mutex_unlock(&ctx->lock);
+		return -1;
+	}
+	if (c->tail)
+		c->tail->next = b;
+	else
+		c->head = b;
+	c->tail = b;
+	c->queued++;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+	return 0;
+}
+
+static int
+beer_scan_stopped(struct beer_scan_ctx *ctx) {
+	pthread_mutex_lock(&ctx->lock);
+	int stop = ctx->stop;
+	pthread_mutex_unlock(&ctx->lock);
+	return stop;
+}
+
+static void
+beer_scan_chunk(struct beer_scan_ctx *ctx, struct beer_scan_chunk *c,
+		int worker) {
+	struct beer_scan *s = ctx->s;
+	struct beer_log *l = &c->log;
+	struct beer_scan_batch *b = NULL;
+	uint64_t rows = 0;
+	if (beer_scan_open(ctx, l, c->file) == -1)
+		goto error;
+	c->opened = 1;
+	beer_log_seek(l, c->start);
+	while (l->offset < c->end) {
+		struct beer_xrow *row = beer_log_next(l);
+		if (row == NULL) {
+			if (l->error != BEER_LOG_EOK)
+				goto error;
+			break;
+		}
+		/* row was found after damaged data, in the next range */
+		off_t marker = l->offset - row->buf_size -
+			       BEER_LOG_FIXHEADER_SIZE;
+		if (marker >= c->end)
+			break;
+		rows++;
+		if (s->order == BEER_SCAN_UNORDERED) {
+			int rc = ctx->cb(ctx->arg, worker, row);
+			if (rc != 0) {
+				pthread_mutex_lock(&ctx->lock);
+				if (!ctx->stop) {
+					ctx->stop = 1;
+					ctx->rc = rc;
+				}
+				pthread_mutex_unlock(&ctx->lock);
+				break;
+			}
+			if (rows % BEER_SCAN_BATCH == 0 &&
+			    beer_scan_stopped(ctx))
+				break;
+			continue;
+		}
+		if (b == NULL && (b = beer_scan_batch(ctx)) == NULL) {
+			l->error = BEER_LOG_EMEMORY;
+			goto error;
+		}
+		b->rows[b->count++] = *row;
+		if (b->count == BEER_SCAN_BATCH) {
+			int rc = beer_scan_push(ctx, c, b);
+			b = NULL;
+			if (rc == -1)
+				break;
+		}
+	}
+	if (b && b->count)
+		beer_scan_push(ctx, c, b);
+	else if (b)
+		beer_mem_free(b);
+	pthread_mutex_lock(&ctx->lock);
+	s->rows += rows;
+	c->done = 1;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->lock);
+	/* in ordered mode the log is closed after delivery */
+	if (s->order == BEER_SCAN_UNORDERED) {
+		beer_log_close(l);
+		c->opened = 0;
+	}
+	return;
+error:
+	if (b)
+		beer_mem_free(b);
+	pthread_mutex_lock(&ctx->lock);
+	s->rows += rows;
+	beer_scan_fail(ctx, l, c->file);
+	c->done = 1;
+	pthread_mutex_unlock(&ctx->lock);
+}
+
+static void *
+beer_scan_worker(void *ptr) {
+	struct beer_scan_worker *w = ptr;
+	struct beer_scan_ctx *ctx = w->ctx;
+	pthread_mutex_lock(&ctx->lock);
+	while (!ctx->stop && ctx->next < ctx->count) {
+		if (ctx->s->order == BEER_SCAN_ORDERED &&
+		    ctx->held >= ctx->held_max) {
+			pthread_cond_wait(&ctx->cond, &ctx->lock);
+			continue;
+		}
+		struct beer_scan_chunk *c = &ctx->chunks[ctx->next++];
+		ctx->held++;
+		pthread_mutex_unlock(&ctx->lock);
+		beer_scan_chunk(ctx, c, w->id);
+		pthread_mutex_lock(&ctx->lock);
+	}
+	pthread_mutex_unlock(&ctx->lock);
+	return NULL;
+}
+
+/* delivers batches of ranges in order, on the calling thread */
+static void
+beer_scan_deliver(struct beer_scan_ctx *ctx) {
+	int i;
+	for (i = 0; i < ctx->count; i++) {
+		struct beer_scan_chunk *c = &ctx->chunks[i];
+		for (;;) {
+			pthread_mutex_lock(&ctx->lock);
+			while (c->head == NULL && !c->done && !ctx->stop)
+				pthread_cond_wait(&ctx->cond, &ctx->lock);
+			struct beer_scan_batch *b = c->head;
+			if (ctx->stop || b == NULL) {
+				pthread_mutex_unlock(&ctx->lock);
+				break;
+			}
+			c->head = b->next;
+			if (c->head == NULL)
+				c->tail = NULL;
+			pthread_mutex_unlock(&ctx->lock);
+			int j, rc = 0;
+			for (j = 0; j < b->count && rc == 0; j++)
+				rc = ctx->cb(ctx->arg, 0, &b->rows[j]);
+			pthread_mutex_lock(&ctx->lock);
+			c->queued--;
+			beer_scan_release(ctx, b);
+			if (rc != 0 && !ctx->stop) {
+				ctx->stop = 1;
+				ctx->rc = rc;
+			}
+			pthread_cond_broadcast(&ctx->cond);
+			pthread_mutex_unlock(&ctx->lock);
+		}
+		/* rows of range are delivered, unless the scan is stopped */
+		pthread_mutex_lock(&ctx->lock);
+		int stop = ctx->stop;
+		if (c->done && c->opened) {
+			beer_log_close(&c->log);
+			c->opened = 0;
+		}
+		/* let workers take the next range */
+		if (c->done) {
+			ctx->held--;
+			pthread_cond_broadcast(&ctx->cond);
+		}
+		pthread_mutex_unlock(&ctx->lock);
+		if (stop)
+			break;
+	}
+}
+
+int
+beer_scan(struct beer_scan *s, beer_scan_f cb, void *arg) {
+	struct beer_scan_ctx ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.s = s;
+	ctx.cb = cb;
+	ctx.arg = arg;
+	s->rows = 0;
+	s->error = BEER_LOG_EOK;
+	s->errno_ = 0;
+	s->file = -1;
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.cond, NULL);
+	int workers = s->workers;
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+	struct beer_scan_worker *w = NULL;
+	int i, started = 0;
+	if (beer_scan_plan(&ctx) == -1 || ctx.count == 0)
+		goto done;
+	if (workers > ctx.count)
+		workers = ctx.count;
+	ctx.held_max = workers * BEER_SCAN_AHEAD;
+	w = beer_mem_alloc(sizeof(struct beer_scan_worker) * workers);
+	if (w == NULL) {
+		ctx.rc = -1;
+		s->error = BEER_LOG_EMEMORY;
+		goto done;
+	}
+	int rc = 0;
+	for (i = 0; i < workers; i++) {
+		w[i].ctx = &ctx;
+		w[i].id = i;
+		rc = pthread_create(&w[i].thread, NULL, beer_scan_worker, &w[i]);
+		if (rc != 0)
+			break;
+		started++;
+	}
+	/* read on the calling thread, if no thread was started */
+	if (started == 0 && s->order == BEER_SCAN_UNORDERED) {
+		w[0].ctx = &ctx;
+		w[0].id = 0;
+		beer_scan_worker(&w[0]);
+	} else if (started == 0) {
+		ctx.rc = -1;
+		s->error = BEER_LOG_ESYSTEM;
+		s->errno_ = rc;
+		goto done;
+	}
+	if (s->order == BEER_SCAN_ORDERED)
+		beer_scan_deliver(&ctx);
+	for (i = 0; i < started; i++)
+		pthread_join(w[i].thread, NULL);
+done:
+	if (w)
+		beer_mem_free(w);
+	for (i = 0; i < ctx.count; i++) {
+		struct beer_scan_chunk *c = &ctx.chunks[i];
+		while (c->head) {
+			struct beer_scan_batch *b = c->head;
+			c->head = b->next;
+			beer_mem_free(b);
+		}
+		if (c->opened)
+			beer_log_close(&c->log);
+	}
+	while (ctx.free) {
+		struct beer_scan_batch *b = ctx.free;
+		ctx.free = b->next;
+		beer_mem_free(b);
+	}
+	if (ctx.chunks)
+		beer_mem_free(ctx.chunks);
+	pthread_cond_destroy(&ctx.cond);
+	pthread_mutex_destroy(&ctx.lock);
+	return ctx.rc;
+}
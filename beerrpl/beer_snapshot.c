@@ -33,15 +33,9 @@
 #include <stdarg.h>
 #include <string.h>
 
-#include <unistd.h>
-#include <fcntl.h>
-#include <errno.h>
-
-#include <third_party/crc32.h>
-
-#include <bee.h>
-#include <beer_log.h>
-#include <beer_snapshot.h>
+#include <bee/bee.h>
+#include <beer/beer_log.h>
+#include <beer/beer_snapshot.h>
 
 static void beer_snapshot_free(struct beer_stream *s) {
 	struct beer_stream_snapshot *ss = BEER_SSNAPSHOT_CAST(s);
@@ -51,17 +45,17 @@ static void beer_snapshot_free(struct beer_stream *s) {
 }
 
 static int
-beer_snapshot_read_tuple(struct beer_stream *s, struct beer_tuple *t)
+beer_snapshot_read_row(struct beer_stream *s, struct beer_xrow *row)
 {
 	struct beer_stream_snapshot *ss = BEER_SSNAPSHOT_CAST(s);
 
-	struct beer_log_row *row =
-		beer_log_next_to(&ss->log, (union beer_log_value*)t);
+	struct beer_xrow *current = beer_log_next(&ss->log);
 
-	if (row == NULL && beer_log_error(&ss->log) == BEER_LOG_EOK)
-		return 1;
+	if (current == NULL)
+		return beer_log_error(&ss->log) == BEER_LOG_EOK ? 1 : -1;
 
-	return (row) ? 0: -1;
+	*row = *current;
+	return 0;
 }
 
 /*
@@ -91,9 +85,8 @@ struct beer_stream *beer_snapshot(struct beer_stream *s)
 	memset(s->data, 0, sizeof(struct beer_stream_snapshot));
 	/* initializing interfaces */
 	s->read = NULL;
-	s->read_request = NULL;
+	s->read_row = beer_snapshot_read_row;
 	s->read_reply = NULL;
-	s->read_tuple = beer_snapshot_read_tuple;
 	s->write = NULL;
 	s->writev = NULL;
 	s->free = beer_snapshot_free;
@@ -106,13 +99,17 @@ struct beer_stream *beer_snapshot(struct beer_stream *s)
  *
  * open snapshot file and associate it with stream;
  *
- * s - snapshot stream pointer
+ * s    - snapshot stream pointer
+ * file - file name, or NULL for stdin
  *
  * returns 0 on success, or -1 on error.
 */
-int beer_snapshot_open(struct beer_stream *s, char *file) {
+int beer_snapshot_open(struct beer_stream *s, const char *file) {
 	struct beer_stream_snapshot *ss = BEER_SSNAPSHOT_CAST(s);
-	return beer_log_open(&ss->log, file, BEER_LOG_SNAPSHOT);
+	beer_log_close(&ss->log);
+	if (beer_log_open(&ss->log, file, BEER_LOG_SNAPSHOT) != BEER_LOG_EOK)
+		return -1;
+	return 0;
 }
 
 /*
@@ -121,8 +118,6 @@ int beer_snapshot_open(struct beer_stream *s, char *file) {
  * close snapshot stream;
  *
  * s - snapshot stream pointer
- *
- * returns 0 on success, or -1 on error.
 */
 void beer_snapshot_close(struct beer_stream *s) {
 	struct beer_stream_snapshot *ss = BEER_SSNAPSHOT_CAST(s);
@@ -33,15 +33,9 @@
 #include <stdarg.h>
 #include <string.h>
 
-#include <unistd.h>
-#include <fcntl.h>
-#include <errno.h>
-
-#include <third_party/crc32.h>
-
-#include <bee.h>
-#include <beer_log.h>
-#include <beer_xlog.h>
+#include <bee/bee.h>
+#include <beer/beer_log.h>
+#include <beer/beer_xlog.h>
 
 static void beer_xlog_free(struct beer_stream *s) {
 	struct beer_stream_xlog *sx = BEER_SXLOG_CAST(s);
@@ -51,17 +45,17 @@ static void beer_xlog_free(struct beer_stream *s) {
 }
 
 static int
-beer_xlog_request(struct beer_stream *s, struct beer_request *r)
+beer_xlog_read_row(struct beer_stream *s, struct beer_xrow *row)
 {
 	struct beer_stream_xlog *sx = BEER_SXLOG_CAST(s);
 
-	struct beer_log_row *row =
-		beer_log_next_to(&sx->log, (union beer_log_value*)r);
+	struct beer_xrow *current = beer_log_next(&sx->log);
 
-	if (row == NULL && beer_log_error(&sx->log) == BEER_LOG_EOK)
-		return 1;
+	if (current == NULL)
+		return beer_log_error(&sx->log) == BEER_LOG_EOK ? 1 : -1;
 
-	return (row) ? 0: -1;
+	*row = *current;
+	return 0;
 }
 
 /*
@@ -70,8 +64,8 @@ beer_xlog_request(struct beer_stream *s, struct beer_request *r)
  * create and initialize xlog stream;
  *
  * s - stream pointer, maybe NULL
- * 
- * if stream pointer is NULL, then new stream will be created. 
+ *
+ * if stream pointer is NULL, then new stream will be created.
  *
  * returns stream pointer, or NULL on error.
 */
@@ -91,9 +85,8 @@ struct beer_stream *beer_xlog(struct beer_stream *s)
 	memset(s->data, 0, sizeof(struct beer_stream_xlog));
 	/* initializing interfaces */
 	s->read = NULL;
-	s->read_request = beer_xlog_request;
+	s->read_row = beer_xlog_read_row;
 	s->read_reply = NULL;
-	s->read_tuple = NULL;
 	s->write = NULL;
 	s->writev = NULL;
 	s->free = beer_xlog_free;
@@ -106,23 +99,25 @@ struct beer_stream *beer_xlog(struct beer_stream *s)
  *
  * open xlog file and associate it with stream;
  *
- * s - xlog stream pointer
- * 
+ * s    - xlog stream pointer
+ * file - file name, or NULL for stdin
+ *
  * returns 0 on success, or -1 on error.
 */
-int beer_xlog_open(struct beer_stream *s, char *file) {
+int beer_xlog_open(struct beer_stream *s, const char *file) {
 	struct beer_stream_xlog *sx = BEER_SXLOG_CAST(s);
-	return beer_log_open(&sx->log, file, BEER_LOG_XLOG);
+	beer_log_close(&sx->log);
+	if (beer_log_open(&sx->log, file, BEER_LOG_XLOG) != BEER_LOG_EOK)
+		return -1;
+	return 0;
 }
 
 /*
  * beer_xlog_close()
  *
- * close xlog stream; 
+ * close xlog stream;
  *
  * s - xlog stream pointer
- * 
- * returns 0 on success, or -1 on error.
 */
 void beer_xlog_close(struct beer_stream *s) {
 	struct beer_stream_xlog *sx = BEER_SXLOG_CAST(s);
@@ -0,0 +1,224 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <msgpuck.h>
+
+#include <bee/bee.h>
+#include <beer/beer_xrow.h>
+
+static int
+beer_xrow_decode_header(struct beer_xrow *row, const char **p)
+{
+	if (mp_typeof(**p) != MP_MAP)
+		return -1;
+	uint32_t n = mp_decode_map(p);
+	while (n-- > 0) {
+		if (mp_typeof(**p) != MP_UINT)
+			return -1;
+		uint64_t key = mp_decode_uint(p);
+		switch (key) {
+		case BEER_CODE:
+			if (mp_typeof(**p) != MP_UINT)
+				return -1;
+			row->type = mp_decode_uint(p);
+			break;
+		case BEER_SYNC:
+			if (mp_typeof(**p) != MP_UINT)
+				return -1;
+			row->sync = mp_decode_uint(p);
+			break;
+		case BEER_SERVER_ID:
+			if (mp_typeof(**p) != MP_UINT)
+				return -1;
+			row->server_id = mp_decode_uint(p);
+			break;
+		case BEER_LSN:
+			if (mp_typeof(**p) != MP_UINT)
+				return -1;
+			row->lsn = mp_decode_uint(p);
+			break;
+		case BEER_TIMESTAMP:
+			if (mp_typeof(**p) == MP_DOUBLE)
+				row->timestamp = mp_decode_double(p);
+			else if (mp_typeof(**p) == MP_FLOAT)
+				row->timestamp = mp_decode_float(p);
+			else
+				return -1;
+			break;
+		default:
+			mp_next(p);
+			continue;
+		}
+		row->bitmap |= (1ULL << key);
+	}
+	return 0;
+}
+
+static int
+beer_xrow_decode_body(struct beer_xrow *row, const char **p)
+{
+	if (mp_typeof(**p) != MP_MAP)
+		return -1;
+	uint32_t n = mp_decode_map(p);
+	while (n-- > 0) {
+		if (mp_typeof(**p) != MP_UINT)
+			return -1;
+		uint64_t key = mp_decode_uint(p);
+		const char *value = *p;
+		switch (key) {
+		case BEER_SPACE:
+		case BEER_INDEX:
+		case BEER_INDEX_BASE:
+			if (mp_typeof(**p) != MP_UINT)
+				return -1;
+			uint32_t number = mp_decode_uint(p);
+			if (key == BEER_SPACE)
+				row->space_id = number;
+			else if (key == BEER_INDEX)
+				row->index_id = number;
+			else
+				row->index_base = number;
+			break;
+		case BEER_KEY:
+		case BEER_TUPLE:
+		case BEER_OPS:
+			if (mp_typeof(**p) != MP_ARRAY)
+				return -1;
+			mp_next(p);
+			if (key == BEER_KEY) {
+				row->key = value;
+				row->key_end = *p;
+			} else if (key == BEER_TUPLE) {
+				row->tuple = value;
+				row->tuple_end = *p;
+			} else {
+				row->ops = value;
+				row->ops_end = *p;
+			}
+			break;
+		case BEER_VCLOCK:
+			if (mp_typeof(**p) != MP_MAP)
+				return -1;
+			mp_next(p);
+			row->vclock = value;
+			row->vclock_end = *p;
+			break;
+		case BEER_ERROR: {
+			if (mp_typeof(**p) != MP_STR)
+				return -1;
+			uint32_t len = 0;
+			row->error = mp_decode_str(p, &len);
+			row->error_end = row->error + len;
+			break;
+		}
+		default:
+			mp_next(p);
+			continue;
+		}
+		if (key < 64)
+			row->bitmap |= (1ULL << key);
+	}
+	return 0;
+}
+
+int
+beer_xrow_decode(struct beer_xrow *row, const char *buf, size_t size)
+{
+	memset(row, 0, sizeof(struct beer_xrow));
+	row->buf = buf;
+	row->buf_size = size;
+	const char *p = buf, *end = buf + size;
+	/* header and body are checked at once */
+	const char *test = p;
+	if (mp_check(&test, end) || beer_xrow_decode_header(row, &p) == -1)
+		return -1;
+	if (p == end)
+		return 0; /* no body */
+	test = p;
+	if (mp_check(&test, end) || beer_xrow_decode_body(row, &p) == -1)
+		return -1;
+	return 0;
+}
+
+int
+beer_vclock_decode(struct beer_vclock *vclock, const char *data,
+		   const char *end)
+{
+	memset(vclock, 0, sizeof(struct beer_vclock));
+	const char *test = data;
+	if (mp_check(&test, end) || mp_typeof(*data) != MP_MAP)
+		return -1;
+	uint32_t n = mp_decode_map(&data);
+	while (n-- > 0) {
+		if (mp_typeof(*data) != MP_UINT)
+			return -1;
+		uint64_t id = mp_decode_uint(&data);
+		if (mp_typeof(*data) != MP_UINT)
+			return -1;
+		uint64_t lsn = mp_decode_uint(&data);
+		if (id >= BEER_VCLOCK_MAX)
+			return -1;
+		vclock->lsn[id] = lsn;
+	}
+	return 0;
+}
+
+size_t
+beer_vclock_sizeof(const struct beer_vclock *vclock)
+{
+	uint32_t id, count = 0;
+	size_t size = 0;
+	for (id = 0; id < BEER_VCLOCK_MAX; id++) {
+		if (vclock->lsn[id] == 0)
+			continue;
+		size += mp_sizeof_uint(id) + mp_sizeof_uint(vclock->lsn[id]);
+		count++;
+	}
+	return size + mp_sizeof_map(count);
+}
+
+char *
+beer_vclock_encode(const struct beer_vclock *vclock, char *data)
+{
+	uint32_t id, count = 0;
+	for (id = 0; id < BEER_VCLOCK_MAX; id++)
+		count += (vclock->lsn[id] != 0);
+	data = mp_encode_map(data, count);
+	for (id = 0; id < BEER_VCLOCK_MAX; id++) {
+		if (vclock->lsn[id] == 0)
+			continue;
+		data = mp_encode_uint(data, id);
+		data = mp_encode_uint(data, vclock->lsn[id]);
+	}
+	return data;
+}
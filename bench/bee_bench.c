@@ -0,0 +1,300 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <msgpuck.h>
+#include <crc32.h>
+
+#include <bee/bee.h>
+
+#include "beer_assoc.h"
+
+#include "bench.h"
+
+/* count of tuples in reply, elements in arrays and maps */
+#define BENCH_ELEMS 16
+
+struct bench_ctx {
+	struct beer_stream *buf;
+	struct beer_stream *key;
+	struct beer_stream *tuple;
+	struct beer_stream *ops;
+	struct beer_request *req;
+	char *reply;
+	size_t reply_size;
+	char *array;
+	size_t array_size;
+	char *map;
+	size_t map_size;
+	struct mh_assoc_t *assoc;
+	struct assoc_val vals[BENCH_ELEMS];
+	char names[BENCH_ELEMS][16];
+};
+
+/* size of the largest checksummed buffer */
+#define BENCH_CRC_SIZE (64 * 1024)
+
+struct bench_crc {
+	const unsigned char *data;
+	unsigned int size;
+};
+
+static void
+bench_writeout(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	uint64_t sync;
+	while (n-- > 0) {
+		beer_buf_reset(c->buf);
+		beer_request_writeout(c->buf, c->req, &sync);
+	}
+	bench_sink += BEER_SBUF_SIZE(c->buf);
+}
+
+static void
+bench_select(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	while (n-- > 0) {
+		beer_buf_reset(c->buf);
+		beer_select(c->buf, 512, 0, 100, 0, BEER_ITER_EQ, c->key);
+	}
+	bench_sink += BEER_SBUF_SIZE(c->buf);
+}
+
+static void
+bench_insert(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	while (n-- > 0) {
+		beer_buf_reset(c->buf);
+		beer_insert(c->buf, 512, c->tuple);
+	}
+	bench_sink += BEER_SBUF_SIZE(c->buf);
+}
+
+static void
+bench_update(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	while (n-- > 0) {
+		beer_buf_reset(c->buf);
+		beer_update(c->buf, 512, 0, c->key, c->ops);
+	}
+	bench_sink += BEER_SBUF_SIZE(c->buf);
+}
+
+static void
+bench_reply(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	struct beer_reply r;
+	beer_reply_init(&r);
+	while (n-- > 0) {
+		size_t off = 0;
+		beer_reply(&r, c->reply, c->reply_size, &off);
+		bench_sink += r.data_end - r.data;
+		beer_reply_free(&r);
+	}
+}
+
+static void
+bench_vformat(void *ptr, uint64_t n) {
+	(void )ptr;
+	struct beer_stream *o = beer_object(NULL);
+	while (n-- > 0) {
+		beer_object_reset(o);
+		beer_object_format(o, "[%d%s{%s%lf%s%u}]", (int)n, "name",
+				   "score", 1.5, "count", 42U);
+	}
+	bench_sink += BEER_SBUF_SIZE(o);
+	beer_stream_free(o);
+}
+
+static void
+bench_iter_array(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	struct beer_iter it;
+	while (n-- > 0) {
+		beer_iter_array(&it, c->array, c->array_size);
+		while (beer_next(&it) == 1)
+			bench_sink += *BEER_IARRAY_ELEM(&it);
+		beer_iter_free(&it);
+	}
+}
+
+static void
+bench_iter_map(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	struct beer_iter it;
+	while (n-- > 0) {
+		beer_iter_map(&it, c->map, c->map_size);
+		while (beer_next(&it) == 1)
+			bench_sink += *BEER_IMAP_VAL(&it);
+		beer_iter_free(&it);
+	}
+}
+
+static void
+bench_assoc(void *ptr, uint64_t n) {
+	struct bench_ctx *c = ptr;
+	while (n-- > 0) {
+		const struct assoc_key *key = &c->vals[n % BENCH_ELEMS].key;
+		bench_sink += mh_assoc_find(c->assoc, key, NULL);
+	}
+}
+
+static void
+bench_crc32c_sw(void *ptr, uint64_t n) {
+	struct bench_crc *c = ptr;
+	uint32_t crc = 0;
+	while (n-- > 0)
+		crc = crc32c_sw(crc, c->data, c->size);
+	bench_sink += crc;
+}
+
+static void
+bench_crc32c_hw(void *ptr, uint64_t n) {
+	struct bench_crc *c = ptr;
+	uint32_t crc = 0;
+	while (n-- > 0)
+		crc = crc32c_hw(crc, c->data, c->size);
+	bench_sink += crc;
+}
+
+static char *
+bench_reply_frame(size_t *size) {
+	char body[4096];
+	char *p = body;
+	p = mp_encode_map(p, 3);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, 0);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_uint(p, 1);
+	p = mp_encode_uint(p, BEER_SCHEMA_ID);
+	p = mp_encode_uint(p, 1);
+	p = mp_encode_map(p, 1);
+	p = mp_encode_uint(p, BEER_DATA);
+	p = mp_encode_array(p, BENCH_ELEMS);
+	int i;
+	for (i = 0; i < BENCH_ELEMS; i++) {
+		p = mp_encode_array(p, 3);
+		p = mp_encode_uint(p, i);
+		p = mp_encode_str(p, "name", 4);
+		p = mp_encode_double(p, i * 1.5);
+	}
+	size_t len = p - body;
+	char *frame = beer_mem_alloc(len + 5);
+	if (frame == NULL)
+		return NULL;
+	*frame = 0xce;
+	mp_store_u32(frame + 1, len);
+	memcpy(frame + 5, body, len);
+	*size = len + 5;
+	return frame;
+}
+
+static int
+bench_setup(struct bench_ctx *c) {
+	memset(c, 0, sizeof(struct bench_ctx));
+	c->buf = beer_buf(NULL);
+	c->key = beer_object(NULL);
+	c->tuple = beer_object(NULL);
+	c->req = beer_request_select(NULL);
+	c->assoc = mh_assoc_new();
+	if (!c->buf || !c->key || !c->tuple || !c->req || !c->assoc)
+		return -1;
+	beer_buf_reserve(c->buf, 1024);
+	beer_object_format(c->key, "[%d]", 42);
+	beer_object_format(c->tuple, "[%d%s%lf]", 42, "name", 1.5);
+	c->ops = beer_update_container(NULL);
+	if (c->ops == NULL)
+		return -1;
+	beer_update_arith_int(c->ops, 2, '+', 1);
+	beer_update_assign(c->ops, 1, c->tuple);
+	beer_update_container_close(c->ops);
+	beer_request_set_space(c->req, 512);
+	beer_request_set_key(c->req, c->key);
+	c->reply = bench_reply_frame(&c->reply_size);
+	struct beer_stream *array = beer_object(NULL);
+	struct beer_stream *map = beer_object(NULL);
+	if (!c->reply || !array || !map)
+		return -1;
+	beer_object_add_array(array, BENCH_ELEMS);
+	beer_object_add_map(map, BENCH_ELEMS);
+	int i;
+	for (i = 0; i < BENCH_ELEMS; i++) {
+		beer_object_add_int(array, i);
+		beer_object_add_int(map, i);
+		beer_object_add_int(map, i * i);
+		snprintf(c->names[i], 16, "space_%d", i);
+		c->vals[i].key.id = c->names[i];
+		c->vals[i].key.id_len = strlen(c->names[i]);
+		const struct assoc_val *val = &c->vals[i];
+		mh_assoc_put(c->assoc, &val, NULL, NULL);
+	}
+	/* iterators take plain msgpack, keep only the data */
+	c->array = BEER_SBUF_DATA(array);
+	c->array_size = BEER_SBUF_SIZE(array);
+	c->map = BEER_SBUF_DATA(map);
+	c->map_size = BEER_SBUF_SIZE(map);
+	return 0;
+}
+
+int
+main(int argc, char **argv) {
+	if (bench_init(argc, argv) == -1)
+		return 1;
+	struct bench_ctx c;
+	if (bench_setup(&c) == -1) {
+		fprintf(stderr, "failed to prepare benchmarks\n");
+		return 1;
+	}
+	bench_run("request_writeout", bench_writeout, &c);
+	bench_run("select", bench_select, &c);
+	bench_run("insert", bench_insert, &c);
+	bench_run("update", bench_update, &c);
+	bench_run("reply", bench_reply, &c);
+	bench_run("object_vformat", bench_vformat, &c);
+	bench_run("iter_array", bench_iter_array, &c);
+	bench_run("iter_map", bench_iter_map, &c);
+	bench_run("assoc_find", bench_assoc, &c);
+
+	/* checksums of xlog rows: a small row and a large span */
+	static unsigned char crc_data[BENCH_CRC_SIZE];
+	unsigned int i;
+	for (i = 0; i < BENCH_CRC_SIZE; i++)
+		crc_data[i] = i * 2654435761U >> 24;
+	struct bench_crc crc_small = { crc_data, 64 };
+	struct bench_crc crc_large = { crc_data, BENCH_CRC_SIZE };
+	bench_run("crc32c_sw_64", bench_crc32c_sw, &crc_small);
+	bench_run("crc32c_sw_64k", bench_crc32c_sw, &crc_large);
+	if (crc32c_hw_available()) {
+		bench_run("crc32c_hw_64", bench_crc32c_hw, &crc_small);
+		bench_run("crc32c_hw_64k", bench_crc32c_hw, &crc_large);
+	}
+	return 0;
+}
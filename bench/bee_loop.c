@@ -0,0 +1,541 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+/**
+ * \file bee_loop.c
+ * \brief Loopback benchmark of the full network path
+ *
+ * Starts an in-process IPROTO responder on a UNIX (or loopback TCP) socket
+ * and drives beer_net streams against it, one thread per connection,
+ * keeping `depth` requests in flight on every connection. Reports latency
+ * percentiles and requests per second.
+ *
+ * The responder answers auth and ping with empty body, select with one
+ * tuple of `size` bytes, and insert with the inserted tuple.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <msgpuck.h>
+
+#include <bee/bee.h>
+#include <beer/beer_net.h>
+
+enum loop_op {
+	LOOP_PING,
+	LOOP_SELECT,
+	LOOP_INSERT,
+	LOOP_GET
+};
+
+struct loop_conf {
+	int conns;
+	uint32_t depth;
+	uint32_t size;
+	uint64_t count;
+	enum loop_op op;
+	int tcp;
+	int send_ref;
+	int io_uring;
+	char uri[128];
+};
+
+static struct loop_conf conf = {
+	.conns = 1,
+	.depth = 1,
+	.size  = 32,
+	.count = 100000,
+	.op    = LOOP_SELECT,
+	.tcp   = 0,
+	.send_ref = 0,
+	.io_uring = 0,
+};
+
+static uint64_t
+loop_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* {{{ responder */
+
+struct loop_buf {
+	char *data;
+	size_t size;
+	size_t alloc;
+};
+
+static int
+loop_buf_reserve(struct loop_buf *b, size_t size) {
+	if (b->size + size <= b->alloc)
+		return 0;
+	size_t alloc = b->alloc ? b->alloc : 65536;
+	while (alloc < b->size + size)
+		alloc *= 2;
+	char *data = realloc(b->data, alloc);
+	if (data == NULL)
+		return -1;
+	b->data = data;
+	b->alloc = alloc;
+	return 0;
+}
+
+static int
+loop_send_all(int fd, const char *data, size_t size) {
+	while (size > 0) {
+		ssize_t rc = send(fd, data, size, MSG_NOSIGNAL);
+		if (rc <= 0)
+			return -1;
+		data += rc;
+		size -= rc;
+	}
+	return 0;
+}
+
+/* appends reply to `out`, `tuple` is written as the only element of data */
+static int
+loop_reply(struct loop_buf *out, uint64_t sync, const char *tuple,
+	   size_t tuple_size) {
+	size_t size = 5 + 32 + 8 + tuple_size;
+	if (loop_buf_reserve(out, size) == -1)
+		return -1;
+	char *frame = out->data + out->size;
+	char *p = frame + 5;
+	p = mp_encode_map(p, 3);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, 0);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_uint(p, sync);
+	p = mp_encode_uint(p, BEER_SCHEMA_ID);
+	p = mp_encode_uint(p, 1);
+	if (tuple) {
+		p = mp_encode_map(p, 1);
+		p = mp_encode_uint(p, BEER_DATA);
+		p = mp_encode_array(p, 1);
+		memcpy(p, tuple, tuple_size);
+		p += tuple_size;
+	} else {
+		p = mp_encode_map(p, 0);
+	}
+	*frame = 0xce;
+	mp_store_u32(frame + 1, p - frame - 5);
+	out->size += p - frame;
+	return 0;
+}
+
+/* handles one request, returns -1 on malformed frame */
+static int
+loop_request(struct loop_buf *out, const char *p, const char *end,
+	     const char *tuple, size_t tuple_size) {
+	const char *test = p;
+	if (mp_check(&test, end) || mp_typeof(*p) != MP_MAP)
+		return -1;
+	uint32_t code = 0, n = mp_decode_map(&p);
+	uint64_t sync = 0;
+	while (n-- > 0) {
+		if (mp_typeof(*p) != MP_UINT)
+			return -1;
+		uint64_t key = mp_decode_uint(&p);
+		if (key == BEER_CODE && mp_typeof(*p) == MP_UINT)
+			code = mp_decode_uint(&p);
+		else if (key == BEER_SYNC && mp_typeof(*p) == MP_UINT)
+			sync = mp_decode_uint(&p);
+		else
+			mp_next(&p);
+	}
+	switch (code) {
+	case BEER_OP_SELECT:
+		return loop_reply(out, sync, tuple, tuple_size);
+	case BEER_OP_INSERT:
+	case BEER_OP_REPLACE:
+		/* return inserted tuple back */
+		test = p;
+		if (p == end || mp_check(&test, end) || mp_typeof(*p) != MP_MAP)
+			return -1;
+		n = mp_decode_map(&p);
+		while (n-- > 0) {
+			uint64_t key = mp_decode_uint(&p);
+			const char *value = p;
+			mp_next(&p);
+			if (key == BEER_TUPLE)
+				return loop_reply(out, sync, value, p - value);
+		}
+		return loop_reply(out, sync, NULL, 0);
+	default:
+		return loop_reply(out, sync, NULL, 0);
+	}
+}
+
+static void *
+loop_serve(void *arg) {
+	int fd = (int)(intptr_t)arg;
+	char greeting[BEER_GREETING_SIZE];
+	memset(greeting, ' ', sizeof(greeting));
+	memcpy(greeting, "Bee 1.6 (Binary)", 16);
+	greeting[63] = '\n';
+	/* base64 of 32 zero bytes */
+	memset(greeting + 64, 'A', 43);
+	greeting[64 + 43] = '=';
+	greeting[127] = '\n';
+	/* tuple for select replies: [1, bin(size)] */
+	size_t tuple_size = mp_sizeof_array(2) + mp_sizeof_uint(1) +
+			    mp_sizeof_bin(conf.size);
+	char *tuple = calloc(1, tuple_size);
+	struct loop_buf in = { NULL, 0, 0 }, out = { NULL, 0, 0 };
+	if (tuple == NULL)
+		goto done;
+	char *t = mp_encode_array(tuple, 2);
+	t = mp_encode_uint(t, 1);
+	t = mp_encode_binl(t, conf.size);
+	if (loop_send_all(fd, greeting, sizeof(greeting)) == -1)
+		goto done;
+	for (;;) {
+		if (loop_buf_reserve(&in, 65536) == -1)
+			goto done;
+		ssize_t rc = recv(fd, in.data + in.size, in.alloc - in.size, 0);
+		if (rc <= 0)
+			goto done;
+		in.size += rc;
+		const char *p = in.data, *end = in.data + in.size;
+		while (end - p >= 5) {
+			const char *len = p;
+			if (mp_typeof(*len) != MP_UINT)
+				goto done;
+			if (mp_check_uint(len, end) > 0)
+				break;
+			uint64_t size = mp_decode_uint(&len);
+			if ((uint64_t)(end - len) < size)
+				break;
+			if (loop_request(&out, len, len + size, tuple,
+					 tuple_size) == -1)
+				goto done;
+			p = len + size;
+		}
+		in.size = end - p;
+		memmove(in.data, p, in.size);
+		/* one write for all requests from one read */
+		if (out.size && loop_send_all(fd, out.data, out.size) == -1)
+			goto done;
+		out.size = 0;
+	}
+done:
+	close(fd);
+	free(tuple);
+	free(in.data);
+	free(out.data);
+	return NULL;
+}
+
+static void *
+loop_accept(void *arg) {
+	int lfd = (int)(intptr_t)arg;
+	for (;;) {
+		int fd = accept(lfd, NULL, NULL);
+		if (fd == -1)
+			continue;
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, loop_serve,
+				   (void *)(intptr_t)fd) != 0) {
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+/* starts responder and fills conf.uri */
+static int
+loop_server(void) {
+	int lfd;
+	if (conf.tcp) {
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(addr);
+		lfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (lfd == -1 ||
+		    bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+		    getsockname(lfd, (struct sockaddr *)&addr, &len) == -1)
+			return -1;
+		snprintf(conf.uri, sizeof(conf.uri), "127.0.0.1:%d",
+			 ntohs(addr.sin_port));
+	} else {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		snprintf(addr.sun_path, sizeof(addr.sun_path),
+			 "/tmp/bee-loop-%d.sock", (int)getpid());
+		unlink(addr.sun_path);
+		lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (lfd == -1 ||
+		    bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+			return -1;
+		snprintf(conf.uri, sizeof(conf.uri), "%s", addr.sun_path);
+	}
+	if (listen(lfd, 128) == -1)
+		return -1;
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, loop_accept,
+			   (void *)(intptr_t)lfd) != 0)
+		return -1;
+	pthread_detach(thread);
+	return 0;
+}
+
+/* }}} */
+
+/* {{{ client */
+
+struct loop_client {
+	pthread_t thread;
+	uint64_t *lat;
+	uint64_t done;
+	int failed;
+};
+
+static int
+loop_send(struct beer_stream *s, struct beer_stream *key,
+	  struct beer_stream *tuple) {
+	switch (conf.op) {
+	case LOOP_PING:
+		return beer_ping(s) == -1 ? -1 : 0;
+	case LOOP_SELECT:
+		return beer_select(s, 512, 0, 1, 0, BEER_ITER_EQ, key) == -1 ?
+		       -1 : 0;
+	case LOOP_INSERT:
+		return beer_insert(s, 512, tuple) == -1 ? -1 : 0;
+	case LOOP_GET:
+		return beer_select_uint(s, 512, 0, 1, 1) == -1 ? -1 : 0;
+	}
+	return -1;
+}
+
+static void *
+loop_client(void *arg) {
+	struct loop_client *c = arg;
+	c->failed = 1;
+	struct beer_stream *s = beer_net(NULL);
+	struct beer_stream *key = beer_object(NULL);
+	struct beer_stream *tuple = beer_object(NULL);
+	uint64_t *sent_at = calloc(conf.depth, sizeof(uint64_t));
+	if (!s || !key || !tuple || !sent_at)
+		goto done;
+	char *payload = calloc(1, conf.size + 1);
+	if (payload == NULL)
+		goto done;
+	beer_object_format(key, "[%d]", 1);
+	beer_object_add_array(tuple, 2);
+	beer_object_add_int(tuple, 1);
+	beer_object_add_bin(tuple, payload, conf.size);
+	free(payload);
+	if (beer_set(s, BEER_OPT_URI, conf.uri) == -1 ||
+	    beer_set(s, BEER_OPT_SEND_REF, conf.send_ref) == -1 ||
+	    beer_set(s, BEER_OPT_IO_URING, conf.io_uring) == -1 ||
+	    beer_connect(s) == -1) {
+		fprintf(stderr, "failed to connect: %s\n", beer_strerror(s));
+		goto done;
+	}
+	uint64_t sent = 0;
+	struct beer_reply r;
+	beer_reply_init(&r);
+	while (c->done < conf.count) {
+		/* keep the window full */
+		while (sent < conf.count && sent - c->done < conf.depth) {
+			if (loop_send(s, key, tuple) == -1)
+				goto done;
+			sent_at[sent % conf.depth] = loop_now();
+			sent++;
+		}
+		if (beer_flush(s) == -1)
+			goto done;
+		if (s->read_reply(s, &r) != 0 || r.code != 0) {
+			fprintf(stderr, "failed to read reply: %s\n",
+				beer_strerror(s));
+			goto done;
+		}
+		/* replies come in order */
+		c->lat[c->done] = loop_now() - sent_at[c->done % conf.depth];
+		c->done++;
+		beer_reply_free(&r);
+	}
+	c->failed = 0;
+done:
+	free(sent_at);
+	if (tuple) beer_stream_free(tuple);
+	if (key) beer_stream_free(key);
+	if (s) beer_stream_free(s);
+	return NULL;
+}
+
+/* }}} */
+
+static int
+loop_cmp(const void *a, const void *b) {
+	uint64_t l = *(const uint64_t *)a, r = *(const uint64_t *)b;
+	return (l > r) - (l < r);
+}
+
+static double
+loop_percentile(uint64_t *lat, uint64_t n, double p) {
+	uint64_t i = (uint64_t)(p * n);
+	if (i >= n)
+		i = n - 1;
+	return lat[i] / 1000.0;
+}
+
+static int
+loop_usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-c conns] [-d depth] [-s size] [-n count] "
+		"[-o ping|select|insert|get] [-r size] [-u] [-T]\n"
+		"  -c  count of connections (thread per connection)\n"
+		"  -d  count of requests in flight on every connection\n"
+		"  -s  size of payload in tuple\n"
+		"  -n  count of requests on every connection\n"
+		"  -o  request type (get is select by integer key)\n"
+		"  -r  send writes of at least size bytes by reference\n"
+		"  -u  send and receive through io_uring\n"
+		"  -T  use loopback TCP instead of UNIX socket\n", name);
+	return 1;
+}
+
+int
+main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "c:d:s:n:o:r:uT")) != -1) {
+		switch (opt) {
+		case 'c':
+			conf.conns = atoi(optarg);
+			break;
+		case 'd':
+			conf.depth = atoi(optarg);
+			break;
+		case 's':
+			conf.size = atoi(optarg);
+			break;
+		case 'n':
+			conf.count = strtoull(optarg, NULL, 10);
+			break;
+		case 'o':
+			if (strcmp(optarg, "ping") == 0)
+				conf.op = LOOP_PING;
+			else if (strcmp(optarg, "select") == 0)
+				conf.op = LOOP_SELECT;
+			else if (strcmp(optarg, "insert") == 0)
+				conf.op = LOOP_INSERT;
+			else if (strcmp(optarg, "get") == 0)
+				conf.op = LOOP_GET;
+			else
+				return loop_usage(argv[0]);
+			break;
+		case 'r':
+			conf.send_ref = atoi(optarg);
+			break;
+		case 'u':
+			conf.io_uring = 1;
+			break;
+		case 'T':
+			conf.tcp = 1;
+			break;
+		default:
+			return loop_usage(argv[0]);
+		}
+	}
+	if (conf.conns <= 0 || conf.depth == 0 || conf.count == 0)
+		return loop_usage(argv[0]);
+	signal(SIGPIPE, SIG_IGN);
+	if (loop_server() == -1) {
+		perror("failed to start responder");
+		return 1;
+	}
+	struct loop_client *clients = calloc(conf.conns,
+					     sizeof(struct loop_client));
+	uint64_t *lat = calloc(conf.conns * conf.count, sizeof(uint64_t));
+	if (clients == NULL || lat == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	uint64_t start = loop_now();
+	int i;
+	for (i = 0; i < conf.conns; i++) {
+		clients[i].lat = lat + i * conf.count;
+		if (pthread_create(&clients[i].thread, NULL, loop_client,
+				   &clients[i]) != 0) {
+			fprintf(stderr, "failed to start client\n");
+			return 1;
+		}
+	}
+	uint64_t total = 0;
+	int failed = 0;
+	for (i = 0; i < conf.conns; i++) {
+		pthread_join(clients[i].thread, NULL);
+		failed |= clients[i].failed;
+		/* pack latencies of all connections together */
+		memmove(lat + total, clients[i].lat,
+			clients[i].done * sizeof(uint64_t));
+		total += clients[i].done;
+	}
+	double spent = (loop_now() - start) / 1e9;
+	if (!conf.tcp)
+		unlink(conf.uri);
+	if (total == 0) {
+		fprintf(stderr, "no replies\n");
+		return 1;
+	}
+	qsort(lat, total, sizeof(uint64_t), loop_cmp);
+	static const char *ops[] = { "ping", "select", "insert", "get" };
+	printf("%s over %s: %d conns, depth %u, payload %u bytes\n",
+	       ops[conf.op], conf.tcp ? "tcp" : "unix", conf.conns,
+	       conf.depth, conf.size);
+	printf("requests: %llu in %.3f s, %.0f req/s\n",
+	       (unsigned long long)total, spent, total / spent);
+	printf("latency us: p50 %.1f, p99 %.1f, p999 %.1f, max %.1f\n",
+	       loop_percentile(lat, total, 0.5),
+	       loop_percentile(lat, total, 0.99),
+	       loop_percentile(lat, total, 0.999),
+	       lat[total - 1] / 1000.0);
+	free(lat);
+	free(clients);
+	return failed;
+}
@@ -0,0 +1,147 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <bee/bee.h>
+
+#include "bench.h"
+
+double bench_time = 0.2;
+int bench_rounds = 5;
+volatile uint64_t bench_sink = 0;
+
+static const char *bench_filter = NULL;
+
+static uint64_t bench_allocs = 0;
+static uint64_t bench_bytes = 0;
+
+static void *
+bench_realloc(void *ptr, size_t size) {
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+	bench_allocs++;
+	bench_bytes += size;
+	if (ptr == NULL)
+		return calloc(1, size);
+	return realloc(ptr, size);
+}
+
+static uint64_t
+bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+bench_init(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "t:r:")) != -1) {
+		switch (opt) {
+		case 't':
+			bench_time = atof(optarg);
+			break;
+		case 'r':
+			bench_rounds = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (bench_time <= 0 || bench_rounds <= 0)
+		goto usage;
+	if (optind < argc)
+		bench_filter = argv[optind];
+	beer_mem_init(bench_realloc);
+	printf("%-28s %12s %12s %12s\n", "benchmark", "ns/op", "allocs/op",
+	       "bytes/op");
+	return 0;
+usage:
+	fprintf(stderr, "usage: %s [-t seconds] [-r rounds] [filter]\n",
+		argv[0]);
+	return -1;
+}
+
+struct bench_round {
+	double ns;
+	double allocs;
+	double bytes;
+};
+
+static int
+bench_round_cmp(const void *a, const void *b) {
+	double l = ((const struct bench_round *)a)->ns;
+	double r = ((const struct bench_round *)b)->ns;
+	return (l > r) - (l < r);
+}
+
+void
+bench_run(const char *name, bench_f f, void *ctx) {
+	if (bench_filter && strstr(name, bench_filter) == NULL)
+		return;
+	/* warm up and find count of iterations for one round */
+	uint64_t n = 1, limit = bench_time * 1e9;
+	for (;;) {
+		uint64_t start = bench_now();
+		f(ctx, n);
+		uint64_t spent = bench_now() - start;
+		if (spent >= limit)
+			break;
+		if (spent < limit / 100)
+			n *= 100;
+		else
+			n = n * limit / spent + 1;
+	}
+	struct bench_round *rounds = calloc(bench_rounds,
+					    sizeof(struct bench_round));
+	if (rounds == NULL)
+		return;
+	int i;
+	for (i = 0; i < bench_rounds; i++) {
+		uint64_t allocs = bench_allocs, bytes = bench_bytes;
+		uint64_t start = bench_now();
+		f(ctx, n);
+		rounds[i].ns = (double)(bench_now() - start) / n;
+		rounds[i].allocs = (double)(bench_allocs - allocs) / n;
+		rounds[i].bytes = (double)(bench_bytes - bytes) / n;
+	}
+	qsort(rounds, bench_rounds, sizeof(struct bench_round),
+	      bench_round_cmp);
+	struct bench_round *m = &rounds[bench_rounds / 2];
+	printf("%-28s %12.1f %12.2f %12.1f\n", name, m->ns, m->allocs,
+	       m->bytes);
+	fflush(stdout);
+	free(rounds);
+}
@@ -0,0 +1,89 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#ifndef BEER_BENCH_H_INCLUDED
+#define BEER_BENCH_H_INCLUDED
+
+/**
+ * \file bench.h
+ * \brief Micro-benchmark harness
+ *
+ * Every benchmark is run for a number of iterations, that is calibrated to
+ * take at least bench_time seconds, and then measured bench_rounds times.
+ * The median round is reported as ns/op, allocations/op and allocated
+ * bytes/op. Allocations are counted with allocator set by beer_mem_init().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Benchmark body, must run operation n times
+ */
+typedef void (*bench_f)(void *ctx, uint64_t n);
+
+/**
+ * \brief Minimal time of one round (in seconds)
+ */
+extern double bench_time;
+
+/**
+ * \brief Count of measured rounds
+ */
+extern int bench_rounds;
+
+/**
+ * \brief Value, that benchmarks accumulate results in (so compiler won't
+ * throw them away)
+ */
+extern volatile uint64_t bench_sink;
+
+/**
+ * \brief Install counting allocator and parse command line
+ *
+ * Usage: prog [-t seconds] [-r rounds] [filter]
+ *
+ * \retval  0 ok
+ * \retval -1 bad arguments
+ */
+int
+bench_init(int argc, char **argv);
+
+/**
+ * \brief Run benchmark and print its results
+ *
+ * Benchmark is skipped, if its name doesn't contain the filter.
+ *
+ * \param name benchmark name
+ * \param f    benchmark body
+ * \param ctx  benchmark context
+ */
+void
+bench_run(const char *name, bench_f f, void *ctx);
+
+#endif /* BEER_BENCH_H_INCLUDED */
@@ -43,6 +43,7 @@ extern "C" {
 #include <stdarg.h>
 
 #include <beer/beer_mem.h>
+#include <beer/beer_arena.h>
 #include <beer/beer_proto.h>
 #include <beer/beer_reply.h>
 #include <beer/beer_stream.h>
@@ -58,6 +59,9 @@ extern "C" {
 #include <beer/beer_update.h>
 #include <beer/beer_schema.h>
 #include <beer/beer_request.h>
+#include <beer/beer_pending.h>
+#include <beer/beer_pool.h>
+#include <beer/beer_batch.h>
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,162 @@
+#ifndef BEER_ARENA_H_INCLUDED
+#define BEER_ARENA_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_arena.h
+ * \brief Arena allocator for batches of requests and replies
+ *
+ * While an arena is entered by a thread, request objects, buffer streams
+ * and reply buffers created by the thread are carved from the arena's
+ * slabs, instead of being allocated one by one. Freeing them is (almost)
+ * free, and all of them are released at once by beer_arena_reset().
+ *
+ * Objects carved from an arena must not be used (or freed) after the arena
+ * is reset. Long-lived objects, like network streams, shouldn't be created
+ * while an arena is entered.
+ *
+ * \code{.c}
+ * struct beer_arena arena;
+ * beer_arena_new(&arena, 0);
+ * beer_arena_enter(&arena);
+ * // build requests, read and process replies
+ * beer_arena_leave(&arena);
+ * beer_arena_reset(&arena);
+ * \endcode
+ */
+
+#include <stddef.h>
+
+/**
+ * \brief Default size of the first slab
+ */
+#define BEER_ARENA_SLAB 65536
+
+struct beer_arena_slab;
+
+/**
+ * \brief Arena allocator
+ */
+struct beer_arena {
+	struct beer_arena_slab *slab; /*!< current slab, followed by the older */
+	size_t slab_size; /*!< size of the next slab */
+	struct beer_arena *prev; /*!< arena entered before this one */
+	int alloc; /*!< allocation mark */
+};
+
+/**
+ * \brief Create arena
+ *
+ * if arena pointer is NULL, then new arena will be allocated
+ *
+ * \param a         arena pointer
+ * \param slab_size size of the first slab (BEER_ARENA_SLAB if 0), next ones
+ *                  are twice as big as the previous
+ *
+ * \returns arena pointer
+ * \retval  NULL oom
+ */
+struct beer_arena *
+beer_arena_new(struct beer_arena *a, size_t slab_size);
+
+/**
+ * \brief Allocate memory from arena
+ *
+ * Memory is aligned on 16 bytes.
+ *
+ * \param a    arena pointer
+ * \param size size of memory block
+ *
+ * \returns pointer to memory block
+ * \retval  NULL oom
+ */
+void *
+beer_arena_alloc(struct beer_arena *a, size_t size);
+
+/**
+ * \brief Route allocations of request objects and replies of the current
+ * thread to arena
+ *
+ * Arenas may be nested, beer_arena_leave() returns to the enclosing one.
+ *
+ * \param a arena pointer
+ */
+void
+beer_arena_enter(struct beer_arena *a);
+
+/**
+ * \brief Stop routing allocations to arena
+ *
+ * \param a arena pointer
+ */
+void
+beer_arena_leave(struct beer_arena *a);
+
+/**
+ * \brief Release all memory carved from arena
+ *
+ * If the batch took more than one slab, then slabs are replaced with one
+ * that fits the whole batch, so the next batch of the same size doesn't
+ * allocate memory.
+ *
+ * \param a arena pointer
+ */
+void
+beer_arena_reset(struct beer_arena *a);
+
+/**
+ * \brief Free arena with all its slabs
+ *
+ * \param a arena pointer
+ */
+void
+beer_arena_free(struct beer_arena *a);
+
+/**
+ * \internal
+ * \brief Grow the last allocated block in place
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 it's not the last block, or there's no room
+ */
+int
+beer_arena_extend(struct beer_arena *a, void *ptr, size_t size,
+		  size_t new_size);
+
+/**
+ * \internal
+ * \brief Give memory block back, it's reused only if it's the last one
+ */
+void
+beer_arena_release(struct beer_arena *a, void *ptr, size_t size);
+
+#endif /* BEER_ARENA_H_INCLUDED */
@@ -0,0 +1,185 @@
+#ifndef BEER_BATCH_H_INCLUDED
+#define BEER_BATCH_H_INCLUDED
+
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_batch.h
+ * \brief Pipelined batch of requests
+ *
+ * Requests of any type are appended to a batch, encoded back to back, and
+ * sent with one write when the batch is sent. Replies are collected by
+ * their sync into items, that are indexed in order of submission, so bulk
+ * loading takes one round trip per batch instead of one per request.
+ *
+ * \code{.c}
+ * struct beer_batch b;
+ * beer_batch_init(&b, s);
+ * for (i = 0; i < 1000; i++) {
+ *	beer_request_set_tuple(req, tuples[i]);
+ *	beer_batch_add(&b, req);
+ * }
+ * if (beer_batch_send(&b) == -1 || beer_batch_recv(&b) == -1)
+ *	// items with BEER_BATCH_FAILED status weren't answered
+ * for (i = 0; i < b.count; i++)
+ *	if (b.items[i].status == BEER_BATCH_ERROR)
+ *		// b.items[i].reply.code, b.items[i].reply.error
+ * beer_batch_free(&b);
+ * \endcode
+ */
+
+#include <stdint.h>
+
+#include <beer/beer_reply.h>
+#include <beer/beer_net.h>
+
+struct beer_stream;
+struct beer_request;
+
+/**
+ * \brief State of batch item
+ */
+enum beer_batch_status {
+	BEER_BATCH_QUEUED, /*!< Encoded, but not sent yet */
+	BEER_BATCH_SENT, /*!< Sent, waiting for reply */
+	BEER_BATCH_OK, /*!< Reply received */
+	BEER_BATCH_ERROR, /*!< Server replied with error (see reply code) */
+	BEER_BATCH_FAILED /*!< Reply won't be received (see error) */
+};
+
+/**
+ * \brief Request of batch with its reply
+ */
+struct beer_batch_item {
+	uint64_t sync; /*!< Sync of the request */
+	enum beer_batch_status status; /*!< State of the request */
+	enum beer_error error; /*!< Stream error, if BEER_BATCH_FAILED */
+	struct beer_reply reply; /*!< Reply, if BEER_BATCH_OK or BEER_BATCH_ERROR */
+};
+
+/**
+ * \brief Batch of requests to a network stream
+ */
+struct beer_batch {
+	struct beer_stream *s; /*!< Network stream */
+	struct beer_stream *buf; /*!< Encoded requests, that aren't sent yet */
+	struct beer_batch_item *items; /*!< Items in order of submission */
+	uint32_t count; /*!< Count of items */
+	uint32_t size; /*!< Count of allocated items */
+	uint32_t sent; /*!< Count of sent items */
+	uint32_t received; /*!< Count of sent items, that are done */
+	int sorted; /*!< Syncs of items grow (they didn't wrap) */
+	int alloc; /*!< allocation mark */
+};
+
+/**
+ * \brief Initialize batch
+ *
+ * if batch pointer is NULL, then new batch will be allocated
+ *
+ * \param b batch pointer
+ * \param s network stream, requests are sent to
+ *
+ * \returns batch pointer
+ * \retval  NULL oom
+ */
+struct beer_batch *
+beer_batch_init(struct beer_batch *b, struct beer_stream *s);
+
+/**
+ * \brief Append request to batch
+ *
+ * Request is encoded right away, with the sync of the stream, so request
+ * object (and its key and tuple) may be changed or freed after that.
+ *
+ * \param b   batch pointer
+ * \param req request pointer
+ *
+ * \returns index of the item
+ * \retval  -1 oom
+ */
+int64_t
+beer_batch_add(struct beer_batch *b, struct beer_request *req);
+
+/**
+ * \brief Send queued requests of batch
+ *
+ * All of them are written at once, and the stream is flushed. Requests
+ * bigger than the send buffer of the stream don't fail, they are sent
+ * directly from the batch.
+ *
+ * \param b batch pointer
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 error (see beer_error() of the stream)
+ */
+int
+beer_batch_send(struct beer_batch *b);
+
+/**
+ * \brief Receive replies to sent requests of batch
+ *
+ * Replies to requests, that don't belong to the batch, are dispatched to
+ * their completion callbacks, or parked (see beer_pending_add()).
+ * On a network error the items without reply are marked as failed.
+ * Non-blocking stream receives only the replies that are already available,
+ * and fails with BEER_EAGAIN until all of them are received.
+ *
+ * \param b batch pointer
+ *
+ * \returns status
+ * \retval  0 all replies are received
+ * \retval -1 error (see beer_error() of the stream)
+ */
+int
+beer_batch_recv(struct beer_batch *b);
+
+/**
+ * \brief Free replies and empty batch, to be filled again
+ *
+ * Replies to sent requests, that weren't received yet, are still
+ * dispatched by the stream, as replies nobody waits for.
+ *
+ * \param b batch pointer
+ */
+void
+beer_batch_reset(struct beer_batch *b);
+
+/**
+ * \brief Free batch
+ *
+ * \param b batch pointer
+ */
+void
+beer_batch_free(struct beer_batch *b);
+
+#endif /* BEER_BATCH_H_INCLUDED */
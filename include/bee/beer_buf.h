@@ -35,6 +35,11 @@
  * \brief basic buffer structure
  */
 
+/*!
+ * Initial capacity of buffer stream
+ */
+#define BEER_BUF_MIN 128
+
 /*!
  * Type for resize function
  */
@@ -85,4 +90,38 @@ beer_buf(struct beer_stream *s);
 struct beer_stream *
 beer_buf_as(struct beer_stream *s, char *buf, size_t buf_len);
 
+/**
+ * \brief Make room for at least size more bytes
+ *
+ * \param s    stream buffer pointer
+ * \param size count of bytes to be written
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 memory allocation failure, or buffer constructed from
+ *            user's string
+ */
+int
+beer_buf_reserve(struct beer_stream *s, size_t size);
+
+/**
+ * \brief Release memory that isn't used by buffer data
+ *
+ * \param s stream buffer pointer
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 memory allocation failure
+ */
+int
+beer_buf_shrink(struct beer_stream *s);
+
+/**
+ * \brief Empty buffer, keeping its memory for reuse
+ *
+ * \param s stream buffer pointer
+ */
+void
+beer_buf_reset(struct beer_stream *s);
+
 #endif /* BEER_BUF_H_INCLUDED */
@@ -49,4 +49,29 @@ ssize_t
 beer_delete(struct beer_stream *s, uint32_t space, uint32_t index,
 	   struct beer_stream *key);
 
+/**
+ * \brief Write delete request by scalar key to stream
+ *
+ * Request is encoded on stack, nothing is allocated.
+ *
+ * \param s     stream instance
+ * \param space space number to delete object from
+ * \param index index to search key in
+ * \param key   key to delete tuple with (key1, key2 - parts of two-part
+ *              key; len - length of string key)
+ *
+ * \retval number of bytes written to stream
+ */
+ssize_t
+beer_delete_uint(struct beer_stream *s, uint32_t space, uint32_t index,
+		uint64_t key);
+
+ssize_t
+beer_delete_uint2(struct beer_stream *s, uint32_t space, uint32_t index,
+		 uint64_t key1, uint64_t key2);
+
+ssize_t
+beer_delete_str(struct beer_stream *s, uint32_t space, uint32_t index,
+	       const char *key, uint32_t len);
+
 #endif /* BEER_DELETE_H_INCLUDED */
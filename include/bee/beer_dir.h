@@ -30,6 +30,13 @@
  * SUCH DAMAGE.
  */
 
+/**
+ * \file beer_dir.h
+ * \brief List of xlog or snapshot files of directory, sorted by lsn
+ */
+
+#include <stdint.h>
+
 enum beer_dir_type {
 	BEER_DIR_XLOG,
 	BEER_DIR_SNAPSHOT
@@ -0,0 +1,152 @@
+#ifndef BEER_EXPORT_H_INCLUDED
+#define BEER_EXPORT_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_export.h
+ * \brief Export of snapshot rows into columnar files
+ *
+ * Rows of every space are written into its own file, "<space name>.col"
+ * in output directory. Columns are named and typed by format of space,
+ * that is read from _space rows of the snapshot itself (they precede rows
+ * of user spaces). Fields that aren't in format are named "field_<n>".
+ *
+ * File consists of row groups (up to group_rows rows), every group holds
+ * a chunk of every column. Layout (integers are little-endian):
+ *
+ * \code
+ * "BEERCOL1"
+ * column chunks of group 0, group 1, ...
+ * footer (msgpack map, see below)
+ * uint32 footer size
+ * "BEERCOL1"
+ * \endcode
+ *
+ * Footer:
+ *
+ * \code
+ * {"space_id": id, "name": name, "rows": count,
+ *  "columns": [{"name": name, "type": type from format}, ...],
+ *  "groups": [{"rows": count, "columns": [{"encoding": encoding,
+ *              "offset": offset, "size": size, "nulls": count,
+ *              "min": value, "max": value, "distinct": count}, ...]}, ...]}
+ * \endcode
+ *
+ * min and max are present for numeric and string chunks, distinct for
+ * dictionary encoded chunks. Chunks of later groups may have more columns
+ * (fields added to tuples). Chunk starts with validity bitmap (bit i is
+ * set if row i has value) if nulls isn't zero, then values follow by
+ * encoding:
+ *
+ * - "null": nothing, all values are nulls;
+ * - "u64", "i64", "double": 8 bytes per row;
+ * - "bool": bitmap;
+ * - "dict": uint32 count, count strings as uint32 length and bytes
+ *   (sorted), then index of string per row, of 1, 2 or 4 bytes (by count);
+ * - "str": uint32 offsets (rows + 1) and string bytes;
+ * - "msgpack": uint32 offsets (rows + 1) and msgpack of values.
+ *
+ * Encoding is chosen by values of chunk, so export is lossless: values,
+ * that don't fit typed encoding, are kept as msgpack.
+ */
+
+#include <stdint.h>
+
+#include <beer/beer_log.h>
+
+/**
+ * \brief Default count of rows in group
+ */
+#define BEER_EXPORT_GROUP_ROWS 65536
+
+struct beer_export_space;
+
+/**
+ * \brief Columnar exporter
+ */
+struct beer_export {
+	char *path; /*!< output directory */
+	uint32_t group_rows; /*!< count of rows in group */
+	int system; /*!< export system spaces (with id < 512) too */
+	uint64_t rows; /*!< count of exported rows */
+	struct beer_export_space *spaces; /*!< spaces by id */
+	int count; /*!< count of spaces */
+	int top; /*!< allocated spaces */
+	enum beer_log_error error; /*!< error of the last operation */
+	int errno_; /*!< errno, if error is BEER_LOG_ESYSTEM */
+};
+
+/**
+ * \brief Initialize exporter into directory path (it must exist)
+ *
+ * \retval  0 ok
+ * \retval -1 memory allocation failed
+ */
+int
+beer_export_init(struct beer_export *e, const char *path);
+
+/**
+ * \brief Export row
+ *
+ * Insert and replace rows are exported, rows of _space define format of
+ * spaces. Other rows are skipped.
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int
+beer_export_row(struct beer_export *e, const struct beer_xrow *row);
+
+/**
+ * \brief Write the rest of rows and footers, close files
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int
+beer_export_flush(struct beer_export *e);
+
+/**
+ * \brief Export all rows of snapshot file and flush
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int
+beer_export_snapshot(struct beer_export *e, const char *file);
+
+/**
+ * \brief Free exporter (files that weren't flushed are closed as is)
+ */
+void
+beer_export_free(struct beer_export *e);
+
+#endif /* BEER_EXPORT_H_INCLUDED */
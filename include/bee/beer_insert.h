@@ -59,4 +59,32 @@ beer_insert(struct beer_stream *s, uint32_t space, struct beer_stream *tuple);
 ssize_t
 beer_replace(struct beer_stream *s, uint32_t space, struct beer_stream *tuple);
 
+/**
+ * \brief Construct insert request with encoded tuple and write it into
+ * stream
+ *
+ * Tuple may be encoded on stack with msgpuck, request header is encoded on
+ * stack too, nothing is allocated.
+ *
+ * \param s     stream object to write request to
+ * \param space space no to insert tuple into
+ * \param tuple msgpack array with tuple to insert
+ * \param size  size of tuple
+ *
+ * \retval number of bytes written to stream
+ */
+ssize_t
+beer_insert_mp(struct beer_stream *s, uint32_t space, const char *tuple,
+	      size_t size);
+
+/**
+ * \brief Construct replace request with encoded tuple and write it into
+ * stream
+ *
+ * \sa beer_insert_mp
+ */
+ssize_t
+beer_replace_mp(struct beer_stream *s, uint32_t space, const char *tuple,
+	       size_t size);
+
 #endif /* BEER_INSERT_H_INCLUDED */
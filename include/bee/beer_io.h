@@ -41,6 +41,8 @@
 
 enum beer_error
 beer_io_connect(struct beer_stream_net *s);
+enum beer_error
+beer_io_connect_check(struct beer_stream_net *s);
 void
 beer_io_close(struct beer_stream_net *s);
 
@@ -63,4 +65,14 @@ beer_io_sendv(struct beer_stream_net *s, struct iovec *iov, int count);
 ssize_t
 beer_io_recv(struct beer_stream_net *s, char *buf, size_t size);
 
+/*
+ * Make sure that the next reply is fully buffered in rbuf, starting at
+ * rbuf.off. Returns 0 and the frame size (with length prefix) in size,
+ * 1 if the frame can't be placed in rbuf (caller must copy it out with
+ * beer_io_recv), -1 on error. In non-blocking mode rbuf is grown to fit
+ * the frame and 1 is never returned.
+ */
+int
+beer_io_peek(struct beer_stream_net *s, size_t *size);
+
 #endif /* BEER_IO_H_INCLUDED */
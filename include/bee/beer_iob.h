@@ -39,6 +39,13 @@
 typedef ssize_t (*beer_iob_tx_t)(void *ptr, const char *buf, size_t size);
 typedef ssize_t (*beer_iob_txv_t)(void *ptr, struct iovec *iov, int count);
 
+/* caller's memory, that is sent before buf + off on flush */
+struct beer_iob_ref {
+	size_t off;
+	const char *data;
+	size_t size;
+};
+
 struct beer_iob {
 	char *buf;
 	size_t off;
@@ -47,6 +54,13 @@ struct beer_iob {
 	beer_iob_tx_t tx;
 	beer_iob_txv_t txv;
 	void *ptr;
+	size_t pin; /* count of replies that point into buf */
+	size_t low; /* start of the first pinned reply */
+	int mirror; /* buf is a ring, mapped twice in a row */
+	struct beer_iob_ref *ref; /* writes queued by reference, in order */
+	int ref_count;
+	size_t peak; /* the most data buffered at once, since the last check */
+	int rounds; /* count of times peak was updated */
 };
 
 int
@@ -59,4 +73,23 @@ beer_iob_clear(struct beer_iob *iob);
 void
 beer_iob_free(struct beer_iob *iob);
 
+int
+beer_iob_init_ring(struct beer_iob *iob, size_t size, beer_iob_tx_t tx,
+		  void *ptr);
+
+int
+beer_iob_resize(struct beer_iob *iob, size_t size);
+
+size_t
+beer_iob_room(struct beer_iob *iob);
+
+void
+beer_iob_wrap(struct beer_iob *iob);
+
+void
+beer_iob_pin(struct beer_iob *iob);
+
+void
+beer_iob_unpin(struct beer_iob *iob);
+
 #endif /* BEER_IOB_H_INCLUDED */
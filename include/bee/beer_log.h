@@ -0,0 +1,177 @@
+#ifndef BEER_LOG_H_INCLUDED
+#define BEER_LOG_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_log.h
+ * \brief Reader of xlog and snapshot files
+ *
+ * File starts with text header (file type, version, server uuid and
+ * vclock), followed by rows. Every row is prefixed with fixed header:
+ * row marker, msgpack length of row, crc32c of previous row (unused) and
+ * crc32c of row, padded to BEER_LOG_FIXHEADER_SIZE bytes. File ends with
+ * eof marker (it's missing while server still writes the file).
+ *
+ * Regular files are mapped into memory and rows are decoded in place of
+ * the mapping, without copying and allocation. Pipes (and files that can't
+ * be mapped) are read with stdio into a row buffer.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <beer/beer_xrow.h>
+
+#define BEER_LOG_MAGIC_XLOG "XLOG\n"
+#define BEER_LOG_MAGIC_SNAP "SNAP\n"
+#define BEER_LOG_VERSION "0.12\n"
+#define BEER_LOG_VERSION_13 "0.13\n"
+
+/**
+ * \brief Row marker (as it's stored in file, big-endian)
+ */
+#define BEER_LOG_MARKER 0xd5ba0babU
+/**
+ * \brief End of file marker (as it's stored in file, big-endian)
+ */
+#define BEER_LOG_MARKER_EOF 0xd510adedU
+/**
+ * \brief Size of fixed header of row (with marker)
+ */
+#define BEER_LOG_FIXHEADER_SIZE 19
+
+enum beer_log_error {
+	BEER_LOG_EOK,
+	BEER_LOG_EFAIL,
+	BEER_LOG_EMEMORY,
+	BEER_LOG_ETYPE,
+	BEER_LOG_EVERSION,
+	BEER_LOG_ECORRUPT,
+	BEER_LOG_ESYSTEM,
+	BEER_LOG_LAST
+};
+
+enum beer_log_type {
+	BEER_LOG_NONE,
+	BEER_LOG_XLOG,
+	BEER_LOG_SNAPSHOT
+};
+
+/**
+ * \brief Log file reader
+ */
+struct beer_log {
+	enum beer_log_type type; /*!< file type */
+	FILE *fd; /*!< file */
+	off_t current_offset; /*!< offset of the current row (of its marker) */
+	off_t offset; /*!< offset of the next row */
+	char server_uuid[BEER_UUID_STR_LEN + 1]; /*!< uuid of server */
+	struct beer_vclock vclock; /*!< vclock from file header, moved forward
+				   * with every row read */
+	struct beer_xrow current; /*!< current row */
+	uint32_t current_crc32c; /*!< checksum of current row */
+	char *buf; /*!< buffer of current row (if file isn't mapped) */
+	size_t buf_size; /*!< size of row buffer */
+	const char *map; /*!< file mapping (NULL if file isn't mapped) */
+	size_t map_size; /*!< size of file mapping */
+	int follow; /*!< extend mapping if file grows (on by default) */
+	enum beer_log_error error; /*!< error of the last operation */
+	int errno_; /*!< errno, if error is BEER_LOG_ESYSTEM */
+};
+
+/**
+ * \brief Guess file type by extension
+ */
+enum beer_log_type
+beer_log_guess(const char *file);
+
+/**
+ * \brief Open log file and read its header
+ *
+ * \param l    log pointer
+ * \param file file name (stdin if NULL)
+ * \param type expected file type
+ *
+ * \returns error status
+ * \retval  BEER_LOG_EOK ok
+ */
+enum beer_log_error
+beer_log_open(struct beer_log *l, const char *file, enum beer_log_type type);
+
+/**
+ * \brief Continue reading from offset (that was returned as offset of the
+ * next row)
+ */
+int
+beer_log_seek(struct beer_log *l, off_t offset);
+
+/**
+ * \brief Find the first row marker at or after offset
+ *
+ * File must be mapped. Marker bytes may occur in row data, so only the
+ * marker of complete row with valid fixed header and checksum is returned.
+ *
+ * \returns offset of row marker
+ * \retval  -1 marker isn't found
+ */
+off_t
+beer_log_find(struct beer_log *l, off_t offset);
+
+/**
+ * \brief Close log file, unmap it and free row buffer
+ */
+void
+beer_log_close(struct beer_log *l);
+
+/**
+ * \brief Read next row
+ *
+ * Row stays valid until the next call. If the last row is incomplete (the
+ * file is still written), NULL is returned and the row will be read
+ * again by the next call.
+ *
+ * \returns row pointer
+ * \retval  NULL end of file (error is BEER_LOG_EOK) or error
+ */
+struct beer_xrow *
+beer_log_next(struct beer_log *l);
+
+enum beer_log_error
+beer_log_error(struct beer_log *l);
+
+char *
+beer_log_strerror(struct beer_log *l);
+
+int
+beer_log_errno(struct beer_log *l);
+
+#endif /* BEER_LOG_H_INCLUDED */
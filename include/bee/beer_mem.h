@@ -99,4 +99,38 @@ beer_mem_dup(char *sz);
 void
 beer_mem_free(void *ptr);
 
+struct beer_arena;
+
+/**
+ * \brief Internal function
+ *
+ * Set arena for batch allocations of the current thread
+ *
+ * \returns previous arena
+ */
+struct beer_arena *
+beer_mem_arena(struct beer_arena *a);
+
+/**
+ * \brief Internal function
+ *
+ * Allocate short-lived block (request object or reply), that is carved
+ * from the current arena, if there's one. It must be freed with
+ * beer_mem_batch_free()
+ */
+void *
+beer_mem_batch_alloc(size_t size);
+
+/**
+ * \brief Internal function
+ */
+void *
+beer_mem_batch_realloc(void *ptr, size_t size);
+
+/**
+ * \brief Internal function
+ */
+void
+beer_mem_batch_free(void *ptr);
+
 #endif /* BEER_MEM_H_INCLUDED */
@@ -62,9 +62,35 @@ enum beer_error {
 	BEER_ETMOUT, /*!< Operation timeout */
 	BEER_EBADVAL, /*!< Bad argument (value) */
 	BEER_ELOGIN, /*!< Failed to login */
+	BEER_EAGAIN, /*!< Operation would block, try again later */
 	BEER_LAST /*!< Not an error */
 };
 
+/**
+ * \brief Connection state of network stream
+ */
+enum beer_net_state {
+	BEER_NET_CLOSED, /*!< Not connected */
+	BEER_NET_CONNECTING, /*!< Waiting for connect(2) to complete */
+	BEER_NET_GREETING, /*!< Waiting for greeting */
+	BEER_NET_AUTH, /*!< Waiting for authentication reply */
+	BEER_NET_SPACES, /*!< Waiting for space list */
+	BEER_NET_INDEXES, /*!< Waiting for index list */
+	BEER_NET_READY /*!< Connected and authenticated */
+};
+
+/**
+ * \brief Events that non-blocking stream is waiting for
+ * \sa beer_want
+ */
+#define BEER_WANT_READ  1
+#define BEER_WANT_WRITE 2
+
+struct mh_pending_t;
+struct mh_retry_t;
+struct beer_retry_frames;
+struct beer_uring;
+
 /**
  * \brief Network stream structure
  */
@@ -79,6 +105,14 @@ struct beer_stream_net {
 	char *greeting; /*!< Pointer to greeting, if connected */
 	struct beer_schema *schema; /*!< Collation for space/index string<->number */
 	int inited; /*!< 1 if iob/schema were allocated */
+	enum beer_net_state state; /*!< Connection state */
+	struct mh_pending_t *pending; /*!< Pending requests and parked replies by sync */
+	uint64_t schema_id; /*!< Schema id from the last reply of server */
+	struct beer_schema *loading; /*!< Schema being loaded in non-blocking mode */
+	struct mh_retry_t *retry; /*!< Requests kept to be sent again by sync */
+	uint32_t retry_ready; /*!< Count of kept replies of requests that failed */
+	struct beer_retry_frames *retry_frames; /*!< Copies of kept requests */
+	struct beer_uring *uring; /*!< io_uring transport, if it's used */
 };
 
 /*!
@@ -160,6 +194,10 @@ beer_init(struct beer_stream *s);
  *
  * \retval 0  ok
  * \retval -1 error (network/oom)
+ *
+ * With BEER_OPT_NONBLOCK set, connection, authentication and schema loading
+ * are done step by step: if -1 is returned and beer_error() is BEER_EAGAIN,
+ * then wait for events from beer_want() on beer_fd() and call it again.
  */
 int
 beer_connect(struct beer_stream *s);
@@ -178,10 +216,24 @@ beer_close(struct beer_stream *s);
  *
  * \returns number of bytes written to socket
  * \retval -1 on network error
+ *
+ * With BEER_OPT_NONBLOCK set, only the part that socket accepts is sent and
+ * the rest is kept in buffer; error is set to BEER_EAGAIN then (-1 is returned
+ * only if nothing was sent).
  */
 ssize_t
 beer_flush(struct beer_stream *s);
 
+/**
+ * \brief Get events that non-blocking stream is waiting for
+ *
+ * \param s stream pointer
+ *
+ * \returns mask of BEER_WANT_READ and BEER_WANT_WRITE
+ */
+int
+beer_want(struct beer_stream *s);
+
 /**
  * \brief Get beer_net stream fd
  */
@@ -218,6 +270,20 @@ beer_errno(struct beer_stream *s);
 int
 beer_reload_schema(struct beer_stream *s);
 
+/**
+ * \brief Reload schema, only if server's schema id changed
+ *
+ * Schema id of server is taken from the last reply on the stream.
+ *
+ * \param s stream pointer
+ *
+ * \returns result
+ * \retval  -1 error
+ * \retval  0  ok
+ */
+int
+beer_check_schema(struct beer_stream *s);
+
 /**
  * \brief Get space number from space name
  *
@@ -54,11 +54,15 @@ struct beer_sbo_stack {
  * - BEER_SBO_PACKED - 1 byte is alloced for map/array, if needed more, then
  *                    everything is moved to n bytes, when called
  *                    "beer_object_container_close"
+ * - BEER_SBO_DEFERRED - headers of map/array are kept aside, and inserted
+ *                    with their real sizes, when the outermost container is
+ *                    closed (data is moved once, whatever depth of nesting)
  */
 enum beer_sbo_type {
 	BEER_SBO_SIMPLE = 0,
 	BEER_SBO_SPARSE,
 	BEER_SBO_PACKED,
+	BEER_SBO_DEFERRED,
 };
 
 struct beer_sbuf_object {
@@ -66,6 +70,9 @@ struct beer_sbuf_object {
 	uint8_t stack_size;
 	uint8_t stack_alloc;
 	enum beer_sbo_type type;
+	struct beer_sbo_stack *slots; /*!< headers for BEER_SBO_DEFERRED */
+	size_t slots_count;
+	size_t slots_alloc;
 };
 
 #define BEER_OBJ_CAST(SB) ((struct beer_sbuf_object *)(SB)->subdata)
@@ -170,7 +177,8 @@ ssize_t
 beer_object_add_map(struct beer_stream *s, uint32_t size);
 
 /**
- * \brief Close array/map in case BEER_SBO_PACKED/BEER_SBO_SPARSE were used
+ * \brief Close array/map in case BEER_SBO_PACKED/BEER_SBO_SPARSE/
+ * BEER_SBO_DEFERRED were used
  * \sa beer_sbo_type
  */
 ssize_t
@@ -245,4 +253,72 @@ beer_object_format(struct beer_stream *s, const char *fmt, ...);
 ssize_t
 beer_object_vformat(struct beer_stream *s, const char *fmt, va_list vl);
 
+/**
+ * \brief compiled format string
+ *
+ * Format string of beer_object_format, turned into a program: headers of
+ * containers (their sizes are known from the format) and nils are encoded
+ * beforehand, so it's executed in one forward pass, without moving data.
+ */
+struct beer_format {
+	char    *ops;   /*!< program */
+	size_t   size;  /*!< program size */
+	size_t   fixed; /*!< max size of msgpack without string data */
+	uint32_t count; /*!< count of values on the top level */
+};
+
+/**
+ * \brief compile format string
+ *
+ * \param f   format to compile into
+ * \param fmt format string (see beer_object_format)
+ *
+ * \retval  0 ok
+ * \retval -1 oom, unbalanced containers, map with odd count of values,
+ *            or unknown format specifier
+ */
+int
+beer_format_compile(struct beer_format *f, const char *fmt);
+
+/**
+ * \brief free compiled format
+ */
+void
+beer_format_free(struct beer_format *f);
+
+/**
+ * \brief append msgpack values to beer_object by compiled format string
+ *
+ * Output is the same as of beer_object_format with the same format and
+ * arguments, but the object type isn't changed and something may be
+ * written before (for example, into a container, that is opened with
+ * beer_object_add_array).
+ *
+ * \code{.c}
+ * struct beer_format f;
+ * beer_format_compile(&f, "[%d%s{%s%lu}]");
+ * for (int i = 0; i < n; i++) {
+ * 	beer_object_reset(s);
+ * 	beer_object_format_compiled(s, &f, i, names[i], "ts", ts[i]);
+ * 	...
+ * }
+ * beer_format_free(&f);
+ * \endcode
+ *
+ * \returns count of bytes written
+ * \retval  -1 oom or immutable object
+ * \sa beer_format_compile
+ */
+ssize_t
+beer_object_format_compiled(struct beer_stream *s, const struct beer_format *f,
+			   ...);
+
+/**
+ * \brief append msgpack values by compiled format string (va_list variation)
+ * \sa beer_object_format_compiled
+ */
+ssize_t
+beer_object_vformat_compiled(struct beer_stream *s, const struct beer_format *f,
+			    va_list vl);
+
 #endif /* BEER_OBJECT_H_INCLUDED */
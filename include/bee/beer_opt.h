@@ -38,6 +38,7 @@
  */
 
 struct beer_iob;
+struct beer_schema;
 
 /**
  * \brief Callback type for read (instead of reading from socket)
@@ -95,7 +96,24 @@ enum beer_opt_type {
 	BEER_OPT_RECV_CB_ARG, /*!< callback context for recv
 			      * \sa recv_cb_t
 			      */
-	BEER_OPT_RECV_BUF /*!< Option for setting recv buffer size */
+	BEER_OPT_RECV_BUF, /*!< Option for setting recv buffer size */
+	BEER_OPT_ZERO_COPY, /*!< Point replies into recv buffer instead of copying */
+	BEER_OPT_NONBLOCK, /*!< Never block on socket, return BEER_EAGAIN instead */
+	BEER_OPT_SCHEMA, /*!< Share external schema between streams */
+	BEER_OPT_SCHEMA_CHECK, /*!< Send schema id with requests, retry them on
+			       *  BEER_ER_WRONG_SCHEMA_VERSION */
+	BEER_OPT_SEND_REF, /*!< Send writes of at least this size from caller's
+			   *  memory on flush, instead of copying them */
+	BEER_OPT_IO_URING, /*!< Send and receive through io_uring, if it's
+			   *  available */
+	BEER_OPT_SOCK_SEND_BUF, /*!< Kernel send buffer of socket: 0 - sized
+				 *  by kernel, -1 - the largest allowed */
+	BEER_OPT_SOCK_RECV_BUF, /*!< Kernel recv buffer of socket: 0 - sized
+				 *  by kernel, -1 - the largest allowed */
+	BEER_OPT_TRUSTED, /*!< Don't validate data of replies, server is
+			   *  trusted */
+	BEER_OPT_ADAPTIVE_BUF /*!< Grow and shrink send/recv buffers by
+			       *  traffic, up to this size */
 };
 
 /**
@@ -115,6 +133,16 @@ struct beer_opt {
 	void *recv_cb;
 	void *recv_cb_arg;
 	int recv_buf;
+	int zero_copy;
+	int nonblock;
+	struct beer_schema *schema;
+	int schema_check;
+	int send_ref;
+	int io_uring;
+	int sock_send_buf;
+	int sock_recv_buf;
+	int trusted;
+	int adaptive_buf;
 };
 
 /**
@@ -0,0 +1,152 @@
+#ifndef BEER_PENDING_H_INCLUDED
+#define BEER_PENDING_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_pending.h
+ * \brief Matching replies with requests by sync
+ *
+ * Replies on a network stream come in the order they are produced by the
+ * server, which isn't the order requests were sent in. Replies are matched
+ * by their sync: a caller can wait for a specific one, or register a
+ * completion callback. Replies nobody waits for yet are parked until they
+ * are claimed.
+ *
+ * \code{.c}
+ * uint64_t sync = s->reqid;
+ * beer_ping(s);
+ * beer_flush(s);
+ * struct beer_reply r;
+ * beer_reply_init(&r);
+ * assert(beer_reply_sync(s, sync, &r) == 0);
+ * beer_reply_free(&r);
+ * \endcode
+ */
+
+struct beer_stream;
+struct beer_reply;
+
+/**
+ * \brief Completion callback for pending request
+ *
+ * \param s   stream pointer
+ * \param r   reply for the request (it's freed after callback returns)
+ * \param arg callback argument
+ */
+typedef void (*beer_pending_cb_t)(struct beer_stream *s, struct beer_reply *r,
+				  void *arg);
+
+/**
+ * \brief Register completion callback for request
+ *
+ * If the reply is already parked, then callback is called immediately.
+ *
+ * \param s    network stream pointer
+ * \param sync sync of the request
+ * \param cb   completion callback
+ * \param arg  callback argument
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 oom
+ */
+int
+beer_pending_add(struct beer_stream *s, uint64_t sync, beer_pending_cb_t cb,
+		 void *arg);
+
+/**
+ * \brief Read replies and dispatch them to completion callbacks
+ *
+ * Replies without registered callback are parked.
+ * Blocking stream reads until all replies are received, non-blocking one
+ * reads only the replies that are already available.
+ *
+ * \param s network stream pointer
+ *
+ * \returns count of received replies
+ * \retval -1 error
+ */
+int
+beer_pending_dispatch(struct beer_stream *s);
+
+/**
+ * \brief Wait for reply to request with specified sync
+ *
+ * Other replies that are received meanwhile are dispatched to their
+ * callbacks, or parked.
+ *
+ * \param s    network stream pointer
+ * \param sync sync of the request
+ * \param r    reply object pointer
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval  1 there's no such request in flight
+ * \retval -1 error (BEER_EAGAIN, if non-blocking stream has no reply yet)
+ */
+int
+beer_reply_sync(struct beer_stream *s, uint64_t sync, struct beer_reply *r);
+
+/**
+ * \internal
+ * \brief Call completion callback for reply, or park it
+ *
+ * Reply is freed, or moved to the parked one.
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 oom
+ */
+int
+beer_pending_route(struct beer_stream *s, struct beer_reply *r);
+
+/**
+ * \internal
+ * \brief Take parked reply to request with specified sync
+ *
+ * Completion callback registered for the request is dropped, as the caller
+ * takes the reply instead.
+ *
+ * \returns status
+ * \retval 0 reply is moved to r
+ * \retval 1 reply isn't received yet
+ */
+int
+beer_pending_take(struct beer_stream *s, uint64_t sync, struct beer_reply *r);
+
+/**
+ * \internal
+ * \brief Drop all pending requests and parked replies
+ */
+void
+beer_pending_clear(struct beer_stream *s);
+
+#endif /* BEER_PENDING_H_INCLUDED */
@@ -0,0 +1,167 @@
+#ifndef BEER_POOL_H_INCLUDED
+#define BEER_POOL_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_pool.h
+ * \brief Pool of network streams to one server
+ *
+ * Pool owns a fixed set of beer_net streams, that share one schema.
+ * Streams are handed out without locks: every thread keeps the last
+ * stream it returned to the pool, other free streams are kept in a
+ * shared stack. Streams that failed with a network error are reconnected
+ * by a background thread.
+ *
+ * \code{.c}
+ * struct beer_pool *p = beer_pool_new(16);
+ * assert(beer_pool_set(p, BEER_OPT_URI, "login:passw@localhost:3302") != -1);
+ * assert(beer_pool_connect(p) != -1);
+ * ...
+ * struct beer_stream *s = beer_pool_get(p);
+ * beer_ping(s);
+ * ...
+ * beer_pool_put(p, s);
+ * ...
+ * beer_pool_free(p);
+ * \endcode
+ */
+
+#include <stdint.h>
+
+#include <beer/beer_stream.h>
+
+struct beer_schema;
+struct beer_pool_thread;
+
+/**
+ * \brief Pool member states
+ */
+enum beer_pool_state {
+	BEER_POOL_FREE, /*!< In shared stack */
+	BEER_POOL_CACHED, /*!< In thread cache, may be taken by other thread */
+	BEER_POOL_BUSY, /*!< Handed out */
+	BEER_POOL_DEAD /*!< Waiting for reconnect */
+};
+
+/**
+ * \internal
+ * \brief Pool member
+ */
+struct beer_pool_member {
+	struct beer_stream s; /*!< Network stream (must be the first member) */
+	uint32_t state; /*!< enum beer_pool_state */
+	uint32_t next; /*!< Next member in shared stack (index + 1) */
+	uint32_t failures; /*!< Count of failed reconnects in a row */
+};
+
+/**
+ * \brief Pool of network streams
+ */
+struct beer_pool {
+	struct beer_pool_member *members; /*!< Pool members */
+	uint32_t size; /*!< Count of members */
+	uint64_t head; /*!< Shared stack head: tag << 32 | (index + 1) */
+	uint32_t alive; /*!< Count of connected members */
+	struct beer_schema *schema; /*!< Schema shared by members */
+	struct beer_pool_thread *thread; /*!< Reconnecting thread */
+	uint64_t id; /*!< Unique id of the pool (for thread caches) */
+};
+
+/**
+ * \brief Create pool of network streams
+ *
+ * \param size count of streams
+ *
+ * \returns pool pointer
+ * \retval NULL oom
+ */
+struct beer_pool *
+beer_pool_new(uint32_t size);
+
+/**
+ * \brief Set option for every stream of the pool
+ *
+ * \sa beer_set
+ *
+ * \retval -1 error
+ * \retval  0 ok
+ */
+int
+beer_pool_set(struct beer_pool *p, int opt, ...);
+
+/**
+ * \brief Connect all streams of the pool
+ *
+ * Schema is loaded only once, with the first stream connected (by the
+ * reconnecting thread, if none was connected here). Streams that failed
+ * to connect are reconnected in background. It may be called again later
+ * (but not concurrently with itself) to connect dead streams right away.
+ *
+ * \returns status
+ * \retval -1 no stream was connected
+ * \retval  0 ok
+ */
+int
+beer_pool_connect(struct beer_pool *p);
+
+/**
+ * \brief Take stream from the pool
+ *
+ * \returns stream pointer
+ * \retval NULL there's no free connected streams
+ */
+struct beer_stream *
+beer_pool_get(struct beer_pool *p);
+
+/**
+ * \brief Return stream to the pool
+ *
+ * Stream must not have requests in flight. If it failed with
+ * network error, then it's reconnected in background.
+ */
+void
+beer_pool_put(struct beer_pool *p, struct beer_stream *s);
+
+/**
+ * \brief Get count of connected streams in the pool
+ */
+uint32_t
+beer_pool_alive(struct beer_pool *p);
+
+/**
+ * \brief Close streams and free the pool
+ *
+ * All streams must be returned to the pool.
+ */
+void
+beer_pool_free(struct beer_pool *p);
+
+#endif /* BEER_POOL_H_INCLUDED */
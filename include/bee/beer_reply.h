@@ -47,6 +47,8 @@
  */
 typedef ssize_t (*beer_reply_t)(void *ptr, char *dst, ssize_t size);
 
+struct beer_iob;
+
 /*!
  * \brief basic reply structure
  */
@@ -62,6 +64,9 @@ struct beer_reply {
 	const char *error_end;	/*!< end of error message (NULL if not present) */
 	const char *data;	/*!< tuple data (NULL if not present) */
 	const char *data_end;	/*!< end if tuple data (NULL if not present) */
+	struct beer_iob *iob;	/*!< buffer that buf points into (NULL if buf is owned) */
+	int owned;		/*!< buf is allocated and freed with the reply */
+	int trusted;		/*!< don't validate data (it's kept by reset) */
 };
 
 /*!
@@ -128,4 +133,36 @@ beer_reply(struct beer_reply *r, char *buf, size_t size, size_t *off);
 int
 beer_reply_from(struct beer_reply *r, beer_reply_t rcv, void *ptr);
 
+/*!
+ * \brief Process iproto reply body in place, without copying it
+ *
+ * \param r    reply object pointer
+ * \param buf  reply body (header and body maps, without length prefix)
+ * \param size reply body size
+ *
+ * Reply fields will point into buf, so it must outlive the reply object.
+ * buf isn't freed by beer_reply_free().
+ *
+ * \returns status of parsing
+ * \retval  0 ok
+ * \retval -1 error, while parsing response
+ */
+int
+beer_reply_view(struct beer_reply *r, const char *buf, size_t size);
+
+/*!
+ * \brief Copy reply out of the receive buffer it points into
+ *
+ * It's no-op for replies that own their buffer. Reply of beer_reply_view()
+ * is copied too, so that the viewed buffer may be reused.
+ *
+ * \param r reply object pointer
+ *
+ * \returns status
+ * \retval  0 ok
+ * \retval -1 oom
+ */
+int
+beer_reply_detach(struct beer_reply *r);
+
 #endif /* BEER_REPLY_H_INCLUDED */
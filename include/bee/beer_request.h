@@ -37,6 +37,8 @@
 
 #include <beer/beer_proto.h>
 
+struct beer_format;
+
 struct beer_request {
 	struct {
 		uint64_t sync; /*!< Request sync id. Generated when encoded */
@@ -74,6 +76,24 @@ struct beer_request {
 	int alloc; /*!< allocation mark */
 };
 
+/**
+ * \brief Request template with constant parts encoded once
+ * \sa beer_request_prepare
+ */
+struct beer_prepared {
+	char head[32]; /*!< length prefix and header, sync and schema id
+			*  are of fixed size */
+	size_t head_size; /*!< size of head without schema id */
+	size_t sync_off; /*!< offset of sync value in head */
+	char body[64]; /*!< body without key and tuple data */
+	size_t body_size; /*!< size of body */
+	size_t key_off; /*!< offset of key data in body (0 if no key) */
+	size_t tuple_off; /*!< offset of tuple data in body (0 if no tuple) */
+	const char *key, *key_end; /*!< key of request, if it's not given */
+	const char *tuple, *tuple_end; /*!< tuple of request, if it's not
+					*  given */
+};
+
 /**
  * \brief Allocate and initialize request object
  *
@@ -188,6 +208,21 @@ beer_request_set_key(struct beer_request *req, struct beer_stream *s);
 int
 beer_request_set_key_format(struct beer_request *req, const char *fmt, ...);
 
+/**
+ * \brief Set key from compiled format string
+ *
+ * \param req request pointer
+ * \param f   compiled format
+ * \param ... arguments for format string
+ *
+ * \retval 0  ok
+ * \retval -1 oom
+ * \sa beer_object_format_compiled
+ */
+int
+beer_request_set_key_compiled(struct beer_request *req,
+			     const struct beer_format *f, ...);
+
 /**
  * \brief Set function from string
  *
@@ -261,6 +296,21 @@ beer_request_set_tuple(struct beer_request *req, struct beer_stream *s);
 int
 beer_request_set_tuple_format(struct beer_request *req, const char *fmt, ...);
 
+/**
+ * \brief Set tuple from compiled format string
+ *
+ * \param req request pointer
+ * \param f   compiled format
+ * \param ... arguments for format string
+ *
+ * \retval 0  ok
+ * \retval -1 oom
+ * \sa beer_object_format_compiled
+ */
+int
+beer_request_set_tuple_compiled(struct beer_request *req,
+			       const struct beer_format *f, ...);
+
 /**
  * \brief Set operations from predefined object
  *
@@ -284,6 +334,41 @@ beer_request_set_ops(struct beer_request *req, struct beer_stream *s);
 int64_t
 beer_request_compile(struct beer_stream *s, struct beer_request *req);
 
+/**
+ * \brief Make request template
+ *
+ * Header and body of request are encoded into template, only sync, schema
+ * id, key and tuple are set when it's executed. Key and tuple of request
+ * (and function name or expression of call/eval) are used, if they aren't
+ * given to beer_prepared_execute(), so they must outlive the template.
+ *
+ * \param req request pointer
+ * \param p   template to fill
+ * \retval 0  ok
+ * \retval -1 error
+ */
+int
+beer_request_prepare(struct beer_request *req, struct beer_prepared *p);
+
+/**
+ * \brief Encode request from template to stream object
+ *
+ * Template isn't changed, it may be shared between streams.
+ *
+ * \param s          stream pointer
+ * \param p          template
+ * \param key        msgpack key (NULL - key of prepared request)
+ * \param key_size   size of key
+ * \param tuple      msgpack tuple (NULL - tuple of prepared request)
+ * \param tuple_size size of tuple
+ * \retval >0 ok, sync is returned
+ * \retval -1 error
+ */
+int64_t
+beer_prepared_execute(struct beer_stream *s, const struct beer_prepared *p,
+		     const char *key, size_t key_size,
+		     const char *tuple, size_t tuple_size);
+
 /**
  * \brief Encode request to stream object.
  *
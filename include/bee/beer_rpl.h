@@ -0,0 +1,142 @@
+#ifndef BEER_RPL_H_INCLUDED
+#define BEER_RPL_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_rpl.h
+ * \brief Replication client
+ *
+ * Replication stream works on top of attached beer_net stream. It may
+ * join the server (receive snapshot rows and register as replica), and
+ * subscribe to the server, to receive rows of every change, starting from
+ * the given vclock.
+ *
+ * Rows are read with s->read_row(), that returns 0 on success, 1 on end of
+ * join stream and -1 on error (if server sent error, then it's in error
+ * field of the row). Rows are decoded in place of the receive buffer of
+ * network stream, and stay valid until the next read.
+ *
+ * \code{.c}
+ * struct beer_stream *net = beer_net(NULL);
+ * beer_set(net, BEER_OPT_URI, "replicator:password@localhost:3301");
+ * struct beer_stream *rpl = beer_rpl(NULL);
+ * beer_rpl_attach(rpl, net);
+ * beer_rpl_set_uuid(rpl, "c35b3e3e-2a37-4bda-8c40-1a61b4b44b7c");
+ * if (beer_rpl_open(rpl, &vclock) == -1)
+ *	return -1;
+ * struct beer_xrow row;
+ * while (rpl->read_row(rpl, &row) == 0) {
+ *	// process row.type, row.space_id, row.tuple...
+ * }
+ * \endcode
+ */
+
+#include <beer/beer_xrow.h>
+
+/**
+ * \brief State of replication stream
+ */
+enum beer_rpl_state {
+	BEER_RPL_NONE, /*!< Nothing was requested */
+	BEER_RPL_JOIN, /*!< Receiving rows of join */
+	BEER_RPL_SUBSCRIBE /*!< Receiving rows of subscription */
+};
+
+struct beer_stream_rpl {
+	struct beer_stream *net; /*!< attached network stream */
+	enum beer_rpl_state state; /*!< what's received */
+	char server_uuid[BEER_UUID_STR_LEN + 1]; /*!< uuid of this replica */
+	char cluster_uuid[BEER_UUID_STR_LEN + 1]; /*!< uuid of cluster */
+	struct beer_vclock vclock; /*!< vclock of the last row read */
+	char *buf; /*!< copy of row, that doesn't fit into receive buffer */
+	size_t buf_size; /*!< size of row copy buffer */
+};
+
+#define BEER_RPL_CAST(S) ((struct beer_stream_rpl*)(S)->data)
+
+/**
+ * \brief Create replication stream
+ *
+ * if stream pointer is NULL, then new stream will be created
+ *
+ * \returns stream pointer
+ * \retval  NULL oom
+ */
+struct beer_stream *beer_rpl(struct beer_stream *s);
+
+/**
+ * \brief Attach network stream (it isn't freed with replication stream)
+ */
+void beer_rpl_attach(struct beer_stream *s, struct beer_stream *net);
+
+/**
+ * \brief Set uuid of replica (random uuid is generated on join, if it
+ * isn't set)
+ *
+ * \retval  0 ok
+ * \retval -1 bad uuid
+ */
+int beer_rpl_set_uuid(struct beer_stream *s, const char *uuid);
+
+/**
+ * \brief Join server
+ *
+ * Connects network stream, if it isn't connected. Then rows of snapshot
+ * are read, until read_row() returns 1. After that vclock of the stream is
+ * vclock of the snapshot, and replica is registered on server with uuid
+ * of the stream.
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int beer_rpl_join(struct beer_stream *s);
+
+/**
+ * \brief Subscribe to changes
+ *
+ * Connects network stream, if it isn't connected. Rows with lsn greater
+ * than in vclock are sent by server. uuid of the stream must be
+ * registered on server.
+ *
+ * \param s      replication stream pointer
+ * \param vclock vclock to start from (NULL for the beginning)
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int beer_rpl_open(struct beer_stream *s, const struct beer_vclock *vclock);
+
+/**
+ * \brief Close network connection
+ */
+void beer_rpl_close(struct beer_stream *s);
+
+#endif /* BEER_RPL_H_INCLUDED */
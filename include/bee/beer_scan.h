@@ -0,0 +1,129 @@
+#ifndef BEER_SCAN_H_INCLUDED
+#define BEER_SCAN_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_scan.h
+ * \brief Parallel scan of xlog or snapshot files of directory
+ *
+ * Files of beer_dir (and ranges of large files, split on row markers) are
+ * read by a pool of worker threads. Rows are delivered to a callback either
+ * unordered, right from workers, or in order of files and rows (that is
+ * lsn order of directory), from the calling thread.
+ *
+ * \code{.c}
+ * struct beer_dir d;
+ * beer_dir_init(&d, BEER_DIR_XLOG);
+ * if (beer_dir_scan(&d, "/var/lib/bee") == -1)
+ *	return -1;
+ * struct beer_scan s;
+ * beer_scan_init(&s, &d, BEER_SCAN_UNORDERED);
+ * s.workers = 8;
+ * int rc = beer_scan(&s, count_row, counters);
+ * beer_dir_free(&d);
+ * \endcode
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <beer/beer_log.h>
+#include <beer/beer_dir.h>
+
+/**
+ * \brief Order of rows delivery
+ */
+enum beer_scan_order {
+	BEER_SCAN_UNORDERED, /*!< callback is called concurrently by workers */
+	BEER_SCAN_ORDERED /*!< callback is called by the calling thread, rows
+			   * are in order of files */
+};
+
+/**
+ * \brief Default size of file range, that is read by one worker
+ */
+#define BEER_SCAN_CHUNK (64 * 1024 * 1024)
+
+/**
+ * \brief Row callback
+ *
+ * \param arg    callback argument
+ * \param worker worker number, from 0 to workers - 1 (always 0 in
+ *               ordered mode), so rows may be aggregated per worker
+ *               without locking
+ * \param row    row, valid until callback returns
+ *
+ * \retval 0 continue, otherwise the scan is stopped and the value is
+ *         returned by beer_scan()
+ */
+typedef int (*beer_scan_f)(void *arg, int worker, struct beer_xrow *row);
+
+/**
+ * \brief Scan options and result
+ */
+struct beer_scan {
+	struct beer_dir *dir; /*!< files to scan */
+	enum beer_scan_order order; /*!< order of rows delivery */
+	int workers; /*!< count of worker threads (count of CPUs if 0) */
+	size_t chunk_size; /*!< files larger than this are split into ranges */
+	uint64_t rows; /*!< count of rows read */
+	enum beer_log_error error; /*!< error of failed file */
+	int errno_; /*!< errno, if error is BEER_LOG_ESYSTEM */
+	int file; /*!< index of failed file in dir (-1 if none) */
+};
+
+/**
+ * \brief Initialize scan of directory files with default options
+ */
+void
+beer_scan_init(struct beer_scan *s, struct beer_dir *dir,
+	       enum beer_scan_order order);
+
+/**
+ * \brief Read all rows of directory files
+ *
+ * Files are mapped into memory, rows are passed to the callback without
+ * copying. In ordered mode, workers read ahead, up to a few batches of
+ * rows per range and up to two ranges per worker (so count of open files
+ * is bounded too).
+ *
+ * \param s   scan pointer
+ * \param cb  row callback
+ * \param arg callback argument
+ *
+ * \retval  0 all rows are read
+ * \retval -1 error (see error and file fields)
+ * \returns non-zero value of callback, that stopped the scan
+ */
+int
+beer_scan(struct beer_scan *s, beer_scan_f cb, void *arg);
+
+#endif /* BEER_SCAN_H_INCLUDED */
@@ -37,6 +37,9 @@
  * \brief Bee schema
  */
 
+#include <stdint.h>
+#include <pthread.h>
+
 struct mh_assoc_t;
 
 /**
@@ -62,10 +65,20 @@ struct beer_schema_sval {
 
 /**
  * \brief Schema of bee instance
+ *
+ * Schema may be shared between streams (and threads). Lookups don't take
+ * locks: they only mark themselves in the current reader epoch, while
+ * beer_schema_replace() publishes new hash, flips the epoch and waits for
+ * readers of the old one before the old hash is freed.
  */
 struct beer_schema {
 	struct mh_assoc_t *space_hash; /*!< hash with spaces */
 	int alloc; /*!< allocation mark */
+	uint32_t refs; /*!< reference counter */
+	uint64_t schema_id; /*!< server schema id it was loaded for (0 if unknown) */
+	uint32_t epoch; /*!< reader epoch, incremented on every update */
+	uint32_t readers[2]; /*!< count of readers in even/odd epoch */
+	pthread_mutex_t lock; /*!< serializes updates */
 };
 
 /**
@@ -156,10 +169,68 @@ beer_schema_flush(struct beer_schema *sch);
 void
 beer_schema_free(struct beer_schema *sch);
 
+/**
+ * \brief Replace contents of shared schema
+ *
+ * Contents of 'from' are published in 'sch', without blocking readers of
+ * 'sch'. Old contents of 'sch' are moved into 'from' once no reader uses
+ * them anymore.
+ *
+ * \param sch  schema pointer
+ * \param from schema with new contents (must not be shared)
+ */
+void
+beer_schema_replace(struct beer_schema *sch, struct beer_schema *from);
+
+/**
+ * \brief Increment reference counter of schema
+ *
+ * \param sch schema pointer
+ * \returns schema pointer
+ */
+struct beer_schema *
+beer_schema_ref(struct beer_schema *sch);
+
+/**
+ * \brief Decrement reference counter of schema, free it on the last one
+ * \param sch schema pointer
+ */
+void
+beer_schema_unref(struct beer_schema *sch);
+
+/**
+ * \brief Reload definitions of a single space in shared schema
+ *
+ * Definitions of space 'sid' are replaced with the ones from replies to
+ * beer_get_space_by_id() and beer_get_index_by_space(), the rest of schema
+ * is kept. Schema id is taken from the space reply, unless the published
+ * schema is already newer: then it's left as is. Writer lock is held from
+ * the copy of the current schema till the new one is published.
+ *
+ * \param sch   schema pointer
+ * \param sid   space id
+ * \param space reply with the space definition
+ * \param index reply with index definitions of the space
+ *
+ * \returns status
+ * \retval -1 failed parsing/oom
+ * \retval  0 ok, space has the same name as before
+ * \retval  1 ok, space was dropped or renamed
+ */
+int
+beer_schema_reload_space(struct beer_schema *sch, uint32_t sid,
+			struct beer_reply *space, struct beer_reply *index);
+
 ssize_t
 beer_get_space(struct beer_stream *s);
 
 ssize_t
 beer_get_index(struct beer_stream *s);
 
+ssize_t
+beer_get_space_by_id(struct beer_stream *s, uint32_t sid);
+
+ssize_t
+beer_get_index_by_space(struct beer_stream *s, uint32_t sid);
+
 #endif /* BEER_SCHEMA_H_INCLUDED */
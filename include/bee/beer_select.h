@@ -56,4 +56,40 @@ beer_select(struct beer_stream *s, uint32_t space, uint32_t index,
 	   uint32_t limit, uint32_t offset, uint8_t iterator,
 	   struct beer_stream *key);
 
+/**
+ * \brief Construct select request by scalar key and write it into stream
+ *
+ * Equality lookup (offset 0, BEER_ITER_EQ). Request is encoded on stack,
+ * nothing is allocated.
+ *
+ * \param s      stream object
+ * \param space  space no
+ * \param index  index no
+ * \param limit  limit of tuples to select
+ * \param key    key for select (key1, key2 - parts of two-part key)
+ *
+ * \returns      number of bytes written to stream
+ * \retval    -1 error
+ */
+ssize_t
+beer_select_uint(struct beer_stream *s, uint32_t space, uint32_t index,
+		uint32_t limit, uint64_t key);
+
+ssize_t
+beer_select_uint2(struct beer_stream *s, uint32_t space, uint32_t index,
+		 uint32_t limit, uint64_t key1, uint64_t key2);
+
+/**
+ * \brief Construct select request by string key and write it into stream
+ *
+ * \param key    key for select (string isn't copied, if stream writes it
+ *               by reference, see BEER_OPT_SEND_REF)
+ * \param len    length of key
+ *
+ * \sa beer_select_uint
+ */
+ssize_t
+beer_select_str(struct beer_stream *s, uint32_t space, uint32_t index,
+	       uint32_t limit, const char *key, uint32_t len);
+
 #endif /* BEER_SELECT_H_INCLUDED */
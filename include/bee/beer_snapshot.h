@@ -30,6 +30,16 @@
  * SUCH DAMAGE.
  */
 
+/**
+ * \file beer_snapshot.h
+ * \brief Stream of snapshot file rows
+ *
+ * Rows are inserts of tuples (space_id and tuple of beer_xrow), space by
+ * space, system spaces first.
+ * Rows are read with s->read_row(), that returns 0 on success, 1 on end of
+ * file and -1 on error. Row stays valid until the next read.
+ */
+
 #include <beer/beer_log.h>
 
 struct beer_stream_snapshot {
@@ -38,9 +48,23 @@ struct beer_stream_snapshot {
 
 #define BEER_SSNAPSHOT_CAST(S) ((struct beer_stream_snapshot*)(S)->data)
 
+/**
+ * \brief Create snapshot stream
+ *
+ * if stream pointer is NULL, then new stream will be created
+ *
+ * \returns stream pointer
+ * \retval  NULL oom
+ */
 struct beer_stream *beer_snapshot(struct beer_stream *s);
 
-int beer_snapshot_open(struct beer_stream *s, char *file);
+/**
+ * \brief Open snapshot file (stdin if file is NULL)
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int beer_snapshot_open(struct beer_stream *s, const char *file);
 void beer_snapshot_close(struct beer_stream *s);
 
 enum beer_log_error beer_snapshot_error(struct beer_stream *s);
@@ -41,6 +41,8 @@
 #include <beer/beer_reply.h>
 #include <beer/beer_request.h>
 
+struct beer_xrow;
+
 /**
  * \brief Basic stream object
  * all function pointers are NULL, if operation is not supported
@@ -53,12 +55,14 @@ struct beer_stream {
 
 	ssize_t (*read)(struct beer_stream *s, char *buf, size_t size); /*!< read from buffer function */
 	int (*read_reply)(struct beer_stream *s, struct beer_reply *r); /*!< read reply from buffer */
+	int (*read_row)(struct beer_stream *s, struct beer_xrow *row); /*!< read row of log or replication stream */
 
 	void (*free)(struct beer_stream *s); /*!< free custom buffer types (destructor) */
 
 	void *data; /*!< subclass data */
 	uint32_t wrcnt; /*!< count of write operations */
 	uint64_t reqid; /*!< request id of current operation */
+	uint64_t schema_id; /*!< schema id sent with requests (0 if not sent) */
 };
 
 /**
@@ -30,6 +30,16 @@
  * SUCH DAMAGE.
  */
 
+/**
+ * \file beer_xlog.h
+ * \brief Stream of xlog file rows
+ *
+ * Rows are requests (insert, replace, update, delete, upsert) with lsn and
+ * id of server, that made them.
+ * Rows are read with s->read_row(), that returns 0 on success, 1 on end of
+ * file and -1 on error. Row stays valid until the next read.
+ */
+
 #include <beer/beer_log.h>
 
 struct beer_stream_xlog {
@@ -38,9 +48,23 @@ struct beer_stream_xlog {
 
 #define BEER_SXLOG_CAST(S) ((struct beer_stream_xlog*)(S)->data)
 
+/**
+ * \brief Create xlog stream
+ *
+ * if stream pointer is NULL, then new stream will be created
+ *
+ * \returns stream pointer
+ * \retval  NULL oom
+ */
 struct beer_stream *beer_xlog(struct beer_stream *s);
 
-int beer_xlog_open(struct beer_stream *s, char *file);
+/**
+ * \brief Open xlog file (stdin if file is NULL)
+ *
+ * \retval  0 ok
+ * \retval -1 error
+ */
+int beer_xlog_open(struct beer_stream *s, const char *file);
 void beer_xlog_close(struct beer_stream *s);
 
 enum beer_log_error beer_xlog_error(struct beer_stream *s);
@@ -0,0 +1,152 @@
+#ifndef BEER_XROW_H_INCLUDED
+#define BEER_XROW_H_INCLUDED
+
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file beer_xrow.h
+ * \brief Rows of xlog/snapshot files and of replication stream
+ *
+ * Row is a msgpack header map (request type, lsn, server id, timestamp)
+ * followed by a body map of the request. Rows are decoded in place:
+ * all pointers of beer_xrow point into the buffer that was decoded.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <beer/beer_proto.h>
+
+/**
+ * \brief Max count of servers in vclock
+ */
+#define BEER_VCLOCK_MAX 32
+
+/**
+ * \brief Length of UUID string (without terminating zero)
+ */
+#define BEER_UUID_STR_LEN 36
+
+/**
+ * \brief Vector clock: lsn of the last row of every server
+ */
+struct beer_vclock {
+	uint64_t lsn[BEER_VCLOCK_MAX]; /*!< lsn by server id */
+};
+
+/**
+ * \brief Decoded row
+ */
+struct beer_xrow {
+	const char *buf; /*!< beginning of row */
+	size_t buf_size; /*!< size of row */
+	uint64_t bitmap; /*!< bitmap of header and body keys that were read */
+	uint32_t type; /*!< request type (or reply code) */
+	uint64_t sync; /*!< synchronization id */
+	uint32_t server_id; /*!< id of server, that made the row */
+	uint64_t lsn; /*!< log sequence number */
+	double timestamp; /*!< time of the row */
+	uint32_t space_id; /*!< space number */
+	uint32_t index_id; /*!< index number */
+	uint32_t index_base; /*!< field offset for update */
+	const char *key; /*!< key for update/delete (NULL if not present) */
+	const char *key_end; /*!< end of key */
+	const char *tuple; /*!< tuple for insert/replace/upsert, ops for
+			    * update (NULL if not present) */
+	const char *tuple_end; /*!< end of tuple */
+	const char *ops; /*!< ops for upsert (NULL if not present) */
+	const char *ops_end; /*!< end of ops */
+	const char *vclock; /*!< vclock map (NULL if not present) */
+	const char *vclock_end; /*!< end of vclock */
+	const char *error; /*!< error message (NULL if not present) */
+	const char *error_end; /*!< end of error message */
+};
+
+/**
+ * \brief Check that row is error reply
+ */
+#define BEER_XROW_ERROR(R) (((R)->type & 0x8000) != 0)
+
+/**
+ * \brief Decode row
+ *
+ * \param row  row pointer
+ * \param buf  row data (without length)
+ * \param size size of row data
+ *
+ * \retval  0 ok
+ * \retval -1 malformed row
+ */
+int
+beer_xrow_decode(struct beer_xrow *row, const char *buf, size_t size);
+
+/**
+ * \brief Decode msgpack vclock map into vclock
+ *
+ * \param vclock vclock pointer
+ * \param data   msgpack map of server id to lsn
+ * \param end    end of data
+ *
+ * \retval  0 ok
+ * \retval -1 malformed map
+ */
+int
+beer_vclock_decode(struct beer_vclock *vclock, const char *data,
+		   const char *end);
+
+/**
+ * \brief Size of vclock encoded as msgpack map
+ */
+size_t
+beer_vclock_sizeof(const struct beer_vclock *vclock);
+
+/**
+ * \brief Encode vclock as msgpack map (only servers with non-zero lsn)
+ *
+ * \param vclock vclock pointer
+ * \param data   buffer of at least beer_vclock_sizeof() bytes
+ *
+ * \returns end of encoded data
+ */
+char *
+beer_vclock_encode(const struct beer_vclock *vclock, char *data);
+
+/**
+ * \brief Move vclock forward with row lsn
+ */
+static inline void
+beer_vclock_follow(struct beer_vclock *vclock, const struct beer_xrow *row)
+{
+	if (row->server_id < BEER_VCLOCK_MAX &&
+	    row->lsn > vclock->lsn[row->server_id])
+		vclock->lsn[row->server_id] = row->lsn;
+}
+
+#endif /* BEER_XROW_H_INCLUDED */
@@ -0,0 +1,692 @@
+#include "test.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <msgpuck.h>
+#include <crc32.h>
+
+#include <bee/bee.h>
+
+#include <beer/beer_log.h>
+#include <beer/beer_xrow.h>
+#include <beer/beer_dir.h>
+#include <beer/beer_scan.h>
+#include <beer/beer_export.h>
+
+#define header() note("*** %s: prep ***", __func__)
+#define footer() note("*** %s: done ***", __func__)
+
+#define TEST_UUID "6a6a8d0b-5a4e-4c4b-8a9e-0c7b0b5b7a11"
+
+static char dir[] = "/tmp/bee-rpl-XXXXXX";
+
+static void
+test_path(char *path, const char *name) {
+	snprintf(path, PATH_MAX, "%s/%s", dir, name);
+}
+
+/* insert of [lsn, data] into space 512, as server writes it */
+static size_t
+test_row(char *buf, uint64_t lsn, const char *data, uint32_t len) {
+	char *p = buf;
+	p = mp_encode_map(p, 4);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, BEER_OP_INSERT);
+	p = mp_encode_uint(p, BEER_SERVER_ID);
+	p = mp_encode_uint(p, 1);
+	p = mp_encode_uint(p, BEER_LSN);
+	p = mp_encode_uint(p, lsn);
+	p = mp_encode_uint(p, BEER_TIMESTAMP);
+	p = mp_encode_double(p, 1.5);
+	p = mp_encode_map(p, 2);
+	p = mp_encode_uint(p, BEER_SPACE);
+	p = mp_encode_uint(p, 512);
+	p = mp_encode_uint(p, BEER_TUPLE);
+	p = mp_encode_array(p, 2);
+	p = mp_encode_uint(p, lsn);
+	p = mp_encode_str(p, data, len);
+	return p - buf;
+}
+
+/*
+ * fixed header of row, that is already written after it: marker, length,
+ * crc32c of previous row and row
+ */
+static size_t
+test_log_fixheader(char *buf, size_t size) {
+	char *row = buf + BEER_LOG_FIXHEADER_SIZE;
+	char *p = mp_store_u32(buf, BEER_LOG_MARKER);
+	*p++ = 0xce;
+	p = mp_store_u32(p, size);
+	p = mp_encode_uint(p, 0);
+	*p++ = 0xce;
+	p = mp_store_u32(p, crc32c(0, (unsigned char *)row, size));
+	/* padded with string up to size of fixed header */
+	size_t pad = buf + BEER_LOG_FIXHEADER_SIZE - p;
+	p = mp_encode_strl(p, pad - 1);
+	memset(p, 0, pad - 1);
+	return BEER_LOG_FIXHEADER_SIZE + size;
+}
+
+static size_t
+test_log_row(char *buf, uint64_t lsn, const char *data, uint32_t len) {
+	char *row = buf + BEER_LOG_FIXHEADER_SIZE;
+	return test_log_fixheader(buf, test_row(row, lsn, data, len));
+}
+
+static size_t
+test_log_header(char *buf, uint64_t lsn) {
+	return sprintf(buf, "XLOG\n0.13\nVersion: 1.6.8\nInstance: %s\n"
+		       "VClock: {1: %llu}\n\n", TEST_UUID,
+		       (unsigned long long)lsn);
+}
+
+static size_t
+test_log_eof(char *buf) {
+	mp_store_u32(buf, BEER_LOG_MARKER_EOF);
+	return sizeof(uint32_t);
+}
+
+/* xlog of rows with lsn from 1 to count, offsets of rows are returned */
+static size_t
+test_log(char *buf, int count, size_t *offsets) {
+	size_t size = test_log_header(buf, 0);
+	int i;
+	for (i = 0; i < count; i++) {
+		char data[64];
+		int len = snprintf(data, sizeof(data), "row %d", i + 1);
+		if (offsets)
+			offsets[i] = size;
+		size += test_log_row(buf + size, i + 1, data, len);
+	}
+	return size;
+}
+
+static void
+test_write(const char *path, const char *data, size_t size, const char *mode) {
+	FILE *f = fopen(path, mode);
+	fwrite(data, size, 1, f);
+	fclose(f);
+}
+
+static int
+test_xrow() {
+	plan(20);
+	header();
+
+	char buf[256];
+	size_t size = test_row(buf, 10, "abc", 3);
+	struct beer_xrow row;
+	is(beer_xrow_decode(&row, buf, size), 0, "decode row");
+	is(row.type, BEER_OP_INSERT, "row type");
+	is(row.server_id, 1, "row server id");
+	is(row.lsn, 10, "row lsn");
+	ok(row.timestamp == 1.5, "row timestamp");
+	is(row.space_id, 512, "row space");
+	ok(row.tuple > buf && row.tuple_end == buf + size, "row tuple");
+	ok(row.key == NULL && row.ops == NULL, "row has no key and ops");
+	ok((row.bitmap & (1ULL << BEER_LSN)) &&
+	   (row.bitmap & (1ULL << BEER_TUPLE)) &&
+	   !(row.bitmap & (1ULL << BEER_KEY)), "row bitmap");
+	const char *p = row.tuple;
+	is(mp_decode_array(&p), 2, "tuple size");
+	is(mp_decode_uint(&p), 10, "tuple field");
+	is(beer_xrow_decode(&row, buf, size - 1), -1, "truncated row");
+
+	struct beer_vclock vclock, decoded;
+	memset(&vclock, 0, sizeof(vclock));
+	vclock.lsn[1] = 10;
+	vclock.lsn[3] = 300000;
+	vclock.lsn[BEER_VCLOCK_MAX - 1] = UINT64_MAX;
+	char *end = beer_vclock_encode(&vclock, buf);
+	is((size_t)(end - buf), beer_vclock_sizeof(&vclock), "vclock size");
+	is(beer_vclock_decode(&decoded, buf, end), 0, "decode vclock");
+	ok(memcmp(&vclock, &decoded, sizeof(vclock)) == 0, "vclock is the same");
+	memset(&vclock, 0, sizeof(vclock));
+	end = beer_vclock_encode(&vclock, buf);
+	is((size_t)(end - buf), beer_vclock_sizeof(&vclock), "empty vclock size");
+	is(beer_vclock_decode(&decoded, buf, end), 0, "decode empty vclock");
+
+	p = mp_encode_map(buf, 1);
+	p = mp_encode_uint((char *)p, BEER_VCLOCK_MAX);
+	p = mp_encode_uint((char *)p, 1);
+	is(beer_vclock_decode(&decoded, buf, p), -1, "server id out of range");
+	is(beer_vclock_decode(&decoded, buf, p - 1), -1, "truncated vclock");
+
+	p = mp_encode_array(buf, 0);
+	is(beer_vclock_decode(&decoded, buf, p), -1, "vclock isn't map");
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_log_read() {
+	plan(13);
+	header();
+
+	char buf[4096];
+	size_t size = test_log(buf, 3, NULL);
+	size += test_log_eof(buf + size);
+	char path[PATH_MAX];
+	test_path(path, "read.xlog");
+	test_write(path, buf, size, "w");
+
+	struct beer_log l;
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "open");
+	is(strcmp(l.server_uuid, TEST_UUID), 0, "server uuid");
+	int i;
+	for (i = 1; i <= 3; i++) {
+		struct beer_xrow *row = beer_log_next(&l);
+		ok(row && row->lsn == (uint64_t)i && row->space_id == 512,
+		   "row %d", i);
+	}
+	is(l.vclock.lsn[1], 3, "vclock follows rows");
+	ok(beer_log_next(&l) == NULL, "eof");
+	is(beer_log_error(&l), BEER_LOG_EOK, "no error");
+	is(l.offset, (off_t)size, "offset after eof marker");
+	beer_log_close(&l);
+
+	is(beer_log_open(&l, path, BEER_LOG_SNAPSHOT), BEER_LOG_ETYPE,
+	   "type mismatch");
+	memcpy(buf + 5, "0.14", 4);
+	test_write(path, buf, size, "w");
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EVERSION,
+	   "version mismatch");
+	is(beer_log_guess(path), BEER_LOG_XLOG, "guess type");
+	unlink(path);
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_ESYSTEM,
+	   "no file");
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_log_truncated() {
+	plan(10);
+	header();
+
+	char buf[4096];
+	size_t offsets[3];
+	size_t size = test_log(buf, 3, offsets);
+	size += test_log_eof(buf + size);
+	/* server still writes the last row */
+	size_t part = offsets[2] + BEER_LOG_FIXHEADER_SIZE + 4;
+	char path[PATH_MAX];
+	test_path(path, "truncated.xlog");
+	test_write(path, buf, part, "w");
+
+	struct beer_log l;
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "open");
+	l.follow = 0;
+	ok(beer_log_next(&l) != NULL, "row 1");
+	ok(beer_log_next(&l) != NULL, "row 2");
+	ok(beer_log_next(&l) == NULL, "row 3 is incomplete");
+	is(beer_log_error(&l), BEER_LOG_EOK, "no error");
+	is(l.offset, (off_t)offsets[2], "offset of incomplete row");
+	off_t offset = l.offset;
+	beer_log_close(&l);
+
+	test_write(path, buf + part, size - part, "a");
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "reopen");
+	beer_log_seek(&l, offset);
+	struct beer_xrow *row = beer_log_next(&l);
+	ok(row && row->lsn == 3, "row 3 after seek");
+	ok(beer_log_next(&l) == NULL && beer_log_error(&l) == BEER_LOG_EOK,
+	   "eof");
+	is(l.offset, (off_t)size, "offset after eof marker");
+	beer_log_close(&l);
+	unlink(path);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_log_corrupt() {
+	plan(5);
+	header();
+
+	char buf[4096];
+	size_t offsets[3];
+	size_t size = test_log(buf, 3, offsets);
+	size += test_log_eof(buf + size);
+	/* last byte of row 2 data */
+	buf[offsets[2] - 1] ^= 1;
+	char path[PATH_MAX];
+	test_path(path, "corrupt.xlog");
+	test_write(path, buf, size, "w");
+
+	struct beer_log l;
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "open");
+	ok(beer_log_next(&l) != NULL, "row 1");
+	ok(beer_log_next(&l) == NULL, "row 2");
+	is(beer_log_error(&l), BEER_LOG_ECORRUPT, "crc error");
+	ok(beer_log_strerror(&l) != NULL, "error message");
+	beer_log_close(&l);
+	unlink(path);
+
+	footer();
+	return check_plan();
+}
+
+/* file is read with stdio, if it's written into fifo */
+static pid_t
+test_fifo(const char *path, const char *data, size_t size) {
+	unlink(path);
+	if (mkfifo(path, 0600) == -1)
+		return -1;
+	pid_t pid = fork();
+	if (pid == 0) {
+		test_write(path, data, size, "w");
+		_exit(0);
+	}
+	return pid;
+}
+
+static int
+test_log_stdio() {
+	plan(11);
+	header();
+
+	char buf[4096];
+	size_t offsets[3];
+	size_t size = test_log(buf, 3, offsets);
+	size += test_log_eof(buf + size);
+	char path[PATH_MAX];
+	test_path(path, "stdio.xlog");
+	test_write(path, buf, size, "w");
+
+	struct beer_log l;
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "open file");
+	ok(l.map != NULL, "file is mapped");
+	struct beer_xrow rows[3];
+	int i;
+	for (i = 0; i < 3; i++) {
+		struct beer_xrow *row = beer_log_next(&l);
+		if (row)
+			rows[i] = *row;
+	}
+	ok(beer_log_next(&l) == NULL && beer_log_error(&l) == BEER_LOG_EOK,
+	   "eof of mapped file");
+
+	char fifo[PATH_MAX];
+	test_path(fifo, "stdio.fifo");
+	pid_t pid = test_fifo(fifo, buf, size);
+	struct beer_log f;
+	is(beer_log_open(&f, fifo, BEER_LOG_XLOG), BEER_LOG_EOK, "open fifo");
+	ok(f.map == NULL, "fifo isn't mapped");
+	for (i = 0; i < 3; i++) {
+		struct beer_xrow *row = beer_log_next(&f);
+		ok(row && row->lsn == rows[i].lsn &&
+		   row->buf_size == rows[i].buf_size &&
+		   memcmp(row->buf, rows[i].buf, row->buf_size) == 0,
+		   "row %d is the same", i + 1);
+	}
+	ok(beer_log_next(&f) == NULL && beer_log_error(&f) == BEER_LOG_EOK,
+	   "eof of fifo");
+	beer_log_close(&f);
+	beer_log_close(&l);
+	waitpid(pid, NULL, 0);
+
+	/* incomplete row is left for the next read */
+	size_t part = offsets[2] + BEER_LOG_FIXHEADER_SIZE + 4;
+	pid = test_fifo(fifo, buf, part);
+	beer_log_open(&f, fifo, BEER_LOG_XLOG);
+	ok(beer_log_next(&f) && beer_log_next(&f), "rows of fifo");
+	ok(beer_log_next(&f) == NULL && beer_log_error(&f) == BEER_LOG_EOK,
+	   "incomplete row of fifo");
+	beer_log_close(&f);
+	waitpid(pid, NULL, 0);
+	unlink(fifo);
+	unlink(path);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_log_grow() {
+	plan(9);
+	header();
+
+	char buf[4096];
+	size_t offsets[3];
+	size_t size = test_log(buf, 3, offsets);
+	size += test_log_eof(buf + size);
+	size_t part = offsets[1] + BEER_LOG_FIXHEADER_SIZE + 4;
+	char path[PATH_MAX];
+	test_path(path, "grow.xlog");
+	test_write(path, buf, part, "w");
+
+	struct beer_log l;
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "open");
+	is(l.map_size, part, "mapping of file");
+	struct beer_xrow *row = beer_log_next(&l);
+	ok(row && row->lsn == 1, "row 1");
+	ok(beer_log_next(&l) == NULL && beer_log_error(&l) == BEER_LOG_EOK,
+	   "row 2 is incomplete");
+
+	/* server writes the rest of file */
+	test_write(path, buf + part, size - part, "a");
+	row = beer_log_next(&l);
+	ok(row && row->lsn == 2, "row 2 after file has grown");
+	is(l.map_size, size, "mapping is extended");
+	row = beer_log_next(&l);
+	ok(row && row->lsn == 3, "row 3");
+	ok(beer_log_next(&l) == NULL && beer_log_error(&l) == BEER_LOG_EOK,
+	   "eof");
+	is(l.offset, (off_t)size, "offset after eof marker");
+	beer_log_close(&l);
+	unlink(path);
+
+	footer();
+	return check_plan();
+}
+
+struct test_scan {
+	uint64_t last;
+	int rows;
+	int unordered;
+};
+
+static int
+test_scan_row(void *arg, int worker, struct beer_xrow *row) {
+	struct test_scan *t = arg;
+	(void)worker;
+	if (!t->unordered && row->lsn != t->last + 1)
+		return 1;
+	t->last = row->lsn;
+	t->rows++;
+	return 0;
+}
+
+static int
+test_log_find() {
+	plan(12);
+	header();
+
+	/* marker (and a valid fixed header) in data of row 2 */
+	const char data[] = "\xd5\xba\x0b\xab\xce\x00\x00\x00\x05\x00"
+			    "\xce\x00\x00\x00\x00\xa3\x00\x00\x00xxxxx";
+	char buf[4096];
+	size_t offsets[4];
+	size_t size = test_log_header(buf, 0);
+	int i;
+	for (i = 0; i < 4; i++) {
+		offsets[i] = size;
+		size += test_log_row(buf + size, i + 1, data,
+				     i == 1 ? sizeof(data) - 1 : 5);
+	}
+	size += test_log_eof(buf + size);
+	const char *marker = buf + offsets[1] + BEER_LOG_FIXHEADER_SIZE;
+	marker = memchr(marker, 0xd5, buf + offsets[2] - marker);
+	off_t split = marker - buf;
+
+	char path[PATH_MAX];
+	test_path(path, "00000000000000000000.xlog");
+	test_write(path, buf, size, "w");
+	struct beer_log l;
+	is(beer_log_open(&l, path, BEER_LOG_XLOG), BEER_LOG_EOK, "open");
+	is(beer_log_find(&l, offsets[0]), (off_t)offsets[0], "row 1");
+	is(beer_log_find(&l, offsets[1] + 1), (off_t)offsets[2],
+	   "marker in data is skipped");
+	is(beer_log_find(&l, split - 1), (off_t)offsets[2],
+	   "marker in data is skipped, right before it");
+	is(beer_log_find(&l, offsets[3] + 1), -1, "no marker after last row");
+	beer_log_close(&l);
+
+	/* range of the first worker ends right before marker in data */
+	struct beer_dir d;
+	beer_dir_init(&d, BEER_DIR_XLOG);
+	is(beer_dir_scan(&d, dir), 0, "scan directory");
+	struct beer_scan scan;
+	struct test_scan t;
+	beer_scan_init(&scan, &d, BEER_SCAN_ORDERED);
+	scan.workers = 2;
+	scan.chunk_size = split - 1 - offsets[0];
+	memset(&t, 0, sizeof(t));
+	is(beer_scan(&scan, test_scan_row, &t), 0, "ordered scan");
+	is(t.rows, 4, "rows in order");
+	is(scan.error, BEER_LOG_EOK, "no error");
+
+	beer_scan_init(&scan, &d, BEER_SCAN_UNORDERED);
+	scan.workers = 2;
+	scan.chunk_size = split - 1 - offsets[0];
+	memset(&t, 0, sizeof(t));
+	t.unordered = 1;
+	is(beer_scan(&scan, test_scan_row, &t), 0, "unordered scan");
+	is(t.rows, 4, "all rows");
+	is(scan.rows, 4, "count of rows");
+	beer_dir_free(&d);
+	unlink(path);
+
+	footer();
+	return check_plan();
+}
+
+/* snapshot row of insert into space */
+static size_t
+test_snap_row(char *buf, uint32_t space, const char *tuple, size_t size) {
+	char *row = buf + BEER_LOG_FIXHEADER_SIZE, *p = row;
+	p = mp_encode_map(p, 1);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, BEER_OP_INSERT);
+	p = mp_encode_map(p, 2);
+	p = mp_encode_uint(p, BEER_SPACE);
+	p = mp_encode_uint(p, space);
+	p = mp_encode_uint(p, BEER_TUPLE);
+	memcpy(p, tuple, size);
+	return test_log_fixheader(buf, p + size - row);
+}
+
+static char *
+test_format(char *p, const char *name, const char *type) {
+	p = mp_encode_map(p, 2);
+	p = mp_encode_str(p, "name", 4);
+	p = mp_encode_str(p, name, strlen(name));
+	p = mp_encode_str(p, "type", 4);
+	return mp_encode_str(p, type, strlen(type));
+}
+
+/* value of key in msgpack map (NULL if there's no key) */
+static const char *
+test_map_get(const char *map, const char *key) {
+	uint32_t n = mp_decode_map(&map);
+	while (n-- > 0) {
+		uint32_t len = 0;
+		const char *k = mp_decode_str(&map, &len);
+		if (len == strlen(key) && memcmp(k, key, len) == 0)
+			return map;
+		mp_next(&map);
+	}
+	return NULL;
+}
+
+static uint64_t
+test_map_uint(const char *map, const char *key) {
+	const char *v = test_map_get(map, key);
+	return (v && mp_typeof(*v) == MP_UINT) ? mp_decode_uint(&v) : UINT64_MAX;
+}
+
+static int64_t
+test_map_int(const char *map, const char *key) {
+	const char *v = test_map_get(map, key);
+	if (v && mp_typeof(*v) == MP_UINT)
+		return mp_decode_uint(&v);
+	return (v && mp_typeof(*v) == MP_INT) ? mp_decode_int(&v) : INT64_MAX;
+}
+
+static int
+test_map_str(const char *map, const char *key, const char *str) {
+	const char *v = test_map_get(map, key);
+	if (v == NULL || mp_typeof(*v) != MP_STR)
+		return 0;
+	uint32_t len = 0;
+	v = mp_decode_str(&v, &len);
+	return len == strlen(str) && memcmp(v, str, len) == 0;
+}
+
+static uint32_t
+test_load_u32(const char *p) {
+	const unsigned char *u = (const unsigned char *)p;
+	return u[0] | u[1] << 8 | u[2] << 16 | (uint32_t)u[3] << 24;
+}
+
+static int
+test_export() {
+	plan(32);
+	header();
+
+	/* users: [id, city, name (null in every fifth row), score] */
+	static const char *cities[] = {"Jakarta", "Bandung"};
+	char buf[8192], tuple[512];
+	size_t size = sprintf(buf, "SNAP\n0.13\nInstance: %s\n"
+			      "VClock: {1: 10}\n\n", TEST_UUID);
+	char *t = tuple;
+	t = mp_encode_array(t, 7);
+	t = mp_encode_uint(t, 512);
+	t = mp_encode_uint(t, 1);
+	t = mp_encode_str(t, "users", 5);
+	t = mp_encode_str(t, "memtx", 5);
+	t = mp_encode_uint(t, 0);
+	t = mp_encode_map(t, 0);
+	t = mp_encode_array(t, 4);
+	t = test_format(t, "id", "unsigned");
+	t = test_format(t, "city", "string");
+	t = test_format(t, "name", "string");
+	t = test_format(t, "score", "integer");
+	size += test_snap_row(buf + size, beer_sp_space, tuple, t - tuple);
+	int i;
+	for (i = 0; i < 10; i++) {
+		char name[16];
+		t = tuple;
+		t = mp_encode_array(t, 4);
+		t = mp_encode_uint(t, i);
+		t = mp_encode_str(t, cities[i % 2], strlen(cities[i % 2]));
+		if (i % 5 == 0)
+			t = mp_encode_nil(t);
+		else
+			t = mp_encode_str(t, name, sprintf(name, "user%d", i));
+		t = i ? mp_encode_int(t, -10 * i) : mp_encode_uint(t, 0);
+		size += test_snap_row(buf + size, 512, tuple, t - tuple);
+	}
+	size += test_log_eof(buf + size);
+	char path[PATH_MAX];
+	test_path(path, "00000000000000000010.snap");
+	test_write(path, buf, size, "w");
+
+	struct beer_export e;
+	is(beer_export_init(&e, dir), 0, "init");
+	is(beer_export_snapshot(&e, path), 0, "export");
+	is(e.rows, 10, "count of rows");
+	beer_export_free(&e);
+	unlink(path);
+	test_path(path, "_space.col");
+	ok(access(path, F_OK) == -1, "system space isn't exported");
+
+	test_path(path, "users.col");
+	FILE *f = fopen(path, "r");
+	size = f ? fread(buf, 1, sizeof(buf), f) : 0;
+	if (f)
+		fclose(f);
+	unlink(path);
+	ok(size > 20 && memcmp(buf, "BEERCOL1", 8) == 0 &&
+	   memcmp(buf + size - 8, "BEERCOL1", 8) == 0, "magic");
+	uint32_t footer_size = test_load_u32(buf + size - 12);
+	const char *footer = buf + size - 12 - footer_size;
+	const char *test = footer;
+	ok(footer_size < size && mp_check(&test, buf + size - 12) == 0 &&
+	   test == buf + size - 12, "footer");
+	is(test_map_uint(footer, "space_id"), 512, "space id");
+	ok(test_map_str(footer, "name", "users"), "space name");
+	is(test_map_uint(footer, "rows"), 10, "rows");
+	const char *cols = test_map_get(footer, "columns");
+	is(mp_decode_array(&cols), 4, "columns");
+	mp_next(&cols);
+	ok(test_map_str(cols, "name", "city") &&
+	   test_map_str(cols, "type", "string"), "column from format");
+	const char *groups = test_map_get(footer, "groups");
+	is(mp_decode_array(&groups), 1, "groups");
+	is(test_map_uint(groups, "rows"), 10, "rows of group");
+	const char *chunk = test_map_get(groups, "columns");
+	is(mp_decode_array(&chunk), 4, "chunks");
+
+	/* id: plain integers */
+	ok(test_map_str(chunk, "encoding", "u64"), "id encoding");
+	is(test_map_uint(chunk, "nulls"), 0, "id has no nulls");
+	ok(test_map_int(chunk, "min") == 0 && test_map_int(chunk, "max") == 9,
+	   "id min and max");
+	const char *data = buf + test_map_uint(chunk, "offset");
+	ok(test_map_uint(chunk, "size") == 80 &&
+	   test_load_u32(data + 72) == 9, "id values");
+	mp_next(&chunk);
+
+	/* city: a couple of strings */
+	ok(test_map_str(chunk, "encoding", "dict"), "city encoding");
+	is(test_map_uint(chunk, "distinct"), 2, "city dictionary");
+	ok(test_map_str(chunk, "min", "Bandung") &&
+	   test_map_str(chunk, "max", "Jakarta"), "city min and max");
+	data = buf + test_map_uint(chunk, "offset");
+	ok(test_load_u32(data) == 2 && test_load_u32(data + 4) == 7 &&
+	   memcmp(data + 8, "Bandung", 7) == 0, "city sorted dictionary");
+	/* codes follow dictionary, Jakarta is the second one */
+	data += 4 + 2 * (4 + 7);
+	ok(data[0] == 1 && data[1] == 0 && data[9] == 0, "city codes");
+	mp_next(&chunk);
+
+	/* name: distinct strings with nulls */
+	ok(test_map_str(chunk, "encoding", "str"), "name encoding");
+	is(test_map_uint(chunk, "nulls"), 2, "name nulls");
+	ok(test_map_get(chunk, "distinct") == NULL, "name isn't dictionary");
+	ok(test_map_str(chunk, "min", "user1") &&
+	   test_map_str(chunk, "max", "user9"), "name min and max");
+	data = buf + test_map_uint(chunk, "offset");
+	/* rows 0 and 5 are nulls */
+	ok((uint8_t)data[0] == 0xde && data[1] == 0x03, "name null bitmap");
+	data += 2;
+	ok(test_load_u32(data) == 0 && test_load_u32(data + 4) == 0 &&
+	   test_load_u32(data + 8) == 5 && test_load_u32(data + 40) == 40 &&
+	   memcmp(data + 44, "user1user2", 10) == 0, "name offsets and bytes");
+	mp_next(&chunk);
+
+	/* score: negative integers */
+	ok(test_map_str(chunk, "encoding", "i64"), "score encoding");
+	ok(test_map_int(chunk, "min") == -90 && test_map_int(chunk, "max") == 0,
+	   "score min and max");
+	data = buf + test_map_uint(chunk, "offset");
+	ok((int32_t)test_load_u32(data + 8) == -10 &&
+	   test_load_u32(data + 12) == UINT32_MAX, "score values");
+
+	footer();
+	return check_plan();
+}
+
+int main() {
+	plan(8);
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	test_xrow();
+	test_log_read();
+	test_log_truncated();
+	test_log_corrupt();
+	test_log_stdio();
+	test_log_grow();
+	test_log_find();
+	test_export();
+
+	rmdir(dir);
+	return check_plan();
+}
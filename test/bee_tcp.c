@@ -2,6 +2,17 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include <msgpuck.h>
 
@@ -88,9 +99,115 @@ test_connect_tcp() {
 	return check_plan();
 }
 
+/* containers of count values, written with any container type */
+typedef void (*test_object_f)(struct beer_stream *s, uint32_t count);
+
+static void
+test_object_array(struct beer_stream *s, uint32_t count) {
+	beer_object_add_array(s, 0);
+	for (uint32_t i = 0; i < count; ++i) beer_object_add_uint(s, i);
+	beer_object_container_close(s);
+}
+
+static void
+test_object_map(struct beer_stream *s, uint32_t count) {
+	beer_object_add_map(s, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		beer_object_add_uint(s, i);
+		beer_object_add_nil(s);
+	}
+	beer_object_container_close(s);
+}
+
+/* 7 [{"a": [0..count], "b": {}} [[NIL x count]] "c"] "after" */
+static void
+test_object_nested(struct beer_stream *s, uint32_t count) {
+	beer_object_add_uint(s, 7);
+	beer_object_add_array(s, 0);
+	beer_object_add_map(s, 0);
+	beer_object_add_strz(s, "a");
+	test_object_array(s, count);
+	beer_object_add_strz(s, "b");
+	beer_object_add_map(s, 0);
+	beer_object_container_close(s);
+	beer_object_container_close(s);
+	beer_object_add_array(s, 0);
+	beer_object_add_array(s, 0);
+	for (uint32_t i = 0; i < count; ++i) beer_object_add_nil(s);
+	beer_object_container_close(s);
+	beer_object_container_close(s);
+	beer_object_add_strz(s, "c");
+	beer_object_container_close(s);
+	beer_object_add_strz(s, "after");
+}
+
+/* [0..count] {0..count} NIL [[0..count]] */
+static void
+test_object_siblings(struct beer_stream *s, uint32_t count) {
+	test_object_array(s, count);
+	test_object_map(s, count);
+	beer_object_add_nil(s);
+	beer_object_add_array(s, 0);
+	test_object_array(s, count);
+	beer_object_container_close(s);
+}
+
+/* compares output of BEER_SBO_DEFERRED with output of BEER_SBO_PACKED */
+static int
+test_object_deferred(test_object_f f, uint32_t count) {
+	struct beer_stream *packed = beer_object(NULL);
+	struct beer_stream *deferred = beer_object(NULL);
+	beer_object_type(packed, BEER_SBO_PACKED);
+	beer_object_type(deferred, BEER_SBO_DEFERRED);
+	f(packed, count);
+	f(deferred, count);
+	int rc = check_sbytes(deferred, BEER_SBUF_DATA(packed),
+			      BEER_SBUF_SIZE(packed));
+	beer_stream_free(packed);
+	beer_stream_free(deferred);
+	return rc;
+}
+
+/* compares output of compiled format with output of beer_object_format */
+static int
+test_object_compiled(const char *fmt, ...) {
+	struct beer_format f;
+	if (beer_format_compile(&f, fmt) == -1)
+		return -2;
+	struct beer_stream *plain = beer_object(NULL);
+	struct beer_stream *compiled = beer_object(NULL);
+	va_list vl, vc;
+	va_start(vl, fmt);
+	va_copy(vc, vl);
+	ssize_t rc1 = beer_object_vformat(plain, fmt, vl);
+	ssize_t rc2 = beer_object_vformat_compiled(compiled, &f, vc);
+	va_end(vc);
+	va_end(vl);
+	int rc = (rc1 != rc2) ? -1 : check_sbytes(compiled, BEER_SBUF_DATA(plain),
+						  BEER_SBUF_SIZE(plain));
+	beer_stream_free(plain);
+	beer_stream_free(compiled);
+	beer_format_free(&f);
+	return rc;
+}
+
+/* compares encoded requests */
+static int
+test_object_requests(struct beer_request *r1, struct beer_request *r2) {
+	struct beer_stream *s1 = beer_buf(NULL), *s2 = beer_buf(NULL);
+	beer_request_compile(s1, r1);
+	beer_request_compile(s2, r2);
+	int rc = check_sbytes(s2, BEER_SBUF_DATA(s1), BEER_SBUF_SIZE(s1));
+	beer_stream_free(s1);
+	beer_stream_free(s2);
+	beer_request_free(r1);
+	beer_request_free(r2);
+	return rc;
+}
+
 static int
 test_object() {
-	plan(109);
+	plan(141);
 	header();
 
 	struct beer_stream *s = NULL; s = beer_object(NULL);
@@ -281,7 +398,1182 @@ test_object() {
 			       "id", "file", "value", "File"), -1, "Pack with format");
 	is  (check_sbytes(s, bb4, bb4_len), 0, "Check bytestring");
 
+	/* headers change size at 15/16 and 65535/65536 values */
+	const uint32_t counts[] = {0, 15, 16, 65535, 65536};
+	for (int i = 0; i < 5; ++i) {
+		uint32_t n = counts[i];
+		is  (test_object_deferred(test_object_array, n), 0,
+		     "Deferred array of %u", n);
+		is  (test_object_deferred(test_object_map, n), 0,
+		     "Deferred map of %u", n);
+		is  (test_object_deferred(test_object_nested, n), 0,
+		     "Deferred nested containers of %u", n);
+		is  (test_object_deferred(test_object_siblings, n), 0,
+		     "Deferred sibling containers of %u", n);
+	}
+
+	const char *all = "[%d %i %u %ld %li %lu %lld %lli %llu %hd %hi %hu "
+			  "%hhd %hhi %hhu %f %lf %b %s %.*s NIL %%]";
+	is  (test_object_compiled(all, -1, 100000, 4000000000U, -5000000000L,
+				  7L, ULONG_MAX, LLONG_MIN, 0LL, ULLONG_MAX,
+				  -300, 300, 65535, -100, 127, 255, 1.5, 2.25,
+				  1, "str", 3, "abcdef"), 0,
+	     "Compiled format, every specifier");
+	is  (test_object_compiled(all, INT_MIN, -33, 0U, LONG_MIN, -1L, 0UL,
+				  LLONG_MAX, -129LL, 128ULL, SHRT_MIN,
+				  SHRT_MAX, 0, CHAR_MIN, -1, 0, -0.25, 1e300,
+				  0, "", 0, "abcdef"), 0,
+	     "Compiled format, every specifier, other values");
+	is  (test_object_compiled("{%s%d %s[%u%u] %s{} %s[]}", "a", 1, "b",
+				  2U, 3U, "c", "d"), 0, "Compiled format, map");
+
+	/* headers and nils are encoded into raw chunks of up to 255 bytes */
+	char fmt[1024] = "[";
+	for (int i = 0; i < 300; ++i) strcat(fmt, "NIL");
+	strcat(fmt, "%d[");
+	for (int i = 0; i < 20; ++i) strcat(fmt, "[{}]");
+	strcat(fmt, "]]");
+	is  (test_object_compiled(fmt, 42), 0,
+	     "Compiled format, long raw chunk");
+
+	/* strings don't fit into buffer, that is reserved beforehand */
+	char *big = malloc(200000);
+	memset(big, 'x', 200000);
+	big[199999] = 0;
+	is  (test_object_compiled("[%s%d%.*s{%s%s}]", big, 5, 150000, big,
+				  "k", big), 0,
+	     "Compiled format, long strings");
+	free(big);
+
+	struct beer_format f;
+	is  (beer_format_compile(&f, "[%d"), -1, "Unclosed container");
+	is  (beer_format_compile(&f, "%d]"), -1, "Unopened container");
+	is  (beer_format_compile(&f, "{%d}"), -1, "Map with odd values");
+	is  (beer_format_compile(&f, "{%d%d%d}"), -1, "Map with odd values");
+	is  (beer_format_compile(&f, "[%q]"), -1, "Unknown specifier");
+
+	beer_format_compile(&f, "[%d%s]");
+	struct beer_request *r1 = beer_request_select(NULL);
+	struct beer_request *r2 = beer_request_select(NULL);
+	beer_request_set_space(r1, 512);
+	beer_request_set_space(r2, 512);
+	beer_request_set_key_format(r1, "[%d%s]", 10, "key");
+	beer_request_set_key_compiled(r2, &f, 10, "key");
+	is  (test_object_requests(r1, r2), 0, "Request key from compiled format");
+	r1 = beer_request_replace(NULL);
+	r2 = beer_request_replace(NULL);
+	beer_request_set_space(r1, 512);
+	beer_request_set_space(r2, 512);
+	beer_request_set_tuple_format(r1, "[%d%s]", -10, "tuple");
+	beer_request_set_tuple_compiled(r2, &f, -10, "tuple");
+	is  (test_object_requests(r1, r2), 0,
+	     "Request tuple from compiled format");
+	beer_format_free(&f);
+
+	beer_stream_free(s);
+
+	footer();
+	return check_plan();
+}
+
+static size_t buf_reallocs = 0;
+
+static void *
+counting_realloc(void *ptr, size_t size) {
+	buf_reallocs++;
+	if (size == 0) {
+		free(ptr);
+		return NULL;
+	}
+	return realloc(ptr, size);
+}
+
+static int
+test_buf() {
+	plan(10);
+	header();
+
+	struct beer_stream *s = beer_buf(NULL);
+	isnt(s, NULL, "Checking that buffer is allocated");
+	void *old = beer_mem_init(counting_realloc);
+	buf_reallocs = 0;
+	int i;
+	for (i = 0; i < 1000; i++)
+		s->write(s, "\xcd\x04\xbb", 3);
+	is  (BEER_SBUF_SIZE(s), 3000, "Checking size after 1000 writes");
+	ok  (buf_reallocs <= 10, "Checking that growth is geometric");
+	size_t alloc = BEER_SBUF_CAST(s)->alloc;
+	beer_buf_reset(s);
+	is  (BEER_SBUF_SIZE(s), 0, "Checking size after reset");
+	is  (BEER_SBUF_CAST(s)->alloc, alloc, "Checking that reset keeps memory");
+	is  (beer_buf_reserve(s, 10000), 0, "Reserving memory");
+	ok  (BEER_SBUF_CAST(s)->alloc >= 10000, "Checking reserved memory");
+	s->write(s, "\xcd\x04\xbb", 3);
+	is  (beer_buf_shrink(s), 0, "Shrinking buffer");
+	is  (BEER_SBUF_CAST(s)->alloc, 3, "Checking memory after shrink");
 	beer_stream_free(s);
+	beer_mem_init(old);
+
+	char str[] = "\x90";
+	struct beer_stream *sa = beer_buf_as(NULL, str, 1);
+	is  (beer_buf_reserve(sa, 1), -1, "Reserving memory in user's string");
+	beer_stream_free(sa);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_arena() {
+	plan(7);
+	header();
+
+	struct beer_arena *a = beer_arena_new(NULL, 0);
+	isnt(a, NULL, "Checking that arena is allocated");
+	void *old = beer_mem_init(counting_realloc);
+	size_t allocs[2];
+	int round, i;
+	for (round = 0; round < 2; round++) {
+		buf_reallocs = 0;
+		beer_arena_enter(a);
+		for (i = 0; i < 1000; i++) {
+			struct beer_stream *o = beer_object(NULL);
+			beer_object_add_array(o, 1);
+			beer_object_add_int(o, i);
+			struct beer_request *r = beer_request_select(NULL);
+			beer_request_set_space(r, 512);
+			beer_request_set_key(r, o);
+			struct beer_stream *s = beer_buf(NULL);
+			beer_request_compile(s, r);
+			beer_request_free(r);
+			beer_stream_free(s);
+			beer_stream_free(o);
+		}
+		beer_arena_leave(a);
+		beer_arena_reset(a);
+		allocs[round] = buf_reallocs;
+	}
+	ok  (allocs[0] <= 10, "Checking allocations of the first batch");
+	is  (allocs[1], 0, "Checking that the next batch doesn't allocate");
+
+	beer_arena_enter(a);
+	char *p1 = beer_arena_alloc(a, 5);
+	char *p2 = beer_arena_alloc(a, 5);
+	is  ((uintptr_t)p1 % 16, 0, "Checking alignment");
+	is  (p2 - p1, 16, "Checking that blocks are carved from one slab");
+	beer_arena_leave(a);
+	buf_reallocs = 0;
+	struct beer_stream *s = beer_buf(NULL);
+	s->write(s, "\xcd\x04\xbb", 3);
+	beer_stream_free(s);
+	ok  (buf_reallocs > 0, "Checking that arena isn't used after leave");
+	beer_arena_reset(a);
+	buf_reallocs = 0;
+	beer_arena_alloc(a, 1024);
+	is  (buf_reallocs, 0, "Checking that reset keeps memory");
+	beer_arena_free(a);
+	beer_mem_init(old);
+
+	footer();
+	return check_plan();
+}
+
+/* appends data at top, as read from socket */
+static int
+test_iob_put(struct beer_iob *iob, const char *data, size_t size) {
+	if (beer_iob_room(iob) < size)
+		return -1;
+	memcpy(iob->buf + iob->top, data, size);
+	iob->top += size;
+	return 0;
+}
+
+/* consumes data at off, as parsed replies */
+static void
+test_iob_take(struct beer_iob *iob, size_t size) {
+	iob->off += size;
+	beer_iob_wrap(iob);
+}
+
+static int
+test_iob() {
+	plan(16);
+	header();
+
+	char data[8192];
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = 'a' + i % 26;
+	struct beer_iob iob;
+	is  (beer_iob_init_ring(&iob, 4096, NULL, NULL), 0, "Init ring");
+	ok  (iob.mirror && iob.size == 4096, "Check that ring is mapped twice");
+
+	/* write past size of ring */
+	test_iob_put(&iob, data, 3000);
+	test_iob_take(&iob, 2000);
+	is  (test_iob_put(&iob, data + 3000, 2000), 0, "Write past the end");
+	ok  (iob.top == 5000 && memcmp(iob.buf + 3000, data + 3000, 2000) == 0 &&
+	     memcmp(iob.buf, data + 4096, 904) == 0,
+	     "Check that wrapped data is contiguous");
+	test_iob_take(&iob, 3000);
+	ok  (iob.off == 0 && iob.top == 0, "Drained ring is rewound");
+
+	/* reply, that is pinned across the end of ring */
+	test_iob_put(&iob, data, 3000);
+	test_iob_take(&iob, 2500);
+	test_iob_put(&iob, data + 3000, 1500);
+	beer_iob_pin(&iob);
+	const char *reply = iob.buf + iob.off;
+	test_iob_take(&iob, 2000);
+	is  (beer_iob_room(&iob), 2500 + 4096 - 4500,
+	     "Room stops at pinned reply");
+	ok  (iob.off == 4500 && iob.top == 4500, "Pinned ring isn't rewound");
+	test_iob_put(&iob, data + 4500, 2000);
+	test_iob_take(&iob, 2000);
+	ok  (memcmp(reply, data + 2500, 2000) == 0,
+	     "Check that pinned reply is intact");
+	beer_iob_unpin(&iob);
+	beer_iob_wrap(&iob);
+	ok  (iob.pin == 0 && iob.off == 0 && iob.top == 0,
+	     "Ring is rewound once reply is unpinned");
+
+	/* offsets move back into the first mapping, low with them */
+	test_iob_put(&iob, data, 3000);
+	test_iob_take(&iob, 2000);
+	test_iob_put(&iob, data + 3000, 3000);
+	test_iob_take(&iob, 2500);
+	beer_iob_pin(&iob);
+	reply = iob.buf + iob.off;
+	test_iob_take(&iob, 1000);
+	ok  (iob.low == 404 && iob.off == 1404 && iob.top == 1904,
+	     "Pinned offsets move back");
+	ok  (memcmp(iob.buf + iob.low, data + 4500, 1000) == 0 &&
+	     memcmp(reply, data + 4500, 1000) == 0,
+	     "Check pinned reply at both addresses");
+	beer_iob_unpin(&iob);
+	test_iob_take(&iob, 500);
+	ok  (iob.off == 0 && iob.top == 0, "Ring is rewound");
+
+	/* resize keeps unread data */
+	test_iob_put(&iob, data, 1000);
+	test_iob_take(&iob, 200);
+	is  (beer_iob_resize(&iob, 16384), 0, "Resize ring");
+	ok  (iob.size == 16384 && iob.off == 0 && iob.top == 800 &&
+	     memcmp(iob.buf, data + 200, 800) == 0, "Check resized ring");
+	beer_iob_free(&iob);
+
+	beer_iob_init(&iob, 1024, NULL, NULL, NULL);
+	test_iob_put(&iob, data, 1000);
+	is  (beer_iob_resize(&iob, 4096), 0, "Resize plain buffer");
+	ok  (iob.size == 4096 && iob.top == 1000 &&
+	     memcmp(iob.buf, data, 1000) == 0, "Check resized buffer");
+	beer_iob_free(&iob);
+
+	footer();
+	return check_plan();
+}
+
+/* compares requests encoded by two streams, resets streams */
+static int
+test_point_check(struct beer_stream *s1, ssize_t rc1,
+		 struct beer_stream *s2, ssize_t rc2) {
+	int rc = (rc1 != rc2 || rc1 != (ssize_t)BEER_SBUF_SIZE(s1)) ? -1 :
+		 check_sbytes(s2, BEER_SBUF_DATA(s1), BEER_SBUF_SIZE(s1));
+	beer_buf_reset(s1);
+	beer_buf_reset(s2);
+	return rc;
+}
+
+static int
+test_point() {
+	plan(16);
+	header();
+
+	struct beer_stream *s1 = beer_buf(NULL), *s2 = beer_buf(NULL);
+	char str[] = "point key";
+	char tuple[64], *tuple_end = mp_encode_array(tuple, 3);
+	tuple_end = mp_encode_uint(tuple_end, 100);
+	tuple_end = mp_encode_uint(tuple_end, UINT64_MAX);
+	tuple_end = mp_encode_str(tuple_end, str, strlen(str));
+	uint64_t schema_ids[] = { 0, 1000 };
+	for (int i = 0; i < 2; i++) {
+		s1->schema_id = s2->schema_id = schema_ids[i];
+		s1->reqid = s2->reqid = 7;
+		const char *with = i ? "with schema id" : "without schema id";
+		ssize_t rc1, rc2;
+
+		struct beer_stream *key = beer_object(NULL);
+		beer_object_format(key, "[%lu]", 300000UL);
+		rc1 = beer_select(s1, 512, 0, 1, 0, BEER_ITER_EQ, key);
+		rc2 = beer_select_uint(s2, 512, 0, 1, 300000);
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_select_uint, %s", with);
+		rc1 = beer_delete(s1, 512, 0, key);
+		rc2 = beer_delete_uint(s2, 512, 0, 300000);
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_delete_uint, %s", with);
+		beer_stream_free(key);
+
+		key = beer_object(NULL);
+		beer_object_format(key, "[%d%llu]", 5, ULLONG_MAX);
+		rc1 = beer_select(s1, 513, 1, UINT32_MAX, 0, BEER_ITER_EQ, key);
+		rc2 = beer_select_uint2(s2, 513, 1, UINT32_MAX, 5, ULLONG_MAX);
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_select_uint2, %s", with);
+		rc1 = beer_delete(s1, 513, 1, key);
+		rc2 = beer_delete_uint2(s2, 513, 1, 5, ULLONG_MAX);
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_delete_uint2, %s", with);
+		beer_stream_free(key);
+
+		key = beer_object(NULL);
+		beer_object_format(key, "[%s]", str);
+		rc1 = beer_select(s1, 512, 2, 10, 0, BEER_ITER_EQ, key);
+		rc2 = beer_select_str(s2, 512, 2, 10, str, strlen(str));
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_select_str, %s", with);
+		rc1 = beer_delete(s1, 512, 2, key);
+		rc2 = beer_delete_str(s2, 512, 2, str, strlen(str));
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_delete_str, %s", with);
+		beer_stream_free(key);
+
+		struct beer_stream *val = beer_object(NULL);
+		beer_object_format(val, "[%d%llu%s]", 100, ULLONG_MAX, str);
+		rc1 = beer_insert(s1, 512, val);
+		rc2 = beer_insert_mp(s2, 512, tuple, tuple_end - tuple);
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_insert_mp, %s", with);
+		rc1 = beer_replace(s1, 512, val);
+		rc2 = beer_replace_mp(s2, 512, tuple, tuple_end - tuple);
+		is  (test_point_check(s1, rc1, s2, rc2), 0,
+		     "beer_replace_mp, %s", with);
+		beer_stream_free(val);
+	}
+	beer_stream_free(s1);
+	beer_stream_free(s2);
+
+	footer();
+	return check_plan();
+}
+
+/*
+ * decodes frame at the start of stream: checks length prefix, returns
+ * code, sync and schema id of header and position of body
+ */
+static int
+test_prepared_frame(struct beer_stream *s, uint64_t *hdr, const char **body,
+		    size_t *body_size) {
+	const char *p = BEER_SBUF_DATA(s), *end = p + BEER_SBUF_SIZE(s);
+	if (mp_typeof(*p) != MP_UINT || mp_decode_uint(&p) != (size_t)(end - p))
+		return -1;
+	if (mp_typeof(*p) != MP_MAP)
+		return -1;
+	hdr[0] = hdr[1] = hdr[2] = UINT64_MAX;
+	uint32_t n = mp_decode_map(&p);
+	while (n-- > 0) {
+		uint64_t key = mp_decode_uint(&p);
+		uint64_t value = mp_decode_uint(&p);
+		if (key == BEER_CODE)
+			hdr[0] = value;
+		else if (key == BEER_SYNC)
+			hdr[1] = value;
+		else if (key == BEER_SCHEMA_ID)
+			hdr[2] = value;
+		else
+			return -1;
+	}
+	*body = p;
+	*body_size = end - p;
+	return 0;
+}
+
+/*
+ * compares frame of template with frame of compile: headers must decode
+ * to the same values, bodies must be byte-identical
+ */
+static int
+test_prepared_check(struct beer_stream *compiled, struct beer_stream *prepared,
+		    uint64_t sync) {
+	uint64_t h1[3], h2[3];
+	const char *b1, *b2;
+	size_t b1_size, b2_size;
+	int rc = 0;
+	if (test_prepared_frame(compiled, h1, &b1, &b1_size) == -1 ||
+	    test_prepared_frame(prepared, h2, &b2, &b2_size) == -1 ||
+	    memcmp(h1, h2, sizeof(h1)) != 0 || h2[1] != sync ||
+	    b1_size != b2_size || memcmp(b1, b2, b1_size) != 0)
+		rc = -1;
+	beer_buf_reset(compiled);
+	beer_buf_reset(prepared);
+	return rc;
+}
+
+static int
+test_prepared() {
+	plan(20);
+	header();
+
+	struct beer_stream *s1 = beer_buf(NULL), *s2 = beer_buf(NULL);
+	struct beer_prepared p;
+	char key[16], *key_end = mp_encode_array(key, 1);
+	key_end = mp_encode_uint(key_end, 300000);
+	char tuple[32], *tuple_end = mp_encode_array(tuple, 2);
+	tuple_end = mp_encode_uint(tuple_end, 300000);
+	tuple_end = mp_encode_str(tuple_end, "tuple", 5);
+	uint64_t schema_ids[] = { 0, 1000 };
+	for (int i = 0; i < 2; i++) {
+		const char *with = i ? "with schema id" : "without schema id";
+		s1->schema_id = s2->schema_id = schema_ids[i];
+		s1->reqid = s2->reqid = 5;
+
+		struct beer_request *req = beer_request_select(NULL);
+		beer_request_set_space(req, 512);
+		beer_request_set_index(req, 1);
+		beer_request_set_limit(req, 10);
+		beer_request_set_key_format(req, "[%d]", 1);
+		is  (beer_request_prepare(req, &p), 0, "Prepare select, %s", with);
+		int64_t sync = beer_request_compile(s1, req);
+		is  (beer_prepared_execute(s2, &p, NULL, 0, NULL, 0), sync,
+		     "Execute select, %s", with);
+		is  (test_prepared_check(s1, s2, sync), 0,
+		     "Check select, %s", with);
+		/* key of the template is replaced, sync is patched again */
+		s1->reqid = 1000;
+		s2->reqid = 1000;
+		beer_request_set_key_format(req, "[%lu]", 300000UL);
+		sync = beer_request_compile(s1, req);
+		beer_prepared_execute(s2, &p, key, key_end - key, NULL, 0);
+		is  (test_prepared_check(s1, s2, 1000), 0,
+		     "Check select with key, %s", with);
+		beer_request_free(req);
+
+		req = beer_request_replace(NULL);
+		beer_request_set_space(req, 512);
+		beer_request_set_tuple_format(req, "[%d%s]", 1, "template");
+		is  (beer_request_prepare(req, &p), 0, "Prepare replace, %s", with);
+		beer_request_set_tuple_format(req, "[%lu%s]", 300000UL, "tuple");
+		sync = beer_request_compile(s1, req);
+		beer_prepared_execute(s2, &p, NULL, 0, tuple, tuple_end - tuple);
+		is  (test_prepared_check(s1, s2, sync), 0,
+		     "Check replace with tuple, %s", with);
+		beer_request_free(req);
+
+		req = beer_request_update(NULL);
+		beer_request_set_space(req, 512);
+		beer_request_set_key_format(req, "[%d]", 1);
+		struct beer_stream *val = beer_object(NULL);
+		beer_object_format(val, "%s", "x");
+		struct beer_stream *ops = beer_update_container(NULL);
+		beer_update_assign(ops, 1, val);
+		beer_update_container_close(ops);
+		beer_request_set_ops(req, ops);
+		beer_request_prepare(req, &p);
+		sync = beer_request_compile(s1, req);
+		beer_prepared_execute(s2, &p, NULL, 0, NULL, 0);
+		is  (test_prepared_check(s1, s2, sync), 0,
+		     "Check update, %s", with);
+		beer_request_free(req);
+		beer_stream_free(ops);
+		beer_stream_free(val);
+
+		req = beer_request_call(NULL);
+		beer_request_set_funcz(req, "test_4");
+		beer_request_set_tuple_format(req, "[]");
+		beer_request_prepare(req, &p);
+		sync = beer_request_compile(s1, req);
+		beer_prepared_execute(s2, &p, NULL, 0, NULL, 0);
+		is  (test_prepared_check(s1, s2, sync), 0,
+		     "Check call, %s", with);
+		beer_request_free(req);
+	}
+
+	struct beer_request *req = beer_request_ping(NULL);
+	is  (beer_request_prepare(req, &p), 0, "Prepare ping");
+	s1->schema_id = s2->schema_id = 0;
+	int64_t sync = beer_request_compile(s1, req);
+	beer_prepared_execute(s2, &p, NULL, 0, NULL, 0);
+	is  (test_prepared_check(s1, s2, sync), 0, "Check ping");
+	beer_request_free(req);
+
+	/* a template is up to 8 bytes longer, sync and schema id are 9 bytes */
+	req = beer_request_select(NULL);
+	beer_request_set_key_format(req, "[]");
+	beer_request_prepare(req, &p);
+	s1->schema_id = s2->schema_id = 1;
+	s1->reqid = s2->reqid = 0;
+	beer_request_compile(s1, req);
+	beer_prepared_execute(s2, &p, NULL, 0, NULL, 0);
+	is  (BEER_SBUF_SIZE(s2) - BEER_SBUF_SIZE(s1), 8,
+	     "Check size of frame with small sync");
+	is  (test_prepared_check(s1, s2, 0), 0, "Check frame with small sync");
+	beer_request_free(req);
+	beer_stream_free(s1);
+	beer_stream_free(s2);
+
+	footer();
+	return check_plan();
+}
+
+/* encodes reply with one tuple [sync, str] (without length prefix) */
+static char *
+test_reply_frame(char *buf, uint64_t sync, const char *str) {
+	char *p = mp_encode_map(buf, 3);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, 0);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_uint(p, sync);
+	p = mp_encode_uint(p, BEER_SCHEMA_ID);
+	p = mp_encode_uint(p, 3);
+	p = mp_encode_map(p, 1);
+	p = mp_encode_uint(p, BEER_DATA);
+	p = mp_encode_array(p, 1);
+	p = mp_encode_array(p, 2);
+	p = mp_encode_uint(p, sync);
+	return mp_encode_str(p, str, strlen(str));
+}
+
+/* checks that reply holds one tuple [sync, str] */
+static int
+test_reply_check(struct beer_reply *r, const char *str) {
+	const char *data = r->data;
+	uint32_t len = 0;
+	if (data == NULL || mp_decode_array(&data) != 1 ||
+	    mp_decode_array(&data) != 2 || mp_decode_uint(&data) != r->sync)
+		return -1;
+	const char *s = mp_decode_str(&data, &len);
+	return (data == r->data_end && len == strlen(str) &&
+		memcmp(s, str, len) == 0) ? 0 : -1;
+}
+
+static int
+test_reply() {
+	plan(9);
+	header();
+
+	char buf[128];
+	char *end = test_reply_frame(buf, 7, "view");
+	struct beer_reply r;
+	beer_reply_init(&r);
+	is  (beer_reply_view(&r, buf, end - buf), 0, "View reply in place");
+	ok  (r.sync == 7 && r.schema_id == 3 && r.code == 0 &&
+	     test_reply_check(&r, "view") == 0, "Check viewed reply");
+	ok  (r.buf == buf && r.owned == 0, "Check that buffer isn't owned");
+	/* buffer on stack isn't freed */
+	beer_reply_free(&r);
+	is  (r.buf, NULL, "Free viewed reply");
+
+	struct beer_reply *rp = beer_reply_init(NULL);
+	is  (beer_reply_view(rp, buf, end - buf), 0, "View into allocated reply");
+	beer_reply_free(rp);
+
+	beer_reply_init(&r);
+	beer_reply_view(&r, buf, end - buf);
+	is  (beer_reply_detach(&r), 0, "Detach viewed reply");
+	memset(buf, 0, sizeof(buf));
+	ok  (r.buf != buf && r.owned == 1 && test_reply_check(&r, "view") == 0,
+	     "Check detached reply");
+	is  (beer_reply_detach(&r), 0, "Detach owned reply");
+	beer_reply_free(&r);
+
+	end = test_reply_frame(buf, 8, "copy");
+	char frame[128];
+	/* server sends length as 5-byte uint */
+	char *p = mp_store_u8(frame, 0xce);
+	p = mp_store_u32(p, end - buf);
+	memcpy(p, buf, end - buf);
+	size_t off = 0;
+	beer_reply_init(&r);
+	ok  (beer_reply(&r, frame, p - frame + (end - buf), &off) == 0 &&
+	     r.owned == 1 && test_reply_check(&r, "copy") == 0,
+	     "Check copied reply");
+	beer_reply_free(&r);
+
+	footer();
+	return check_plan();
+}
+
+/* parses frame, cut to size */
+static int
+test_reply_cut(const char *buf, size_t size, int trusted) {
+	struct beer_reply r;
+	beer_reply_init(&r);
+	r.trusted = trusted;
+	int rc = beer_reply_view(&r, buf, size);
+	/* nothing is kept of malformed reply */
+	if (rc == -1 && (r.buf != NULL || r.data != NULL || r.sync != 0))
+		rc = -2;
+	beer_reply_free(&r);
+	return rc;
+}
+
+static int
+test_reply_malformed() {
+	plan(10);
+	header();
+
+	char buf[128];
+	char *end = test_reply_frame(buf, 9, "malformed");
+	size_t size = end - buf;
+	/* header is map of 3 pairs, 7 bytes long */
+	is  (test_reply_cut(buf, 0, 0), -1, "Empty frame");
+	is  (test_reply_cut(buf, 3, 0), -1, "Truncated header map");
+	is  (test_reply_cut(buf, 4, 1), -1, "Truncated header map, trusted");
+	is  (test_reply_cut(buf, 7, 0), 0, "Header without body");
+
+	char frame[128];
+	char *p = mp_encode_map(frame, 1);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_uint(p, 9);
+	char *body = p;
+	p = mp_encode_map(p, 1);
+	p = mp_encode_str(p, "data", 4);
+	p = mp_encode_array(p, 0);
+	is  (test_reply_cut(frame, p - frame, 1), -1,
+	     "Body key isn't uint");
+	p = mp_encode_map(body, 1);
+	p = mp_encode_int(p, -BEER_DATA);
+	p = mp_encode_array(p, 0);
+	is  (test_reply_cut(frame, p - frame, 1), -1,
+	     "Body key is negative");
+	p = mp_encode_map(frame, 1);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_str(p, "9", 1);
+	is  (test_reply_cut(frame, p - frame, 1), -1,
+	     "Header value isn't uint");
+
+	/* data is the last key of body, so string is cut */
+	is  (test_reply_cut(buf, size - 1, 0), -1, "Truncated data");
+	/* data of trusted reply is taken up to the end of frame unchecked */
+	struct beer_reply r;
+	beer_reply_init(&r);
+	r.trusted = 1;
+	ok  (beer_reply_view(&r, buf, size - 1) == 0 &&
+	     r.data_end == buf + size - 1, "Truncated data, trusted");
+	beer_reply_free(&r);
+	/* but its type is still checked */
+	p = mp_encode_map(body, 1);
+	p = mp_encode_uint(p, BEER_DATA);
+	p = mp_encode_uint(p, 1);
+	is  (test_reply_cut(frame, p - frame, 1), -1,
+	     "Data isn't array, trusted");
+
+	footer();
+	return check_plan();
+}
+
+/* listening socket on loopback, test plays server of non-blocking stream */
+static int
+test_nonblock_listen(int *port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	/* small buffer of accepted socket makes flush partial */
+	int size = 4096;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(fd, 1) == -1 ||
+	    getsockname(fd, (struct sockaddr *)&addr, &len) == -1) {
+		close(fd);
+		return -1;
+	}
+	*port = ntohs(addr.sin_port);
+	return fd;
+}
+
+static void
+test_nonblock_wait(struct beer_stream *s) {
+	int want = beer_want(s);
+	struct pollfd p = { beer_fd(s), 0, 0 };
+	if (want & BEER_WANT_READ)
+		p.events |= POLLIN;
+	if (want & BEER_WANT_WRITE)
+		p.events |= POLLOUT;
+	poll(&p, 1, 100);
+}
+
+/* reads reply, waiting while it's not fully received */
+static int
+test_nonblock_read(struct beer_stream *s, struct beer_reply *r) {
+	int rc, i;
+	for (i = 0; i < 100; i++) {
+		beer_reply_init(r);
+		rc = s->read_reply(s, r);
+		if (rc != -1 || beer_error(s) != BEER_EAGAIN)
+			return rc;
+		test_nonblock_wait(s);
+	}
+	return rc;
+}
+
+/* appends everything that was sent to peer to buf */
+static void
+test_nonblock_drain(int fd, char **buf, size_t *size) {
+	char data[65536];
+	ssize_t rc;
+	while ((rc = read(fd, data, sizeof(data))) > 0) {
+		*buf = realloc(*buf, *size + rc);
+		memcpy(*buf + *size, data, rc);
+		*size += rc;
+	}
+}
+
+static size_t
+test_nonblock_frames(const char *buf, size_t size) {
+	size_t count = 0;
+	const char *p = buf, *end = buf + size;
+	while (end - p >= 5 && (uint8_t)p[0] == 0xce) {
+		p++;
+		uint32_t len = mp_load_u32(&p);
+		p += len;
+		count++;
+	}
+	return p == end ? count : 0;
+}
+
+/* encodes reply with length prefix, with tuple of string of len bytes */
+static size_t
+test_nonblock_reply(char *buf, uint64_t sync, size_t len) {
+	char *p = mp_encode_map(buf + 5, 2);
+	p = mp_encode_uint(p, BEER_CODE);
+	p = mp_encode_uint(p, 0);
+	p = mp_encode_uint(p, BEER_SYNC);
+	p = mp_encode_uint(p, sync);
+	if (len > 0) {
+		p = mp_encode_map(p, 1);
+		p = mp_encode_uint(p, BEER_DATA);
+		p = mp_encode_array(p, 1);
+		p = mp_encode_strl(p, len);
+		memset(p, 'x', len);
+		p += len;
+	}
+	char *h = mp_store_u8(buf, 0xce);
+	mp_store_u32(h, p - buf - 5);
+	return p - buf;
+}
+
+static int
+test_nonblock() {
+	plan(17);
+	header();
+
+	int port = 0;
+	int lfd = test_nonblock_listen(&port);
+	isnt(lfd, -1, "Listen on loopback");
+	char uri[32];
+	snprintf(uri, sizeof(uri), "127.0.0.1:%d", port);
+	struct beer_stream *s = beer_net(NULL);
+	beer_set(s, BEER_OPT_URI, uri);
+	beer_set(s, BEER_OPT_NONBLOCK, 1);
+	beer_set(s, BEER_OPT_ZERO_COPY, 1);
+	beer_set(s, BEER_OPT_SEND_BUF, 4096);
+	beer_set(s, BEER_OPT_RECV_BUF, 4096);
+	beer_set(s, BEER_OPT_SOCK_SEND_BUF, 4096);
+
+	/* connect may be done at once on loopback, greeting can't */
+	int rc;
+	while ((rc = beer_connect(s)) == -1 && beer_error(s) == BEER_EAGAIN &&
+	       beer_want(s) == BEER_WANT_WRITE)
+		test_nonblock_wait(s);
+	ok  (rc == -1 && beer_error(s) == BEER_EAGAIN, "Connect doesn't block");
+	is  (beer_want(s), BEER_WANT_READ, "Wait for greeting");
+	int fd = accept(lfd, NULL, NULL);
+	char greeting[128];
+	memset(greeting, 'A', sizeof(greeting));
+	memcpy(greeting, "Bee 1.6 (Binary)", 16);
+	greeting[63] = greeting[127] = '\n';
+	write(fd, greeting, 64);
+	test_nonblock_wait(s);
+	ok  (beer_connect(s) == -1 && beer_error(s) == BEER_EAGAIN,
+	     "Connect waits for the rest of greeting");
+	write(fd, greeting + 64, 64);
+	test_nonblock_wait(s);
+	is  (beer_connect(s), 0, "Connected");
+
+	/* server doesn't read, until the socket is full */
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	uint64_t sync = s->reqid;
+	uint64_t sent = 0;
+	while (sent < 100000 && beer_ping(s) != -1)
+		sent++;
+	ok  (sent < 100000 && beer_error(s) == BEER_EAGAIN,
+	     "Write fails with EAGAIN, when socket is full");
+	beer_flush(s);
+	ok  (beer_error(s) == BEER_EAGAIN && (beer_want(s) & BEER_WANT_WRITE),
+	     "Flush is partial");
+	char *in = NULL;
+	size_t in_size = 0;
+	while (beer_want(s) & BEER_WANT_WRITE) {
+		test_nonblock_drain(fd, &in, &in_size);
+		beer_flush(s);
+	}
+	test_nonblock_drain(fd, &in, &in_size);
+	is  (test_nonblock_frames(in, in_size), sent, "Check requests sent");
+	is  (s->wrcnt, sent, "Check requests in flight");
+
+	/* reply is split across reads, request is answered once it's read */
+	char out[8192];
+	size_t size = test_nonblock_reply(out, sync, 0);
+	struct beer_reply r;
+	beer_reply_init(&r);
+	write(fd, out, 2);
+	test_nonblock_wait(s);
+	ok  (s->read_reply(s, &r) == -1 && beer_error(s) == BEER_EAGAIN &&
+	     s->wrcnt == sent, "Read part of length");
+	write(fd, out + 2, 5);
+	test_nonblock_wait(s);
+	ok  (s->read_reply(s, &r) == -1 && beer_error(s) == BEER_EAGAIN &&
+	     s->wrcnt == sent, "Read part of header");
+	write(fd, out + 7, size - 7);
+	ok  (test_nonblock_read(s, &r) == 0 && r.sync == sync &&
+	     s->wrcnt == sent - 1, "Read the rest");
+	beer_reply_free(&r);
+	uint64_t got = 1;
+	while (got < sent) {
+		size = test_nonblock_reply(out, sync + got, 0);
+		write(fd, out, size);
+		if (test_nonblock_read(s, &r) != 0 || r.sync != sync + got)
+			break;
+		beer_reply_free(&r);
+		got++;
+	}
+	is  (got, sent, "Read all replies");
+
+	/*
+	 * the first reply is kept, the last one starts 2 bytes before the
+	 * end of ring, so even its length doesn't fit
+	 */
+	sync = s->reqid;
+	for (int i = 0; i < 5; i++)
+		beer_ping(s);
+	beer_flush(s);
+	test_nonblock_drain(fd, &in, &in_size);
+	size_t ring = BEER_SNET_CAST(s)->rbuf.size;
+	size_t len[5] = { 1, 1000, 1000, 300, 1 };
+	size_t overhead = test_nonblock_reply(out, sync + 3, 300) - 300;
+	len[3] = ring - 2 - test_nonblock_reply(out, sync, len[0]) -
+		 test_nonblock_reply(out, sync + 1, len[1]) -
+		 test_nonblock_reply(out, sync + 2, len[2]) - overhead;
+	size = 0;
+	for (int i = 0; i < 5; i++)
+		size += test_nonblock_reply(out + size, sync + i, len[i]);
+	write(fd, out, size);
+	struct beer_reply kept;
+	rc = test_nonblock_read(s, &kept);
+	for (int i = 1; rc == 0 && i < 4; i++) {
+		rc = test_nonblock_read(s, &r);
+		beer_reply_free(&r);
+	}
+	is  (rc, 0, "Read replies, while the first one is kept");
+	ok  (test_nonblock_read(s, &r) == -1 && beer_error(s) == BEER_EBIG &&
+	     s->wrcnt == 1, "Reply that doesn't fit isn't consumed");
+	beer_reply_free(&kept);
+	ok  (test_nonblock_read(s, &r) == 0 && r.sync == sync + 4 &&
+	     s->wrcnt == 0, "Reply is read, once the kept one is freed");
+	beer_reply_free(&r);
+	is  (s->read_reply(s, &r), 1, "Check that nothing is in flight");
+
+	beer_stream_free(s);
+	free(in);
+	close(fd);
+	close(lfd);
+
+	footer();
+	return check_plan();
+}
+
+/*
+ * peer, that sends greeting (and prepared replies), and keeps everything
+ * it receives
+ */
+struct test_peer {
+	int lfd;
+	const char *out;
+	size_t out_size;
+	char *in;
+	size_t size;
+};
+
+static void *
+test_peer_thread(void *arg) {
+	struct test_peer *p = arg;
+	int fd = accept(p->lfd, NULL, NULL);
+	if (fd == -1)
+		return NULL;
+	char greeting[128];
+	memset(greeting, 'A', sizeof(greeting));
+	memcpy(greeting, "Bee 1.6 (Binary)", 16);
+	greeting[63] = greeting[127] = '\n';
+	write(fd, greeting, sizeof(greeting));
+	if (p->out_size)
+		write(fd, p->out, p->out_size);
+	test_nonblock_drain(fd, &p->in, &p->size);
+	close(fd);
+	return NULL;
+}
+
+/* writes to stream, and to the expected output of it */
+static void
+test_send_ref_write(struct beer_stream *s, char *expect, size_t *off,
+		    const char *buf, size_t size) {
+	s->write(s, buf, size);
+	memcpy(expect + *off, buf, size);
+	*off += size;
+}
+
+static int
+test_send_ref() {
+	plan(9);
+	header();
+
+	struct test_peer peer;
+	memset(&peer, 0, sizeof(peer));
+	int port = 0;
+	peer.lfd = test_nonblock_listen(&port);
+	isnt(peer.lfd, -1, "Listen on loopback");
+	pthread_t t;
+	pthread_create(&t, NULL, test_peer_thread, &peer);
+	char uri[32];
+	snprintf(uri, sizeof(uri), "127.0.0.1:%d", port);
+	struct beer_stream *s = beer_net(NULL);
+	beer_set(s, BEER_OPT_URI, uri);
+	beer_set(s, BEER_OPT_SEND_BUF, 4096);
+	beer_set(s, BEER_OPT_SEND_REF, 1);
+	is  (beer_connect(s), 0, "Connected");
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+
+	/* everything written, in order */
+	size_t size = 100 * 301 + 4096;
+	char *expect = malloc(size), *data = malloc(size);
+	size_t off = 0;
+	for (size_t i = 0; i < size; i++)
+		data[i] = 'a' + i % 26;
+	/* references are taken at least from 256 bytes */
+	test_send_ref_write(s, expect, &off, "aaa", 3);
+	test_send_ref_write(s, expect, &off, data, 255);
+	is  (sn->sbuf.ref_count, 0, "Write below 256 bytes is copied");
+	test_send_ref_write(s, expect, &off, data + 1, 256);
+	ok  (sn->sbuf.ref_count == 1 && sn->sbuf.off == 258,
+	     "Write of 256 bytes is queued by reference");
+	struct iovec v[3] = {
+		{ "dd", 2 }, { data + 2, 1000 }, { "ff", 2 }
+	};
+	s->writev(s, v, 3);
+	for (int i = 0; i < 3; i++) {
+		memcpy(expect + off, v[i].iov_base, v[i].iov_len);
+		off += v[i].iov_len;
+	}
+	ok  (sn->sbuf.ref_count == 2 && sn->sbuf.off == 262,
+	     "Big part of writev is queued by reference");
+	ok  (beer_flush(s) != -1 && sn->sbuf.ref_count == 0 &&
+	     sn->sbuf.off == 0, "Flush buffered data with references");
+
+	/* more references than fit one writev */
+	for (int i = 0; i < 100; i++) {
+		test_send_ref_write(s, expect, &off, &data[i], 1);
+		test_send_ref_write(s, expect, &off, data + i, 300);
+	}
+	isnt(beer_flush(s), -1, "Flush more than 64 references");
+
+	beer_stream_free(s);
+	pthread_join(t, NULL);
+	close(peer.lfd);
+	is  (peer.size, off, "Check size of sent data");
+	ok  (peer.size == off && memcmp(peer.in, expect, off) == 0,
+	     "Check that data is sent in order of writes");
+	free(peer.in);
+	free(expect);
+	free(data);
+
+	footer();
+	return check_plan();
+}
+
+/* kernel buffer of socket */
+static int
+test_sockbuf(int fd, int opt) {
+	int size = 0;
+	socklen_t len = sizeof(size);
+	if (getsockopt(fd, SOL_SOCKET, opt, &size, &len) == -1)
+		return -1;
+	return size;
+}
+
+/* stream connected to a new peer, with kernel buffers of sizes */
+static struct beer_stream *
+test_sockbuf_connect(struct test_peer *peer, pthread_t *t, int snd, int rcv) {
+	memset(peer, 0, sizeof(struct test_peer));
+	int port = 0;
+	peer->lfd = test_nonblock_listen(&port);
+	pthread_create(t, NULL, test_peer_thread, peer);
+	char uri[32];
+	snprintf(uri, sizeof(uri), "127.0.0.1:%d", port);
+	struct beer_stream *s = beer_net(NULL);
+	beer_set(s, BEER_OPT_URI, uri);
+	beer_set(s, BEER_OPT_SOCK_SEND_BUF, snd);
+	beer_set(s, BEER_OPT_SOCK_RECV_BUF, rcv);
+	beer_connect(s);
+	return s;
+}
+
+static void
+test_sockbuf_close(struct beer_stream *s, struct test_peer *peer,
+		   pthread_t t) {
+	beer_stream_free(s);
+	pthread_join(t, NULL);
+	close(peer->lfd);
+	free(peer->in);
+}
+
+static int
+test_sockbuf_opts() {
+	plan(6);
+	header();
+
+	/* sizes of a socket, that is connected the same way by hand */
+	int port = 0;
+	int lfd = test_nonblock_listen(&port);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+	int snd = test_sockbuf(fd, SO_SNDBUF), rcv = test_sockbuf(fd, SO_RCVBUF);
+	close(fd);
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	int max = 128 * 1024 * 1024;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &max, sizeof(max));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &max, sizeof(max));
+	int snd_max = test_sockbuf(fd, SO_SNDBUF);
+	int rcv_max = test_sockbuf(fd, SO_RCVBUF);
+	close(fd);
+	close(lfd);
+
+	struct test_peer peer;
+	pthread_t t;
+	struct beer_stream *s = test_sockbuf_connect(&peer, &t, 0, 0);
+	ok  (test_sockbuf(beer_fd(s), SO_SNDBUF) == snd &&
+	     test_sockbuf(beer_fd(s), SO_RCVBUF) == rcv,
+	     "Kernel buffers are left unset");
+	test_sockbuf_close(s, &peer, t);
+
+	s = test_sockbuf_connect(&peer, &t, 65536, 32768);
+	int snd_set = test_sockbuf(beer_fd(s), SO_SNDBUF);
+	int rcv_set = test_sockbuf(beer_fd(s), SO_RCVBUF);
+	/* Linux reports double of the size, that was set */
+	ok  (snd_set == 65536 || snd_set == 2 * 65536, "Send buffer is set");
+	ok  (rcv_set == 32768 || rcv_set == 2 * 32768, "Recv buffer is set");
+	test_sockbuf_close(s, &peer, t);
+
+	s = test_sockbuf_connect(&peer, &t, -1, -1);
+	is  (test_sockbuf(beer_fd(s), SO_SNDBUF), snd_max,
+	     "Send buffer is the largest");
+	is  (test_sockbuf(beer_fd(s), SO_RCVBUF), rcv_max,
+	     "Recv buffer is the largest");
+	test_sockbuf_close(s, &peer, t);
+
+	s = test_sockbuf_connect(&peer, &t, 0, 0);
+	beer_set(s, BEER_OPT_SOCK_SEND_BUF, 65536);
+	ok  (test_sockbuf(beer_fd(s), SO_SNDBUF) == snd,
+	     "Option is applied on connect");
+	test_sockbuf_close(s, &peer, t);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_adaptive_buf() {
+	plan(10);
+	header();
+
+	/* big reply, then small ones */
+	size_t out_size = 0, i;
+	char *out = malloc(30000 + 101 * 64);
+	out_size += test_nonblock_reply(out, 0, 20000);
+	for (i = 0; i < 101; i++)
+		out_size += test_nonblock_reply(out + out_size, i + 1, 8);
+
+	struct test_peer peer;
+	memset(&peer, 0, sizeof(peer));
+	int port = 0;
+	peer.lfd = test_nonblock_listen(&port);
+	peer.out = out;
+	peer.out_size = out_size;
+	pthread_t t;
+	pthread_create(&t, NULL, test_peer_thread, &peer);
+	char uri[32];
+	snprintf(uri, sizeof(uri), "127.0.0.1:%d", port);
+	struct beer_stream *s = beer_net(NULL);
+	beer_set(s, BEER_OPT_URI, uri);
+	beer_set(s, BEER_OPT_SEND_BUF, 4096);
+	beer_set(s, BEER_OPT_RECV_BUF, 4096);
+	beer_set(s, BEER_OPT_ZERO_COPY, 1);
+	beer_set(s, BEER_OPT_ADAPTIVE_BUF, 65536);
+	is  (beer_connect(s), 0, "Connected");
+	struct beer_stream_net *sn = BEER_SNET_CAST(s);
+
+	/* send buffer grows, instead of being flushed */
+	char data[1000];
+	memset(data, 'x', sizeof(data));
+	for (i = 0; i < 10; i++)
+		s->write(s, data, sizeof(data));
+	ok  (sn->sbuf.size == 16384 && sn->sbuf.off == 10000,
+	     "Send buffer grows by writes");
+	for (i = 0; i < 100; i++)
+		s->write(s, data, sizeof(data));
+	ok  (sn->sbuf.size == 65536, "Send buffer grows up to the limit");
+	isnt(beer_flush(s), -1, "Flush");
+
+	/*
+	 * and shrinks back, while it's mostly empty (the rounds, that
+	 * include the big flush, don't count)
+	 */
+	for (i = 0; i < 2 * 64; i++) {
+		s->write(s, data, 100);
+		beer_flush(s);
+	}
+	is  (sn->sbuf.size, 32768, "Send buffer shrinks");
+	for (i = 0; i < 64 * 8; i++) {
+		s->write(s, data, 100);
+		beer_flush(s);
+	}
+	is  (sn->sbuf.size, 4096, "Send buffer shrinks to its size");
+
+	/* recv buffer grows for reply, that doesn't fit it */
+	struct beer_reply r;
+	beer_reply_init(&r);
+	s->wrcnt = 102;
+	ok  (s->read_reply(s, &r) == 0 && r.iob == &sn->rbuf,
+	     "Big reply is read into recv buffer");
+	is  (sn->rbuf.size, 32768, "Recv buffer grows");
+	beer_reply_free(&r);
+	int good = 0;
+	for (i = 0; i < 101; i++) {
+		beer_reply_init(&r);
+		if (s->read_reply(s, &r) == 0 && r.sync == i + 1)
+			good++;
+		beer_reply_free(&r);
+	}
+	is  (good, 101, "Read small replies");
+	/* it's shrunk before the next reply is read */
+	s->wrcnt = 1;
+	shutdown(beer_fd(s), SHUT_WR);
+	beer_reply_init(&r);
+	s->read_reply(s, &r);
+	is  (sn->rbuf.size, 16384, "Recv buffer shrinks");
+
+	beer_stream_free(s);
+	pthread_join(t, NULL);
+	close(peer.lfd);
+	free(peer.in);
+	free(out);
 
 	footer();
 	return check_plan();
@@ -715,6 +2007,1037 @@ test_request_05(char *uri) {
 	return check_plan();
 }
 
+/* checks that reply holds one tuple [id, id + 1, str] */
+static int
+test_request_06_tuple(struct beer_reply *r, uint64_t id, const char *str) {
+	const char *data = r->data;
+	uint32_t len = 0;
+	if (r->code != 0 || data == NULL || mp_typeof(*data) != MP_ARRAY ||
+	    mp_decode_array(&data) != 1 || mp_typeof(*data) != MP_ARRAY ||
+	    mp_decode_array(&data) != 3)
+		return -1;
+	if (mp_typeof(*data) != MP_UINT || mp_decode_uint(&data) != id ||
+	    mp_typeof(*data) != MP_UINT || mp_decode_uint(&data) != id + 1 ||
+	    mp_typeof(*data) != MP_STR)
+		return -1;
+	const char *s = mp_decode_str(&data, &len);
+	return (len == strlen(str) && memcmp(s, str, len) == 0) ? 0 : -1;
+}
+
+static int
+test_request_06(char *uri) {
+	plan(14);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	char tuple[64], *end = mp_encode_array(tuple, 3);
+	end = mp_encode_uint(end, 1000);
+	end = mp_encode_uint(end, 1001);
+	end = mp_encode_str(end, "point", 5);
+	char tuple2[64], *end2 = mp_encode_array(tuple2, 3);
+	end2 = mp_encode_uint(end2, 1000);
+	end2 = mp_encode_uint(end2, 1001);
+	end2 = mp_encode_str(end2, "replaced", 8);
+
+	beer_stream_reqid(beer, 0);
+	isnt(beer_insert_mp(beer, sno, tuple, end - tuple), -1, "Insert");
+	isnt(beer_select_uint(beer, sno, 0, 1, 1000), -1, "Select");
+	isnt(beer_replace_mp(beer, sno, tuple2, end2 - tuple2), -1, "Replace");
+	isnt(beer_delete_uint(beer, sno, 0, 1000), -1, "Delete");
+	isnt(beer_select_uint(beer, sno, 0, 1, 1000), -1, "Select deleted");
+	isnt(beer_flush(beer), -1, "Send package to server");
+
+	struct beer_reply reply;
+	const char *str[] = { "point", "point", "replaced", "replaced" };
+	uint64_t sync;
+	for (sync = 0; sync < 4; sync++) {
+		beer_reply_init(&reply);
+		if (beer->read_reply(beer, &reply) == -1 ||
+		    reply.sync != sync ||
+		    test_request_06_tuple(&reply, 1000, str[sync]) == -1) {
+			beer_reply_free(&reply);
+			break;
+		}
+		beer_reply_free(&reply);
+	}
+	is  (sync, 4, "Check replies of insert, select, replace and delete");
+
+	beer_reply_init(&reply);
+	isnt(beer->read_reply(beer, &reply), -1, "Read reply");
+	is  (reply.sync, 4, "Check sync");
+	const char *data = reply.data;
+	ok  (reply.code == 0 && data != NULL &&
+	     mp_typeof(*data) == MP_ARRAY && mp_decode_array(&data) == 0,
+	     "Check that tuple is deleted");
+	beer_reply_free(&reply);
+
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_request_07(char *uri) {
+	plan(12);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	/* templates use tuple and key of requests, they are kept */
+	struct beer_prepared replace, select;
+	struct beer_request *req1 = beer_request_replace(NULL);
+	beer_request_set_space(req1, sno);
+	beer_request_set_tuple_format(req1, "[%d%d%s]", 2000, 2001, "template");
+	is  (beer_request_prepare(req1, &replace), 0, "Prepare replace");
+	struct beer_request *req2 = beer_request_select(NULL);
+	beer_request_set_space(req2, sno);
+	beer_request_set_key_format(req2, "[%d]", 2000);
+	is  (beer_request_prepare(req2, &select), 0, "Prepare select");
+
+	char tuple[64], *end = mp_encode_array(tuple, 3);
+	end = mp_encode_uint(end, 2010);
+	end = mp_encode_uint(end, 2011);
+	end = mp_encode_str(end, "executed", 8);
+	char key[16], *key_end = mp_encode_array(key, 1);
+	key_end = mp_encode_uint(key_end, 2010);
+
+	beer_stream_reqid(beer, 0);
+	beer_prepared_execute(beer, &replace, NULL, 0, NULL, 0);
+	beer_prepared_execute(beer, &replace, NULL, 0, tuple, end - tuple);
+	beer_prepared_execute(beer, &select, NULL, 0, NULL, 0);
+	beer_prepared_execute(beer, &select, key, key_end - key, NULL, 0);
+	beer_delete_uint(beer, sno, 0, 2000);
+	beer_delete_uint(beer, sno, 0, 2010);
+	isnt(beer_flush(beer), -1, "Send package to server");
+
+	struct beer_reply reply;
+	const char *str[] = { "template", "executed", "template", "executed",
+			      "template", "executed" };
+	uint64_t id[] = { 2000, 2010, 2000, 2010, 2000, 2010 };
+	uint64_t sync;
+	for (sync = 0; sync < 6; sync++) {
+		beer_reply_init(&reply);
+		if (beer->read_reply(beer, &reply) == -1 ||
+		    reply.sync != sync ||
+		    test_request_06_tuple(&reply, id[sync], str[sync]) == -1) {
+			beer_reply_free(&reply);
+			break;
+		}
+		beer_reply_free(&reply);
+	}
+	is  (sync, 6, "Check replies of templates");
+
+	/* templates don't depend on stream, they may be shared */
+	struct beer_stream *beer2 = beer_net(NULL);
+	beer_set(beer2, BEER_OPT_URI, uri);
+	isnt(beer_connect(beer2), -1, "Connecting another stream");
+	beer_stream_reqid(beer2, 100);
+	is  (beer_prepared_execute(beer2, &select, NULL, 0, NULL, 0), 100,
+	     "Execute template on another stream");
+	beer_flush(beer2);
+	beer_reply_init(&reply);
+	isnt(beer2->read_reply(beer2, &reply), -1, "Read reply");
+	const char *data = reply.data;
+	ok  (reply.sync == 100 && reply.code == 0 && data != NULL &&
+	     mp_typeof(*data) == MP_ARRAY && mp_decode_array(&data) == 0,
+	     "Check that tuple is deleted");
+	beer_reply_free(&reply);
+
+	beer_request_free(req1);
+	beer_request_free(req2);
+	beer_stream_free(beer2);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_request_08(char *uri) {
+	plan(18);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(beer, BEER_OPT_SEND_BUF, 4096), -1, "Setting send buffer");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	/* reply to this one comes while batch is received */
+	uint64_t stray = beer->reqid;
+	beer_ping(beer);
+
+	/* item 5 duplicates item 4, item 7 is bigger than send buffer */
+	size_t big_size = 100000;
+	char *big = malloc(big_size);
+	memset(big, 'x', big_size);
+	struct beer_batch b;
+	isnt(beer_batch_init(&b, beer), NULL, "Init batch");
+	struct beer_request *req = beer_request_insert(NULL);
+	beer_request_set_space(req, sno);
+	int i, added = 0;
+	for (i = 0; i < 10; i++) {
+		int id = 3000 + (i == 5 ? 4 : i);
+		struct beer_stream *t = beer_object(NULL);
+		beer_object_format(t, "[%d%d%.*s]", id, id + 1,
+				   i == 7 ? (int)big_size : 5,
+				   i == 7 ? big : "batch");
+		beer_request_set_tuple(req, t);
+		if (beer_batch_add(&b, req) == i)
+			added++;
+		beer_stream_free(t);
+	}
+	beer_request_free(req);
+	is  (added, 10, "Add requests");
+	isnt(beer_batch_send(&b), -1, "Send batch");
+	isnt(beer_batch_recv(&b), -1, "Receive batch");
+
+	int in_order = 1, ok_items = 0;
+	for (i = 0; i < 10; i++) {
+		struct beer_batch_item *it = &b.items[i];
+		if (it->reply.sync != it->sync ||
+		    (i > 0 && it->sync <= b.items[i - 1].sync))
+			in_order = 0;
+		if (i == 5 || i == 7 || it->status != BEER_BATCH_OK)
+			continue;
+		if (test_request_06_tuple(&it->reply, 3000 + i, "batch") == 0)
+			ok_items++;
+	}
+	ok  (in_order, "Check that items are in order of submission");
+	is  (ok_items, 8, "Check replies");
+	ok  (b.items[5].status == BEER_BATCH_ERROR &&
+	     b.items[5].reply.code != 0 && b.items[5].reply.error != NULL,
+	     "Check error of duplicate");
+	const char *data = b.items[7].reply.data;
+	uint32_t len = 0;
+	ok  (b.items[7].status == BEER_BATCH_OK && data != NULL &&
+	     mp_decode_array(&data) == 1 && mp_decode_array(&data) == 3 &&
+	     mp_decode_uint(&data) == 3007 && mp_decode_uint(&data) == 3008 &&
+	     mp_decode_str(&data, &len) != NULL && len == big_size,
+	     "Check request bigger than send buffer");
+
+	struct beer_reply reply;
+	beer_reply_init(&reply);
+	is  (beer_reply_sync(beer, stray, &reply), 0,
+	     "Check that other reply is parked");
+	beer_reply_free(&reply);
+
+	/*
+	 * batch is reused to clean up, deletes sent before it are answered
+	 * first, replies to them are parked
+	 */
+	beer_batch_reset(&b);
+	uint64_t first = beer->reqid;
+	for (i = 0; i < 10; i++)
+		beer_delete_uint(beer, sno, 0, 3000 + i);
+	req = beer_request_delete(NULL);
+	beer_request_set_space(req, sno);
+	for (i = 0; i < 10; i++) {
+		beer_request_set_key_format(req, "[%d]", 3000 + i);
+		beer_batch_add(&b, req);
+	}
+	beer_request_free(req);
+	beer_batch_send(&b);
+	/* replies to the batch are parked, while other one is waited for */
+	uint64_t other = beer->reqid;
+	beer_ping(beer);
+	beer_flush(beer);
+	beer_reply_init(&reply);
+	is  (beer_reply_sync(beer, other, &reply), 0,
+	     "Wait for reply sent after batch");
+	beer_reply_free(&reply);
+	is  (beer_batch_recv(&b), 0, "Receive batch again");
+	int empty = 0;
+	for (i = 0; i < 10; i++) {
+		data = b.items[i].reply.data;
+		if (b.items[i].status == BEER_BATCH_OK && data != NULL &&
+		    mp_decode_array(&data) == 0)
+			empty++;
+	}
+	is  (empty, 10, "Check replies of batch");
+	beer_reply_init(&reply);
+	ok  (beer_reply_sync(beer, first, &reply) == 0 &&
+	     test_request_06_tuple(&reply, 3000, "batch") == 0,
+	     "Check parked reply");
+	beer_reply_free(&reply);
+
+	beer_batch_free(&b);
+	free(big);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_request_09(char *uri) {
+	plan(9);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(beer, BEER_OPT_ZERO_COPY, 1), -1, "Setting zero copy");
+	isnt(beer_set(beer, BEER_OPT_RECV_BUF, 4096), -1, "Setting recv buffer");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	/* 20 replies of 1K don't fit recv buffer, first ones are pinned */
+	enum { count = 20, str_size = 1000 };
+	char str[count][str_size + 1];
+	int i;
+	for (i = 0; i < count; i++) {
+		memset(str[i], 'a' + i, str_size);
+		str[i][str_size] = 0;
+		char tuple[str_size + 32], *end = mp_encode_array(tuple, 3);
+		end = mp_encode_uint(end, 5000 + i);
+		end = mp_encode_uint(end, 5001 + i);
+		end = mp_encode_str(end, str[i], str_size);
+		beer_replace_mp(beer, sno, tuple, end - tuple);
+	}
+	for (i = 0; i < count; i++)
+		beer_delete_uint(beer, sno, 0, 5000 + i);
+	beer_flush(beer);
+
+	struct beer_reply r[2 * count];
+	int read = 0, pinned = 0;
+	for (i = 0; i < 2 * count; i++) {
+		beer_reply_init(&r[i]);
+		if (beer->read_reply(beer, &r[i]) == 0)
+			read++;
+		if (r[i].iob != NULL)
+			pinned++;
+	}
+	is  (read, 2 * count, "Read replies, keeping them");
+	ok  (pinned > 1, "Check that replies point into recv buffer");
+	int good = 0;
+	for (i = 0; i < 2 * count; i++)
+		if (test_request_06_tuple(&r[i], 5000 + i % count,
+					  str[i % count]) == 0)
+			good++;
+	is  (good, 2 * count, "Check replies");
+	for (i = 0; i < 2 * count; i++)
+		beer_reply_free(&r[i]);
+
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+struct test_pending {
+	uint64_t sync; /* sync of the first request */
+	int calls;
+	int good;
+	uint64_t order[8];
+};
+
+static void
+test_pending_cb(struct beer_stream *s, struct beer_reply *r, void *arg) {
+	(void)s;
+	struct test_pending *t = arg;
+	uint64_t i = r->sync - t->sync;
+	if (t->calls < 8)
+		t->order[t->calls] = i;
+	t->calls++;
+	if (test_request_06_tuple(r, 6000 + i, "pending") == 0)
+		t->good++;
+}
+
+static int
+test_request_10(char *uri) {
+	plan(16);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	struct test_pending t;
+	memset(&t, 0, sizeof(t));
+	t.sync = beer->reqid;
+	for (int i = 0; i < 6; i++) {
+		char tuple[32], *end = mp_encode_array(tuple, 3);
+		end = mp_encode_uint(end, 6000 + i);
+		end = mp_encode_uint(end, 6001 + i);
+		end = mp_encode_str(end, "pending", 7);
+		beer_replace_mp(beer, sno, tuple, end - tuple);
+	}
+	isnt(beer_flush(beer), -1, "Send package to server");
+
+	/* replies 0 and 2 are parked, while reply 4 is waited for */
+	is  (beer_pending_add(beer, t.sync + 1, test_pending_cb, &t), 0,
+	     "Register callback");
+	is  (beer_pending_add(beer, t.sync + 3, test_pending_cb, &t), 0,
+	     "Register callback");
+	struct beer_reply r;
+	beer_reply_init(&r);
+	ok  (beer_reply_sync(beer, t.sync + 4, &r) == 0 &&
+	     test_request_06_tuple(&r, 6004, "pending") == 0,
+	     "Wait for reply out of order");
+	beer_reply_free(&r);
+	ok  (t.calls == 2 && t.good == 2 && t.order[0] == 1 && t.order[1] == 3,
+	     "Check callbacks called meanwhile");
+
+	is  (beer_pending_add(beer, t.sync + 2, test_pending_cb, &t), 0,
+	     "Register callback for parked reply");
+	ok  (t.calls == 3 && t.good == 3 && t.order[2] == 2,
+	     "Check that callback is called at once");
+
+	beer_reply_init(&r);
+	ok  (beer_reply_sync(beer, t.sync, &r) == 0 &&
+	     test_request_06_tuple(&r, 6000, "pending") == 0,
+	     "Take parked reply");
+	beer_reply_free(&r);
+
+	is  (beer_pending_add(beer, t.sync + 5, test_pending_cb, &t), 0,
+	     "Register callback");
+	is  (beer_pending_dispatch(beer), 1, "Dispatch the rest");
+	ok  (t.calls == 4 && t.good == 4 && t.order[3] == 5,
+	     "Check callback of dispatched reply");
+	beer_reply_init(&r);
+	is  (beer_reply_sync(beer, t.sync, &r), 1,
+	     "Check that taken reply isn't in flight");
+
+	for (int i = 0; i < 6; i++)
+		beer_delete_uint(beer, sno, 0, 6000 + i);
+	beer_flush(beer);
+	beer_pending_dispatch(beer);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_request_12(char *uri) {
+	plan(8);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(beer, BEER_OPT_SEND_REF, 1024), -1,
+	     "Setting send by reference");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	/* tuple is sent from memory of object */
+	size_t big_size = 100000;
+	char *big = malloc(big_size);
+	for (size_t i = 0; i < big_size; i++)
+		big[i] = 'a' + i % 26;
+	struct beer_stream *tuple = beer_object(NULL);
+	beer_object_format(tuple, "[%d%d%.*s]", 8000, 8001, (int)big_size, big);
+	beer_insert(beer, sno, tuple);
+	beer_flush(beer);
+	beer_stream_free(tuple);
+	struct beer_reply r;
+	beer_reply_init(&r);
+	ok  (beer->read_reply(beer, &r) == 0 && r.code == 0,
+	     "Insert tuple above threshold");
+	beer_reply_free(&r);
+
+	struct beer_stream *key = beer_object(NULL);
+	beer_object_format(key, "[%d]", 8000);
+	beer_select(beer, sno, 0, 1, 0, BEER_ITER_EQ, key);
+	beer_flush(beer);
+	beer_stream_free(key);
+	beer_reply_init(&r);
+	const char *data = NULL, *str = NULL;
+	uint32_t len = 0;
+	if (beer->read_reply(beer, &r) == 0 && r.code == 0)
+		data = r.data;
+	ok  (data != NULL && mp_decode_array(&data) == 1 &&
+	     mp_decode_array(&data) == 3 && mp_decode_uint(&data) == 8000 &&
+	     mp_decode_uint(&data) == 8001 &&
+	     (str = mp_decode_str(&data, &len)) != NULL,
+	     "Read tuple back");
+	ok  (str != NULL && len == big_size && memcmp(str, big, len) == 0,
+	     "Check data of tuple");
+	beer_reply_free(&r);
+
+	beer_delete_uint(beer, sno, 0, 8000);
+	beer_flush(beer);
+	beer_reply_init(&r);
+	beer->read_reply(beer, &r);
+	beer_reply_free(&r);
+	free(big);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_trusted(char *uri) {
+	plan(8);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(beer, BEER_OPT_TRUSTED, 1), -1, "Setting trusted");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	struct beer_stream *tuple = beer_object(NULL);
+	beer_object_format(tuple, "[%d%s]", 8100, "trusted");
+	beer_replace(beer, sno, tuple);
+	beer_flush(beer);
+	beer_stream_free(tuple);
+	struct beer_reply r;
+	beer_reply_init(&r);
+	beer->read_reply(beer, &r);
+	beer_reply_free(&r);
+
+	beer_select_uint(beer, sno, 0, 1, 8100);
+	beer_flush(beer);
+	beer_reply_init(&r);
+	const char *data = NULL, *str = NULL;
+	uint32_t len = 0;
+	if (beer->read_reply(beer, &r) == 0 && r.code == 0 && r.trusted)
+		data = r.data;
+	ok  (data != NULL && mp_decode_array(&data) == 1 &&
+	     mp_decode_array(&data) == 2 && mp_decode_uint(&data) == 8100 &&
+	     (str = mp_decode_str(&data, &len)) != NULL && len == 7 &&
+	     memcmp(str, "trusted", len) == 0 && data == r.data_end,
+	     "Select trusted reply");
+	beer_reply_free(&r);
+
+	/* error of trusted reply is checked as usual */
+	beer_select_uint(beer, 0x7fff, 0, 1, 8100);
+	beer_flush(beer);
+	beer_reply_init(&r);
+	ok  (beer->read_reply(beer, &r) == 0 && r.code != 0 &&
+	     r.error != NULL && r.data == NULL, "Select from no space");
+	beer_reply_free(&r);
+
+	beer_delete_uint(beer, sno, 0, 8100);
+	beer_flush(beer);
+	beer_reply_init(&r);
+	is  (beer->read_reply(beer, &r), 0, "Delete tuple");
+	beer_reply_free(&r);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_request_13(char *uri) {
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	beer_set(beer, BEER_OPT_URI, uri);
+	beer_set(beer, BEER_OPT_IO_URING, 1);
+	int rc = beer_connect(beer);
+	/* kernel (or build) without io_uring falls back to sockets */
+	if (rc != -1 && BEER_SNET_CAST(beer)->uring == NULL) {
+		plan(0);
+		note("io_uring isn't available, skipped");
+		beer_stream_free(beer);
+		return check_plan();
+	}
+	plan(7);
+	header();
+
+	isnt(rc, -1, "Connecting through io_uring");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+
+	uint64_t sync = beer->reqid;
+	beer_ping(beer);
+	beer_flush(beer);
+	struct beer_reply r;
+	beer_reply_init(&r);
+	ok  (beer->read_reply(beer, &r) == 0 && r.sync == sync && r.code == 0,
+	     "Ping");
+	beer_reply_free(&r);
+
+	/* replies to big requests are read, while requests are written */
+	size_t big_size = 50000;
+	char *big = malloc(big_size);
+	for (size_t i = 0; i < big_size; i++)
+		big[i] = 'a' + i % 26;
+	int i, good = 0;
+	for (i = 0; i < 20; i++) {
+		struct beer_stream *tuple = beer_object(NULL);
+		beer_object_format(tuple, "[%d%d%.*s]", 9000 + i, 9001 + i,
+				   (int)big_size - i, big + i);
+		beer_replace(beer, sno, tuple);
+		beer_stream_free(tuple);
+	}
+	isnt(beer_flush(beer), -1, "Send big requests");
+	for (i = 0; i < 20; i++) {
+		beer_reply_init(&r);
+		if (beer->read_reply(beer, &r) == 0 && r.code == 0)
+			good++;
+		beer_reply_free(&r);
+	}
+	is  (good, 20, "Check replies to big requests");
+
+	for (i = 0; i < 20; i++)
+		beer_select_uint(beer, sno, 0, 1, 9000 + i);
+	isnt(beer_flush(beer), -1, "Send selects");
+	good = 0;
+	for (i = 0; i < 20; i++) {
+		beer_reply_init(&r);
+		const char *data = NULL, *str = NULL;
+		uint32_t len = 0;
+		if (beer->read_reply(beer, &r) == 0 && r.code == 0)
+			data = r.data;
+		uint64_t id = data ? r.sync - (sync + 21) : 0;
+		if (data != NULL && mp_decode_array(&data) == 1 &&
+		    mp_decode_array(&data) == 3 &&
+		    mp_decode_uint(&data) == 9000 + id &&
+		    mp_decode_uint(&data) == 9001 + id &&
+		    (str = mp_decode_str(&data, &len)) != NULL &&
+		    len == big_size - id && memcmp(str, big + id, len) == 0)
+			good++;
+		beer_reply_free(&r);
+	}
+	is  (good, 20, "Select big tuples");
+
+	for (i = 0; i < 20; i++)
+		beer_delete_uint(beer, sno, 0, 9000 + i);
+	beer_flush(beer);
+	for (i = 0; i < 20; i++) {
+		beer_reply_init(&r);
+		beer->read_reply(beer, &r);
+		beer_reply_free(&r);
+	}
+	free(big);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+/* counts frames of request, as they are written to socket */
+static struct {
+	int fd;
+	uint64_t sync;
+	int sent;
+	char buf[65536];
+	size_t len;
+} test_retry;
+
+static void
+test_retry_scan(const char *data, size_t size) {
+	if (test_retry.len + size > sizeof(test_retry.buf))
+		return;
+	memcpy(test_retry.buf + test_retry.len, data, size);
+	test_retry.len += size;
+	const char *p = test_retry.buf, *end = p + test_retry.len;
+	while (1) {
+		const char *frame = p, *test = p;
+		if (mp_check(&test, end))
+			break;
+		uint64_t len = mp_decode_uint(&p);
+		if ((uint64_t)(end - p) < len) {
+			p = frame;
+			break;
+		}
+		const char *h = p;
+		uint32_t n = mp_decode_map(&h);
+		while (n-- > 0) {
+			if (mp_decode_uint(&h) != BEER_SYNC) {
+				mp_next(&h);
+				continue;
+			}
+			if (mp_decode_uint(&h) == test_retry.sync)
+				test_retry.sent++;
+		}
+		p += len;
+	}
+	test_retry.len = end - p;
+	memmove(test_retry.buf, p, test_retry.len);
+}
+
+static ssize_t
+test_retry_tx(void *ptr, const char *buf, size_t size) {
+	(void)ptr;
+	ssize_t rc = send(test_retry.fd, buf, size, 0);
+	if (rc > 0)
+		test_retry_scan(buf, rc);
+	return rc;
+}
+
+/* call function, that changes schema on server */
+static int
+test_retry_call(struct beer_stream *s, const char *proc) {
+	struct beer_stream *args = beer_object(NULL);
+	beer_object_add_array(args, 0);
+	beer_call(s, proc, strlen(proc), args);
+	beer_stream_free(args);
+	beer_flush(s);
+	struct beer_reply r;
+	beer_reply_init(&r);
+	int rc = s->read_reply(s, &r);
+	if (rc == 0 && r.code != 0)
+		rc = -1;
+	beer_reply_free(&r);
+	return rc;
+}
+
+static int
+test_request_11(char *uri) {
+	plan(13);
+	header();
+
+	struct beer_stream *beer = NULL; beer = beer_net(NULL);
+	isnt(beer, NULL, "Check connection creation");
+	isnt(beer_set(beer, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(beer, BEER_OPT_SCHEMA_CHECK, 1), -1,
+	     "Setting schema check");
+	isnt(beer_connect(beer), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(beer, "test", 4);
+	isnt(sno, -1, "Get space number");
+	uint64_t schema_id = beer->schema_id;
+	isnt(schema_id, 0, "Check that requests carry schema id");
+
+	memset(&test_retry, 0, sizeof(test_retry));
+	test_retry.fd = BEER_SNET_CAST(beer)->fd;
+	BEER_SNET_CAST(beer)->sbuf.tx = test_retry_tx;
+
+	/* schema is changed, while definitions of space test stay the same */
+	is  (test_retry_call(beer, "retry_bump"), 0, "Change schema");
+	test_retry.sync = beer->reqid;
+	char tuple[32], *end = mp_encode_array(tuple, 3);
+	end = mp_encode_uint(end, 7000);
+	end = mp_encode_uint(end, 7001);
+	end = mp_encode_str(end, "retry", 5);
+	beer_replace_mp(beer, sno, tuple, end - tuple);
+	beer_flush(beer);
+	struct beer_reply r;
+	beer_reply_init(&r);
+	ok  (beer->read_reply(beer, &r) == 0 && r.sync == test_retry.sync &&
+	     test_request_06_tuple(&r, 7000, "retry") == 0,
+	     "Check that request succeeds");
+	beer_reply_free(&r);
+	is  (test_retry.sent, 2, "Check that request is sent again once");
+	ok  (beer->schema_id != schema_id, "Check that schema id is updated");
+
+	/* space is dropped after its definitions are loaded */
+	test_retry_call(beer, "retry_create");
+	beer_reload_schema(beer);
+	int32_t rsno = beer_get_spaceno(beer, "retry", 5);
+	isnt(rsno, -1, "Get number of space to be dropped");
+	test_retry_call(beer, "retry_drop");
+	test_retry.sent = 0;
+	test_retry.sync = beer->reqid;
+	end = mp_encode_array(tuple, 1);
+	end = mp_encode_uint(end, 1);
+	beer_replace_mp(beer, rsno, tuple, end - tuple);
+	beer_flush(beer);
+	beer_reply_init(&r);
+	ok  (beer->read_reply(beer, &r) == 0 && r.sync == test_retry.sync &&
+	     r.code == BEER_ER_WRONG_SCHEMA_VERSION,
+	     "Check that original error is returned");
+	beer_reply_free(&r);
+	is  (test_retry.sent, 1, "Check that request isn't sent again");
+
+	beer_delete_uint(beer, sno, 0, 7000);
+	beer_flush(beer);
+	beer_reply_init(&r);
+	beer->read_reply(beer, &r);
+	beer_reply_free(&r);
+	beer_stream_free(beer);
+
+	footer();
+	return check_plan();
+}
+
+static int
+test_schema_shared(char *uri) {
+	plan(13);
+	header();
+
+	struct beer_schema *sch = beer_schema_new(NULL);
+	isnt(sch, NULL, "Check schema creation");
+	struct beer_stream *s1 = beer_net(NULL), *s2 = beer_net(NULL);
+	isnt(beer_set(s1, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(s2, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_set(s1, BEER_OPT_SCHEMA, sch), -1, "Setting schema");
+	isnt(beer_set(s2, BEER_OPT_SCHEMA, sch), -1, "Setting schema");
+
+	isnt(beer_connect(s1), -1, "Connecting");
+	int32_t sno = beer_get_spaceno(s1, "test", 4);
+	ok  (sno != -1 && sch->schema_id != 0, "Check that schema is loaded");
+
+	/* schema id is the same, so schema isn't loaded again */
+	uint32_t epoch = sch->epoch;
+	isnt(beer_connect(s2), -1, "Connecting with loaded schema");
+	is  (beer_check_schema(s1), 0, "Check schema again");
+	ok  (sch->epoch == epoch && beer_get_spaceno(s2, "test", 4) == sno,
+	     "Check that schema isn't reloaded");
+	is  (sch->refs, 3, "Check that streams hold schema");
+
+	/* schema is freed with the last stream */
+	beer_schema_unref(sch);
+	beer_stream_free(s1);
+	is  (sch->refs, 1, "Check that schema is released");
+	is  (beer_get_spaceno(s2, "test", 4), sno,
+	     "Check that the last stream keeps schema");
+	beer_stream_free(s2);
+
+	footer();
+	return check_plan();
+}
+
+struct test_schema_arg {
+	struct beer_schema *sch;
+	int *done;
+	int lookups;
+	int missed;
+};
+
+static void *
+test_schema_reader(void *arg) {
+	struct test_schema_arg *a = arg;
+	while (!__sync_fetch_and_add(a->done, 0)) {
+		if (beer_schema_stosid(a->sch, "stable", 6) != 512 ||
+		    beer_schema_stoiid(a->sch, 512, "primary", 7) != 0)
+			a->missed++;
+		a->lookups++;
+	}
+	return NULL;
+}
+
+/* definitions of space 512, and of space 513 with name of turn */
+static struct beer_schema *
+test_schema_turn(int turn) {
+	char sbuf[128], ibuf[128];
+	char *end = mp_encode_array(sbuf, 2);
+	end = mp_encode_array(end, 3);
+	end = mp_encode_uint(end, 512);
+	end = mp_encode_uint(end, 1);
+	end = mp_encode_str(end, "stable", 6);
+	end = mp_encode_array(end, 3);
+	end = mp_encode_uint(end, 513);
+	end = mp_encode_uint(end, 1);
+	end = mp_encode_str(end, turn % 2 ? "odd" : "even", turn % 2 ? 3 : 4);
+	struct beer_reply space;
+	beer_reply_init(&space);
+	space.data = sbuf;
+	space.data_end = end;
+	end = mp_encode_array(ibuf, 2);
+	for (uint32_t sid = 512; sid <= 513; sid++) {
+		end = mp_encode_array(end, 4);
+		end = mp_encode_uint(end, sid);
+		end = mp_encode_uint(end, 0);
+		end = mp_encode_str(end, "primary", 7);
+		end = mp_encode_str(end, "tree", 4);
+	}
+	struct beer_reply index;
+	beer_reply_init(&index);
+	index.data = ibuf;
+	index.data_end = end;
+	struct beer_schema *from = beer_schema_new(NULL);
+	if (beer_schema_add_spaces(from, &space) == -1 ||
+	    beer_schema_add_indexes(from, &index) == -1) {
+		beer_schema_unref(from);
+		return NULL;
+	}
+	from->schema_id = turn + 1;
+	return from;
+}
+
+static int
+test_schema_replace() {
+	plan(4);
+	header();
+
+	struct beer_schema *sch = beer_schema_new(NULL);
+	struct beer_schema *from = test_schema_turn(0);
+	isnt(from, NULL, "Build schema");
+	beer_schema_replace(sch, from);
+	beer_schema_unref(from);
+
+	/* lookups of space, which is kept, go on while schema is replaced */
+	int done = 0, i, replaced = 0;
+	struct test_schema_arg a[2];
+	pthread_t t[2];
+	for (i = 0; i < 2; i++) {
+		memset(&a[i], 0, sizeof(struct test_schema_arg));
+		a[i].sch = sch;
+		a[i].done = &done;
+		pthread_create(&t[i], NULL, test_schema_reader, &a[i]);
+	}
+	for (i = 1; i <= 1000; i++) {
+		from = test_schema_turn(i);
+		if (from == NULL)
+			break;
+		beer_schema_replace(sch, from);
+		beer_schema_unref(from);
+		replaced++;
+	}
+	__sync_fetch_and_add(&done, 1);
+	int lookups = 0, missed = 0;
+	for (i = 0; i < 2; i++) {
+		pthread_join(t[i], NULL);
+		lookups += a[i].lookups;
+		missed += a[i].missed;
+	}
+	is  (replaced, 1000, "Replace schema");
+	ok  (lookups > 0 && missed == 0,
+	     "Check lookups during replace (%d)", lookups);
+	ok  (beer_schema_stosid(sch, "even", 4) == 513 &&
+	     beer_schema_stosid(sch, "odd", 3) == -1,
+	     "Check the last schema");
+	beer_schema_unref(sch);
+
+	footer();
+	return check_plan();
+}
+
+struct test_pool_arg {
+	struct beer_pool *p;
+	uint32_t *busy;   /* members taken by threads */
+	int good;
+	int bad;
+	int shared;       /* member given to two threads at once */
+};
+
+static void *
+test_pool_thread(void *arg) {
+	struct test_pool_arg *a = arg;
+	for (int i = 0; i < 500; i++) {
+		struct beer_stream *s = beer_pool_get(a->p);
+		if (s == NULL)
+			continue;
+		uint32_t idx = (struct beer_pool_member *)s - a->p->members;
+		if (!__sync_bool_compare_and_swap(&a->busy[idx], 0, 1))
+			a->shared++;
+		uint64_t sync = s->reqid;
+		beer_ping(s);
+		struct beer_reply r;
+		beer_reply_init(&r);
+		if (beer_flush(s) != -1 && s->read_reply(s, &r) == 0 &&
+		    r.sync == sync && r.code == 0)
+			a->good++;
+		else
+			a->bad++;
+		beer_reply_free(&r);
+		__sync_lock_release(&a->busy[idx]);
+		beer_pool_put(a->p, s);
+	}
+	return NULL;
+}
+
+static int
+test_pool_ping(struct beer_stream *s) {
+	uint64_t sync = s->reqid;
+	beer_ping(s);
+	if (beer_flush(s) == -1)
+		return -1;
+	struct beer_reply r;
+	beer_reply_init(&r);
+	int rc = s->read_reply(s, &r);
+	if (rc == 0 && r.sync != sync)
+		rc = -1;
+	beer_reply_free(&r);
+	return rc;
+}
+
+static int
+test_pool(char *uri) {
+	plan(15);
+	header();
+
+	/* nobody listens on port 1 */
+	struct beer_pool *p = beer_pool_new(4);
+	isnt(p, NULL, "Check pool creation");
+	isnt(beer_pool_set(p, BEER_OPT_URI, "test:test@localhost:1"), -1,
+	     "Setting wrong URI");
+	is  (beer_pool_connect(p), -1, "Connecting to nowhere");
+	is  (beer_pool_alive(p), 0, "Check that all members are dead");
+	is  (beer_pool_get(p), NULL, "Check that dead members aren't given");
+
+	/* dead members are revived, once the server is reachable */
+	isnt(beer_pool_set(p, BEER_OPT_URI, uri), -1, "Setting URI");
+	isnt(beer_pool_connect(p), -1, "Reviving members");
+	is  (beer_pool_alive(p), 4, "Check that all members are alive");
+	ok  (p->schema->schema_id != 0, "Check that schema is loaded");
+
+	struct test_pool_arg a[3];
+	pthread_t t[3];
+	uint32_t busy[4] = {0};
+	int i, good = 0, bad = 0, shared = 0;
+	for (i = 0; i < 3; i++) {
+		memset(&a[i], 0, sizeof(struct test_pool_arg));
+		a[i].p = p;
+		a[i].busy = busy;
+		pthread_create(&t[i], NULL, test_pool_thread, &a[i]);
+	}
+	for (i = 0; i < 3; i++) {
+		pthread_join(t[i], NULL);
+		good += a[i].good;
+		bad += a[i].bad;
+		shared += a[i].shared;
+	}
+	ok  (good > 0 && bad == 0, "Ping through pool from threads (%d)", good);
+	is  (shared, 0, "Check that members are never shared");
+
+	/* connection of a member is dropped, while it's taken */
+	signal(SIGPIPE, SIG_IGN);
+	struct beer_stream *s = beer_pool_get(p);
+	shutdown(BEER_SNET_CAST(s)->fd, SHUT_RDWR);
+	is  (test_pool_ping(s), -1, "Request on dropped connection");
+	beer_pool_put(p, s);
+	int alive = 0;
+	for (i = 0; i < 50 && !alive; i++) {
+		struct beer_stream *m[4];
+		int n;
+		for (n = 0; n < 4; n++) {
+			m[n] = beer_pool_get(p);
+			if (m[n] == NULL)
+				break;
+			if (test_pool_ping(m[n]) == 0)
+				alive++;
+		}
+		while (n-- > 0)
+			beer_pool_put(p, m[n]);
+		if (alive < 4) {
+			alive = 0;
+			usleep(100000);
+		}
+	}
+	ok  (alive && beer_pool_alive(p) == 4,
+	     "Check that dead member is reconnected");
+
+	/* thread cache still names the member of freed pool */
+	beer_pool_put(p, beer_pool_get(p));
+	beer_pool_free(p);
+	p = beer_pool_new(1);
+	isnt(p, NULL, "Check pool creation");
+	is  (beer_pool_get(p), NULL,
+	     "Check that freed pool isn't taken from cache");
+	beer_pool_free(p);
+
+	footer();
+	return check_plan();
+}
+
 static inline int
 test_msgpack_array_iter() {
 	plan(32);
@@ -904,18 +3227,41 @@ test_msgpack_mapa_iter() {
 }
 */
 int main() {
-	plan(9);
+	plan(33);
 
 	char uri[128] = {0};
 	snprintf(uri, 128, "%s%s%s", "test:test@", "localhost:", getenv("PRIMARY_PORT"));
 
 	test_connect_tcp();
 	test_object();
+	test_buf();
+	test_arena();
+	test_iob();
+	test_point();
+	test_prepared();
+	test_reply();
+	test_reply_malformed();
+	test_nonblock();
+	test_send_ref();
+	test_sockbuf_opts();
+	test_adaptive_buf();
+	test_schema_replace();
 	test_request_01(uri);
 	test_request_02(uri);
 	test_request_03(uri);
 	test_request_04(uri);
 	test_request_05(uri);
+	test_request_06(uri);
+	test_request_07(uri);
+	test_request_08(uri);
+	test_request_09(uri);
+	test_request_10(uri);
+	test_request_11(uri);
+	test_request_12(uri);
+	test_trusted(uri);
+	test_request_13(uri);
+	test_schema_shared(uri);
+	test_pool(uri);
 	test_msgpack_array_iter();
 	test_msgpack_mapa_iter();
 
@@ -92,3 +92,29 @@ end
 function test_4()
     return box.session.user()
 end
+
+-- schema changes, for requests sent again with BEER_OPT_SCHEMA_CHECK
+function retry_create()
+    if not box.space.retry then
+        local retry = box.schema.space.create('retry')
+        retry:create_index('primary', {parts = {1, 'NUM'}})
+        box.schema.user.grant('test', 'read,write', 'space', 'retry')
+    end
+end
+
+function retry_drop()
+    if box.space.retry then
+        box.space.retry:drop()
+    end
+end
+
+function retry_bump()
+    retry_create()
+    retry_drop()
+end
+
+for _, name in ipairs({'retry_create', 'retry_drop', 'retry_bump'}) do
+    if #box.space._func.index.name:select{name} == 0 then
+        box.schema.func.create(name, {setuid = true})
+    end
+end
@@ -56,12 +56,19 @@ def run_test(name, unix = False):
 
     return retval
 
+def run_plain(name):
+    cmd = compile_cmd(name)
+    print('Running ' + repr(cmd))
+    proc = subprocess.Popen(cmd, shell=True)
+    return proc.wait() == 0
+
 def main():
     changedir()
 
     retval = True
     retval = retval & run_test('bee-tcp', False)
     retval = retval & run_test('bee-unix', True)
+    retval = retval & run_plain('bee-rpl')
 
     if (retval):
         print "Everything is OK"
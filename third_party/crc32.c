@@ -0,0 +1,284 @@
+/*
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ *    copyright notice, this list of conditions and the
+ *    following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "crc32.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HW 1
+#include <nmmintrin.h>
+#endif
+
+/* CRC-32C (Castagnoli) polynomial, reversed */
+#define CRC32C_POLY 0x82f63b78U
+
+/* blocks of data, that are checksummed in three parallel streams */
+#define CRC32C_LONG 8192
+#define CRC32C_SHORT 256
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+/* slicing-by-8 tables */
+static uint32_t crc32c_table[8][256];
+
+#ifdef CRC32C_HW
+/* tables of shift of crc by CRC32C_LONG and CRC32C_SHORT zero bytes */
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+#endif
+
+static int crc32c_hw_found;
+
+#ifdef CRC32C_HW
+/*
+ * Shift of crc over zero bytes is a linear operator in GF(2), it's built
+ * as 32x32 bit matrix by repeated squaring (as in zlib crc32_combine).
+ */
+static uint32_t
+gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+	while (vec) {
+		if (vec & 1)
+			sum ^= *mat;
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+static void
+gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+	int n;
+	for (n = 0; n < 32; n++)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/* builds operator of shift over len (> 0) zero bytes */
+static void
+crc32c_zeros_op(uint32_t *even, size_t len)
+{
+	uint32_t odd[32];
+	uint32_t row = 1;
+	int n;
+	/* one zero bit */
+	odd[0] = CRC32C_POLY;
+	for (n = 1; n < 32; n++) {
+		odd[n] = row;
+		row <<= 1;
+	}
+	/* two and four zero bits */
+	gf2_matrix_square(even, odd);
+	gf2_matrix_square(odd, even);
+	/* one zero byte, then two, four... while len is rotated down */
+	do {
+		gf2_matrix_square(even, odd);
+		len >>= 1;
+		if (len == 0)
+			return;
+		gf2_matrix_square(odd, even);
+		len >>= 1;
+	} while (len);
+	memcpy(even, odd, sizeof(odd));
+}
+
+static void
+crc32c_zeros(uint32_t zeros[4][256], size_t len)
+{
+	uint32_t op[32];
+	uint32_t n;
+	crc32c_zeros_op(op, len);
+	for (n = 0; n < 256; n++) {
+		zeros[0][n] = gf2_matrix_times(op, n);
+		zeros[1][n] = gf2_matrix_times(op, n << 8);
+		zeros[2][n] = gf2_matrix_times(op, n << 16);
+		zeros[3][n] = gf2_matrix_times(op, n << 24);
+	}
+}
+
+static inline uint32_t
+crc32c_shift(uint32_t zeros[4][256], uint32_t crc)
+{
+	return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+	       zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+#endif
+
+static void
+crc32c_init(void)
+{
+	uint32_t n, crc;
+	int k;
+	for (n = 0; n < 256; n++) {
+		crc = n;
+		for (k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		crc32c_table[0][n] = crc;
+	}
+	for (n = 0; n < 256; n++) {
+		crc = crc32c_table[0][n];
+		for (k = 1; k < 8; k++) {
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[k][n] = crc;
+		}
+	}
+#ifdef CRC32C_HW
+	__builtin_cpu_init();
+	crc32c_hw_found = __builtin_cpu_supports("sse4.2") != 0;
+	if (crc32c_hw_found) {
+		crc32c_zeros(crc32c_long, CRC32C_LONG);
+		crc32c_zeros(crc32c_short, CRC32C_SHORT);
+	}
+#endif
+}
+
+uint32_t
+crc32c_sw(uint32_t crc, const unsigned char *buf, unsigned int len)
+{
+	pthread_once(&crc32c_once, crc32c_init);
+	while (len && ((uintptr_t)buf & 7) != 0) {
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	/* eight bytes at a time, independent of byte order of host */
+	while (len >= 8) {
+		crc ^= (uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+		       (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+		crc = crc32c_table[7][crc & 0xff] ^
+		      crc32c_table[6][(crc >> 8) & 0xff] ^
+		      crc32c_table[5][(crc >> 16) & 0xff] ^
+		      crc32c_table[4][crc >> 24] ^
+		      crc32c_table[3][buf[4]] ^
+		      crc32c_table[2][buf[5]] ^
+		      crc32c_table[1][buf[6]] ^
+		      crc32c_table[0][buf[7]];
+		buf += 8;
+		len -= 8;
+	}
+	while (len--)
+		crc = crc32c_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef CRC32C_HW
+static inline uint64_t
+crc32c_load64(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*
+ * crc32 instruction has latency of three cycles and throughput of one, so
+ * large buffers are split into three blocks, that are checksummed in
+ * parallel, and block checksums are combined with shift tables.
+ */
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	uint64_t crc0 = crc, crc1, crc2;
+	const unsigned char *end;
+	while (len && ((uintptr_t)buf & 7) != 0) {
+		crc0 = _mm_crc32_u8((uint32_t)crc0, *buf++);
+		len--;
+	}
+	while (len >= CRC32C_LONG * 3) {
+		crc1 = 0;
+		crc2 = 0;
+		end = buf + CRC32C_LONG;
+		do {
+			crc0 = _mm_crc32_u64(crc0, crc32c_load64(buf));
+			crc1 = _mm_crc32_u64(crc1,
+				crc32c_load64(buf + CRC32C_LONG));
+			crc2 = _mm_crc32_u64(crc2,
+				crc32c_load64(buf + CRC32C_LONG * 2));
+			buf += 8;
+		} while (buf < end);
+		crc0 = crc32c_shift(crc32c_long, (uint32_t)crc0) ^ crc1;
+		crc0 = crc32c_shift(crc32c_long, (uint32_t)crc0) ^ crc2;
+		buf += CRC32C_LONG * 2;
+		len -= CRC32C_LONG * 3;
+	}
+	while (len >= CRC32C_SHORT * 3) {
+		crc1 = 0;
+		crc2 = 0;
+		end = buf + CRC32C_SHORT;
+		do {
+			crc0 = _mm_crc32_u64(crc0, crc32c_load64(buf));
+			crc1 = _mm_crc32_u64(crc1,
+				crc32c_load64(buf + CRC32C_SHORT));
+			crc2 = _mm_crc32_u64(crc2,
+				crc32c_load64(buf + CRC32C_SHORT * 2));
+			buf += 8;
+		} while (buf < end);
+		crc0 = crc32c_shift(crc32c_short, (uint32_t)crc0) ^ crc1;
+		crc0 = crc32c_shift(crc32c_short, (uint32_t)crc0) ^ crc2;
+		buf += CRC32C_SHORT * 2;
+		len -= CRC32C_SHORT * 3;
+	}
+	while (len >= 8) {
+		crc0 = _mm_crc32_u64(crc0, crc32c_load64(buf));
+		buf += 8;
+		len -= 8;
+	}
+	while (len) {
+		crc0 = _mm_crc32_u8((uint32_t)crc0, *buf++);
+		len--;
+	}
+	return (uint32_t)crc0;
+}
+#endif
+
+int
+crc32c_hw_available(void)
+{
+	pthread_once(&crc32c_once, crc32c_init);
+	return crc32c_hw_found;
+}
+
+uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *buf, unsigned int len)
+{
+#ifdef CRC32C_HW
+	if (crc32c_hw_available())
+		return crc32c_sse42(crc, buf, len);
+#endif
+	return crc32c_sw(crc, buf, len);
+}
+
+uint32_t
+crc32c(uint32_t crc, const unsigned char *buf, unsigned int len)
+{
+	return crc32c_hw(crc, buf, len);
+}
@@ -1,6 +1,5 @@
-#ifndef BEER_RPL_H_INCLUDED
-#define BEER_RPL_H_INCLUDED
-
+#ifndef CRC32_H_INCLUDED
+#define CRC32_H_INCLUDED
 /*
  * Redistribution and use in source and binary forms, with or
  * without modification, are permitted provided that the following
@@ -30,18 +29,34 @@
  * SUCH DAMAGE.
  */
 
-struct beer_stream_rpl {
-	struct beer_log_header_v11 hdr;
-	struct beer_log_row_v11 row;
-	struct beer_stream *net;
-};
+#include <stdint.h>
 
-#define BEER_RPL_CAST(S) ((struct beer_stream_rpl*)(S)->data)
+/**
+ * CRC32C (Castagnoli), as it's used in xlog and snapshot files: there's
+ * no inversion of the initial value and of the result.
+ *
+ * Uses crc32 instruction of SSE4.2, if it's supported by CPU (checked
+ * once at runtime), and slicing-by-8 tables otherwise.
+ */
+uint32_t
+crc32c(uint32_t crc, const unsigned char *buf, unsigned int len);
 
-struct beer_stream *beer_rpl(struct beer_stream *s);
-void beer_rpl_attach(struct beer_stream *s, struct beer_stream *net);
+/**
+ * Portable slicing-by-8 implementation.
+ */
+uint32_t
+crc32c_sw(uint32_t crc, const unsigned char *buf, unsigned int len);
 
-int beer_rpl_open(struct beer_stream *s, uint64_t lsn);
-void beer_rpl_close(struct beer_stream *s);
+/**
+ * SSE4.2 implementation (falls back to crc32c_sw() if it's unavailable).
+ */
+uint32_t
+crc32c_hw(uint32_t crc, const unsigned char *buf, unsigned int len);
+
+/**
+ * Returns 1, if crc32c_hw() uses crc32 instruction.
+ */
+int
+crc32c_hw_available(void);
 
-#endif /* BEER_XLOG_H_INCLUDED */
+#endif /* CRC32_H_INCLUDED */